@@ -0,0 +1,192 @@
+#pragma once
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+/**
+ * @file bench.h
+ *
+ * @brief Minimal host benchmark harness for the [env:native_bench] build.
+ *
+ * Every benchmark prints one line and keeps its figures in bench_results():
+ * nanoseconds and time stamp counter cycles per operation, and heap
+ * allocations per operation counted by the operator new of bench/main.cpp.
+ * main() writes them as JSON for comparisons between revisions.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @brief Figures of one benchmark, in the order they were added.
+ */
+struct BenchResult
+{
+    std::string name;
+    std::vector<std::pair<std::string, double>> values;
+};
+
+/**
+ * @brief Results of all benchmarks run so far.
+ */
+inline std::vector<BenchResult> &bench_results(void)
+{
+    static std::vector<BenchResult> results;
+    return results;
+}
+
+/**
+ * @brief Heap allocations through operator new since start, counted by bench/main.cpp.
+ */
+inline std::atomic<uint64_t> &bench_allocations(void)
+{
+    static std::atomic<uint64_t> allocations(0);
+    return allocations;
+}
+
+/**
+ * @brief Keep <value> of metric <key> for benchmark <name>.
+ *
+ * Outside timed regions only, this allocates.
+ *
+ * @return None
+ */
+inline void bench_record(const char *name, const char *key, double value)
+{
+    std::vector<BenchResult> &results = bench_results();
+
+    if (results.empty() || results.back().name != name)
+        results.push_back(BenchResult{name, {}});
+    results.back().values.emplace_back(key, value);
+}
+
+/**
+ * @brief Write bench_results() to <path> as a JSON array of {"name": ..., metric: value, ...}.
+ *
+ * @return false if the file could not be written
+ */
+inline bool bench_write_json(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "[\n");
+    for (size_t i = 0; i < bench_results().size(); i++)
+    {
+        const BenchResult &result = bench_results()[i];
+
+        fprintf(file, "  {\"name\": \"");
+        for (char c : result.name)
+            fprintf(file, c == '"' || c == '\\' ? "\\%c" : "%c", c);
+        fprintf(file, "\"");
+        for (const auto &value : result.values)
+            fprintf(file, ", \"%s\": %.6g", value.first.c_str(), value.second);
+        fprintf(file, "}%s\n", i + 1 < bench_results().size() ? "," : "");
+    }
+    fprintf(file, "]\n");
+    return fclose(file) == 0;
+}
+
+/**
+ * @brief Keep the optimizer from dropping a benchmarked result.
+ */
+template <typename T>
+inline void bench_keep(const T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+ * @brief Time stamp counter of the host CPU, nanoseconds where there is none.
+ */
+inline uint64_t bench_cycles_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @brief Time <iterations> calls of <body> after a 1/10 warm-up, and keep ns, cycles and allocations per op.
+ *
+ * @param ops Operations done by one call
+ *
+ * @return None
+ */
+template <typename F>
+inline void bench_measure(const char *name, uint64_t iterations, uint32_t ops, F body, double &ns, double &cycles, double &allocs)
+{
+    for (uint64_t i = 0; i < iterations / 10; i++)
+        body(i);
+
+    uint64_t allocations = bench_allocations().load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_cycles = bench_cycles_now();
+    for (uint64_t i = 0; i < iterations; i++)
+        body(i);
+    uint64_t stop_cycles = bench_cycles_now();
+    auto stop = std::chrono::steady_clock::now();
+
+    double count = (double)iterations * ops;
+    ns = std::chrono::duration<double, std::nano>(stop - start).count() / count;
+    cycles = (double)(stop_cycles - start_cycles) / count;
+    allocs = (double)(bench_allocations().load(std::memory_order_relaxed) - allocations) / count;
+
+    bench_record(name, "ns_per_op", ns);
+    bench_record(name, "cycles_per_op", cycles);
+    bench_record(name, "allocs_per_op", allocs);
+}
+
+/**
+ * @brief Time <iterations> calls of <body>, print and return ns per call.
+ *
+ * @param name       Benchmark name
+ * @param iterations Number of timed calls, after a 1/10 warm-up
+ * @param body       Callable taking the iteration index
+ *
+ * @return Nanoseconds per iteration
+ */
+template <typename F>
+double bench_run(const char *name, uint64_t iterations, F body)
+{
+    double ns, cycles, allocs;
+
+    bench_measure(name, iterations, 1, body, ns, cycles, allocs);
+    printf("%-44s %10.2f ns/op %8.2f allocs/op\n", name, ns, allocs);
+    return ns;
+}
+
+/**
+ * @brief Time <iterations> calls of <body> processing <samples> each, print and return cycles per sample.
+ *
+ * @param name       Benchmark name
+ * @param iterations Number of timed calls, after a 1/10 warm-up
+ * @param samples    Samples processed by one call
+ * @param body       Callable taking the iteration index
+ *
+ * @return Time stamp counter cycles per sample
+ */
+template <typename F>
+double bench_cycles(const char *name, uint64_t iterations, uint32_t samples, F body)
+{
+    double ns, cycles, allocs;
+
+    bench_measure(name, iterations, samples, body, ns, cycles, allocs);
+    printf("%-44s %10.2f cycles/sample %8.2f ns/sample %6.2f allocs/sample\n", name, cycles, ns, allocs);
+    return cycles;
+}
+
+#endif
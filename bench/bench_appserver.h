@@ -0,0 +1,79 @@
+#pragma once
+
+#ifndef __BENCH_APPSERVER_H__
+#define __BENCH_APPSERVER_H__
+
+/**
+ * @file bench_appserver.h
+ *
+ * @brief The whole firmware on the simulated board: cost of one publish tick.
+ *
+ * Builds appserver.cpp into the benchmark and runs ApplicationStart() for
+ * HOST_SIM_RUN_MS of virtual time with the scripted central subscribed, from
+ * a cold boot at rest: the motion profile starts over as the run does, like
+ * in [env:native]. Every updateGyroCharacteristics() call (stream packing, bias
+ * tracking, fusion and the GATT writes of one tick) is timed by its
+ * tracepoint, so ns/op is host time per tick; the other hot-path tracepoints
+ * are reported alongside. No allocations per tick are given: the counter
+ * sees the whole process, and on the host the event queue and BLE stand-ins
+ * allocate, which would be charged to a firmware path that does not.
+ */
+
+#include <stdio.h>
+
+/* Flash file of the benchmark run, deleted before and after for a cold boot */
+#ifndef HOST_SIM_FLASH_FILE
+#define HOST_SIM_FLASH_FILE "bench_app_flash.bin"
+#endif
+
+#include "bench.h"
+#include "appserver.cpp"
+
+/**
+ * @brief Print and keep the figures of tracepoint <point> as benchmark <name>.
+ *
+ * @return None
+ */
+inline void bench_appserver_point(const char *name, uint8_t point)
+{
+    const TraceHistogram &histogram = traceHistograms()[point];
+    double ns = histogram.count ? trace_ticks_to_ns((uint32_t)(histogram.total / histogram.count)) : 0.0;
+    uint32_t p50 = trace_ticks_to_ns(trace_percentile(histogram, 500));
+    uint32_t p99 = trace_ticks_to_ns(trace_percentile(histogram, 990));
+
+    bench_record(name, "ns_per_op", ns);
+    bench_record(name, "p50_ns", p50);
+    bench_record(name, "p99_ns", p99);
+    bench_record(name, "ops", histogram.count);
+
+    printf("%-44s %10.2f ns/op p50 < %7u p99 < %7u ns, %6u ops\n", name, ns, (unsigned)p50, (unsigned)p99,
+           (unsigned)histogram.count);
+}
+
+/**
+ * @brief Run the firmware, then report the publish tick and the other tracepoints.
+ *
+ * @return None
+ */
+inline void bench_appserver(void)
+{
+    sim::Motion motion = sim::board().mpu6050().motion();
+
+    motion.start_ms += (uint32_t)sim::clock().now_ms();
+    sim::board().mpu6050().set_motion(motion);
+    remove(HOST_SIM_FLASH_FILE);
+    trace_clear();
+
+    ApplicationStart();
+
+    bench_appserver_point("firmware updateGyroCharacteristics() tick", TRACE_UPDATE_CHARACTERISTICS);
+    bench_appserver_point("firmware MPU6050 I2C transaction", TRACE_MPU_I2C);
+    bench_appserver_point("firmware GattServer::write()", TRACE_GATT_WRITE);
+    bench_appserver_point("firmware BLE::processEvents()", TRACE_BLE_EVENTS);
+    bench_appserver_point("firmware log record write", TRACE_LOG_WRITE);
+    bench_appserver_point("firmware sample to notify, virtual time", TRACE_SAMPLE_TO_NOTIFY);
+
+    remove(HOST_SIM_FLASH_FILE);
+}
+
+#endif
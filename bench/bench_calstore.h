@@ -0,0 +1,109 @@
+#pragma once
+
+#ifndef __BENCH_CALSTORE_H__
+#define __BENCH_CALSTORE_H__
+
+/**
+ * @file bench_calstore.h
+ *
+ * @brief Start-up time with and without a stored calibration, on the simulated board.
+ *
+ * Runs the start-up of one sensor as the application does it, against a
+ * file-backed flash that starts erased: the cold boot calibrates and saves
+ * the record, the warm boot loads it into the offset registers. Reported
+ * are the bus cost and the virtual time of each path, flash busy time
+ * included. A record with one changed value must be rejected.
+ */
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "bench_mpu_config.h"
+#include "calstore.h"
+#include "mpu6050.h"
+#include "sim_blockdevice.h"
+
+#define BENCH_CALSTORE_FILE "bench_flash.bin"
+
+/**
+ * @brief Time a cold and a warm boot, then check CRC protection.
+ *
+ * @return None
+ */
+inline void bench_calstore(void)
+{
+    MPU6050<> mpu;
+    CalibrationRecord record;
+
+    remove(BENCH_CALSTORE_FILE);
+    i2c.frequency(400000);
+
+    {
+        sim::FileBlockDevice flash(BENCH_CALSTORE_FILE, sim::FileBlockDevice::PAGE_SIZE);
+        CalibrationStore store(flash);
+
+        sim::I2CStats before = sim::i2c_bus().stats();
+        uint64_t start = sim::clock().now_ns();
+
+        mpu.reset();
+        mpu.init();
+        float temperature = mpu.readTemperature();
+        bool loaded = store.load(record, mpu.gyroScale, mpu.accelScale, 1);
+
+        mpu.calibrate();
+        mpu.init();
+        float gyro_residual[3];
+        mpu.gyroOffsets(record.sensor[0].gyro_offsets);
+        mpu.residualBias(gyro_residual, record.sensor[0].accel_bias);
+        record.sensor[0].temperature_c = temperature;
+        record.gyro_scale = mpu.gyroScale;
+        record.accel_scale = mpu.accelScale;
+        record.sensors = 1;
+        bool saved = store.save(record);
+
+        bench_mpu_report("cold boot: calibrate() + save", before, start);
+        printf("  record %s before, saved %s, flash busy %.3f ms\n", loaded ? "found" : "missing", saved ? "ok" : "failed",
+               flash.stats().busy_ns / 1e6);
+    }
+
+    {
+        sim::FileBlockDevice flash(BENCH_CALSTORE_FILE, sim::FileBlockDevice::PAGE_SIZE);
+        CalibrationStore store(flash);
+        int16_t offsets[3];
+
+        sim::I2CStats before = sim::i2c_bus().stats();
+        uint64_t start = sim::clock().now_ns();
+
+        mpu.reset();
+        mpu.init();
+        float temperature = mpu.readTemperature();
+        bool loaded = store.load(record, mpu.gyroScale, mpu.accelScale, 1) && calibrationFresh(record.sensor[0], temperature);
+        if (loaded)
+            mpu.setGyroOffsets(record.sensor[0].gyro_offsets);
+
+        bench_mpu_report("warm boot: load + offsets", before, start);
+        mpu.gyroOffsets(offsets);
+        printf("  record %s (sequence %lu), offsets %d %d %d\n", loaded ? "loaded" : "rejected",
+               (unsigned long)store.sequence(), offsets[0], offsets[1], offsets[2]);
+
+        CalibrationRecord damaged;
+        flash.read(&damaged, 0, sizeof(damaged));
+        damaged.sensor[0].accel_bias[1] = -damaged.sensor[0].accel_bias[1];
+        flash.erase(0, flash.get_erase_size());
+        flash.program(&damaged, 0, (sizeof(damaged) + 3) & ~3u);
+        printf("  record with a changed value %s\n",
+               store.load(record, mpu.gyroScale, mpu.accelScale, 1) ? "accepted" : "rejected");
+    }
+
+    uint8_t data[sizeof(CalibrationRecord)] = {};
+    bench_cycles("calibration record crc", 100000, 1, [&](uint64_t i)
+                 {
+                     data[0] = (uint8_t)i;
+                     bench_keep(calibrationCrc32(data, sizeof(data)));
+                 });
+
+    mpu.sleep();
+    remove(BENCH_CALSTORE_FILE);
+}
+
+#endif
@@ -0,0 +1,189 @@
+#pragma once
+
+#ifndef __BENCH_CONVERT_H__
+#define __BENCH_CONVERT_H__
+
+/**
+ * @file bench_convert.h
+ *
+ * @brief Cost and accuracy of the gyro conversion kernels, and of unpacking raw registers.
+ *
+ * Cycles are host time stamp counter cycles per gyro triple, so only the
+ * ratios carry over to the target. The legacy line is the per-value long
+ * multiply and divide the 1-byte characteristics used before the kernels
+ * (fromADCtoInt()). The unpacking lines turn big-endian register bytes into
+ * counts: the shift/or of readGyroData() and calibrate() per triple, a byte
+ * swap of the same bytes for comparison, and unpackSample() over a FIFO
+ * burst of whole packets; all must agree. The sizing lines show how many
+ * samples a notification at ATT_MTU 247 carries, in how many link layer PDUs,
+ * without and with LE Data Length Extension.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "bench.h"
+#include "gyroconvert.h"
+#include "gyrostream.h"
+#include "mpu6050.h"
+
+/* Gyro triples converted per call, one full notification of compact samples */
+#define BENCH_CONVERT_SAMPLES GYRO_STREAM_MAX_SAMPLES
+
+/**
+ * @brief Largest deviation of the kernels from a double precision reference over all raw counts.
+ *
+ * @return None
+ */
+inline void bench_convert_accuracy(void)
+{
+    for (int fs_sel = GFS_250DPS; fs_sel <= GFS_2000DPS; fs_sel++)
+    {
+        double dps_per_count = (250 << fs_sel) / 32768.0;
+        double max_mdps = 0, max_compact = 0;
+
+        for (int32_t raw = INT16_MIN; raw <= INT16_MAX; raw++)
+        {
+            double dps = raw * dps_per_count;
+            double compact = fmin(fmax(dps / 2, INT8_MIN), INT8_MAX);
+
+            max_mdps = fmax(max_mdps, fabs(gyroMilliDps((int16_t)raw, fs_sel) - dps * 1000));
+            max_compact = fmax(max_compact, fabs(gyroCompact8((int16_t)raw, fs_sel) - compact));
+        }
+
+        printf("gyro convert +-%-4d dps max error          %8.4f mdps %8.4f compact counts\n",
+               250 << fs_sel, max_mdps, max_compact);
+    }
+}
+
+/**
+ * @brief Cycles per sample of unpacking <BENCH_CONVERT_SAMPLES> raw register blocks.
+ *
+ * @return None
+ */
+inline void bench_unpack(void)
+{
+    static uint8_t raw[MPU_FIFO_PACKET_SIZE * BENCH_CONVERT_SAMPLES];
+    static int16_t shifted[3 * BENCH_CONVERT_SAMPLES], swapped[3 * BENCH_CONVERT_SAMPLES];
+    static MPU6050Sample samples[BENCH_CONVERT_SAMPLES];
+
+    for (uint32_t i = 0; i < sizeof(raw); i++)
+        raw[i] = (uint8_t)(i * 37 + 11);
+
+    /* Gyro bytes of every packet, as readGyroData() reads them from GYRO_XOUT_H */
+    bench_cycles("register unpack gyro shift/or", 100000, BENCH_CONVERT_SAMPLES, [&](uint64_t i)
+                 {
+                     for (int n = 0; n < BENCH_CONVERT_SAMPLES; n++)
+                     {
+                         const uint8_t *rawData = &raw[n * MPU_FIFO_PACKET_SIZE + 8];
+                         shifted[3 * n + 0] = (int16_t)(((int16_t)rawData[0] << 8) | rawData[1]);
+                         shifted[3 * n + 1] = (int16_t)(((int16_t)rawData[2] << 8) | rawData[3]);
+                         shifted[3 * n + 2] = (int16_t)(((int16_t)rawData[4] << 8) | rawData[5]);
+                     }
+                     bench_keep(shifted);
+                 });
+
+    bench_cycles("register unpack gyro memcpy + bswap16", 100000, BENCH_CONVERT_SAMPLES, [&](uint64_t i)
+                 {
+                     for (int n = 0; n < BENCH_CONVERT_SAMPLES; n++)
+                     {
+                         uint16_t words[3];
+                         memcpy(words, &raw[n * MPU_FIFO_PACKET_SIZE + 8], sizeof(words));
+                         for (int axis = 0; axis < 3; axis++)
+                             swapped[3 * n + axis] = (int16_t)__builtin_bswap16(words[axis]);
+                     }
+                     bench_keep(swapped);
+                 });
+
+    bench_cycles("register unpack unpackSample() FIFO burst", 100000, BENCH_CONVERT_SAMPLES, [&](uint64_t i)
+                 {
+                     for (int n = 0; n < BENCH_CONVERT_SAMPLES; n++)
+                         unpackSample(&raw[n * MPU_FIFO_PACKET_SIZE], samples[n]);
+                     bench_keep(samples);
+                 });
+
+    bool equal = memcmp(shifted, swapped, sizeof(shifted)) == 0;
+    for (int n = 0; n < BENCH_CONVERT_SAMPLES; n++)
+        equal = equal && memcmp(samples[n].gyro, &shifted[3 * n], sizeof(samples[n].gyro)) == 0;
+    printf("register unpack variants                     %s\n", equal ? "agree" : "DIFFER");
+}
+
+/**
+ * @brief Cycles per sample of every output format and of a full stream notification.
+ *
+ * @return None
+ */
+inline void bench_convert(void)
+{
+    static int16_t raw[3 * BENCH_CONVERT_SAMPLES];
+    static uint8_t out[12 * BENCH_CONVERT_SAMPLES];
+    static MPU6050TimedSample samples[BENCH_CONVERT_SAMPLES];
+    static uint8_t notification[GYRO_STREAM_HEADER_SIZE + 12 * BENCH_CONVERT_SAMPLES];
+
+    for (int i = 0; i < 3 * BENCH_CONVERT_SAMPLES; i++)
+    {
+        raw[i] = (int16_t)(i * 2731 - 32768);
+        samples[i / 3].sample.gyro[i % 3] = raw[i];
+    }
+
+    bench_convert_accuracy();
+    bench_unpack();
+
+    bench_cycles("gyro legacy long mul/div to uint8", 100000, BENCH_CONVERT_SAMPLES, [&](uint64_t i)
+                 {
+                     /* Range arguments of the old out-of-line call, opaque to the optimizer */
+                     long from_min = -32768, from_max = 32767, to_min = -250, to_max = 250;
+                     bench_keep(from_min);
+                     bench_keep(to_max);
+
+                     for (int n = 0; n < 3 * BENCH_CONVERT_SAMPLES; n++)
+                         out[n] = (uint8_t)((raw[n] - from_min) * (to_max - to_min) / (from_max - from_min) + to_min);
+                     bench_keep(out);
+                 });
+
+    bench_cycles("gyro raw16 kernel", 100000, BENCH_CONVERT_SAMPLES, [&](uint64_t i)
+                 {
+                     bench_keep(gyroConvertRaw16(raw, out, 3 * BENCH_CONVERT_SAMPLES));
+                 });
+
+    bench_cycles("gyro compact8 Q15 kernel", 100000, BENCH_CONVERT_SAMPLES, [&](uint64_t i)
+                 {
+                     bench_keep(gyroConvertCompact8(raw, out, 3 * BENCH_CONVERT_SAMPLES, GFS_250DPS));
+                 });
+
+    bench_cycles("gyro milli-dps Q16 kernel", 100000, BENCH_CONVERT_SAMPLES, [&](uint64_t i)
+                 {
+                     bench_keep(gyroConvertMilliDps(raw, out, 3 * BENCH_CONVERT_SAMPLES, GFS_250DPS));
+                 });
+
+    for (uint8_t format = 0; format < GYRO_FORMAT_COUNT; format++)
+    {
+        static const char *names[GYRO_FORMAT_COUNT] = {"gyro stream pack raw16 @ MTU 247",
+                                                       "gyro stream pack compact8 @ MTU 247",
+                                                       "gyro stream pack milli-dps @ MTU 247"};
+        uint8_t count = gyroStreamCapacity(GYRO_STREAM_MAX_MTU, GYRO_STREAM_MAX_DATA_LENGTH, format);
+
+        bench_cycles(names[format], 100000, count, [&](uint64_t i)
+                     {
+                         bench_keep(packGyroStream(notification, (uint16_t)i, format, GFS_250DPS, samples, count));
+                     });
+    }
+
+    for (uint16_t data_length : {(uint16_t)GYRO_STREAM_DEFAULT_DATA_LENGTH, (uint16_t)GYRO_STREAM_MAX_DATA_LENGTH})
+    {
+        for (uint8_t format = 0; format < GYRO_FORMAT_COUNT; format++)
+        {
+            static const char *formats[GYRO_FORMAT_COUNT] = {"raw16", "compact8", "milli-dps"};
+            char name[64];
+            uint8_t count = gyroStreamCapacity(GYRO_STREAM_MAX_MTU, data_length, format);
+            uint16_t bytes = GYRO_STREAM_L2CAP_OVERHEAD + GYRO_STREAM_HEADER_SIZE + count * gyroFormatSampleSize(format);
+            uint16_t pdus = (bytes + data_length - 1) / data_length;
+
+            snprintf(name, sizeof(name), "gyro stream %s @ MTU 247, PDU %u", formats[format], data_length);
+            bench_record(name, "samples_per_pdu", (double)count / pdus);
+            printf("%-44s %3u samples in %2u PDUs, %5.2f samples/PDU\n", name, count, pdus, (double)count / pdus);
+        }
+    }
+}
+
+#endif
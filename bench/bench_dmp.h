@@ -0,0 +1,77 @@
+#pragma once
+
+#ifndef __BENCH_DMP_H__
+#define __BENCH_DMP_H__
+
+/**
+ * @file bench_dmp.h
+ *
+ * @brief DMP firmware upload on the simulated board and DMP packet parsing.
+ *
+ * The upload runs as the application does it, after start-up, and reports
+ * the bus cost of writing and of verifying the image like bench_mpu_config,
+ * plus the upload time the driver measured. The recorded DMP memory of the
+ * model is compared with the image. Parsing is timed per FIFO packet.
+ */
+
+#include <string.h>
+
+#include "bench.h"
+#include "bench_mpu_config.h"
+#include "dmpimage.h"
+#include "mpu6050.h"
+
+/**
+ * @brief Count the upload, check what the model recorded, then cycles per packet parse.
+ *
+ * @return None
+ */
+inline void bench_dmp(void)
+{
+    MPU6050<> mpu;
+
+    i2c.frequency(400000);
+    mpu.reset();
+    mpu.init();
+
+    sim::I2CStats before = sim::i2c_bus().stats();
+    uint64_t start = sim::clock().now_ns();
+    bool written = mpu.writeDmpMemory(0, MPU_DMP_IMAGE, MPU_DMP_IMAGE_SIZE);
+    bench_mpu_report("mpu6050 writeDmpMemory() image", before, start);
+
+    before = sim::i2c_bus().stats();
+    start = sim::clock().now_ns();
+    bool loaded = mpu.loadDmp(MPU_DMP_IMAGE, MPU_DMP_IMAGE_SIZE, MPU_DMP_START_ADDRESS);
+    bench_mpu_report("mpu6050 loadDmp() write + verify", before, start);
+
+    before = sim::i2c_bus().stats();
+    start = sim::clock().now_ns();
+    mpu.setDmpRate(1);
+    mpu.startDmp();
+    bench_mpu_report("mpu6050 setDmpRate() + startDmp()", before, start);
+
+    const uint8_t *memory = sim::board().mpu6050().dmp_memory();
+    bool recorded = memcmp(memory, MPU_DMP_IMAGE, MPU_DMP_FIFO_RATE_ADDRESS) == 0;
+    printf("dmp image %u bytes, %u byte chunks: write %s, load %s in %lu us, model memory %s, dmp %s\n",
+           (unsigned)MPU_DMP_IMAGE_SIZE, (unsigned)MPU_DMP_CHUNK_SIZE, written ? "ok" : "failed",
+           loaded ? "verified" : "failed", (unsigned long)mpu.dmpLoadUs, recorded ? "matches" : "differs",
+           sim::board().mpu6050().dmp_running() ? "running" : "stopped");
+
+    uint8_t packets[16][MPU_DMP_PACKET_SIZE];
+    for (int n = 0; n < 16; n++)
+        for (int i = 0; i < MPU_DMP_PACKET_SIZE; i++)
+            packets[n][i] = (uint8_t)(n * 31 + i * 7);
+
+    MPU6050Sample sample;
+    int32_t quaternion[4];
+    bench_cycles("dmp packet unpack", 1000000, 1, [&](uint64_t i)
+                 {
+                     unpackDmpPacket(packets[i & 15], sample, quaternion);
+                     bench_keep(sample);
+                     bench_keep(quaternion[0]);
+                 });
+
+    mpu.sleep();
+}
+
+#endif
@@ -0,0 +1,200 @@
+#pragma once
+
+#ifndef __BENCH_FUSION_H__
+#define __BENCH_FUSION_H__
+
+/**
+ * @file bench_fusion.h
+ *
+ * @brief Accuracy and cost of the attitude filters on reference trajectories.
+ *
+ * Every trajectory is integrated into a true attitude with the simulator's
+ * reference model (sim_motion.h) at 1 kHz. The raw counts the sensor would
+ * report are synthesized from it, at +-250 dps and +-2 g with quantization,
+ * noise and an uncalibrated gyro bias, and fed to the filters. Tilt is the
+ * roll/pitch error, heading drift the full attitude error at the end of the
+ * run. "gyro only" is Madgwick with beta 0, plain integration.
+ */
+
+#include <math.h>
+#include <vector>
+
+#include "bench.h"
+#include "fusion.h"
+#include "sim_motion.h"
+
+/* Sample rate and length of every trajectory */
+#define BENCH_FUSION_RATE_HZ 1000
+#define BENCH_FUSION_SECONDS 60
+
+/* Errors before this are the filters converging and are not counted */
+#define BENCH_FUSION_SETTLE_MS 1000
+
+/**
+ * Reference trajectory: body rates are a constant plus a sine per axis; <shake_g> adds
+ * horizontal earth-frame acceleration, which the filters must not mistake for tilt.
+ */
+struct BenchTrajectory
+{
+    const char *name;
+    double tilt_deg;
+    double rate_dps[3];
+    double amplitude_dps[3];
+    double frequency_hz;
+    double shake_g;
+    double shake_hz;
+    double gyro_bias_dps[3];
+};
+
+/**
+ * One synthesized sample and the attitude it was taken at.
+ */
+struct BenchFusionSample
+{
+    int16_t gyro[3];
+    int16_t accel[3];
+    sim::Attitude truth;
+};
+
+/**
+ * @brief Integrate <trajectory> and synthesize the raw samples of a +-250 dps, +-2 g sensor.
+ */
+inline std::vector<BenchFusionSample> bench_fusion_samples(const BenchTrajectory &trajectory)
+{
+    std::vector<BenchFusionSample> samples(BENCH_FUSION_RATE_HZ * BENCH_FUSION_SECONDS);
+    const double dt = 1.0 / BENCH_FUSION_RATE_HZ;
+    uint32_t rng = 0x2545F491;
+    sim::Attitude attitude;
+
+    /* Start tilted about a horizontal axis between X and Y */
+    double tilt = trajectory.tilt_deg * M_PI / 180.0;
+    double tilt_rate[3] = {tilt * 0.8, tilt * 0.6, 0.0};
+    attitude.rotate(tilt_rate, 1.0);
+
+    auto noise = [&rng]()
+    {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        return (int)(rng % 9) - 4;
+    };
+
+    auto rate = [&trajectory](int axis, double t)
+    {
+        return trajectory.rate_dps[axis] +
+               trajectory.amplitude_dps[axis] * sin(2.0 * M_PI * trajectory.frequency_hz * t + axis * M_PI / 3.0);
+    };
+
+    for (size_t n = 0; n < samples.size(); n++)
+    {
+        BenchFusionSample &sample = samples[n];
+        double t = n * dt;
+        double rate_rad[3];
+
+        for (int axis = 0; axis < 3; axis++)
+            rate_rad[axis] = rate(axis, t - dt / 2) * M_PI / 180.0;
+        if (n)
+            attitude.rotate(rate_rad, dt);
+
+        double shake = trajectory.shake_g * sin(2.0 * M_PI * trajectory.shake_hz * t);
+        double earth[3] = {shake, 0.5 * shake, 0.0}, body[3], gravity[3];
+        attitude.toBody(earth, body);
+        attitude.gravity(gravity);
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            sample.gyro[axis] = (int16_t)lrint((rate(axis, t) + trajectory.gyro_bias_dps[axis]) * 131.0 + noise());
+            sample.accel[axis] = (int16_t)lrint((gravity[axis] + body[axis]) * 16384.0 + noise());
+        }
+        sample.truth = attitude;
+    }
+    return samples;
+}
+
+/**
+ * @brief Run <filter> over <samples>, print tilt RMS/max and final heading error.
+ */
+template <typename Filter>
+inline void bench_fusion_accuracy(const char *name, Filter filter, const std::vector<BenchFusionSample> &samples)
+{
+    const float dt = 1.0f / BENCH_FUSION_RATE_HZ;
+    const size_t settle = BENCH_FUSION_SETTLE_MS * BENCH_FUSION_RATE_HZ / 1000;
+    double sum_sq = 0, max_tilt = 0;
+    sim::Attitude estimate;
+
+    for (size_t n = 0; n < samples.size(); n++)
+    {
+        filter.update(samples[n].gyro, samples[n].accel, dt);
+
+        const Quaternion &q = filter.quaternion();
+        estimate.w = q.w;
+        estimate.x = q.x;
+        estimate.y = q.y;
+        estimate.z = q.z;
+
+        if (n < settle)
+            continue;
+
+        double tilt = sim::tilt_error_deg(estimate, samples[n].truth);
+        sum_sq += tilt * tilt;
+        max_tilt = fmax(max_tilt, tilt);
+    }
+
+    printf("  %-12s tilt rms %7.3f deg max %7.3f deg, attitude error at %d s %8.3f deg\n", name,
+           sqrt(sum_sq / (samples.size() - settle)), max_tilt, BENCH_FUSION_SECONDS,
+           sim::attitude_error_deg(estimate, samples.back().truth));
+}
+
+/**
+ * @brief Accuracy of every filter on every trajectory, then cycles per update.
+ *
+ * @return None
+ */
+inline void bench_fusion(void)
+{
+    const float gyro_scale = 250.0f / 32768.0f * FUSION_DEG_TO_RAD;
+
+    static const BenchTrajectory trajectories[] = {
+        {"still, tilted 30 deg", 30, {0, 0, 0}, {0, 0, 0}, 0, 0, 0, {0.10, -0.05, 0.08}},
+        {"sim default profile", 0, {0, 0, 0}, {90, 45, 20}, 0.5, 0, 0, {0.10, -0.05, 0.08}},
+        {"spin 180 dps + wobble", 10, {0, 0, 180}, {30, 30, 0}, 1.0, 0, 0, {0.10, -0.05, 0.08}},
+        {"sim profile + 0.3 g shake", 0, {0, 0, 0}, {90, 45, 20}, 0.5, 0.3, 3.0, {0.10, -0.05, 0.08}},
+    };
+
+    for (const BenchTrajectory &trajectory : trajectories)
+    {
+        std::vector<BenchFusionSample> samples = bench_fusion_samples(trajectory);
+
+        printf("fusion accuracy, %s\n", trajectory.name);
+        bench_fusion_accuracy("gyro only", MadgwickFilter(gyro_scale, 0.0f), samples);
+        bench_fusion_accuracy("madgwick", MadgwickFilter(gyro_scale), samples);
+        bench_fusion_accuracy("mahony", MahonyFilter(gyro_scale), samples);
+    }
+
+    std::vector<BenchFusionSample> samples = bench_fusion_samples(trajectories[1]);
+    const uint32_t count = 1000;
+    MadgwickFilter madgwick(gyro_scale);
+    MahonyFilter mahony(gyro_scale);
+
+    bench_cycles("fusion madgwick update", 2000, count, [&](uint64_t i)
+                 {
+                     for (uint32_t n = 0; n < count; n++)
+                         madgwick.update(samples[n].gyro, samples[n].accel, 0.001f);
+                     bench_keep(madgwick.quaternion());
+                 });
+
+    bench_cycles("fusion mahony update", 2000, count, [&](uint64_t i)
+                 {
+                     for (uint32_t n = 0; n < count; n++)
+                         mahony.update(samples[n].gyro, samples[n].accel, 0.001f);
+                     bench_keep(mahony.quaternion());
+                 });
+
+    uint8_t encoded[FUSION_QUATERNION_SIZE];
+    bench_cycles("fusion quaternion encode", 100000, 1, [&](uint64_t i)
+                 {
+                     bench_keep(packQuaternion(encoded, madgwick.quaternion(), (uint32_t)i));
+                 });
+}
+
+#endif
@@ -0,0 +1,91 @@
+#pragma once
+
+#ifndef __BENCH_GYROBIAS_H__
+#define __BENCH_GYROBIAS_H__
+
+/**
+ * @file bench_gyrobias.h
+ *
+ * @brief Convergence and cost of the online gyro bias tracker.
+ *
+ * A +-250 dps, +-2 g sensor at 1 kHz alternates between motion and rest
+ * while its gyro bias drifts. The offsets the tracker hands out are applied
+ * to the following samples, as the offset registers would, so the reported
+ * error is what the stream plus residual() still carries: at the first
+ * update, and averaged and worst over the second half of the run.
+ */
+
+#include <math.h>
+
+#include "bench.h"
+#include "gyrobias.h"
+
+/* Length of the run and its motion/rest cycle */
+#define BENCH_GYROBIAS_SECONDS 120
+#define BENCH_GYROBIAS_MOVE_MS 6000
+#define BENCH_GYROBIAS_STILL_MS 3000
+
+/**
+ * @brief Run the tracker on the drifting stream, then cycles per sample.
+ *
+ * @return None
+ */
+inline void bench_gyrobias(void)
+{
+    const double bias_dps[3] = {0.35, -0.20, 0.10};
+    const double drift_dps_per_s[3] = {0.004, -0.003, 0.002};
+    const uint32_t samples = 1000 * BENCH_GYROBIAS_SECONDS;
+    GyroBiasTracker<0, 0> tracker;
+    uint32_t rng = 0x2545F491, first_update_ms = 0;
+    double sum_error = 0, max_error = 0;
+
+    auto noise = [&rng]()
+    {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        return (int)(rng % 9) - 4;
+    };
+
+    for (uint32_t n = 0; n < samples; n++)
+    {
+        double t = n / 1000.0;
+        bool moving = n % (BENCH_GYROBIAS_MOVE_MS + BENCH_GYROBIAS_STILL_MS) < BENCH_GYROBIAS_MOVE_MS;
+        int16_t gyro[3], accel[3] = {0, 0, 16384};
+        double error = 0;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            double rate = moving ? 60.0 * sin(2.0 * M_PI * 0.5 * t + axis) : 0.0;
+            double bias = bias_dps[axis] + drift_dps_per_s[axis] * t;
+            gyro[axis] = (int16_t)lrint((rate + bias) * 131.072 + tracker.offsets()[axis] * 4 + noise());
+            accel[axis] = (int16_t)(accel[axis] + noise() + (moving ? 400 : 0) * sin(6.0 * t + axis));
+
+            double left = bias + tracker.offsets()[axis] * 4 / 131.072 - tracker.residual()[axis] / 131.072;
+            error = fmax(error, fabs(left));
+        }
+
+        if (tracker.update(gyro, accel) && !first_update_ms)
+            first_update_ms = n;
+
+        if (n >= samples / 2)
+        {
+            sum_error += error;
+            max_error = fmax(max_error, error);
+        }
+    }
+
+    printf("gyro bias tracker: first update at %u ms, %u updates, %u stationary windows\n", first_update_ms,
+           tracker.offsetUpdates(), tracker.stationaryWindows());
+    printf("  bias left over the last %d s: mean %.4f dps, max %.4f dps (offset count %.4f dps)\n",
+           BENCH_GYROBIAS_SECONDS / 2, sum_error / (samples - samples / 2), max_error, 4 / 131.072);
+
+    int16_t gyro[3] = {40, -25, 13}, accel[3] = {12, -30, 16390};
+    bench_cycles("gyro bias tracker update", 1000000, 1, [&](uint64_t i)
+                 {
+                     gyro[0] ^= (int16_t)(i & 3);
+                     bench_keep(tracker.update(gyro, accel));
+                 });
+}
+
+#endif
@@ -0,0 +1,80 @@
+#pragma once
+
+#ifndef __BENCH_MPU_CONFIG_H__
+#define __BENCH_MPU_CONFIG_H__
+
+/**
+ * @file bench_mpu_config.h
+ *
+ * @brief Bus cost of the MPU6050 start-up sequence on the simulated board.
+ *
+ * Runs the same reset, calibrate, init and startFifo sequence as the
+ * application, blocking, and reports I2C transactions, bytes, bus time and
+ * the virtual time the sequence takes. These are exact counts, not timings,
+ * so they can be compared between revisions of the driver.
+ */
+
+#include "bench.h"
+#include "mpu6050.h"
+
+/**
+ * @brief Print one counted step of the sequence.
+ */
+inline void bench_mpu_report(const char *name, const sim::I2CStats &before, uint64_t start_ns)
+{
+    const sim::I2CStats &after = sim::i2c_bus().stats();
+
+    bench_record(name, "transactions", (double)(after.transactions - before.transactions));
+    bench_record(name, "bytes", (double)(after.bytes - before.bytes));
+    bench_record(name, "bus_ms", (after.busy_ns - before.busy_ns) / 1e6);
+    bench_record(name, "virtual_ms", (sim::clock().now_ns() - start_ns) / 1e6);
+    printf("%-44s %6llu transactions %6llu bytes %9.3f ms bus %9.3f ms\n", name,
+           (unsigned long long)(after.transactions - before.transactions),
+           (unsigned long long)(after.bytes - before.bytes),
+           (after.busy_ns - before.busy_ns) / 1e6,
+           (sim::clock().now_ns() - start_ns) / 1e6);
+}
+
+/**
+ * @brief Count the transactions of every configuration step.
+ *
+ * @return None
+ */
+inline void bench_mpu_config(void)
+{
+    MPU6050<> mpu;
+
+    i2c.frequency(400000);
+
+    sim::I2CStats total = sim::i2c_bus().stats();
+    uint64_t total_start = sim::clock().now_ns();
+
+    sim::I2CStats before = sim::i2c_bus().stats();
+    uint64_t start = sim::clock().now_ns();
+    mpu.reset();
+    bench_mpu_report("mpu6050 reset()", before, start);
+
+    before = sim::i2c_bus().stats();
+    start = sim::clock().now_ns();
+    mpu.calibrate();
+    bench_mpu_report("mpu6050 calibrate()", before, start);
+
+    before = sim::i2c_bus().stats();
+    start = sim::clock().now_ns();
+    mpu.init();
+    bench_mpu_report("mpu6050 init()", before, start);
+
+    before = sim::i2c_bus().stats();
+    start = sim::clock().now_ns();
+    mpu.startFifo();
+    bench_mpu_report("mpu6050 startFifo()", before, start);
+
+    before = sim::i2c_bus().stats();
+    start = sim::clock().now_ns();
+    mpu.lowPowerAccelOnly();
+    bench_mpu_report("mpu6050 lowPowerAccelOnly()", before, start);
+
+    bench_mpu_report("mpu6050 start-up sequence total", total, total_start);
+}
+
+#endif
@@ -0,0 +1,99 @@
+#pragma once
+
+#ifndef __BENCH_RINGBUFFER_H__
+#define __BENCH_RINGBUFFER_H__
+
+/**
+ * @file bench_ringbuffer.h
+ *
+ * @brief Throughput of the SPSC sample ring between acquisition and publishing.
+ */
+
+#include <thread>
+
+#include "bench.h"
+#include "ringbuffer.h"
+#include "mpu6050.h"
+
+/**
+ * @brief Wait policy of the two thread benchmark: spin, then yield, then sleep.
+ *
+ * Sleeping matters on single core hosts, where a spinning thread would hold the CPU for a whole
+ * time slice.
+ */
+inline void bench_backoff(int spins)
+{
+    if (spins < 16)
+        return;
+    if (spins < 64)
+        std::this_thread::yield();
+    else
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+}
+
+/**
+ * @brief Single thread push/pop cost and two thread producer/consumer throughput.
+ *
+ * @return None
+ */
+inline void bench_ringbuffer(void)
+{
+    static MPU6050SampleRing ring;
+    MPU6050TimedSample sample = {};
+    MPU6050TimedSample batch[32];
+
+    bench_run("spsc push+pop", 10000000, [&](uint64_t i)
+              {
+                  sample.timestamp_us = (uint32_t)i;
+                  ring.push(sample);
+                  ring.pop(sample);
+                  bench_keep(sample);
+              });
+
+    bench_run("spsc 32x push + popBatch(32)", 1000000, [&](uint64_t i)
+              {
+                  for (int n = 0; n < 32; n++)
+                  {
+                      sample.timestamp_us = (uint32_t)i;
+                      ring.push(sample);
+                  }
+                  bench_keep(ring.popBatch(batch, 32));
+              });
+
+    /* Producer and consumer on two threads, the consumer drains in batches */
+    const uint32_t items = 2000000;
+    static MPU6050SampleRing shared;
+    uint64_t checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer([&]()
+                         {
+                             MPU6050TimedSample s = {};
+                             for (uint32_t i = 0; i < items; i++)
+                             {
+                                 s.timestamp_us = i;
+                                 for (int spins = 0; !shared.push(s); spins++)
+                                     bench_backoff(spins);
+                             }
+                         });
+    uint32_t received = 0;
+    int spins = 0;
+    while (received < items)
+    {
+        uint32_t count = shared.popBatch(batch, 32);
+        spins = count ? 0 : spins + 1;
+        bench_backoff(spins);
+        for (uint32_t n = 0; n < count; n++)
+            checksum += batch[n].timestamp_us;
+        received += count;
+    }
+    producer.join();
+    auto stop = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    printf("%-44s %10.2f Msamples/s (%u full-ring pushes, checksum %s)\n", "spsc 2-thread throughput",
+           items / seconds / 1e6, shared.dropped(),
+           checksum == (uint64_t)items * (items - 1) / 2 ? "ok" : "BAD");
+}
+
+#endif
@@ -0,0 +1,218 @@
+#pragma once
+
+#ifndef __BENCH_SYSLOGGER_H__
+#define __BENCH_SYSLOGGER_H__
+
+/**
+ * @file bench_syslogger.h
+ *
+ * @brief Caller-side cost of logging, and the MPSC log queue under several producers.
+ *
+ * The same two messages, one without and one with arguments, go through
+ * every path of syslogger.h into the console stand-in (muted in this build):
+ * the original text path (color write plus nrf_fast_log()), text and binary
+ * records written on the caller's thread, and capture into logQueue() with
+ * the queue drained every 16 calls outside the timed region. An empty call
+ * shows what the timing itself adds. The LOGW() macro is timed as well:
+ * compiled in, held back by logLevel() at runtime, and compiled out by a
+ * module level of LOG_LEVEL_NONE. Reported are
+ * the median and 99th percentile cycles of a single call, the bytes per
+ * message and the time they take on the 115200 baud line, 10 bits per byte.
+ * A deferred call sends nothing itself: its bytes go out when the untimed
+ * drain writes the record, and the row says so.
+ *
+ * Then three producer threads push numbered records through one MpscRing
+ * to a consumer thread, which checks every producer's sequence arrives
+ * complete and in order apart from the counted drops.
+ */
+
+#include <algorithm>
+#include <thread>
+
+#include "bench.h"
+#include "bench_ringbuffer.h"
+#include "syslogger.h"
+
+/* Timed calls per logging path */
+#define BENCH_SYSLOGGER_CALLS 20000
+
+/**
+ * @brief Time single calls of <log>, drain the log queue every 16 calls outside the timing.
+ *
+ * @return None
+ */
+template <typename F>
+inline void bench_syslogger_case(const char *name, F log)
+{
+    static uint64_t cycles[BENCH_SYSLOGGER_CALLS];
+    uint64_t before = debugOut.bytes_written(), written = 0;
+    uint64_t allocations = bench_allocations().load(std::memory_order_relaxed);
+
+    for (uint32_t i = 0; i < BENCH_SYSLOGGER_CALLS; i++)
+    {
+        uint64_t call = debugOut.bytes_written();
+        uint64_t start = bench_cycles_now();
+        log(i);
+        cycles[i] = bench_cycles_now() - start;
+        written += debugOut.bytes_written() - call;
+
+        if ((i & 15) == 15)
+            log_drain();
+    }
+    log_drain();
+
+    double bytes = (double)(debugOut.bytes_written() - before) / BENCH_SYSLOGGER_CALLS;
+    double deferred = bytes - (double)written / BENCH_SYSLOGGER_CALLS;
+    std::sort(cycles, cycles + BENCH_SYSLOGGER_CALLS);
+
+    bench_record(name, "p50_cycles", (double)cycles[BENCH_SYSLOGGER_CALLS / 2]);
+    bench_record(name, "p99_cycles", (double)cycles[BENCH_SYSLOGGER_CALLS * 99 / 100]);
+    bench_record(name, "bytes_per_op", bytes);
+    bench_record(name, "allocs_per_op", (double)(bench_allocations().load(std::memory_order_relaxed) - allocations) / BENCH_SYSLOGGER_CALLS);
+    printf("%-44s p50 %6llu p99 %6llu cycles/call, %3.0f bytes, %6.1f us on the line%s\n", name,
+           (unsigned long long)cycles[BENCH_SYSLOGGER_CALLS / 2], (unsigned long long)cycles[BENCH_SYSLOGGER_CALLS * 99 / 100],
+           bytes, bytes * 10.0 * 1e6 / BAUDRATE, deferred > 0 ? " later, sent by the drain" : "");
+}
+
+/**
+ * @brief Write a captured record in binary on the caller's thread, as log_write() does with LOG_BINARY.
+ *
+ * @return None
+ */
+inline void bench_syslogger_binary(const LogRecord &record)
+{
+    uint8_t data[LOG_RECORD_HEADER_SIZE + 4 * LOG_RECORD_MAX_ARGS];
+
+    debugMutex.lock();
+    debugOut.write(data, log_encode_binary(data, record));
+    debugMutex.unlock();
+}
+
+/**
+ * @brief Module whose LOG calls are all compiled out.
+ */
+struct BenchSilentModule
+{
+    static constexpr uint8_t logModuleLevel = LOG_LEVEL_NONE;
+
+    /**
+     * @brief Time a LOGW() call of this module.
+     *
+     * @return None
+     */
+    static void run(void)
+    {
+        bench_syslogger_case("LOGW() compiled out, 2 arguments", [](uint32_t i)
+                             { LOGW("Sample ring overflow, %u samples dropped on sensor %u\r\n", (unsigned)i, 1u); });
+    }
+};
+
+/**
+ * @brief Logging paths compared per call, then the multi-producer queue check.
+ *
+ * @return None
+ */
+inline void bench_syslogger(void)
+{
+#define BENCH_LOG_PLAIN "Subscribed, sampling started\r\n"
+#define BENCH_LOG_ARGS "Sample ring overflow, %u samples dropped on sensor %u\r\n"
+
+    LogRecord record;
+
+    bench_syslogger_case("log nothing, timing overhead", [](uint32_t) {});
+    bench_syslogger_case("log original text, no arguments", [](uint32_t)
+                         {
+                             debugMutex.lock();
+                             debugOut.write(blueBold, 8);
+                             debugMutex.unlock();
+                             nrf_fast_log(BENCH_LOG_PLAIN);
+                         });
+    bench_syslogger_case("log text on caller, no arguments", [](uint32_t)
+                         { log_now(LOG_LEVEL_INFO, LOG_ID(BENCH_LOG_PLAIN), BENCH_LOG_PLAIN); });
+    bench_syslogger_case("log binary on caller, no arguments", [&](uint32_t)
+                         {
+                             log_capture(record, LOG_LEVEL_INFO, LOG_ID(BENCH_LOG_PLAIN), nullptr);
+                             bench_syslogger_binary(record);
+                         });
+    bench_syslogger_case("log deferred, no arguments", [](uint32_t)
+                         { log_push(LOG_LEVEL_INFO, LOG_ID(BENCH_LOG_PLAIN), BENCH_LOG_PLAIN); });
+
+    bench_syslogger_case("log text on caller, 2 arguments", [](uint32_t i)
+                         { log_now(LOG_LEVEL_WARNING, LOG_ID(BENCH_LOG_ARGS), BENCH_LOG_ARGS, i, 1u); });
+    bench_syslogger_case("log binary on caller, 2 arguments", [&](uint32_t i)
+                         {
+                             log_capture(record, LOG_LEVEL_WARNING, LOG_ID(BENCH_LOG_ARGS), nullptr, i, 1u);
+                             bench_syslogger_binary(record);
+                         });
+    bench_syslogger_case("log deferred, 2 arguments", [](uint32_t i)
+                         { log_push(LOG_LEVEL_WARNING, LOG_ID(BENCH_LOG_ARGS), BENCH_LOG_ARGS, i, 1u); });
+
+    bench_syslogger_case("LOGW() enabled, 2 arguments", [](uint32_t i)
+                         { LOGW("Sample ring overflow, %u samples dropped on sensor %u\r\n", (unsigned)i, 1u); });
+    uint8_t level = logLevel().exchange(LOG_LEVEL_ERROR);
+    bench_syslogger_case("LOGW() below logLevel(), 2 arguments", [](uint32_t i)
+                         { LOGW("Sample ring overflow, %u samples dropped on sensor %u\r\n", (unsigned)i, 1u); });
+    logLevel().store(level);
+    BenchSilentModule::run();
+
+    /* Three producers, one consumer; args carry producer and sequence number */
+    const uint32_t producers = 3, items = 200000;
+    static MpscRing<LogRecord, LOG_QUEUE_SIZE> shared;
+    std::thread threads[producers];
+    uint32_t expected[producers] = {}, received = 0, gaps = 0;
+    bool ordered = true;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t p = 0; p < producers; p++)
+    {
+        threads[p] = std::thread([p, items]()
+                                 {
+                                     LogRecord item;
+                                     for (uint32_t i = 0; i < items; i++)
+                                     {
+                                         log_capture(item, LOG_LEVEL_INFO, 0, nullptr, p, i);
+                                         shared.push(item);
+                                         if ((i & 15) == 15)
+                                             bench_backoff(64);
+                                     }
+                                 });
+    }
+
+    int spins = 0;
+    while (received + shared.dropped() < producers * items)
+    {
+        if (!shared.pop(record))
+        {
+            bench_backoff(++spins);
+            continue;
+        }
+        spins = 0;
+        received++;
+
+        uint32_t p = record.args[0], i = record.args[1];
+        if (p >= producers || i < expected[p])
+        {
+            ordered = false;
+            continue;
+        }
+        gaps += i - expected[p];
+        expected[p] = i + 1;
+    }
+    for (uint32_t p = 0; p < producers; p++)
+        threads[p].join();
+    auto stop = std::chrono::steady_clock::now();
+
+    /* Drops show up as gaps, except those at the end of a sequence */
+    for (uint32_t p = 0; p < producers; p++)
+        gaps += items - expected[p];
+
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    printf("%-44s %10.2f Mrecords/s (%u received, %u dropped, sequences %s)\n", "mpsc 3 producers to 1 consumer",
+           received / seconds / 1e6, received, shared.dropped(),
+           ordered && received + shared.dropped() == producers * items && gaps == shared.dropped() ? "ok" : "BAD");
+
+#undef BENCH_LOG_PLAIN
+#undef BENCH_LOG_ARGS
+}
+
+#endif
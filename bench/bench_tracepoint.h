@@ -0,0 +1,50 @@
+#pragma once
+
+#ifndef __BENCH_TRACEPOINT_H__
+#define __BENCH_TRACEPOINT_H__
+
+/**
+ * @file bench_tracepoint.h
+ *
+ * @brief Cost of a tracepoint, and the percentiles read from its histogram.
+ *
+ * trace_record() is what a point adds on the target besides two DWT_CYCCNT
+ * loads. A whole TraceScope on the host also reads the steady clock twice,
+ * which is most of its cost here. The histogram check records known
+ * durations and compares the percentiles with the bucket ends they must hit.
+ */
+
+#include "bench.h"
+#include "tracepoint.h"
+
+/**
+ * @brief Time trace_record() and TraceScope, then check trace_percentile().
+ *
+ * @return None
+ */
+inline void bench_tracepoint(void)
+{
+    bench_cycles("trace_record()", 10000000, 1, [](uint64_t i)
+                 { trace_record(TRACE_UPDATE_CHARACTERISTICS, (uint32_t)i & 0xFFFF); });
+    bench_cycles("TraceScope, empty scope", 10000000, 1, [](uint64_t)
+                 { TraceScope trace(TRACE_GATT_WRITE); });
+    bench_cycles("trace_ticks()", 10000000, 1, [](uint64_t)
+                 { bench_keep(trace_ticks()); });
+
+    /* 1000 passes of 100 ticks and 10 of 100000: p50 and p99 end the 64..127 bucket */
+    trace_clear();
+    for (int i = 0; i < 1000; i++)
+        trace_record(TRACE_MPU_I2C, 100);
+    for (int i = 0; i < 10; i++)
+        trace_record(TRACE_MPU_I2C, 100000);
+
+    const TraceHistogram &histogram = traceHistograms()[TRACE_MPU_I2C];
+    uint32_t p50 = trace_percentile(histogram, 500), p99 = trace_percentile(histogram, 990);
+    uint32_t p999 = trace_percentile(histogram, 999);
+    printf("%-44s p50 %u p99 %u p99.9 %u max %u ticks (%s)\n", "trace histogram percentiles", (unsigned)p50, (unsigned)p99,
+           (unsigned)p999, (unsigned)histogram.max,
+           p50 == 127 && p99 == 127 && p999 == 100000 && histogram.max == 100000 && histogram.count == 1010 ? "ok" : "BAD");
+    trace_clear();
+}
+
+#endif
@@ -0,0 +1,126 @@
+/**
+ * @file main.cpp
+ *
+ * @brief Host benchmark entry point, built by [env:native_bench].
+ *
+ * Usage: program [--json <file>], the file receives every figure printed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+#include "bench_appserver.h"
+#include "bench_calstore.h"
+#include "bench_convert.h"
+#include "bench_dmp.h"
+#include "bench_fusion.h"
+#include "bench_gyrobias.h"
+#include "bench_mpu_config.h"
+#include "bench_ringbuffer.h"
+#include "bench_syslogger.h"
+#include "bench_tracepoint.h"
+
+/*
+ * Heap allocations of the whole program are counted for allocs/op. Every replaced new takes its
+ * memory from malloc() or aligned_alloc(), every replaced delete gives it back with free(); the
+ * deletes stay out of line so the compiler does not pair an inlined free() with a new expression.
+ */
+void *operator new(size_t size)
+{
+    bench_allocations().fetch_add(1, std::memory_order_relaxed);
+    if (void *memory = malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    size_t align = (size_t)alignment;
+
+    bench_allocations().fetch_add(1, std::memory_order_relaxed);
+    /* aligned_alloc() wants a multiple of the alignment */
+    if (void *memory = aligned_alloc(align, ((size ? size : 1) + align - 1) & ~(align - 1)))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+__attribute__((noinline)) void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+__attribute__((noinline)) void operator delete[](void *memory) noexcept
+{
+    operator delete(memory);
+}
+
+__attribute__((noinline)) void operator delete(void *memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+
+__attribute__((noinline)) void operator delete[](void *memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+
+__attribute__((noinline)) void operator delete(void *memory, std::align_val_t) noexcept
+{
+    operator delete(memory);
+}
+
+__attribute__((noinline)) void operator delete[](void *memory, std::align_val_t) noexcept
+{
+    operator delete(memory);
+}
+
+__attribute__((noinline)) void operator delete(void *memory, size_t, std::align_val_t) noexcept
+{
+    operator delete(memory);
+}
+
+__attribute__((noinline)) void operator delete[](void *memory, size_t, std::align_val_t) noexcept
+{
+    operator delete(memory);
+}
+
+int main(int argc, char **argv)
+{
+    const char *json = nullptr;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            json = argv[++i];
+    }
+
+    bench_mpu_config();
+    bench_dmp();
+    bench_calstore();
+    bench_ringbuffer();
+    bench_convert();
+    bench_fusion();
+    bench_gyrobias();
+    bench_syslogger();
+    bench_tracepoint();
+    bench_appserver();
+
+    if (json && !bench_write_json(json))
+    {
+        printf("could not write %s\n", json);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,164 @@
+"""
+    Decoder of the binary log records written by firmware built with LOG_BINARY=1.
+
+    The message IDs are FNV-1a hashes of the LOG format strings, folded to
+    16 bits (log_message_id() in src/syslogger.h). The table of IDs is built
+    here from the same format strings in the sources, so the decoder must see
+    the sources the firmware was built from. Bytes that do not form a record,
+    like the board banner, are passed through unchanged.
+
+    Examples:
+
+    1. decode a serial port (needs pyserial)
+    >>> python3 logdecode.py --port /dev/ttyACM0
+
+    2. decode the host simulation
+    >>> .pio/build/native_binlog/program | python3 logdecode.py
+
+    3. only check the format strings for ID collisions
+    >>> python3 logdecode.py --check
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+RECORD_SYNC = 0xA0
+RECORD_HEADER_SIZE = 7
+LEVELS = [("I", "\033[1;34m"), ("W", "\033[0;33m"), ("E", "\033[1;31m")]
+
+LOG_CALL = re.compile(r'\bLOG(?:[IWE](?:_LIMIT)?|_RECORD)\s*\(\s*(?:\w+\s*,\s*)?((?:"(?:[^"\\]|\\.)*"\s*)+)')
+LITERAL = re.compile(r'"((?:[^"\\]|\\.)*)"')
+CONVERSION = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|z|j|t)?([diuxXcfeEgG%])")
+
+
+def c_string(literal):
+    """Bytes of the concatenated C string literals in <literal>."""
+    text = "".join(LITERAL.findall(literal))
+    return text.encode("latin-1").decode("unicode_escape").encode("latin-1")
+
+
+def message_id(data):
+    """log_message_id() of syslogger.h."""
+    value = 2166136261
+    for byte in data:
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return ((value >> 16) ^ value) & 0xFFFF
+
+
+def scan_sources(directories):
+    """Table of message ID -> list of distinct format strings."""
+    table = {}
+    for directory in directories:
+        for root, _, files in os.walk(directory):
+            for name in sorted(files):
+                if not name.endswith((".h", ".hpp", ".c", ".cpp")):
+                    continue
+                with open(os.path.join(root, name), encoding="utf-8", errors="replace") as source:
+                    for match in LOG_CALL.finditer(source.read()):
+                        text = c_string(match.group(1)).decode("latin-1")
+                        formats = table.setdefault(message_id(text.encode("latin-1")), [])
+                        if text not in formats:
+                            formats.append(text)
+    return table
+
+
+def format_message(text, words):
+    """Put the raw 32-bit <words> into the C format string <text>."""
+    words = list(words)
+
+    def convert(match):
+        flags, kind = match.groups()
+        if kind == "%":
+            return "%"
+        if not words:
+            return match.group(0)
+        word = words.pop(0)
+        if kind in "di":
+            value = struct.unpack("<i", struct.pack("<I", word))[0]
+            return ("%" + flags + "d") % value
+        if kind in "uxX":
+            return ("%" + flags + kind.replace("u", "d")) % word
+        if kind == "c":
+            return chr(word & 0xFF)
+        return ("%" + flags + kind) % struct.unpack("<f", struct.pack("<I", word))[0]
+
+    return CONVERSION.sub(convert, text)
+
+
+def decode(stream, output, table, color):
+    """Decode records from <stream> until it ends, write text to <output>."""
+    buffer = b""
+    ended = False
+    last_us = 0
+    epoch_us = 0
+
+    while not ended or buffer:
+        if not ended:
+            chunk = stream.read(1)
+            ended = not chunk
+            buffer += chunk
+
+        while buffer:
+            header = buffer[0]
+            size = RECORD_HEADER_SIZE + 4 * (header & 7)
+            record = (header & 0xE0) == RECORD_SYNC and (header >> 3) & 3 < len(LEVELS)
+            if record and len(buffer) >= 3:
+                record = buffer[1] | buffer[2] << 8 in table
+            if record and len(buffer) < size and not ended:
+                break
+
+            if not record or len(buffer) < size:
+                output.write(chr(header))
+                buffer = buffer[1:]
+                continue
+
+            timestamp = struct.unpack_from("<I", buffer, 3)[0]
+            words = struct.unpack_from("<%dI" % (header & 7), buffer, RECORD_HEADER_SIZE)
+            texts = table[buffer[1] | buffer[2] << 8]
+            buffer = buffer[size:]
+
+            if timestamp < last_us and last_us - timestamp > 1 << 31:
+                epoch_us += 1 << 32
+            last_us = timestamp
+
+            level, code = LEVELS[(header >> 3) & 3]
+            text = " | ".join(format_message(text, words) for text in texts)
+            line = "%s  (%.3f)\t%s" % (level, (epoch_us + timestamp) / 1000.0, text.rstrip("\r\n"))
+            output.write((code + line + "\033[0m" if color else line) + "\n")
+        output.flush()
+
+
+parser = argparse.ArgumentParser()
+parser.add_argument("input", nargs="?", help="Recorded binary log, standard input if omitted")
+parser.add_argument("--port", help="Serial port to read instead, e.g. /dev/ttyACM0")
+parser.add_argument("--baud", type=int, default=115200, help="Baudrate of the serial port")
+parser.add_argument("--src", action="append", help="Source directory with the LOG calls, src/ by default")
+parser.add_argument("--color", action="store_true", help="Color the levels like the text log")
+parser.add_argument("--check", action="store_true", help="Only report message ID collisions")
+args = parser.parse_args()
+
+table = scan_sources(args.src or [os.path.join(os.path.dirname(os.path.abspath(__file__)), "src")])
+collisions = {ident: texts for ident, texts in table.items() if len(texts) > 1}
+for ident, texts in sorted(collisions.items()):
+    sys.stderr.write("message ID 0x%04X shared by %s\n" % (ident, ", ".join(repr(text) for text in texts)))
+
+if args.check:
+    print("%d format strings, %d ID collisions" % (sum(len(texts) for texts in table.values()), len(collisions)))
+    sys.exit(1 if collisions else 0)
+
+if args.port:
+    import serial
+
+    stream = serial.Serial(args.port, args.baud)
+elif args.input:
+    stream = open(args.input, "rb")
+else:
+    stream = sys.stdin.buffer
+
+try:
+    decode(stream, sys.stdout, table, args.color)
+except (KeyboardInterrupt, BrokenPipeError):
+    pass
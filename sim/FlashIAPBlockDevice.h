@@ -0,0 +1,29 @@
+#pragma once
+
+#ifndef __SIM_FLASHIAP_BLOCKDEVICE_H__
+#define __SIM_FLASHIAP_BLOCKDEVICE_H__
+
+/**
+ * @file FlashIAPBlockDevice.h
+ *
+ * @brief Host stand-in for FlashIAPBlockDevice, the internal flash as a block device.
+ *
+ * The flash region is the file HOST_SIM_FLASH_FILE in the working directory;
+ * delete it for a first boot.
+ */
+
+#include "sim_blockdevice.h"
+
+#ifndef HOST_SIM_FLASH_FILE
+#define HOST_SIM_FLASH_FILE "sim_flash.bin"
+#endif
+
+class FlashIAPBlockDevice : public sim::FileBlockDevice
+{
+public:
+    FlashIAPBlockDevice(uint32_t address, uint32_t size) : sim::FileBlockDevice(HOST_SIM_FLASH_FILE, size) {}
+
+    const char *get_type() const override { return "FLASHIAP"; }
+};
+
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+
+#ifndef __SIM_GAP_H__
+#define __SIM_GAP_H__
+
+/**
+ * @file Gap.h
+ *
+ * @brief Top level include used by the firmware, as provided by mbed OS.
+ */
+
+#include "ble/BLE.h"
+
+#endif
@@ -0,0 +1,115 @@
+#pragma once
+
+#ifndef __SIM_BLE_H__
+#define __SIM_BLE_H__
+
+/**
+ * @file BLE.h
+ *
+ * @brief Host stand-in for the mbed BLE singleton.
+ *
+ * init() completes asynchronously through the events-to-process hook, so the
+ * firmware goes through the same schedule_ble_events() path as on target.
+ */
+
+#include "blecommon.h"
+#include "sim_stack.h"
+#include "Gap.h"
+#include "GattServer.h"
+#include "GattClient.h"
+#include "sim_central.h"
+#include "common/FunctionPointerWithContext.h"
+
+namespace ble
+{
+
+/**
+ * @class BLE
+ */
+class BLE
+{
+public:
+    struct InitializationCompleteCallbackContext
+    {
+        BLE &ble;
+        ble_error_t error;
+    };
+
+    struct OnEventsToProcessCallbackContext
+    {
+        BLE &ble;
+    };
+
+    typedef FunctionPointerWithContext<OnEventsToProcessCallbackContext *> OnEventsToProcessCallback_t;
+
+    static BLE &Instance()
+    {
+        static BLE instance;
+        return instance;
+    }
+
+    template <typename T>
+    ble_error_t init(T *object, void (T::*completion_cb)(InitializationCompleteCallbackContext *context))
+    {
+        if (_initialized)
+            return BLE_ERROR_ALREADY_INITIALIZED;
+
+        sim::ble_stack().post([this, object, completion_cb]()
+                              {
+                                  _initialized = true;
+                                  for (int i = 0; i < HOST_SIM_CENTRALS; i++)
+                                      _centrals[i].start(_gap, _gatt_server, i);
+                                  InitializationCompleteCallbackContext context = {*this, BLE_ERROR_NONE};
+                                  (object->*completion_cb)(&context);
+                              });
+        return BLE_ERROR_NONE;
+    }
+
+    bool hasInitialized() const { return _initialized; }
+
+    ble_error_t shutdown()
+    {
+        _initialized = false;
+        return BLE_ERROR_NONE;
+    }
+
+    void onEventsToProcess(const OnEventsToProcessCallback_t &on_event_cb)
+    {
+        _on_events = on_event_cb;
+        sim::ble_stack().on_signal([this]()
+                                   {
+                                       OnEventsToProcessCallbackContext context = {*this};
+                                       _on_events.call(&context);
+                                   });
+    }
+
+    void processEvents()
+    {
+        sim::ble_stack().process();
+    }
+
+    /**
+     * @brief Simulation hook: the scripted centrals of the native run.
+     */
+    sim::Central &sim_central(int index) { return _centrals[index]; }
+
+    Gap &gap() { return _gap; }
+    GattServer &gattServer() { return _gatt_server; }
+    GattClient &gattClient() { return _gatt_client; }
+
+private:
+    BLE() {}
+
+    bool _initialized = false;
+    OnEventsToProcessCallback_t _on_events;
+    Gap _gap;
+    GattServer _gatt_server;
+    GattClient _gatt_client;
+    sim::Central _centrals[HOST_SIM_CENTRALS > 0 ? HOST_SIM_CENTRALS : 1];
+};
+
+} // namespace ble
+
+using ble::BLE;
+
+#endif
@@ -0,0 +1,555 @@
+#pragma once
+
+#ifndef __SIM_BLE_GAP_H__
+#define __SIM_BLE_GAP_H__
+
+/**
+ * @file Gap.h
+ *
+ * @brief Host stand-in for the mbed BLE GAP API (peripheral role only).
+ *
+ * Advertising runs on the virtual clock and ends after its duration with an
+ * AdvertisingEndEvent. Centrals are injected by the simulation with
+ * sim_connect() / sim_disconnect().
+ *
+ * The link layer procedures (connection parameter update, PHY update and the
+ * data length update the host starts on every connection) run one after
+ * another per link, each HOST_SIM_PROCEDURE_EVENTS connection events long,
+ * and settle on what both sides support (HOST_SIM_CENTRAL_* of sim_stack.h).
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "blecommon.h"
+#include "sim_stack.h"
+#include "../sim_clock.h"
+
+namespace ble
+{
+
+struct millisecond_t
+{
+    explicit millisecond_t(uint32_t ms) : value(ms) {}
+    uint32_t value;
+};
+
+struct adv_interval_t
+{
+    explicit adv_interval_t(millisecond_t ms) : value(ms.value) {}
+    uint32_t valueInMs() const { return value; }
+    uint32_t value;
+};
+
+struct adv_duration_t
+{
+    adv_duration_t() : value(0) {}
+    explicit adv_duration_t(millisecond_t ms) : value(ms.value) {}
+    uint32_t valueInMs() const { return value; }
+    uint32_t value;
+};
+
+/* Connection interval in 1.25 ms units */
+struct conn_interval_t
+{
+    explicit conn_interval_t(uint16_t value_1250us) : _value(value_1250us) {}
+    uint16_t value() const { return _value; }
+    uint32_t valueInUs() const { return _value * 1250u; }
+
+private:
+    uint16_t _value;
+};
+
+/* Supervision timeout in 10 ms units */
+struct supervision_timeout_t
+{
+    explicit supervision_timeout_t(uint16_t value_10ms) : _value(value_10ms) {}
+    uint16_t value() const { return _value; }
+
+private:
+    uint16_t _value;
+};
+
+/* Peripheral latency in connection events, 0 to 499; like mbed's Bounded<uint16_t, 0, 499> it does not convert back to an integer */
+struct slave_latency_t
+{
+    slave_latency_t(uint16_t value = 0) : _value(value > 499 ? 499 : value) {}
+    uint16_t value() const { return _value; }
+
+private:
+    uint16_t _value;
+};
+
+/**
+ * @brief PHY of one direction of a link.
+ */
+struct phy_t
+{
+    enum type
+    {
+        NONE = 0,
+        LE_1M = 1,
+        LE_2M = 2,
+        LE_CODED = 3
+    };
+
+    phy_t(type value = NONE) : _value(value) {}
+    uint8_t value() const { return (uint8_t)_value; }
+    bool operator==(type other) const { return _value == other; }
+
+private:
+    type _value;
+};
+
+/**
+ * @brief Set of PHYs a link may use.
+ */
+class phy_set_t
+{
+public:
+    phy_set_t(bool phy_1m = false, bool phy_2m = false, bool phy_coded = false) : _1m(phy_1m), _2m(phy_2m), _coded(phy_coded) {}
+    bool get_1m() const { return _1m; }
+    bool get_2m() const { return _2m; }
+    bool get_coded() const { return _coded; }
+
+private:
+    bool _1m;
+    bool _2m;
+    bool _coded;
+};
+
+enum class coded_symbol_per_bit_t
+{
+    UNDEFINED,
+    S2,
+    S8
+};
+
+enum class controller_supported_features_t
+{
+    LE_ENCRYPTION,
+    CONNECTION_PARAMETERS_REQUEST_PROCEDURE,
+    LE_PACKET_LENGTH_EXTENSION,
+    LE_2M_PHY,
+    LE_CODED_PHY
+};
+
+enum class advertising_type_t
+{
+    CONNECTABLE_UNDIRECTED,
+    CONNECTABLE_DIRECTED,
+    SCANNABLE_UNDIRECTED,
+    NON_CONNECTABLE_UNDIRECTED
+};
+
+/**
+ * @class AdvertisingParameters
+ */
+class AdvertisingParameters
+{
+public:
+    AdvertisingParameters(advertising_type_t type = advertising_type_t::CONNECTABLE_UNDIRECTED,
+                          adv_interval_t interval = adv_interval_t(millisecond_t(40)))
+        : _type(type), _interval(interval)
+    {
+    }
+
+    advertising_type_t getType() const { return _type; }
+    adv_interval_t getMinPrimaryInterval() const { return _interval; }
+
+private:
+    advertising_type_t _type;
+    adv_interval_t _interval;
+};
+
+/**
+ * @brief View over an encoded advertising payload.
+ */
+struct AdvertisingPayload
+{
+    const uint8_t *data;
+    size_t size;
+};
+
+/**
+ * @class AdvertisingDataBuilder
+ *
+ * @brief AD structure encoder writing into an application buffer.
+ */
+class AdvertisingDataBuilder
+{
+public:
+    template <size_t N>
+    AdvertisingDataBuilder(uint8_t (&buffer)[N]) : _buffer(buffer), _capacity(N)
+    {
+    }
+
+    AdvertisingDataBuilder &clear()
+    {
+        _size = 0;
+        return *this;
+    }
+
+    AdvertisingDataBuilder &setFlags(uint8_t flags = 0x06)
+    {
+        append(0x01, &flags, 1);
+        return *this;
+    }
+
+    AdvertisingDataBuilder &setName(const char *name, bool complete = true)
+    {
+        append(complete ? 0x09 : 0x08, reinterpret_cast<const uint8_t *>(name), strlen(name));
+        return *this;
+    }
+
+    AdvertisingPayload getAdvertisingData() const
+    {
+        return AdvertisingPayload{_buffer, _size};
+    }
+
+private:
+    void append(uint8_t type, const uint8_t *data, size_t length)
+    {
+        if (_size + length + 2 > _capacity)
+            return;
+        _buffer[_size++] = (uint8_t)(length + 1);
+        _buffer[_size++] = type;
+        memcpy(&_buffer[_size], data, length);
+        _size += length;
+    }
+
+    uint8_t *_buffer;
+    size_t _capacity;
+    size_t _size = 0;
+};
+
+/**
+ * @class ConnectionCompleteEvent
+ */
+class ConnectionCompleteEvent
+{
+public:
+    ConnectionCompleteEvent(ble_error_t status, connection_handle_t handle, conn_interval_t interval = conn_interval_t(24),
+                            slave_latency_t latency = 0, supervision_timeout_t timeout = supervision_timeout_t(400))
+        : _status(status), _handle(handle), _interval(interval), _latency(latency), _timeout(timeout)
+    {
+    }
+
+    ble_error_t getStatus() const { return _status; }
+    connection_handle_t getConnectionHandle() const { return _handle; }
+    conn_interval_t getConnectionInterval() const { return _interval; }
+    slave_latency_t getConnectionLatency() const { return _latency; }
+    supervision_timeout_t getSupervisionTimeout() const { return _timeout; }
+
+private:
+    ble_error_t _status;
+    connection_handle_t _handle;
+    conn_interval_t _interval;
+    slave_latency_t _latency;
+    supervision_timeout_t _timeout;
+};
+
+/**
+ * @class ConnectionParametersUpdateCompleteEvent
+ */
+class ConnectionParametersUpdateCompleteEvent
+{
+public:
+    ConnectionParametersUpdateCompleteEvent(ble_error_t status, connection_handle_t handle, conn_interval_t interval,
+                                            slave_latency_t latency, supervision_timeout_t timeout)
+        : _status(status), _handle(handle), _interval(interval), _latency(latency), _timeout(timeout)
+    {
+    }
+
+    ble_error_t getStatus() const { return _status; }
+    connection_handle_t getConnectionHandle() const { return _handle; }
+    conn_interval_t getConnectionInterval() const { return _interval; }
+    slave_latency_t getSlaveLatency() const { return _latency; }
+    supervision_timeout_t getSupervisionTimeout() const { return _timeout; }
+
+private:
+    ble_error_t _status;
+    connection_handle_t _handle;
+    conn_interval_t _interval;
+    slave_latency_t _latency;
+    supervision_timeout_t _timeout;
+};
+
+/**
+ * @class DisconnectionCompleteEvent
+ */
+class DisconnectionCompleteEvent
+{
+public:
+    DisconnectionCompleteEvent(connection_handle_t handle, uint8_t reason = 0x13) : _handle(handle), _reason(reason) {}
+
+    connection_handle_t getConnectionHandle() const { return _handle; }
+    uint8_t getReason() const { return _reason; }
+
+private:
+    connection_handle_t _handle;
+    uint8_t _reason;
+};
+
+/**
+ * @class AdvertisingEndEvent
+ */
+class AdvertisingEndEvent
+{
+public:
+    AdvertisingEndEvent(advertising_handle_t adv_handle, connection_handle_t connection, bool connected)
+        : _adv_handle(adv_handle), _connection(connection), _connected(connected)
+    {
+    }
+
+    advertising_handle_t getAdvHandle() const { return _adv_handle; }
+    connection_handle_t getConnection() const { return _connection; }
+    bool isConnected() const { return _connected; }
+
+private:
+    advertising_handle_t _adv_handle;
+    connection_handle_t _connection;
+    bool _connected;
+};
+
+/**
+ * @class Gap
+ */
+class Gap
+{
+public:
+    /**
+     * @brief Application side handler of GAP events.
+     */
+    class EventHandler
+    {
+    public:
+        virtual void onAdvertisingEnd(const AdvertisingEndEvent &event) {}
+        virtual void onConnectionComplete(const ConnectionCompleteEvent &event) {}
+        virtual void onDisconnectionComplete(const DisconnectionCompleteEvent &event) {}
+        virtual void onConnectionParametersUpdateComplete(const ConnectionParametersUpdateCompleteEvent &event) {}
+        virtual void onPhyUpdateComplete(ble_error_t status, connection_handle_t connectionHandle, phy_t txPhy, phy_t rxPhy) {}
+        virtual void onDataLengthChange(connection_handle_t connectionHandle, uint16_t txSize, uint16_t rxSize) {}
+
+    protected:
+        ~EventHandler() {}
+    };
+
+    void setEventHandler(EventHandler *handler) { _handler = handler; }
+
+    bool isAdvertisingActive(advertising_handle_t handle) const
+    {
+        (void)handle;
+        return _advertising;
+    }
+
+    ble_error_t setAdvertisingParameters(advertising_handle_t handle, const AdvertisingParameters &params)
+    {
+        (void)handle;
+        _params = params;
+        return BLE_ERROR_NONE;
+    }
+
+    ble_error_t setAdvertisingPayload(advertising_handle_t handle, AdvertisingPayload payload)
+    {
+        (void)handle;
+        return payload.size <= 31 ? BLE_ERROR_NONE : BLE_ERROR_INVALID_PARAM;
+    }
+
+    ble_error_t startAdvertising(advertising_handle_t handle, adv_duration_t maxDuration = adv_duration_t(), uint8_t maxEvents = 0)
+    {
+        (void)maxEvents;
+        if (_advertising)
+            return BLE_ERROR_INVALID_STATE;
+        _advertising = true;
+
+        if (maxDuration.valueInMs())
+        {
+            uint64_t deadline = sim::clock().now_ns() + (uint64_t)maxDuration.valueInMs() * 1000000ull;
+            _adv_timer = sim::clock().schedule_at_ns(deadline, [this, handle]()
+                                                     {
+                                                         _adv_timer = 0;
+                                                         _advertising = false;
+                                                         AdvertisingEndEvent event(handle, INVALID_CONNECTION_HANDLE, false);
+                                                         sim::ble_stack().post([this, event]()
+                                                                               {
+                                                                                   if (_handler)
+                                                                                       _handler->onAdvertisingEnd(event);
+                                                                               });
+                                                     });
+        }
+        return BLE_ERROR_NONE;
+    }
+
+    ble_error_t stopAdvertising(advertising_handle_t handle)
+    {
+        (void)handle;
+        if (_adv_timer)
+            sim::clock().cancel(_adv_timer);
+        _adv_timer = 0;
+        _advertising = false;
+        return BLE_ERROR_NONE;
+    }
+
+    bool isFeatureSupported(controller_supported_features_t feature)
+    {
+        return feature != controller_supported_features_t::LE_CODED_PHY;
+    }
+
+    /**
+     * @brief Ask the central for new connection parameters
+     *
+     * The central picks the shortest interval in range it supports, or rejects the request when it supports none;
+     * with HOST_SIM_CENTRAL_PARAM_UPDATE 0 it never answers.
+     */
+    ble_error_t updateConnectionParameters(connection_handle_t connectionHandle, conn_interval_t minConnectionInterval,
+                                           conn_interval_t maxConnectionInterval, slave_latency_t slaveLatency,
+                                           supervision_timeout_t supervisionTimeout)
+    {
+        uint16_t min = minConnectionInterval.value(), max = maxConnectionInterval.value();
+        uint16_t timeout = supervisionTimeout.value();
+
+        if (min < 6 || min > max || max > 3200 || timeout < 10 || timeout > 3200)
+            return BLE_ERROR_INVALID_PARAM;
+
+        return procedure(connectionHandle, [this, min, max, slaveLatency, timeout](sim::BleConnection &link)
+                         {
+                             if (!HOST_SIM_CENTRAL_PARAM_UPDATE)
+                                 return;
+
+                             uint16_t interval = min > HOST_SIM_CENTRAL_INTERVAL_MIN ? min : HOST_SIM_CENTRAL_INTERVAL_MIN;
+                             ble_error_t status = interval <= max ? BLE_ERROR_NONE : BLE_ERROR_UNSPECIFIED;
+                             if (!status)
+                             {
+                                 link.interval = interval;
+                                 link.latency = slaveLatency.value();
+                                 link.supervision_timeout = timeout;
+                             }
+
+                             ConnectionParametersUpdateCompleteEvent event(status, link.handle, conn_interval_t(link.interval), link.latency,
+                                                                           supervision_timeout_t(link.supervision_timeout));
+                             sim::ble_stack().post([this, event]()
+                                                   {
+                                                       if (_handler)
+                                                           _handler->onConnectionParametersUpdateComplete(event);
+                                                   });
+                         });
+    }
+
+    /**
+     * @brief Ask for the PHYs of a link; the fastest PHY both sides support in the sets is taken
+     */
+    ble_error_t setPhy(connection_handle_t connection, const phy_set_t *txPhys, const phy_set_t *rxPhys, coded_symbol_per_bit_t codedSymbol)
+    {
+        (void)codedSymbol;
+        bool tx_2m = !txPhys || txPhys->get_2m();
+        bool rx_2m = !rxPhys || rxPhys->get_2m();
+
+        return procedure(connection, [this, tx_2m, rx_2m](sim::BleConnection &link)
+                         {
+                             link.tx_phy = tx_2m && HOST_SIM_CENTRAL_PHY_2M ? 2 : 1;
+                             link.rx_phy = rx_2m && HOST_SIM_CENTRAL_PHY_2M ? 2 : 1;
+
+                             connection_handle_t handle = link.handle;
+                             phy_t tx((phy_t::type)link.tx_phy), rx((phy_t::type)link.rx_phy);
+                             sim::ble_stack().post([this, handle, tx, rx]()
+                                                   {
+                                                       if (_handler)
+                                                           _handler->onPhyUpdateComplete(BLE_ERROR_NONE, handle, tx, rx);
+                                                   });
+                         });
+    }
+
+    /**
+     * @brief Simulation hook: a central connects while advertising.
+     *
+     * @return Connection handle or INVALID_CONNECTION_HANDLE when not connectable
+     */
+    connection_handle_t sim_connect()
+    {
+        if (!_advertising)
+            return INVALID_CONNECTION_HANDLE;
+        stopAdvertising(LEGACY_ADVERTISING_HANDLE);
+
+        connection_handle_t handle = _next_handle++;
+        sim::BleConnection &link = sim::ble_stack().connections()[handle];
+        link.handle = handle;
+
+        ConnectionCompleteEvent event(BLE_ERROR_NONE, handle, conn_interval_t(link.interval), link.latency,
+                                      supervision_timeout_t(link.supervision_timeout));
+        sim::ble_stack().post([this, event]()
+                              {
+                                  if (_handler)
+                                      _handler->onConnectionComplete(event);
+                              });
+
+        /* The host asks for the largest data length right after connecting */
+        procedure(handle, [this](sim::BleConnection &link)
+                  {
+                      uint16_t length = HOST_SIM_CENTRAL_DATA_LENGTH < HOST_SIM_SERVER_DATA_LENGTH ? HOST_SIM_CENTRAL_DATA_LENGTH : HOST_SIM_SERVER_DATA_LENGTH;
+                      if (length <= link.tx_data_length)
+                          return;
+
+                      link.tx_data_length = link.rx_data_length = length;
+                      connection_handle_t handle = link.handle;
+                      sim::ble_stack().post([this, handle, length]()
+                                            {
+                                                if (_handler)
+                                                    _handler->onDataLengthChange(handle, length, length);
+                                            });
+                  });
+        return handle;
+    }
+
+    /**
+     * @brief Simulation hook: the link to <handle> is lost or closed by the central.
+     */
+    void sim_disconnect(connection_handle_t handle)
+    {
+        if (!sim::ble_stack().connections().erase(handle))
+            return;
+
+        DisconnectionCompleteEvent event(handle);
+        sim::ble_stack().post([this, event]()
+                              {
+                                  if (_handler)
+                                      _handler->onDisconnectionComplete(event);
+                              });
+    }
+
+private:
+    /**
+     * @brief Queue a link layer procedure on <handle>, <complete> runs at its instant if the link still exists
+     *
+     * @return BLE_ERROR_INVALID_PARAM for an unknown link
+     */
+    template <typename F>
+    ble_error_t procedure(connection_handle_t handle, F complete)
+    {
+        sim::BleConnection *link = sim::ble_stack().connection(handle);
+        if (!link)
+            return BLE_ERROR_INVALID_PARAM;
+
+        uint64_t now = sim::clock().now_ns();
+        uint64_t start = link->procedure_end_ns > now ? link->procedure_end_ns : now;
+        link->procedure_end_ns = start + (uint64_t)HOST_SIM_PROCEDURE_EVENTS * link->interval * 1250000ull;
+
+        sim::clock().schedule_at_ns(link->procedure_end_ns, [handle, complete]()
+                                    {
+                                        sim::BleConnection *link = sim::ble_stack().connection(handle);
+                                        if (link)
+                                            complete(*link);
+                                    });
+        return BLE_ERROR_NONE;
+    }
+
+    EventHandler *_handler = nullptr;
+    AdvertisingParameters _params;
+    bool _advertising = false;
+    uint64_t _adv_timer = 0;
+    connection_handle_t _next_handle = 0;
+};
+
+} // namespace ble
+
+#endif
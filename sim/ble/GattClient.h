@@ -0,0 +1,79 @@
+#pragma once
+
+#ifndef __SIM_GATT_CLIENT_H__
+#define __SIM_GATT_CLIENT_H__
+
+/**
+ * @file GattClient.h
+ *
+ * @brief Host stand-in for the mbed BLE GATT client API, ATT MTU exchange only.
+ *
+ * The exchange started by the peripheral completes two connection events
+ * later. Either side runs it at most once per connection; the GATT server and
+ * client handlers both learn the result, as on target.
+ */
+
+#include <stdint.h>
+
+#include "blecommon.h"
+#include "sim_stack.h"
+#include "GattServer.h"
+#include "../sim_clock.h"
+
+namespace ble
+{
+
+/**
+ * @class GattClient
+ */
+class GattClient
+{
+public:
+    /**
+     * @brief Application side handler of GATT client events.
+     */
+    class EventHandler
+    {
+    public:
+        virtual void onAttMtuChange(connection_handle_t connectionHandle, uint16_t attMtuSize) {}
+
+    protected:
+        ~EventHandler() {}
+    };
+
+    GattClient()
+    {
+        sim::ble_stack().on_att_mtu([this](connection_handle_t connectionHandle, uint16_t attMtuSize)
+                                    {
+                                        if (_handler)
+                                            _handler->onAttMtuChange(connectionHandle, attMtuSize);
+                                    });
+    }
+
+    void setEventHandler(EventHandler *handler) { _handler = handler; }
+
+    /**
+     * @brief Start the ATT MTU exchange with the largest ATT_MTU of the server
+     *
+     * @return BLE_ERROR_INVALID_PARAM for an unknown link, BLE_ERROR_INVALID_STATE when it already ran
+     */
+    ble_error_t negotiateAttMtu(connection_handle_t connection)
+    {
+        sim::BleConnection *link = sim::ble_stack().connection(connection);
+        if (!link)
+            return BLE_ERROR_INVALID_PARAM;
+        if (link->mtu_exchanged)
+            return BLE_ERROR_INVALID_STATE;
+
+        sim::clock().schedule_at_ns(sim::clock().now_ns() + 2ull * link->interval * 1250000ull, [connection]()
+                                    { sim::ble_stack().exchange_mtu(connection, HOST_SIM_CENTRAL_MTU, HOST_SIM_SERVER_MTU); });
+        return BLE_ERROR_NONE;
+    }
+
+private:
+    EventHandler *_handler = nullptr;
+};
+
+} // namespace ble
+
+#endif
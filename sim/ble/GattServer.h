@@ -0,0 +1,608 @@
+#pragma once
+
+#ifndef __SIM_GATT_SERVER_H__
+#define __SIM_GATT_SERVER_H__
+
+/**
+ * @file GattServer.h
+ *
+ * @brief Host stand-in for the mbed BLE GATT server API.
+ *
+ * Attributes live in a flat table. Handles are assigned per service in
+ * declaration order: service declaration, then for every characteristic its
+ * declaration, value and (for notify/indicate) CCCD, as the Cordio stack does.
+ * Notifications are counted per connection that enabled them in its CCCD.
+ * Reads by a client go through the read authorization callback, which may
+ * supply the value, as in the Cordio stack.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <functional>
+#include <vector>
+
+#include "blecommon.h"
+#include "sim_stack.h"
+
+/* Largest ATT_MTU the simulated server accepts, like cordio.desired-att-mtu */
+#ifndef HOST_SIM_SERVER_MTU
+#define HOST_SIM_SERVER_MTU 247
+#endif
+
+/**
+ * @class GattAttribute
+ *
+ * @brief Attribute with a value buffer owned by the application.
+ */
+class GattAttribute
+{
+public:
+    typedef uint16_t Handle_t;
+    static const Handle_t INVALID_HANDLE = 0x0000;
+
+    GattAttribute(const UUID &uuid, uint8_t *valuePtr = nullptr, uint16_t len = 0, uint16_t maxLen = 0, bool hasVariableLen = true)
+        : _uuid(uuid), _value(valuePtr), _len(len), _max_len(maxLen), _variable_len(hasVariableLen)
+    {
+    }
+
+    Handle_t getHandle() const { return _handle; }
+    void setHandle(Handle_t handle) { _handle = handle; }
+    const UUID &getUUID() const { return _uuid; }
+    uint16_t getLength() const { return _len; }
+    uint16_t getMaxLength() const { return _max_len; }
+    uint8_t *getValuePtr() { return _value; }
+    bool hasVariableLength() const { return _variable_len; }
+
+private:
+    UUID _uuid;
+    uint8_t *_value;
+    uint16_t _len;
+    uint16_t _max_len;
+    bool _variable_len;
+    Handle_t _handle = INVALID_HANDLE;
+};
+
+enum GattAuthCallbackReply_t
+{
+    AUTH_CALLBACK_REPLY_SUCCESS = 0x00,
+    AUTH_CALLBACK_REPLY_ATTERR_INVALID_HANDLE = 0x0101,
+    AUTH_CALLBACK_REPLY_ATTERR_READ_NOT_PERMITTED = 0x0102,
+    AUTH_CALLBACK_REPLY_ATTERR_WRITE_NOT_PERMITTED = 0x0103,
+    AUTH_CALLBACK_REPLY_ATTERR_INVALID_PDU = 0x0104,
+    AUTH_CALLBACK_REPLY_ATTERR_INSUFFICIENT_AUTHENTICATION = 0x0105,
+    AUTH_CALLBACK_REPLY_ATTERR_REQUEST_NOT_SUPPORTED = 0x0106,
+    AUTH_CALLBACK_REPLY_ATTERR_INVALID_OFFSET = 0x0107,
+    AUTH_CALLBACK_REPLY_ATTERR_INSUFFICIENT_AUTHORIZATION = 0x0108,
+    AUTH_CALLBACK_REPLY_ATTERR_PREPARE_QUEUE_FULL = 0x0109,
+    AUTH_CALLBACK_REPLY_ATTERR_ATTRIBUTE_NOT_FOUND = 0x010A,
+    AUTH_CALLBACK_REPLY_ATTERR_ATTRIBUTE_NOT_LONG = 0x010B,
+    AUTH_CALLBACK_REPLY_ATTERR_INSUFFICIENT_ENCRYPTION_KEY_SIZE = 0x010C,
+    AUTH_CALLBACK_REPLY_ATTERR_INVALID_ATT_VAL_LENGTH = 0x010D,
+    AUTH_CALLBACK_REPLY_ATTERR_UNLIKELY_ERROR = 0x010E,
+    AUTH_CALLBACK_REPLY_ATTERR_INSUFFICIENT_ENCRYPTION = 0x010F,
+    AUTH_CALLBACK_REPLY_ATTERR_UNSUPPORTED_GROUP_TYPE = 0x0110,
+    AUTH_CALLBACK_REPLY_ATTERR_INSUFFICIENT_RESOURCES = 0x0111
+};
+
+struct GattWriteCallbackParams
+{
+    enum WriteOp_t
+    {
+        OP_INVALID = 0x00,
+        OP_WRITE_REQ = 0x01,
+        OP_WRITE_CMD = 0x02,
+        OP_SIGN_WRITE_CMD = 0x03,
+        OP_PREP_WRITE_REQ = 0x04,
+        OP_EXEC_WRITE_REQ_CANCEL = 0x05,
+        OP_EXEC_WRITE_REQ_NOW = 0x06
+    };
+
+    ble::connection_handle_t connHandle;
+    GattAttribute::Handle_t handle;
+    WriteOp_t writeOp;
+    uint16_t offset;
+    uint16_t len;
+    const uint8_t *data;
+};
+
+struct GattReadCallbackParams
+{
+    ble::connection_handle_t connHandle;
+    GattAttribute::Handle_t handle;
+    uint16_t offset;
+    uint16_t len;
+    const uint8_t *data;
+    ble_error_t status;
+};
+
+struct GattWriteAuthCallbackParams
+{
+    ble::connection_handle_t connHandle;
+    GattAttribute::Handle_t handle;
+    uint16_t offset;
+    uint16_t len;
+    const uint8_t *data;
+    GattAuthCallbackReply_t authorizationReply;
+};
+
+struct GattReadAuthCallbackParams
+{
+    ble::connection_handle_t connHandle;
+    GattAttribute::Handle_t handle;
+    uint16_t offset;
+    uint16_t len;
+    uint8_t *data;
+    GattAuthCallbackReply_t authorizationReply;
+};
+
+struct GattDataSentCallbackParams
+{
+    ble::connection_handle_t connHandle;
+    GattAttribute::Handle_t attHandle;
+};
+
+struct GattUpdatesEnabledCallbackParams
+{
+    ble::connection_handle_t connHandle;
+    GattAttribute::Handle_t attHandle;
+    GattAttribute::Handle_t charHandle;
+};
+
+typedef GattUpdatesEnabledCallbackParams GattUpdatesDisabledCallbackParams;
+
+struct GattConfirmationReceivedCallbackParams
+{
+    ble::connection_handle_t connHandle;
+    GattAttribute::Handle_t attHandle;
+};
+
+/**
+ * @class GattCharacteristic
+ *
+ * @brief Characteristic declaration with its value attribute.
+ */
+class GattCharacteristic
+{
+public:
+    enum Properties_t
+    {
+        BLE_GATT_CHAR_PROPERTIES_NONE = 0x00,
+        BLE_GATT_CHAR_PROPERTIES_BROADCAST = 0x01,
+        BLE_GATT_CHAR_PROPERTIES_READ = 0x02,
+        BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE = 0x04,
+        BLE_GATT_CHAR_PROPERTIES_WRITE = 0x08,
+        BLE_GATT_CHAR_PROPERTIES_NOTIFY = 0x10,
+        BLE_GATT_CHAR_PROPERTIES_INDICATE = 0x20,
+        BLE_GATT_CHAR_PROPERTIES_AUTHENTICATED_SIGNED_WRITES = 0x40,
+        BLE_GATT_CHAR_PROPERTIES_EXTENDED_PROPERTIES = 0x80
+    };
+
+    GattCharacteristic(const UUID &uuid, uint8_t *valuePtr = nullptr, uint16_t len = 0, uint16_t maxLen = 0,
+                       uint8_t props = BLE_GATT_CHAR_PROPERTIES_NONE, GattAttribute *descriptors[] = nullptr,
+                       unsigned numDescriptors = 0, bool hasVariableLen = true)
+        : _value_attribute(uuid, valuePtr, len, maxLen, hasVariableLen), _properties(props),
+          _descriptors(descriptors), _descriptor_count(numDescriptors)
+    {
+    }
+
+    virtual ~GattCharacteristic() {}
+
+    GattAttribute &getValueAttribute() { return _value_attribute; }
+    const GattAttribute &getValueAttribute() const { return _value_attribute; }
+    GattAttribute::Handle_t getValueHandle() const { return _value_attribute.getHandle(); }
+    uint8_t getProperties() const { return _properties; }
+    uint8_t getDescriptorCount() const { return (uint8_t)_descriptor_count; }
+    GattAttribute *getDescriptor(uint8_t index) { return index < _descriptor_count ? _descriptors[index] : nullptr; }
+
+    template <typename T>
+    void setWriteAuthorizationCallback(T *object, void (T::*member)(GattWriteAuthCallbackParams *))
+    {
+        _write_auth = [object, member](GattWriteAuthCallbackParams *params) { (object->*member)(params); };
+    }
+
+    bool isWriteAuthorizationEnabled() const { return static_cast<bool>(_write_auth); }
+
+    template <typename T>
+    void setReadAuthorizationCallback(T *object, void (T::*member)(GattReadAuthCallbackParams *))
+    {
+        _read_auth = [object, member](GattReadAuthCallbackParams *params) { (object->*member)(params); };
+    }
+
+    bool isReadAuthorizationEnabled() const { return static_cast<bool>(_read_auth); }
+
+    GattAuthCallbackReply_t authorizeRead(GattReadAuthCallbackParams *params)
+    {
+        if (!_read_auth)
+            return AUTH_CALLBACK_REPLY_SUCCESS;
+        params->authorizationReply = AUTH_CALLBACK_REPLY_SUCCESS;
+        _read_auth(params);
+        return params->authorizationReply;
+    }
+
+    GattAuthCallbackReply_t authorizeWrite(GattWriteAuthCallbackParams *params)
+    {
+        if (!_write_auth)
+            return AUTH_CALLBACK_REPLY_SUCCESS;
+        params->authorizationReply = AUTH_CALLBACK_REPLY_SUCCESS;
+        _write_auth(params);
+        return params->authorizationReply;
+    }
+
+private:
+    GattAttribute _value_attribute;
+    uint8_t _properties;
+    GattAttribute **_descriptors;
+    unsigned _descriptor_count;
+    std::function<void(GattWriteAuthCallbackParams *)> _write_auth;
+    std::function<void(GattReadAuthCallbackParams *)> _read_auth;
+};
+
+/**
+ * @class GattService
+ *
+ * @brief Primary service made of application owned characteristics.
+ */
+class GattService
+{
+public:
+    GattService(const UUID &uuid, GattCharacteristic *characteristics[], unsigned numCharacteristics)
+        : _uuid(uuid), _characteristics(characteristics), _count(numCharacteristics)
+    {
+    }
+
+    const UUID &getUUID() const { return _uuid; }
+    GattAttribute::Handle_t getHandle() const { return _handle; }
+    void setHandle(GattAttribute::Handle_t handle) { _handle = handle; }
+    uint8_t getCharacteristicCount() const { return (uint8_t)_count; }
+    GattCharacteristic *getCharacteristic(uint8_t index) { return index < _count ? _characteristics[index] : nullptr; }
+
+private:
+    UUID _uuid;
+    GattCharacteristic **_characteristics;
+    unsigned _count;
+    GattAttribute::Handle_t _handle = GattAttribute::INVALID_HANDLE;
+};
+
+namespace ble
+{
+
+/**
+ * @class GattServer
+ *
+ * @brief Attribute table with read/write/notify semantics of the mbed API.
+ */
+class GattServer
+{
+public:
+    GattServer()
+    {
+        sim::ble_stack().on_att_mtu([this](ble::connection_handle_t connectionHandle, uint16_t attMtuSize)
+                                    {
+                                        if (_handler)
+                                            _handler->onAttMtuChange(connectionHandle, attMtuSize);
+                                    });
+    }
+
+    /**
+     * @brief Application side handler of GATT server events.
+     */
+    class EventHandler
+    {
+    public:
+        virtual void onAttMtuChange(ble::connection_handle_t connectionHandle, uint16_t attMtuSize) {}
+        virtual void onDataSent(const GattDataSentCallbackParams &params) {}
+        virtual void onDataWritten(const GattWriteCallbackParams &params) {}
+        virtual void onDataRead(const GattReadCallbackParams &params) {}
+        virtual void onShutdown(const GattServer &server) {}
+        virtual void onUpdatesEnabled(const GattUpdatesEnabledCallbackParams &params) {}
+        virtual void onUpdatesDisabled(const GattUpdatesDisabledCallbackParams &params) {}
+        virtual void onConfirmationReceived(const GattConfirmationReceivedCallbackParams &params) {}
+
+    protected:
+        ~EventHandler() {}
+    };
+
+    void setEventHandler(EventHandler *handler) { _handler = handler; }
+    EventHandler *getEventHandler() { return _handler; }
+
+    ble_error_t addService(GattService &service)
+    {
+        service.setHandle(++_last_handle);
+        for (uint8_t i = 0; i < service.getCharacteristicCount(); i++)
+        {
+            GattCharacteristic *characteristic = service.getCharacteristic(i);
+            GattAttribute &value = characteristic->getValueAttribute();
+
+            /* Characteristic declaration, then its value */
+            ++_last_handle;
+            value.setHandle(++_last_handle);
+
+            Attribute attribute;
+            attribute.characteristic = characteristic;
+            attribute.value.assign(value.getValuePtr(), value.getValuePtr() + value.getLength());
+            attribute.max_len = value.getMaxLength();
+            attribute.variable_len = value.hasVariableLength();
+            _attributes.push_back(attribute);
+
+            if (characteristic->getProperties() & (GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY |
+                                                   GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE))
+                ++_last_handle; /* CCCD added by the stack */
+
+            for (uint8_t d = 0; d < characteristic->getDescriptorCount(); d++)
+                characteristic->getDescriptor(d)->setHandle(++_last_handle);
+        }
+        return BLE_ERROR_NONE;
+    }
+
+    ble_error_t read(GattAttribute::Handle_t attributeHandle, uint8_t buffer[], uint16_t *lengthP)
+    {
+        sim::ble_stack().stats().server_reads++;
+        Attribute *attribute = find(attributeHandle);
+        if (!attribute)
+            return BLE_ERROR_INVALID_PARAM;
+
+        uint16_t length = attribute->value.size() < *lengthP ? (uint16_t)attribute->value.size() : *lengthP;
+        memcpy(buffer, attribute->value.data(), length);
+        *lengthP = (uint16_t)attribute->value.size();
+        return BLE_ERROR_NONE;
+    }
+
+    ble_error_t read(ble::connection_handle_t connectionHandle, GattAttribute::Handle_t attributeHandle, uint8_t *buffer, uint16_t *lengthP)
+    {
+        (void)connectionHandle;
+        return read(attributeHandle, buffer, lengthP);
+    }
+
+    ble_error_t write(GattAttribute::Handle_t attributeHandle, const uint8_t *value, uint16_t size, bool localOnly = false)
+    {
+        return write_value(nullptr, attributeHandle, value, size, localOnly);
+    }
+
+    ble_error_t write(ble::connection_handle_t connectionHandle, GattAttribute::Handle_t attributeHandle, const uint8_t *value, uint16_t size, bool localOnly = false)
+    {
+        return write_value(&connectionHandle, attributeHandle, value, size, localOnly);
+    }
+
+    ble_error_t areUpdatesEnabled(const GattCharacteristic &characteristic, bool *enabledP)
+    {
+        *enabledP = false;
+        for (auto &link : sim::ble_stack().connections())
+        {
+            auto it = link.second.cccd.find(characteristic.getValueHandle());
+            if (it != link.second.cccd.end() && it->second)
+                *enabledP = true;
+        }
+        return BLE_ERROR_NONE;
+    }
+
+    ble_error_t areUpdatesEnabled(ble::connection_handle_t connectionHandle, const GattCharacteristic &characteristic, bool *enabledP)
+    {
+        *enabledP = false;
+        sim::BleConnection *link = sim::ble_stack().connection(connectionHandle);
+        if (!link)
+            return BLE_ERROR_INVALID_PARAM;
+        auto it = link->cccd.find(characteristic.getValueHandle());
+        *enabledP = it != link->cccd.end() && it->second;
+        return BLE_ERROR_NONE;
+    }
+
+    /**
+     * @brief Simulation hook: a central changes its CCCD for <valueHandle>.
+     *
+     * @param cccd Bit 0 enables notifications, bit 1 indications
+     */
+    void sim_client_subscribe(ble::connection_handle_t connectionHandle, GattAttribute::Handle_t valueHandle, uint16_t cccd)
+    {
+        sim::BleConnection *link = sim::ble_stack().connection(connectionHandle);
+        if (!link || !find(valueHandle))
+            return;
+        link->cccd[valueHandle] = cccd;
+
+        GattUpdatesEnabledCallbackParams params = {connectionHandle, valueHandle, (GattAttribute::Handle_t)(valueHandle - 1)};
+        sim::ble_stack().post([this, params, cccd]()
+                              {
+                                  if (!_handler)
+                                      return;
+                                  if (cccd)
+                                      _handler->onUpdatesEnabled(params);
+                                  else
+                                      _handler->onUpdatesDisabled(params);
+                              });
+    }
+
+    /**
+     * @brief Simulation hook: a central runs the ATT MTU exchange, unless it already ran on the link.
+     *
+     * @return ATT_MTU of the link, the smaller of both sides
+     */
+    uint16_t sim_client_exchange_mtu(ble::connection_handle_t connectionHandle, uint16_t clientMtu)
+    {
+        return sim::ble_stack().exchange_mtu(connectionHandle, clientMtu, HOST_SIM_SERVER_MTU);
+    }
+
+    /**
+     * @brief Simulation hook: value handles of all characteristics a client can subscribe to.
+     */
+    std::vector<GattAttribute::Handle_t> sim_subscribable_handles() const
+    {
+        std::vector<GattAttribute::Handle_t> handles;
+        for (const auto &attribute : _attributes)
+        {
+            if (attribute.characteristic->getProperties() & (GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY |
+                                                             GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE))
+                handles.push_back(attribute.characteristic->getValueHandle());
+        }
+        return handles;
+    }
+
+    /**
+     * @brief Simulation hook: value handle of the characteristic with <uuid>, 0 if there is none.
+     */
+    GattAttribute::Handle_t sim_find_handle(const UUID &uuid) const
+    {
+        for (const auto &attribute : _attributes)
+        {
+            if (attribute.characteristic->getValueAttribute().getUUID() == uuid)
+                return attribute.characteristic->getValueHandle();
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Simulation hook: properties of the characteristic owning <valueHandle>.
+     */
+    uint8_t sim_properties(GattAttribute::Handle_t valueHandle)
+    {
+        Attribute *attribute = find(valueHandle);
+        return attribute ? attribute->characteristic->getProperties() : 0;
+    }
+
+    /**
+     * @brief Simulation hook: a central reads <valueHandle>, subject to read authorization.
+     */
+    ble_error_t sim_client_read(ble::connection_handle_t connectionHandle, GattAttribute::Handle_t valueHandle, std::vector<uint8_t> &out)
+    {
+        Attribute *attribute = find(valueHandle);
+        if (!attribute)
+            return BLE_ERROR_INVALID_PARAM;
+
+        GattReadAuthCallbackParams auth = {connectionHandle, valueHandle, 0, 0, nullptr, AUTH_CALLBACK_REPLY_SUCCESS};
+        if (attribute->characteristic->authorizeRead(&auth) != AUTH_CALLBACK_REPLY_SUCCESS)
+            return BLE_ERROR_OPERATION_NOT_PERMITTED;
+        if (auth.data)
+            attribute->value.assign(auth.data, auth.data + auth.len);
+        out = attribute->value;
+
+        GattReadCallbackParams params = {connectionHandle, valueHandle, 0, (uint16_t)out.size(), nullptr, BLE_ERROR_NONE};
+        sim::ble_stack().post([this, params]()
+                              {
+                                  if (_handler)
+                                      _handler->onDataRead(params);
+                              });
+        return BLE_ERROR_NONE;
+    }
+
+    /**
+     * @brief Simulation hook: a central writes <valueHandle>, subject to write authorization.
+     */
+    GattAuthCallbackReply_t sim_client_write(ble::connection_handle_t connectionHandle, GattAttribute::Handle_t valueHandle, const uint8_t *data, uint16_t length)
+    {
+        Attribute *attribute = find(valueHandle);
+        if (!attribute)
+            return AUTH_CALLBACK_REPLY_ATTERR_INVALID_HANDLE;
+
+        GattWriteAuthCallbackParams auth = {connectionHandle, valueHandle, 0, length, data, AUTH_CALLBACK_REPLY_SUCCESS};
+        GattAuthCallbackReply_t reply = attribute->characteristic->authorizeWrite(&auth);
+        if (reply != AUTH_CALLBACK_REPLY_SUCCESS)
+            return reply;
+
+        if (length > attribute->max_len)
+            return AUTH_CALLBACK_REPLY_ATTERR_INVALID_ATT_VAL_LENGTH;
+        attribute->value.assign(data, data + length);
+
+        std::vector<uint8_t> copy(data, data + length);
+        sim::ble_stack().post([this, connectionHandle, valueHandle, copy]()
+                              {
+                                  GattWriteCallbackParams params = {connectionHandle, valueHandle, GattWriteCallbackParams::OP_WRITE_REQ, 0, (uint16_t)copy.size(), copy.data()};
+                                  if (_handler)
+                                      _handler->onDataWritten(params);
+                              });
+        return AUTH_CALLBACK_REPLY_SUCCESS;
+    }
+
+private:
+    struct Attribute
+    {
+        GattCharacteristic *characteristic;
+        std::vector<uint8_t> value;
+        uint16_t max_len;
+        bool variable_len;
+    };
+
+    Attribute *find(GattAttribute::Handle_t handle)
+    {
+        for (auto &attribute : _attributes)
+        {
+            if (attribute.characteristic->getValueHandle() == handle)
+                return &attribute;
+        }
+        return nullptr;
+    }
+
+    ble_error_t write_value(const ble::connection_handle_t *only, GattAttribute::Handle_t attributeHandle, const uint8_t *value, uint16_t size, bool localOnly)
+    {
+        sim::BleStack &stack = sim::ble_stack();
+        stack.stats().server_writes++;
+
+        Attribute *attribute = find(attributeHandle);
+        if (!attribute)
+            return BLE_ERROR_INVALID_PARAM;
+        if (size > attribute->max_len || (!attribute->variable_len && size != attribute->max_len))
+            return BLE_ERROR_INVALID_PARAM;
+
+        attribute->value.assign(value, value + size);
+        if (localOnly)
+            return BLE_ERROR_NONE;
+
+        for (auto &entry : stack.connections())
+        {
+            sim::BleConnection &link = entry.second;
+            if (only && *only != link.handle)
+                continue;
+
+            auto it = link.cccd.find(attributeHandle);
+            if (it == link.cccd.end() || !it->second)
+                continue;
+
+            /* A write to every link leaves out the stalled one, a write to it alone fails */
+            if (link.stalled)
+            {
+                if (only)
+                    return BLE_ERROR_NO_MEM;
+                continue;
+            }
+
+            /* Payload is truncated to ATT_MTU - 3, like a real notification */
+            uint16_t payload = size < link.att_mtu - 3 ? size : link.att_mtu - 3;
+            stack.stats().notified_bytes += payload;
+            link.transmit(payload);
+            link.received++;
+            link.received_bytes += payload;
+            if (link.on_value)
+                link.on_value(attributeHandle, value, payload);
+
+            GattDataSentCallbackParams sent = {link.handle, attributeHandle};
+            if (it->second & 0x0001)
+            {
+                stack.stats().notifications++;
+                stack.post([this, sent]()
+                           {
+                               if (_handler)
+                                   _handler->onDataSent(sent);
+                           });
+            }
+            else
+            {
+                stack.stats().indications++;
+                GattConfirmationReceivedCallbackParams confirmation = {link.handle, attributeHandle};
+                stack.post([this, confirmation]()
+                           {
+                               if (_handler)
+                                   _handler->onConfirmationReceived(confirmation);
+                           });
+            }
+        }
+        return BLE_ERROR_NONE;
+    }
+
+    EventHandler *_handler = nullptr;
+    GattAttribute::Handle_t _last_handle = 0;
+    std::vector<Attribute> _attributes;
+};
+
+} // namespace ble
+
+using ble::GattServer;
+
+#endif
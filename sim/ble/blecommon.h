@@ -0,0 +1,96 @@
+#pragma once
+
+#ifndef __SIM_BLE_COMMON_H__
+#define __SIM_BLE_COMMON_H__
+
+/**
+ * @file blecommon.h
+ *
+ * @brief Host stand-in for the BLE API error codes and basic types.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+enum ble_error_t
+{
+    BLE_ERROR_NONE = 0,
+    BLE_ERROR_BUFFER_OVERFLOW = 1,
+    BLE_ERROR_NOT_IMPLEMENTED = 2,
+    BLE_ERROR_PARAM_OUT_OF_RANGE = 3,
+    BLE_ERROR_INVALID_PARAM = 4,
+    BLE_STACK_BUSY = 5,
+    BLE_ERROR_INVALID_STATE = 6,
+    BLE_ERROR_NO_MEM = 7,
+    BLE_ERROR_OPERATION_NOT_PERMITTED = 8,
+    BLE_ERROR_INITIALIZATION_INCOMPLETE = 9,
+    BLE_ERROR_ALREADY_INITIALIZED = 10,
+    BLE_ERROR_UNSPECIFIED = 11,
+    BLE_ERROR_INTERNAL_STACK_FAILURE = 12,
+    BLE_ERROR_NOT_FOUND = 13
+};
+
+namespace ble
+{
+
+typedef uint16_t connection_handle_t;
+typedef uint8_t advertising_handle_t;
+
+static const advertising_handle_t LEGACY_ADVERTISING_HANDLE = 0x00;
+static const connection_handle_t INVALID_CONNECTION_HANDLE = 0xFFFF;
+
+} // namespace ble
+
+/**
+ * @class UUID
+ *
+ * @brief 16-bit or 128-bit attribute type, parsed from the usual string form.
+ */
+class UUID
+{
+public:
+    static const unsigned LENGTH_OF_LONG_UUID = 16;
+
+    UUID(uint16_t short_uuid) : _short(true)
+    {
+        memset(_bytes, 0, sizeof(_bytes));
+        _bytes[0] = (uint8_t)short_uuid;
+        _bytes[1] = (uint8_t)(short_uuid >> 8);
+    }
+
+    UUID(const char *string) : _short(false)
+    {
+        memset(_bytes, 0, sizeof(_bytes));
+        unsigned nibbles = 0;
+        for (const char *c = string; *c && nibbles < 2 * LENGTH_OF_LONG_UUID; c++)
+        {
+            int value;
+            if (*c >= '0' && *c <= '9')
+                value = *c - '0';
+            else if (*c >= 'a' && *c <= 'f')
+                value = *c - 'a' + 10;
+            else if (*c >= 'A' && *c <= 'F')
+                value = *c - 'A' + 10;
+            else
+                continue;
+            /* Stored little endian, like the stack does */
+            unsigned index = LENGTH_OF_LONG_UUID - 1 - nibbles / 2;
+            _bytes[index] |= (nibbles % 2) ? value : value << 4;
+            nibbles++;
+        }
+    }
+
+    bool shortUUID() const { return _short; }
+    const uint8_t *getBaseUUID() const { return _bytes; }
+
+    bool operator==(const UUID &other) const
+    {
+        return _short == other._short && memcmp(_bytes, other._bytes, sizeof(_bytes)) == 0;
+    }
+
+private:
+    uint8_t _bytes[LENGTH_OF_LONG_UUID];
+    bool _short;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+
+#ifndef __SIM_FUNCTION_POINTER_WITH_CONTEXT_H__
+#define __SIM_FUNCTION_POINTER_WITH_CONTEXT_H__
+
+/**
+ * @file FunctionPointerWithContext.h
+ *
+ * @brief Host stand-in for the BLE API single-argument callback type.
+ */
+
+#include <functional>
+
+template <typename ContextType>
+class FunctionPointerWithContext
+{
+public:
+    FunctionPointerWithContext() {}
+
+    FunctionPointerWithContext(void (*function)(ContextType))
+    {
+        if (function)
+            _func = function;
+    }
+
+    template <typename T>
+    FunctionPointerWithContext(T *object, void (T::*member)(ContextType))
+    {
+        _func = [object, member](ContextType context) { (object->*member)(context); };
+    }
+
+    void call(ContextType context) const
+    {
+        if (_func)
+            _func(context);
+    }
+
+    void operator()(ContextType context) const
+    {
+        call(context);
+    }
+
+    explicit operator bool() const
+    {
+        return static_cast<bool>(_func);
+    }
+
+private:
+    std::function<void(ContextType)> _func;
+};
+
+template <typename T, typename ContextType>
+FunctionPointerWithContext<ContextType> makeFunctionPointer(T *object, void (T::*member)(ContextType))
+{
+    return FunctionPointerWithContext<ContextType>(object, member);
+}
+
+#endif
@@ -0,0 +1,333 @@
+#pragma once
+
+#ifndef __SIM_BLE_CENTRAL_H__
+#define __SIM_BLE_CENTRAL_H__
+
+/**
+ * @file sim_central.h
+ *
+ * @brief Scripted centrals for the native simulation run.
+ *
+ * Each central connects as soon as the peripheral advertises (retrying every
+ * 100 ms of virtual time), runs the ATT MTU exchange (unless
+ * HOST_SIM_CENTRAL_MTU_EXCHANGE is 0, then the peripheral has to) and subscribes to every
+ * characteristic offering notify or indicate, after selecting the gyro stream
+ * format given by HOST_SIM_CENTRAL_FORMAT and the log level given by
+ * HOST_SIM_CENTRAL_LOG_LEVEL; every central but the first also asks for the
+ * stream rate given by HOST_SIM_CENTRAL_RATE. Optionally it disconnects again
+ * after HOST_SIM_CENTRAL_LEAVE_MS. At exit it reports what it received, which
+ * is the end-to-end throughput of the firmware, the link layer parameters the
+ * link ended up with and the PDUs and airtime it spent, and how far the attitude
+ * notifications were off the true attitude of the simulated sensor at the
+ * time of the sample they were fused up to. A second before the end it reads
+ * the metrics characteristic; with HOST_SIM_CENTRAL_TRACE it also selects a
+ * tracepoint and reads its histogram then.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "Gap.h"
+#include "GattServer.h"
+#include "sim_stack.h"
+#include "../sim_board.h"
+#include "../sim_clock.h"
+
+/* Number of scripted centrals in the native run, 0 leaves the device unconnected */
+#ifndef HOST_SIM_CENTRALS
+#define HOST_SIM_CENTRALS 1
+#endif
+
+/* Gyro stream sample format the centrals write before subscribing, GyroFormat; -1 keeps the default */
+#ifndef HOST_SIM_CENTRAL_FORMAT
+#define HOST_SIM_CENTRAL_FORMAT -1
+#endif
+
+/* Runtime log level the centrals write, LOG_LEVEL_INFO..LOG_LEVEL_NONE; -1 keeps the default */
+#ifndef HOST_SIM_CENTRAL_LOG_LEVEL
+#define HOST_SIM_CENTRAL_LOG_LEVEL -1
+#endif
+
+/* Tracepoint the centrals select on the trace characteristic and read before the end, TracePoint; -1 for none */
+#ifndef HOST_SIM_CENTRAL_TRACE
+#define HOST_SIM_CENTRAL_TRACE -1
+#endif
+
+/* Trace characteristic of the gyro service */
+#define HOST_SIM_TRACE_UUID "7ffe706c-7fdd-410e-bd19-80367d343f67"
+
+/* Metrics characteristic of the metrics service: version, field count, then uint32 fields, see metrics_pack() */
+#define HOST_SIM_METRICS_UUID "ba9f8450-5489-41d2-baec-fe3d64d2fe34"
+
+/* Log level characteristic of the gyro service */
+#define HOST_SIM_LOG_LEVEL_UUID "dde4935f-3ff7-4068-94ac-76c1cef3d0ec"
+
+/* Stream format characteristic of the gyro service */
+#define HOST_SIM_STREAM_FORMAT_UUID "3abb60e4-54df-4c83-afb4-7271c9d58672"
+
+/* Attitude characteristic of the gyro service: uint32 timestamp in us, then w, x, y, z as int16 Q14 */
+#define HOST_SIM_ATTITUDE_UUID "55533d5d-5cac-49ec-b2e9-c34c5d0ce863"
+
+/* Stream rate divider written by every central but the first, -1 keeps the full rate */
+#ifndef HOST_SIM_CENTRAL_RATE
+#define HOST_SIM_CENTRAL_RATE -1
+#endif
+
+#define HOST_SIM_STREAM_RATE_UUID "b0076f1e-8b6c-4f6b-ba35-5f5e61b45644"
+
+/* Virtual time of the first connection attempt */
+#ifndef HOST_SIM_CENTRAL_START_MS
+#define HOST_SIM_CENTRAL_START_MS 1000
+#endif
+
+/* Virtual time a central stays connected, 0 keeps it connected until the end of the run */
+#ifndef HOST_SIM_CENTRAL_LEAVE_MS
+#define HOST_SIM_CENTRAL_LEAVE_MS 0
+#endif
+
+namespace sim
+{
+
+/**
+ * @class Central
+ */
+class Central
+{
+public:
+    void start(ble::Gap &gap, ble::GattServer &server, int index)
+    {
+        _gap = &gap;
+        _server = &server;
+        _index = index;
+        retry((uint64_t)HOST_SIM_CENTRAL_START_MS * 1000000ull);
+    }
+
+    ~Central()
+    {
+        if (!_gap || clock().now_ns() == 0)
+            return;
+
+        uint64_t connected_ns = _left ? _connected_at : (_connected_at ? clock().now_ns() - _connected_at : 0);
+        double connected_s = connected_ns / 1e9;
+        BleConnection *link = ble_stack().connection(_handle);
+        if (link)
+            _last = *link;
+
+        printf("[sim] central %d          : mtu %u, %llu notifications, %llu bytes, %.1f B/s over %.3f s\r\n",
+               _index, _last.att_mtu, (unsigned long long)_last.received, (unsigned long long)_last.received_bytes,
+               connected_s > 0 ? _last.received_bytes / connected_s : 0.0, connected_s);
+
+        printf("[sim] central %d link     : interval %.2f ms, latency %u, timeout %u ms, phy %uM/%uM, data length %u/%u, "
+               "%llu pdus (%.2f per notification), airtime %.1f%%\r\n",
+               _index, _last.interval * 1.25, _last.latency, _last.supervision_timeout * 10u, _last.tx_phy, _last.rx_phy,
+               _last.tx_data_length, _last.rx_data_length, (unsigned long long)_last.pdus,
+               _last.received ? (double)_last.pdus / _last.received : 0.0,
+               connected_ns ? 100.0 * _last.airtime_ns / connected_ns : 0.0);
+
+        if (_attitudes)
+        {
+            printf("[sim] central %d attitude : %llu values, tilt error rms %.3f deg max %.3f deg, attitude error rms %.3f deg\r\n",
+                   _index, (unsigned long long)_attitudes, sqrt(_tilt_sq / _attitudes), _tilt_max,
+                   sqrt(_attitude_sq / _attitudes));
+        }
+
+        if (_trace.size() >= 12)
+        {
+            uint16_t ticks_per_us = _trace[2] | (_trace[3] << 8);
+            printf("[sim] central %d trace    : point %u, %u passes, max %.1f us, log2 buckets", _index, _trace[0],
+                   (unsigned)read32(&_trace[4]), read32(&_trace[8]) / (double)ticks_per_us);
+            for (size_t bucket = 0; 12 + 4 * bucket + 4 <= _trace.size(); bucket++)
+                printf(" %u", (unsigned)read32(&_trace[12 + 4 * bucket]));
+            printf("\r\n");
+        }
+
+        if (_metrics.size() >= 2 + 4 * 12)
+        {
+            const uint8_t *field = &_metrics[2];
+            printf("[sim] central %d metrics  : up %.3f s, connected %.3f s, samples %u acquired %u dropped %u published, "
+                   "i2c %u errors %u retries, notifications %u queued %u sent, event queue high-water %u, "
+                   "sample to notify p50 %u p99 %u us\r\n",
+                   _index, read32(&field[0]) / 1e3, read32(&field[4]) / 1e3, (unsigned)read32(&field[8]),
+                   (unsigned)read32(&field[12]), (unsigned)read32(&field[16]), (unsigned)read32(&field[20]),
+                   (unsigned)read32(&field[24]), (unsigned)read32(&field[28]), (unsigned)read32(&field[32]),
+                   (unsigned)read32(&field[36]), (unsigned)read32(&field[40]), (unsigned)read32(&field[44]));
+        }
+    }
+
+    ble::connection_handle_t handle() const { return _handle; }
+
+private:
+    void retry(uint64_t at_ns)
+    {
+        clock().schedule_at_ns(at_ns, [this]()
+                               { connect(); });
+    }
+
+    void connect()
+    {
+        _handle = _gap->sim_connect();
+        if (_handle == ble::INVALID_CONNECTION_HANDLE)
+        {
+            retry(clock().now_ns() + 100000000ull);
+            return;
+        }
+        _connected_at = clock().now_ns();
+
+        /* Discovery and MTU exchange take a few connection events */
+        clock().schedule_at_ns(clock().now_ns() + 50000000ull, [this]()
+                               { setup(); });
+
+        if (HOST_SIM_RUN_MS > 1000)
+        {
+            clock().schedule_at_ns((uint64_t)(HOST_SIM_RUN_MS - 1000) * 1000000ull, [this]()
+                                   {
+                                       if (!ble_stack().connection(_handle))
+                                           return;
+
+                                       GattAttribute::Handle_t handle = _server->sim_find_handle(UUID(HOST_SIM_METRICS_UUID));
+                                       if (handle)
+                                           _server->sim_client_read(_handle, handle, _metrics);
+
+                                       handle = _server->sim_find_handle(UUID(HOST_SIM_TRACE_UUID));
+                                       if (HOST_SIM_CENTRAL_TRACE >= 0 && handle)
+                                           _server->sim_client_read(_handle, handle, _trace);
+                                   });
+        }
+
+        if (HOST_SIM_CENTRAL_LEAVE_MS)
+        {
+            clock().schedule_at_ns(clock().now_ns() + (uint64_t)HOST_SIM_CENTRAL_LEAVE_MS * 1000000ull, [this]()
+                                   { leave(); });
+        }
+    }
+
+    void leave()
+    {
+        BleConnection *link = ble_stack().connection(_handle);
+        if (!link)
+            return;
+
+        _last = *link;
+        _connected_at = clock().now_ns() - _connected_at;
+        _gap->sim_disconnect(_handle);
+        _left = true;
+    }
+
+    void setup()
+    {
+        if (HOST_SIM_CENTRAL_MTU_EXCHANGE)
+            _server->sim_client_exchange_mtu(_handle, HOST_SIM_CENTRAL_MTU);
+
+        if (HOST_SIM_CENTRAL_FORMAT >= 0)
+        {
+            uint8_t format = (uint8_t)HOST_SIM_CENTRAL_FORMAT;
+            GattAttribute::Handle_t handle = _server->sim_find_handle(UUID(HOST_SIM_STREAM_FORMAT_UUID));
+            if (handle)
+                _server->sim_client_write(_handle, handle, &format, 1);
+        }
+
+        if (HOST_SIM_CENTRAL_RATE >= 0 && _index > 0)
+        {
+            uint8_t rate = (uint8_t)HOST_SIM_CENTRAL_RATE;
+            GattAttribute::Handle_t handle = _server->sim_find_handle(UUID(HOST_SIM_STREAM_RATE_UUID));
+            if (handle)
+                _server->sim_client_write(_handle, handle, &rate, 1);
+        }
+
+        if (HOST_SIM_CENTRAL_LOG_LEVEL >= 0)
+        {
+            uint8_t level = (uint8_t)HOST_SIM_CENTRAL_LOG_LEVEL;
+            GattAttribute::Handle_t handle = _server->sim_find_handle(UUID(HOST_SIM_LOG_LEVEL_UUID));
+            if (handle)
+                _server->sim_client_write(_handle, handle, &level, 1);
+        }
+
+        if (HOST_SIM_CENTRAL_TRACE >= 0)
+        {
+            uint8_t point = (uint8_t)HOST_SIM_CENTRAL_TRACE;
+            GattAttribute::Handle_t handle = _server->sim_find_handle(UUID(HOST_SIM_TRACE_UUID));
+            if (handle)
+                _server->sim_client_write(_handle, handle, &point, 1);
+        }
+
+        BleConnection *link = ble_stack().connection(_handle);
+        if (link && _index == HOST_SIM_CENTRAL_STALLED)
+            link->stalled = true;
+
+        GattAttribute::Handle_t attitude = _server->sim_find_handle(UUID(HOST_SIM_ATTITUDE_UUID));
+        if (link && attitude)
+        {
+            link->on_value = [this, attitude](uint16_t handle, const uint8_t *value, uint16_t length)
+            {
+                if (handle == attitude && length == 12)
+                    check_attitude(value);
+            };
+        }
+
+        for (GattAttribute::Handle_t value : _server->sim_subscribable_handles())
+        {
+            uint8_t properties = _server->sim_properties(value);
+            uint16_t cccd = (properties & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY) ? 0x0001 : 0x0002;
+            _server->sim_client_subscribe(_handle, value, cccd);
+        }
+    }
+
+    static uint32_t read32(const uint8_t *data)
+    {
+        return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+    }
+
+    /**
+     * @brief Compare a received attitude with the true one at its sample time
+     */
+    void check_attitude(const uint8_t *value)
+    {
+        uint32_t timestamp_us = value[0] | (value[1] << 8) | (value[2] << 16) | ((uint32_t)value[3] << 24);
+        uint64_t now_us = clock().now_us();
+        uint64_t sample_us = now_us - (uint32_t)((uint32_t)now_us - timestamp_us);
+
+        Attitude received;
+        double *components[4] = {&received.w, &received.x, &received.y, &received.z};
+        double norm = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            *components[i] = (int16_t)(value[4 + 2 * i] | (value[5 + 2 * i] << 8)) / 16384.0;
+            norm += *components[i] * *components[i];
+        }
+
+        /* Q14 rounding leaves the quaternion slightly off unit length */
+        for (int i = 0; i < 4; i++)
+            *components[i] /= sqrt(norm);
+
+        const Attitude &truth = board().mpu6050().attitude_at(sample_us * 1000);
+        double tilt = tilt_error_deg(received, truth);
+        double error = attitude_error_deg(received, truth);
+
+        _attitudes++;
+        _tilt_sq += tilt * tilt;
+        _tilt_max = tilt > _tilt_max ? tilt : _tilt_max;
+        _attitude_sq += error * error;
+    }
+
+    ble::Gap *_gap = nullptr;
+    ble::GattServer *_server = nullptr;
+    int _index = 0;
+    ble::connection_handle_t _handle = ble::INVALID_CONNECTION_HANDLE;
+    uint64_t _connected_at = 0;
+    bool _left = false;
+    BleConnection _last;
+
+    uint64_t _attitudes = 0;
+    double _tilt_sq = 0;
+    double _tilt_max = 0;
+    double _attitude_sq = 0;
+
+    /* Trace and metrics characteristic values read before the end */
+    std::vector<uint8_t> _trace;
+    std::vector<uint8_t> _metrics;
+};
+
+} // namespace sim
+
+#endif
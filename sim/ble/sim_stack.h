@@ -0,0 +1,250 @@
+#pragma once
+
+#ifndef __SIM_BLE_STACK_H__
+#define __SIM_BLE_STACK_H__
+
+/**
+ * @file sim_stack.h
+ *
+ * @brief Shared state of the simulated BLE stack.
+ *
+ * Like the real Cordio port, the simulated stack never calls application
+ * handlers directly: it queues them and raises "events to process", and the
+ * application drains them from its EventQueue through BLE::processEvents().
+ *
+ * Every link has the parameters of the link layer: connection interval, PHY
+ * and data length, changed by the procedures of the GAP stand-in, and counts
+ * the PDUs and airtime its notifications take with them.
+ */
+
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "blecommon.h"
+
+/* Connection interval the centrals connect with, 1.25 ms units */
+#ifndef HOST_SIM_CENTRAL_INTERVAL
+#define HOST_SIM_CENTRAL_INTERVAL 24
+#endif
+
+/* Shortest connection interval the centrals accept in a parameter update, 1.25 ms units (12 like iOS) */
+#ifndef HOST_SIM_CENTRAL_INTERVAL_MIN
+#define HOST_SIM_CENTRAL_INTERVAL_MIN 6
+#endif
+
+/* Centrals answer connection parameter update requests (1) or ignore them (0) */
+#ifndef HOST_SIM_CENTRAL_PARAM_UPDATE
+#define HOST_SIM_CENTRAL_PARAM_UPDATE 1
+#endif
+
+/* Centrals support the 2M PHY */
+#ifndef HOST_SIM_CENTRAL_PHY_2M
+#define HOST_SIM_CENTRAL_PHY_2M 1
+#endif
+
+/* Largest link layer payload of the centrals, 27 without Data Length Extension */
+#ifndef HOST_SIM_CENTRAL_DATA_LENGTH
+#define HOST_SIM_CENTRAL_DATA_LENGTH 251
+#endif
+
+/* Largest link layer payload of the simulated controller, like the nRF52832 */
+#ifndef HOST_SIM_SERVER_DATA_LENGTH
+#define HOST_SIM_SERVER_DATA_LENGTH 251
+#endif
+
+/* ATT_MTU the centrals accept */
+#ifndef HOST_SIM_CENTRAL_MTU
+#define HOST_SIM_CENTRAL_MTU 247
+#endif
+
+/* Centrals start the ATT MTU exchange themselves (1) or leave it to the peripheral (0) */
+#ifndef HOST_SIM_CENTRAL_MTU_EXCHANGE
+#define HOST_SIM_CENTRAL_MTU_EXCHANGE 1
+#endif
+
+/* Index of a central whose link never frees a transmit buffer, its notifications fail with BLE_ERROR_NO_MEM; -1 for none */
+#ifndef HOST_SIM_CENTRAL_STALLED
+#define HOST_SIM_CENTRAL_STALLED -1
+#endif
+
+/* Connection events a link layer procedure takes until its instant */
+#define HOST_SIM_PROCEDURE_EVENTS 6
+
+namespace sim
+{
+
+/**
+ * @brief Per-link state of a simulated central.
+ */
+struct BleConnection
+{
+    ble::connection_handle_t handle = ble::INVALID_CONNECTION_HANDLE;
+    uint16_t att_mtu = 23;
+
+    /* Link layer parameters: interval in 1.25 ms, supervision timeout in 10 ms units, PHY 1 (1M) or 2 (2M) */
+    uint16_t interval = HOST_SIM_CENTRAL_INTERVAL;
+    uint16_t latency = 0;
+    uint16_t supervision_timeout = 400;
+    uint8_t tx_phy = 1;
+    uint8_t rx_phy = 1;
+    uint16_t tx_data_length = 27;
+    uint16_t rx_data_length = 27;
+
+    /* Virtual time the last queued link layer procedure completes, the controller runs them one after another */
+    uint64_t procedure_end_ns = 0;
+
+    /* The ATT MTU exchange ran, it runs once per connection */
+    bool mtu_exchanged = false;
+
+    /* No transmit buffer is ever free on this link, see HOST_SIM_CENTRAL_STALLED */
+    bool stalled = false;
+
+    /* Data PDUs of the notifications sent to this central and their airtime, acknowledgement included */
+    uint64_t pdus = 0;
+    uint64_t airtime_ns = 0;
+
+    /* Client characteristic configuration per value handle: bit 0 notify, bit 1 indicate */
+    std::map<uint16_t, uint16_t> cccd;
+
+    /* Handle value notifications/indications delivered to this central */
+    uint64_t received = 0;
+    uint64_t received_bytes = 0;
+
+    /* Called with every value delivered to this central: value handle, payload, length */
+    std::function<void(uint16_t, const uint8_t *, uint16_t)> on_value;
+
+    /**
+     * @brief Count the data PDUs and airtime of a notification with <payload> bytes
+     *
+     * The L2CAP and ATT headers (7 bytes) go with the payload, split into PDUs of the transmit data length.
+     * Every PDU adds preamble, access address, header and CRC (10 bytes on the 1M PHY, 11 on 2M) and is
+     * answered by an empty PDU of the central, each after the 150 us inter frame space.
+     */
+    void transmit(uint16_t payload)
+    {
+        uint32_t bytes = payload + 7u;
+        uint32_t count = (bytes + tx_data_length - 1) / tx_data_length;
+        uint32_t framing = tx_phy == 2 ? 11 : 10;
+        uint64_t bit_ns = tx_phy == 2 ? 500 : 1000;
+
+        pdus += count;
+        airtime_ns += (bytes + 2 * framing * count) * 8 * bit_ns + 2 * 150000ull * count;
+    }
+};
+
+/**
+ * @brief Counters of GATT server traffic.
+ */
+struct BleStats
+{
+    uint64_t server_reads = 0;
+    uint64_t server_writes = 0;
+    uint64_t notifications = 0;
+    uint64_t indications = 0;
+    uint64_t notified_bytes = 0;
+};
+
+/**
+ * @class BleStack
+ *
+ * @brief Deferred event queue and link table of the simulated controller/host.
+ */
+class BleStack
+{
+public:
+    typedef std::function<void()> Event;
+
+    /**
+     * @brief Hook used to raise "events to process" towards the application.
+     */
+    void on_signal(std::function<void()> signal) { _signal = std::move(signal); }
+
+    void post(Event event)
+    {
+        _pending.push_back(std::move(event));
+        if (!_signaled && _signal)
+        {
+            _signaled = true;
+            _signal();
+        }
+    }
+
+    /**
+     * @brief Run all queued stack events; called from BLE::processEvents().
+     */
+    void process()
+    {
+        _signaled = false;
+        while (!_pending.empty())
+        {
+            Event event = std::move(_pending.front());
+            _pending.pop_front();
+            event();
+        }
+    }
+
+    std::map<ble::connection_handle_t, BleConnection> &connections() { return _connections; }
+
+    BleConnection *connection(ble::connection_handle_t handle)
+    {
+        auto it = _connections.find(handle);
+        return it == _connections.end() ? nullptr : &it->second;
+    }
+
+    BleStats &stats() { return _stats; }
+
+    /**
+     * @brief Hook of a GATT server or client told about ATT_MTU changes.
+     */
+    void on_att_mtu(std::function<void(ble::connection_handle_t, uint16_t)> listener) { _mtu_listeners.push_back(std::move(listener)); }
+
+    /**
+     * @brief Run the ATT MTU exchange on <handle> once, tell the server and client handlers.
+     *
+     * @return ATT_MTU of the link, the smaller of both sides
+     */
+    uint16_t exchange_mtu(ble::connection_handle_t handle, uint16_t client_mtu, uint16_t server_mtu)
+    {
+        BleConnection *link = connection(handle);
+        if (!link)
+            return 0;
+        if (link->mtu_exchanged)
+            return link->att_mtu;
+
+        uint16_t mtu = client_mtu < server_mtu ? client_mtu : server_mtu;
+        link->att_mtu = mtu < 23 ? 23 : mtu;
+        link->mtu_exchanged = true;
+
+        uint16_t negotiated = link->att_mtu;
+        post([this, handle, negotiated]()
+             {
+                 for (auto &listener : _mtu_listeners)
+                     listener(handle, negotiated);
+             });
+        return negotiated;
+    }
+
+private:
+    std::deque<Event> _pending;
+    std::function<void()> _signal;
+    bool _signaled = false;
+
+    std::map<ble::connection_handle_t, BleConnection> _connections;
+    BleStats _stats;
+    std::vector<std::function<void(ble::connection_handle_t, uint16_t)>> _mtu_listeners;
+};
+
+inline BleStack &ble_stack()
+{
+    static BleStack instance;
+    return instance;
+}
+
+} // namespace sim
+
+#endif
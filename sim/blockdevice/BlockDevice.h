@@ -0,0 +1,48 @@
+#pragma once
+
+#ifndef __SIM_BLOCKDEVICE_BLOCKDEVICE_H__
+#define __SIM_BLOCKDEVICE_BLOCKDEVICE_H__
+
+/**
+ * @file BlockDevice.h
+ *
+ * @brief Host stand-in for the mbed::BlockDevice interface.
+ */
+
+#include <stdint.h>
+
+namespace mbed
+{
+
+typedef uint64_t bd_addr_t;
+typedef uint64_t bd_size_t;
+
+enum
+{
+    BD_ERROR_OK = 0,
+    BD_ERROR_DEVICE_ERROR = -4001,
+};
+
+class BlockDevice
+{
+public:
+    virtual ~BlockDevice() {}
+
+    virtual int init() = 0;
+    virtual int deinit() = 0;
+    virtual int sync() { return 0; }
+    virtual int read(void *buffer, bd_addr_t addr, bd_size_t size) = 0;
+    virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size) = 0;
+    virtual int erase(bd_addr_t addr, bd_size_t size) { return 0; }
+    virtual bd_size_t get_read_size() const = 0;
+    virtual bd_size_t get_program_size() const = 0;
+    virtual bd_size_t get_erase_size() const { return get_program_size(); }
+    virtual bd_size_t get_erase_size(bd_addr_t addr) const { return get_erase_size(); }
+    virtual int get_erase_value() const { return -1; }
+    virtual bd_size_t size() const = 0;
+    virtual const char *get_type() const = 0;
+};
+
+} // namespace mbed
+
+#endif
@@ -0,0 +1,241 @@
+#pragma once
+
+#ifndef __SIM_MBED_EVENTS_H__
+#define __SIM_MBED_EVENTS_H__
+
+/**
+ * @file mbed_events.h
+ *
+ * @brief Host stand-in for events::EventQueue running on virtual time.
+ *
+ * Posted events are ordered by due time; dispatching jumps the simulation
+ * clock straight to the next due event or virtual timer, so periodic work
+ * scheduled with call_every() runs back-to-back on the host.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <utility>
+
+#include "../sim_clock.h"
+
+#ifndef EVENTS_QUEUE_SIZE
+#define EVENTS_QUEUE_SIZE (32 * 32)
+#endif
+
+namespace events
+{
+
+/**
+ * @class EventQueue
+ *
+ * @brief Deferred call queue with one-shot and periodic events.
+ */
+class EventQueue
+{
+public:
+    typedef std::chrono::duration<int, std::milli> duration;
+
+    EventQueue(unsigned size = EVENTS_QUEUE_SIZE, unsigned char *buffer = nullptr)
+    {
+        (void)size;
+        (void)buffer;
+    }
+
+    ~EventQueue()
+    {
+        if (!_dispatched)
+            return;
+
+        printf("[sim] event queue       : %llu events, %.3f ms in handlers (longest %.3f ms)\r\n",
+               (unsigned long long)_dispatched, _handler_ns / 1e6, _longest_ns / 1e6);
+    }
+
+    template <typename F>
+    int call(F f)
+    {
+        return post(0, 0, std::function<void()>(std::move(f)));
+    }
+
+    template <typename F>
+    int call_in(duration ms, F f)
+    {
+        return post(ms_to_ns(ms), 0, std::function<void()>(std::move(f)));
+    }
+
+    template <typename F>
+    int call_every(duration ms, F f)
+    {
+        return post(ms_to_ns(ms), ms_to_ns(ms), std::function<void()>(std::move(f)));
+    }
+
+    bool cancel(int id)
+    {
+        for (auto it = _events.begin(); it != _events.end(); ++it)
+        {
+            if (it->second.id == id)
+            {
+                _events.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Dispatch for HOST_SIM_RUN_MS of virtual time.
+     *
+     * On target this never returns; the simulation ends the run so that
+     * statistics can be collected.
+     */
+    void dispatch_forever()
+    {
+        dispatch_for(duration(HOST_SIM_RUN_MS));
+    }
+
+    void dispatch_for(duration ms)
+    {
+        dispatch_until(sim::clock().now_ns() + ms_to_ns(ms));
+    }
+
+    void break_dispatch()
+    {
+        _break = true;
+    }
+
+    /**
+     * @brief Number of events executed so far.
+     */
+    uint64_t dispatched() const { return _dispatched; }
+
+    /**
+     * @brief Largest number of events that were pending at once.
+     */
+    size_t high_water_mark() const { return _high_water; }
+
+    /**
+     * @brief Virtual time spent inside event handlers, i.e. with the queue blocked.
+     */
+    uint64_t handler_ns() const { return _handler_ns; }
+
+private:
+    struct Event
+    {
+        int id;
+        uint64_t period_ns;
+        std::function<void()> func;
+    };
+
+    static uint64_t ms_to_ns(duration ms)
+    {
+        return ms.count() > 0 ? (uint64_t)ms.count() * 1000000ull : 0;
+    }
+
+    int post(uint64_t delay_ns, uint64_t period_ns, std::function<void()> func)
+    {
+        int id = ++_last_id;
+        uint64_t due = sim::clock().now_ns() + delay_ns;
+        _events.emplace(std::make_pair(due, _seq++), Event{id, period_ns, std::move(func)});
+        if (_events.size() > _high_water)
+            _high_water = _events.size();
+        return id;
+    }
+
+    void dispatch_until(uint64_t deadline_ns)
+    {
+        _break = false;
+        while (!_break)
+        {
+            uint64_t next = sim::clock().next_deadline_ns();
+            if (!_events.empty() && _events.begin()->first.first < next)
+                next = _events.begin()->first.first;
+
+            if (next > deadline_ns)
+            {
+                sim::clock().advance_to_ns(deadline_ns);
+                return;
+            }
+
+            /* Fires virtual timers (interrupt sources) up to the next event */
+            sim::clock().advance_to_ns(next);
+
+            if (_events.empty() || _events.begin()->first.first > sim::clock().now_ns())
+                continue;
+
+            auto it = _events.begin();
+            uint64_t due = it->first.first;
+            Event event = std::move(it->second);
+            _events.erase(it);
+
+            if (event.period_ns)
+                _events.emplace(std::make_pair(due + event.period_ns, _seq++), Event{event.id, event.period_ns, event.func});
+
+            _dispatched++;
+            uint64_t started = sim::clock().now_ns();
+            event.func();
+
+            uint64_t spent = sim::clock().now_ns() - started;
+            _handler_ns += spent;
+            if (spent > _longest_ns)
+                _longest_ns = spent;
+        }
+    }
+
+    std::multimap<std::pair<uint64_t, uint64_t>, Event> _events;
+    uint64_t _seq = 0;
+    uint64_t _dispatched = 0;
+    size_t _high_water = 0;
+    uint64_t _handler_ns = 0;
+    uint64_t _longest_ns = 0;
+    int _last_id = 0;
+    bool _break = false;
+};
+
+template <typename F, typename A>
+class UserAllocatedEvent;
+
+/**
+ * @class UserAllocatedEvent
+ *
+ * @brief Event whose storage belongs to its owner; posting it never allocates and only fails
+ * while it is still pending.
+ */
+template <typename F>
+class UserAllocatedEvent<F, void()>
+{
+public:
+    UserAllocatedEvent(F f) : _f(f) {}
+    UserAllocatedEvent(EventQueue *queue, F f) : _queue(queue), _f(f) {}
+
+    bool try_call()
+    {
+        return try_call_on(_queue);
+    }
+
+    bool try_call_on(EventQueue *queue)
+    {
+        if (_pending || !queue)
+            return false;
+
+        _pending = true;
+        queue->call([this]()
+                    {
+                        _pending = false;
+                        _f();
+                    });
+        return true;
+    }
+
+private:
+    EventQueue *_queue = nullptr;
+    F _f;
+    bool _pending = false;
+};
+
+} // namespace events
+
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+
+#ifndef __SIM_ADVERTISING_DATA_PARSER_H__
+#define __SIM_ADVERTISING_DATA_PARSER_H__
+
+/**
+ * @file AdvertisingDataParser.h
+ *
+ * @brief Included by the firmware; the builder lives in ble/Gap.h here.
+ */
+
+#include "../ble/BLE.h"
+
+#endif
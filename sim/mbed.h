@@ -0,0 +1,323 @@
+#pragma once
+
+#ifndef __SIM_MBED_H__
+#define __SIM_MBED_H__
+
+/**
+ * @file mbed.h
+ *
+ * @brief Host stand-in for the subset of mbed OS 6 used by the firmware.
+ *
+ * Only the [env:native] simulation build puts the sim/ directory on the
+ * include path. Peripherals are backed by the simulated board in sim_board.h,
+ * and time is the virtual clock in sim_clock.h.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <mutex>
+
+#include "sim_clock.h"
+#include "sim_gpio.h"
+#include "sim_i2c.h"
+#include "sim_board.h"
+#include "sim_thread.h"
+
+#include "events/mbed_events.h"
+#include "platform/Callback.h"
+#include "platform/NonCopyable.h"
+
+#define MBED_PACKED(struct) struct __attribute__((packed))
+
+/* Asynchronous I2C API, as on the nRF52 (TWIM with EasyDMA) */
+#define DEVICE_I2C_ASYNCH 1
+
+#define I2C_EVENT_ERROR (1 << 1)
+#define I2C_EVENT_ERROR_NO_SLAVE (1 << 2)
+#define I2C_EVENT_TRANSFER_COMPLETE (1 << 3)
+#define I2C_EVENT_TRANSFER_EARLY_NACK (1 << 4)
+#define I2C_EVENT_ALL (I2C_EVENT_ERROR | I2C_EVENT_TRANSFER_COMPLETE | I2C_EVENT_ERROR_NO_SLAVE | I2C_EVENT_TRANSFER_EARLY_NACK)
+
+typedef enum
+{
+    P0_0 = 0, P0_1, P0_2, P0_3, P0_4, P0_5, P0_6, P0_7,
+    P0_8, P0_9, P0_10, P0_11, P0_12, P0_13, P0_14, P0_15,
+    P0_16, P0_17, P0_18, P0_19, P0_20, P0_21, P0_22, P0_23,
+    P0_24, P0_25, P0_26, P0_27, P0_28, P0_29, P0_30, P0_31,
+
+    USBTX = P0_6,
+    USBRX = P0_8,
+
+    NC = (int)0xFFFFFFFF
+} PinName;
+
+/**
+ * @brief Sleep the calling thread; consumes virtual time only.
+ *
+ * On the simulation thread the clock moves on, an rtos::Thread hands
+ * control back until the clock got there.
+ */
+inline void thread_sleep_for(uint32_t millisec)
+{
+    if (sim::Fiber *fiber = sim::Fiber::current())
+        fiber->sleep_ns((uint64_t)millisec * 1000000ull);
+    else
+        sim::clock().advance_ns((uint64_t)millisec * 1000000ull);
+}
+
+inline uint64_t get_ms_count(void)
+{
+    return sim::clock().now_ms();
+}
+
+/**
+ * @brief Free running 32-bit microsecond counter.
+ */
+inline uint32_t us_ticker_read(void)
+{
+    return (uint32_t)sim::clock().now_us();
+}
+
+/**
+ * @brief newlib itoa(), missing from glibc.
+ */
+inline char *itoa(int value, char *str, int base)
+{
+    char *p = str;
+    unsigned int magnitude = (value < 0 && base == 10) ? -(unsigned int)value : (unsigned int)value;
+
+    if (value < 0 && base == 10)
+        *p++ = '-';
+
+    char *start = p;
+    do
+    {
+        unsigned int digit = magnitude % base;
+        *p++ = digit < 10 ? '0' + digit : 'a' + digit - 10;
+        magnitude /= base;
+    } while (magnitude);
+    *p = '\0';
+
+    for (char *end = p - 1; start < end; start++, end--)
+    {
+        char tmp = *start;
+        *start = *end;
+        *end = tmp;
+    }
+    return str;
+}
+
+namespace mbed
+{
+
+typedef Callback<void(int)> event_callback_t;
+
+/**
+ * @class I2C
+ *
+ * @brief I2C master forwarding to the simulated bus.
+ */
+class I2C
+{
+public:
+    I2C(PinName sda, PinName scl)
+    {
+        (void)sda;
+        (void)scl;
+        sim::board();
+    }
+
+    void frequency(int hz)
+    {
+        sim::i2c_bus().frequency(hz);
+    }
+
+    int write(int address, const char *data, int length, bool repeated = false)
+    {
+        return sim::i2c_bus().write(address, data, length, repeated);
+    }
+
+    int read(int address, char *data, int length, bool repeated = false)
+    {
+        return sim::i2c_bus().read(address, data, length, repeated);
+    }
+
+    /**
+     * @brief Non-blocking write-then-read; <callback> runs in "interrupt" context with the event flags.
+     *
+     * @return 0 if the transfer started, -1 if the peripheral is busy
+     */
+    int transfer(int address, const char *tx_buffer, int tx_length, char *rx_buffer, int rx_length,
+                 const event_callback_t &callback, int event = I2C_EVENT_TRANSFER_COMPLETE, bool repeated = false)
+    {
+        return sim::i2c_bus().transfer(address, tx_buffer, tx_length, rx_buffer, rx_length, repeated,
+                                       [callback, event](bool ack)
+                                       {
+                                           int flags = ack ? I2C_EVENT_TRANSFER_COMPLETE : I2C_EVENT_ERROR_NO_SLAVE;
+                                           if ((flags & event) && callback)
+                                               callback(flags);
+                                       });
+    }
+
+    void abort_transfer() {}
+};
+
+/**
+ * @class InterruptIn
+ *
+ * @brief Edge interrupt on a simulated GPIO line.
+ */
+class InterruptIn
+{
+public:
+    InterruptIn(PinName pin) : _line(sim::gpio(pin))
+    {
+        sim::board();
+        _rise_slot = _line.on_rise([this]()
+                                   {
+                                       if (_enabled && _rise)
+                                           _rise();
+                                   });
+        _fall_slot = _line.on_fall([this]()
+                                   {
+                                       if (_enabled && _fall)
+                                           _fall();
+                                   });
+    }
+
+    ~InterruptIn()
+    {
+        _line.set_rise(_rise_slot, nullptr);
+        _line.set_fall(_fall_slot, nullptr);
+    }
+
+    void rise(Callback<void()> func) { _rise = func; }
+    void fall(Callback<void()> func) { _fall = func; }
+    int read() { return _line.level(); }
+    void enable_irq() { _enabled = true; }
+    void disable_irq() { _enabled = false; }
+
+private:
+    sim::InterruptLine &_line;
+    size_t _rise_slot;
+    size_t _fall_slot;
+    Callback<void()> _rise;
+    Callback<void()> _fall;
+    bool _enabled = true;
+};
+
+/**
+ * @class BufferedSerial
+ *
+ * @brief UART console, echoed to stdout unless HOST_SIM_QUIET is defined.
+ */
+class BufferedSerial
+{
+public:
+    BufferedSerial(PinName tx, PinName rx, int baud = 9600) : _baud(baud)
+    {
+        (void)tx;
+        (void)rx;
+    }
+
+    ssize_t write(const void *buffer, size_t length)
+    {
+        _bytes += length;
+#ifndef HOST_SIM_QUIET
+        fwrite(buffer, 1, length, stdout);
+#else
+        (void)buffer;
+#endif
+        return (ssize_t)length;
+    }
+
+    uint64_t bytes_written() const { return _bytes; }
+    int baud() const { return _baud; }
+
+private:
+    int _baud;
+    uint64_t _bytes = 0;
+};
+
+} // namespace mbed
+
+namespace rtos
+{
+
+/**
+ * @class Mutex
+ *
+ * @brief Recursive mutex, like the RTX based original.
+ */
+class Mutex
+{
+public:
+    void lock() { _mutex.lock(); }
+    bool trylock() { return _mutex.try_lock(); }
+    void unlock() { _mutex.unlock(); }
+
+private:
+    std::recursive_mutex _mutex;
+};
+
+typedef enum
+{
+    osPriorityIdle = 1,
+    osPriorityLow = 8,
+    osPriorityBelowNormal = 16,
+    osPriorityNormal = 24,
+    osPriorityAboveNormal = 32,
+    osPriorityHigh = 40,
+    osPriorityRealtime = 48
+} osPriority;
+
+typedef enum
+{
+    osOK = 0,
+    osError = -1
+} osStatus;
+
+#ifndef OS_STACK_SIZE
+#define OS_STACK_SIZE 4096
+#endif
+
+/**
+ * @class Thread
+ *
+ * @brief RTOS thread, run in lockstep with the simulation thread, see sim_thread.h.
+ *
+ * Priority and stack are not modeled: the task runs whenever the firmware
+ * on the simulation thread moves the clock past its wake-up time.
+ */
+class Thread
+{
+public:
+    Thread(osPriority priority = osPriorityNormal, uint32_t stack_size = OS_STACK_SIZE,
+           unsigned char *stack_mem = nullptr, const char *name = nullptr)
+    {
+        (void)priority;
+        (void)stack_size;
+        (void)stack_mem;
+        (void)name;
+    }
+
+    osStatus start(mbed::Callback<void()> task)
+    {
+        _fiber.start([task]() { task(); });
+        return osOK;
+    }
+
+private:
+    sim::Fiber _fiber;
+};
+
+} // namespace rtos
+
+using namespace mbed;
+using namespace rtos;
+
+#endif
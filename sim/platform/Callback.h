@@ -0,0 +1,100 @@
+#pragma once
+
+#ifndef __SIM_PLATFORM_CALLBACK_H__
+#define __SIM_PLATFORM_CALLBACK_H__
+
+/**
+ * @file Callback.h
+ *
+ * @brief Host stand-in for mbed::Callback built on std::function.
+ */
+
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+namespace mbed
+{
+
+template <typename Signature>
+class Callback;
+
+/**
+ * @class Callback
+ *
+ * @brief Callable holding a free function, bound member function or functor.
+ */
+template <typename R, typename... Args>
+class Callback<R(Args...)>
+{
+public:
+    Callback() {}
+    Callback(std::nullptr_t) {}
+
+    Callback(R (*func)(Args...))
+    {
+        if (func)
+            _func = func;
+    }
+
+    template <typename T, typename U>
+    Callback(U *obj, R (T::*method)(Args...))
+    {
+        _func = [obj, method](Args... args) -> R { return (obj->*method)(std::forward<Args>(args)...); };
+    }
+
+    template <typename T, typename U>
+    Callback(const U *obj, R (T::*method)(Args...) const)
+    {
+        _func = [obj, method](Args... args) -> R { return (obj->*method)(std::forward<Args>(args)...); };
+    }
+
+    template <typename F,
+              typename = typename std::enable_if<
+                  !std::is_same<typename std::decay<F>::type, Callback>::value &&
+                  !std::is_pointer<typename std::decay<F>::type>::value>::type>
+    Callback(F func) : _func(std::move(func))
+    {
+    }
+
+    R call(Args... args) const
+    {
+        return _func(std::forward<Args>(args)...);
+    }
+
+    R operator()(Args... args) const
+    {
+        return _func(std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const
+    {
+        return static_cast<bool>(_func);
+    }
+
+private:
+    std::function<R(Args...)> _func;
+};
+
+template <typename R, typename... Args>
+Callback<R(Args...)> callback(R (*func)(Args...))
+{
+    return Callback<R(Args...)>(func);
+}
+
+template <typename T, typename U, typename R, typename... Args>
+Callback<R(Args...)> callback(U *obj, R (T::*method)(Args...))
+{
+    return Callback<R(Args...)>(obj, method);
+}
+
+template <typename T, typename U, typename R, typename... Args>
+Callback<R(Args...)> callback(const U *obj, R (T::*method)(Args...) const)
+{
+    return Callback<R(Args...)>(obj, method);
+}
+
+} // namespace mbed
+
+#endif
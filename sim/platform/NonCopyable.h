@@ -0,0 +1,29 @@
+#pragma once
+
+#ifndef __SIM_PLATFORM_NONCOPYABLE_H__
+#define __SIM_PLATFORM_NONCOPYABLE_H__
+
+/**
+ * @file NonCopyable.h
+ *
+ * @brief Host stand-in for mbed::NonCopyable.
+ */
+
+namespace mbed
+{
+
+template <typename T>
+class NonCopyable
+{
+protected:
+    NonCopyable() = default;
+    ~NonCopyable() = default;
+
+public:
+    NonCopyable(const NonCopyable &) = delete;
+    NonCopyable &operator=(const NonCopyable &) = delete;
+};
+
+} // namespace mbed
+
+#endif
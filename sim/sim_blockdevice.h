@@ -0,0 +1,154 @@
+#pragma once
+
+#ifndef __SIM_BLOCKDEVICE_H__
+#define __SIM_BLOCKDEVICE_H__
+
+/**
+ * @file sim_blockdevice.h
+ *
+ * @brief Flash block device backed by a host file.
+ *
+ * Behaves like the nRF52 internal flash through FlashIAP: erase sets a page
+ * to 0xFF, program can only clear bits (so programming without an erase
+ * corrupts the data, as on the device), and both stall the caller for the
+ * datasheet times in virtual time. The file outlives the process, so a
+ * second run of the simulation finds what the first one stored.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "blockdevice/BlockDevice.h"
+#include "sim_clock.h"
+
+namespace sim
+{
+
+/**
+ * @brief Counters of a FileBlockDevice.
+ */
+struct FlashStats
+{
+    uint64_t reads = 0;
+    uint64_t programs = 0;
+    uint64_t erases = 0;
+    uint64_t busy_ns = 0;
+};
+
+/**
+ * @class FileBlockDevice
+ */
+class FileBlockDevice : public mbed::BlockDevice
+{
+public:
+    /* nRF52832 NVMC: 4 KB pages, 32-bit words, 85 ms page erase, 41 us word write */
+    static const uint32_t PAGE_SIZE = 4096;
+    static const uint32_t WORD_SIZE = 4;
+    static const uint64_t ERASE_NS = 85000000ull;
+    static const uint64_t PROGRAM_WORD_NS = 41000ull;
+
+    FileBlockDevice(const char *path, uint32_t size) : _path(path), _size(size) {}
+
+    ~FileBlockDevice() { deinit(); }
+
+    int init() override
+    {
+        if (_file)
+            return mbed::BD_ERROR_OK;
+
+        _file = fopen(_path.c_str(), "r+b");
+        if (!_file)
+        {
+            /* A fresh device is erased */
+            _file = fopen(_path.c_str(), "w+b");
+            if (!_file)
+                return mbed::BD_ERROR_DEVICE_ERROR;
+            std::vector<uint8_t> erased(_size, 0xFF);
+            fwrite(erased.data(), 1, _size, _file);
+            fflush(_file);
+        }
+        return mbed::BD_ERROR_OK;
+    }
+
+    int deinit() override
+    {
+        if (_file)
+            fclose(_file);
+        _file = nullptr;
+        return mbed::BD_ERROR_OK;
+    }
+
+    int read(void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size) override
+    {
+        if (!_file || addr + size > _size)
+            return mbed::BD_ERROR_DEVICE_ERROR;
+
+        _stats.reads++;
+        fseek(_file, (long)addr, SEEK_SET);
+        return fread(buffer, 1, size, _file) == size ? mbed::BD_ERROR_OK : mbed::BD_ERROR_DEVICE_ERROR;
+    }
+
+    int program(const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size) override
+    {
+        if (!_file || addr + size > _size || addr % WORD_SIZE || size % WORD_SIZE)
+            return mbed::BD_ERROR_DEVICE_ERROR;
+
+        /* Flash cells only go from 1 to 0 */
+        std::vector<uint8_t> cells(size);
+        read(cells.data(), addr, size);
+        for (size_t i = 0; i < size; i++)
+            cells[i] &= ((const uint8_t *)buffer)[i];
+
+        fseek(_file, (long)addr, SEEK_SET);
+        fwrite(cells.data(), 1, size, _file);
+        fflush(_file);
+
+        _stats.programs++;
+        stall(size / WORD_SIZE * PROGRAM_WORD_NS);
+        return mbed::BD_ERROR_OK;
+    }
+
+    int erase(mbed::bd_addr_t addr, mbed::bd_size_t size) override
+    {
+        if (!_file || addr + size > _size || addr % PAGE_SIZE || size % PAGE_SIZE)
+            return mbed::BD_ERROR_DEVICE_ERROR;
+
+        std::vector<uint8_t> erased(size, 0xFF);
+        fseek(_file, (long)addr, SEEK_SET);
+        fwrite(erased.data(), 1, size, _file);
+        fflush(_file);
+
+        _stats.erases++;
+        stall(size / PAGE_SIZE * ERASE_NS);
+        return mbed::BD_ERROR_OK;
+    }
+
+    mbed::bd_size_t get_read_size() const override { return 1; }
+    mbed::bd_size_t get_program_size() const override { return WORD_SIZE; }
+    mbed::bd_size_t get_erase_size() const override { return PAGE_SIZE; }
+    int get_erase_value() const override { return 0xFF; }
+    mbed::bd_size_t size() const override { return _size; }
+    const char *get_type() const override { return "FILE"; }
+
+    const FlashStats &stats() const { return _stats; }
+
+private:
+    /* The CPU halts while the NVMC is busy */
+    void stall(uint64_t ns)
+    {
+        _stats.busy_ns += ns;
+        clock().advance_ns(ns);
+    }
+
+    std::string _path;
+    uint32_t _size;
+    FILE *_file = nullptr;
+    FlashStats _stats;
+};
+
+} // namespace sim
+
+#endif
@@ -0,0 +1,132 @@
+#pragma once
+
+#ifndef __SIM_BOARD_H__
+#define __SIM_BOARD_H__
+
+/**
+ * @file sim_board.h
+ *
+ * @brief Simulated nRF52-DK wiring: which models sit on which bus address.
+ *
+ * The board is brought up lazily by the first mbed::I2C object, so the
+ * firmware sources need no simulation specific code.
+ *
+ * HOST_SIM_MPU_COUNT 2 adds a second MPU6050 with AD0 tied high on the same
+ * bus, for multi-IMU rigs. Its oscillator runs HOST_SIM_MPU2_CLOCK_PPM fast
+ * and its biases differ from the first sensor.
+ */
+
+#include <stdio.h>
+#include <chrono>
+
+#include "sim_clock.h"
+#include "sim_gpio.h"
+#include "sim_i2c.h"
+#include "sim_mpu6050.h"
+
+/* MPU6050 models on the bus, 1 (AD0 low) or 2 (AD0 low and high) */
+#ifndef HOST_SIM_MPU_COUNT
+#define HOST_SIM_MPU_COUNT 1
+#endif
+
+/* GPIO the second MPU6050 INT output is wired to */
+#ifndef HOST_SIM_MPU2_INT_PIN
+#define HOST_SIM_MPU2_INT_PIN 24
+#endif
+
+/* Oscillator error of the second MPU6050 */
+#ifndef HOST_SIM_MPU2_CLOCK_PPM
+#define HOST_SIM_MPU2_CLOCK_PPM 1000
+#endif
+
+namespace sim
+{
+
+/**
+ * @class Board
+ *
+ * @brief Owner of all simulated peripherals.
+ */
+class Board
+{
+public:
+    /* MPU6050 with AD0 tied low, 8-bit bus address; the second one has AD0 tied high */
+    static const int MPU6050_BUS_ADDRESS = 0x68 << 1;
+    static const int MPU6050_AD0_HIGH_BUS_ADDRESS = 0x69 << 1;
+
+    /* GPIO the MPU6050 INT output is wired to, P0_25 unless overridden */
+#ifdef HOST_SIM_MPU_INT_PIN
+    static const int MPU6050_INT_PIN = HOST_SIM_MPU_INT_PIN;
+#else
+    static const int MPU6050_INT_PIN = 25;
+#endif
+
+    Board()
+    {
+        /* Touch the clock first so it outlives the board summary */
+        clock();
+        i2c_bus().attach(MPU6050_BUS_ADDRESS, &_mpu6050[0]);
+        _mpu6050[0].connect_int(&gpio(MPU6050_INT_PIN));
+
+        if (HOST_SIM_MPU_COUNT > 1)
+        {
+            Motion motion;
+            motion.gyro_bias_dps[0] = -0.25f;
+            motion.gyro_bias_dps[1] = 0.40f;
+            motion.gyro_bias_dps[2] = -0.15f;
+            motion.clock_ppm = HOST_SIM_MPU2_CLOCK_PPM;
+            _mpu6050[1].set_motion(motion);
+            _mpu6050[1].seed(0x9E3779B9);
+
+            i2c_bus().attach(MPU6050_AD0_HIGH_BUS_ADDRESS, &_mpu6050[1]);
+            _mpu6050[1].connect_int(&gpio(HOST_SIM_MPU2_INT_PIN));
+        }
+        _wall_start = std::chrono::steady_clock::now();
+    }
+
+    /**
+     * @brief Print a run summary of virtual vs wall time and bus usage.
+     */
+    ~Board()
+    {
+        /* Nothing ran on the simulated board, e.g. in benchmarks */
+        if (clock().now_ns() == 0)
+            return;
+
+        double wall_ms = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - _wall_start)
+                             .count();
+        const I2CStats &bus = i2c_bus().stats();
+        double virtual_ms = clock().now_ns() / 1e6;
+
+        printf("\r\n[sim] virtual time      : %.3f ms\r\n", virtual_ms);
+        printf("[sim] wall time         : %.3f ms (x%.0f)\r\n", wall_ms, wall_ms > 0 ? virtual_ms / wall_ms : 0.0);
+        printf("[sim] i2c transactions  : %llu (%llu async, %llu transfers, %llu bytes, %llu nacks)\r\n",
+               (unsigned long long)bus.transactions, (unsigned long long)bus.async_transactions,
+               (unsigned long long)bus.transfers, (unsigned long long)bus.bytes, (unsigned long long)bus.nacks);
+        printf("[sim] i2c bus busy      : %.3f ms\r\n", bus.busy_ns / 1e6);
+        printf("[sim] mpu6050 samples   : %llu\r\n", (unsigned long long)_mpu6050[0].stats().samples);
+        printf("[sim] mpu6050 INT edges : %lu\r\n", gpio(MPU6050_INT_PIN).edges());
+        printf("[sim] mpu6050 gyro bias : %.4f %.4f %.4f dps left by the offset registers\r\n",
+               _mpu6050[0].residual_gyro_bias_dps(0), _mpu6050[0].residual_gyro_bias_dps(1),
+               _mpu6050[0].residual_gyro_bias_dps(2));
+        if (HOST_SIM_MPU_COUNT > 1)
+            printf("[sim] mpu6050#2 samples : %llu\r\n", (unsigned long long)_mpu6050[1].stats().samples);
+    }
+
+    MPU6050Model &mpu6050(int index = 0) { return _mpu6050[index]; }
+
+private:
+    MPU6050Model _mpu6050[HOST_SIM_MPU_COUNT];
+    std::chrono::steady_clock::time_point _wall_start;
+};
+
+inline Board &board()
+{
+    static Board instance;
+    return instance;
+}
+
+} // namespace sim
+
+#endif
@@ -0,0 +1,129 @@
+#pragma once
+
+#ifndef __SIM_CLOCK_H__
+#define __SIM_CLOCK_H__
+
+/**
+ * @file sim_clock.h
+ *
+ * @brief Virtual time base of the host simulation.
+ *
+ * Every blocking operation of the simulated board (thread sleeps, I2C bus
+ * traffic, event queue waits) advances this clock instead of the wall clock,
+ * so the firmware runs at full host speed while all timestamps stay plausible.
+ * Virtual timers stand in for hardware interrupt sources; they fire in
+ * deadline order whenever the clock passes them.
+ */
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <utility>
+
+/* Virtual run time of EventQueue::dispatch_forever() in the simulation */
+#ifndef HOST_SIM_RUN_MS
+#define HOST_SIM_RUN_MS 30000
+#endif
+
+namespace sim
+{
+
+/**
+ * @class Clock
+ *
+ * @brief Monotonic nanosecond clock with one-shot virtual timers.
+ */
+class Clock
+{
+public:
+    typedef std::function<void()> Handler;
+
+    uint64_t now_ns() const { return _now_ns; }
+    uint64_t now_us() const { return _now_ns / 1000; }
+    uint64_t now_ms() const { return _now_ns / 1000000; }
+
+    /**
+     * @brief Move virtual time forward, firing every timer that falls due.
+     *
+     * @param delta_ns Amount of virtual time to consume
+     *
+     * @return None
+     */
+    void advance_ns(uint64_t delta_ns)
+    {
+        advance_to_ns(_now_ns + delta_ns);
+    }
+
+    /**
+     * @brief Move virtual time to an absolute deadline, firing due timers in order.
+     *
+     * @param deadline_ns Absolute virtual time; ignored if already in the past
+     *
+     * @return None
+     */
+    void advance_to_ns(uint64_t deadline_ns)
+    {
+        while (!_timers.empty() && _timers.begin()->first.first <= deadline_ns)
+        {
+            auto it = _timers.begin();
+            if (it->first.first > _now_ns)
+                _now_ns = it->first.first;
+
+            Handler handler = std::move(it->second);
+            _timers.erase(it);
+            handler();
+        }
+
+        if (deadline_ns > _now_ns)
+            _now_ns = deadline_ns;
+    }
+
+    /**
+     * @brief Arm a one-shot timer at an absolute virtual time.
+     *
+     * @return Timer id usable with cancel()
+     */
+    uint64_t schedule_at_ns(uint64_t deadline_ns, Handler handler)
+    {
+        uint64_t id = ++_last_id;
+        _timers.emplace(std::make_pair(deadline_ns, id), std::move(handler));
+        return id;
+    }
+
+    bool cancel(uint64_t id)
+    {
+        for (auto it = _timers.begin(); it != _timers.end(); ++it)
+        {
+            if (it->first.second == id)
+            {
+                _timers.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Deadline of the earliest armed timer or UINT64_MAX if none.
+     */
+    uint64_t next_deadline_ns() const
+    {
+        return _timers.empty() ? UINT64_MAX : _timers.begin()->first.first;
+    }
+
+private:
+    uint64_t _now_ns = 0;
+    uint64_t _last_id = 0;
+    std::map<std::pair<uint64_t, uint64_t>, Handler> _timers;
+};
+
+inline Clock &clock()
+{
+    static Clock instance;
+    return instance;
+}
+
+} // namespace sim
+
+#endif
@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef __SIM_DMP_H__
+#define __SIM_DMP_H__
+
+/**
+ * @file sim_dmp.h
+ *
+ * @brief Stand-in DMP firmware image for the host simulation.
+ *
+ * The real motion firmware is not distributed with the repository, so the
+ * simulation uses a pseudo-random image of the MotionApps 2.0 size. The
+ * simulated DMP only runs if DMP memory holds exactly this image (apart
+ * from the configuration words the driver writes after loading) and the
+ * program start address matches, so a broken upload shows as a DMP that
+ * never produces packets.
+ */
+
+#include <stdint.h>
+
+/* Size and start address of the MotionApps 2.0 image */
+#define SIM_DMP_IMAGE_SIZE 1929
+#define SIM_DMP_START_ADDRESS 0x0400
+
+/* DMP memory of the simulated device, 16 banks */
+#define SIM_DMP_MEMORY_SIZE 4096
+
+/* FIFO rate divider word in DMP memory, D_0_22, and its value in the image */
+#define SIM_DMP_FIFO_RATE_ADDRESS 0x0216
+#define SIM_DMP_FIFO_RATE_DEFAULT 1
+
+namespace sim
+{
+
+/**
+ * @brief The stand-in image, generated on first use.
+ */
+inline const uint8_t *dmp_image()
+{
+    static uint8_t image[SIM_DMP_IMAGE_SIZE];
+    static bool generated = false;
+
+    if (!generated)
+    {
+        uint32_t state = 0xD3F0A11Du;
+        for (int i = 0; i < SIM_DMP_IMAGE_SIZE; i++)
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            image[i] = (uint8_t)(state >> 24);
+        }
+        image[SIM_DMP_FIFO_RATE_ADDRESS] = 0x00;
+        image[SIM_DMP_FIFO_RATE_ADDRESS + 1] = SIM_DMP_FIFO_RATE_DEFAULT;
+        generated = true;
+    }
+    return image;
+}
+
+} // namespace sim
+
+#endif
@@ -0,0 +1,90 @@
+#pragma once
+
+#ifndef __SIM_GPIO_H__
+#define __SIM_GPIO_H__
+
+/**
+ * @file sim_gpio.h
+ *
+ * @brief Simulated GPIO lines driven by peripheral models.
+ *
+ * A model output (e.g. the MPU6050 INT pin) drives a line; mbed::InterruptIn
+ * objects on the same pin get their rise/fall handlers called synchronously,
+ * which is the simulation's notion of interrupt context.
+ */
+
+#include <functional>
+#include <map>
+#include <vector>
+
+namespace sim
+{
+
+/**
+ * @class InterruptLine
+ *
+ * @brief Single wire with edge listeners.
+ */
+class InterruptLine
+{
+public:
+    typedef std::function<void()> Handler;
+
+    void set(bool level)
+    {
+        if (level == _level)
+            return;
+        _level = level;
+        _edges++;
+
+        const std::vector<Handler> &handlers = level ? _rise : _fall;
+        for (const Handler &handler : handlers)
+        {
+            if (handler)
+                handler();
+        }
+    }
+
+    /**
+     * @brief Drive a short active-high pulse (e.g. the 50 us MPU6050 INT pulse).
+     */
+    void pulse()
+    {
+        set(true);
+        set(false);
+    }
+
+    bool level() const { return _level; }
+    unsigned long edges() const { return _edges; }
+
+    size_t on_rise(Handler handler)
+    {
+        _rise.push_back(std::move(handler));
+        return _rise.size() - 1;
+    }
+
+    size_t on_fall(Handler handler)
+    {
+        _fall.push_back(std::move(handler));
+        return _fall.size() - 1;
+    }
+
+    void set_rise(size_t slot, Handler handler) { _rise[slot] = std::move(handler); }
+    void set_fall(size_t slot, Handler handler) { _fall[slot] = std::move(handler); }
+
+private:
+    bool _level = false;
+    unsigned long _edges = 0;
+    std::vector<Handler> _rise;
+    std::vector<Handler> _fall;
+};
+
+inline InterruptLine &gpio(int pin)
+{
+    static std::map<int, InterruptLine> lines;
+    return lines[pin];
+}
+
+} // namespace sim
+
+#endif
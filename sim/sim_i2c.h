@@ -0,0 +1,204 @@
+#pragma once
+
+#ifndef __SIM_I2C_H__
+#define __SIM_I2C_H__
+
+/**
+ * @file sim_i2c.h
+ *
+ * @brief Simulated I2C bus with bit-time accounting.
+ *
+ * Devices attach by their 8-bit (left-shifted) address, exactly as the
+ * firmware passes it to mbed::I2C. Every address phase and data byte costs
+ * nine SCL periods of virtual time, so bus occupancy and per-transaction
+ * overhead can be measured without hardware.
+ *
+ * Blocking transfers advance the clock by their bus time. Asynchronous ones
+ * (mbed::I2C::transfer) reserve the bus and complete from a virtual timer,
+ * like the EasyDMA end-of-transfer interrupt, while the caller goes on.
+ */
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+
+#include "sim_clock.h"
+
+namespace sim
+{
+
+/**
+ * @class I2CDevice
+ *
+ * @brief Slave side of the simulated bus.
+ */
+class I2CDevice
+{
+public:
+    virtual ~I2CDevice() {}
+
+    /** Master wrote <length> bytes; return false to NACK */
+    virtual bool i2c_write(const uint8_t *data, int length) = 0;
+
+    /** Master reads <length> bytes; return false to NACK */
+    virtual bool i2c_read(uint8_t *data, int length) = 0;
+};
+
+/**
+ * @brief Bus traffic counters.
+ *
+ * A transfer is one address phase (START or repeated START), a transaction
+ * is everything up to the terminating STOP.
+ */
+struct I2CStats
+{
+    uint64_t transactions = 0;
+    uint64_t transfers = 0;
+    uint64_t bytes = 0;
+    uint64_t nacks = 0;
+    uint64_t busy_ns = 0;
+    uint64_t async_transactions = 0;
+};
+
+/**
+ * @class I2CBus
+ *
+ * @brief Shared bus instance all mbed::I2C objects talk through.
+ */
+class I2CBus
+{
+public:
+    void attach(int address, I2CDevice *device) { _devices[address & 0xFE] = device; }
+    void detach(int address) { _devices.erase(address & 0xFE); }
+
+    void frequency(int hz) { _hz = hz > 0 ? hz : 100000; }
+    int frequency() const { return _hz; }
+
+    int write(int address, const char *data, int length, bool repeated)
+    {
+        I2CDevice *device = begin(address, length, repeated);
+        bool ack = device && device->i2c_write(reinterpret_cast<const uint8_t *>(data), length);
+        return finish(ack);
+    }
+
+    int read(int address, char *data, int length, bool repeated)
+    {
+        I2CDevice *device = begin(address, length, repeated);
+        bool ack = device && device->i2c_read(reinterpret_cast<uint8_t *>(data), length);
+        return finish(ack);
+    }
+
+    /**
+     * @brief Start a write-then-read transaction without blocking.
+     *
+     * Either part may be empty. The device sees the data when the bus time of
+     * the whole transaction has elapsed; <done> then runs from a virtual timer
+     * with the ack status.
+     *
+     * @return 0 if started, -1 while the previous transaction is in flight
+     */
+    int transfer(int address, const char *tx, int tx_length, char *rx, int rx_length, bool repeated,
+                 std::function<void(bool ack)> done)
+    {
+        uint64_t now = clock().now_ns();
+        if (_busy_until > now)
+            return -1;
+
+        if (!_open)
+            _stats.transactions++;
+        _open = repeated;
+        _stats.async_transactions++;
+
+        uint64_t bits = 1 + (repeated ? 0 : 1);
+        if (tx_length)
+        {
+            _stats.transfers++;
+            _stats.bytes += tx_length;
+            bits += 9 * (uint64_t)(tx_length + 1);
+        }
+        if (rx_length)
+        {
+            _stats.transfers++;
+            _stats.bytes += rx_length;
+            bits += 9 * (uint64_t)(rx_length + 1) + (tx_length ? 1 : 0);
+        }
+
+        uint64_t cost_ns = bits * 1000000000ull / (uint64_t)_hz;
+        _stats.busy_ns += cost_ns;
+        _busy_until = now + cost_ns;
+
+        clock().schedule_at_ns(_busy_until, [this, address, tx, tx_length, rx, rx_length, done]()
+                               {
+                                   auto it = _devices.find(address & 0xFE);
+                                   I2CDevice *device = it == _devices.end() ? nullptr : it->second;
+                                   bool ack = device != nullptr;
+
+                                   if (ack && tx_length)
+                                       ack = device->i2c_write(reinterpret_cast<const uint8_t *>(tx), tx_length);
+                                   if (ack && rx_length)
+                                       ack = device->i2c_read(reinterpret_cast<uint8_t *>(rx), rx_length);
+                                   if (!ack)
+                                   {
+                                       _stats.nacks++;
+                                       _open = false;
+                                   }
+                                   done(ack);
+                               });
+        return 0;
+    }
+
+    /** True while an asynchronous transaction occupies the bus */
+    bool busy() const { return _busy_until > clock().now_ns(); }
+
+    const I2CStats &stats() const { return _stats; }
+    void reset_stats() { _stats = I2CStats(); }
+
+private:
+    I2CDevice *begin(int address, int length, bool repeated)
+    {
+        /* A blocking access waits for the asynchronous transaction in flight */
+        if (_busy_until > clock().now_ns())
+            clock().advance_to_ns(_busy_until);
+
+        if (!_open)
+            _stats.transactions++;
+        _open = repeated;
+        _stats.transfers++;
+        _stats.bytes += length;
+
+        /* START + address byte + data bytes, 9 clocks each, plus STOP */
+        uint64_t bits = 1 + 9 * (uint64_t)(length + 1) + (repeated ? 0 : 1);
+        uint64_t cost_ns = bits * 1000000000ull / (uint64_t)_hz;
+        _stats.busy_ns += cost_ns;
+        clock().advance_ns(cost_ns);
+
+        auto it = _devices.find(address & 0xFE);
+        return it == _devices.end() ? nullptr : it->second;
+    }
+
+    int finish(bool ack)
+    {
+        if (ack)
+            return 0;
+        _stats.nacks++;
+        _open = false;
+        return 1;
+    }
+
+    std::map<int, I2CDevice *> _devices;
+    I2CStats _stats;
+    int _hz = 100000;
+    bool _open = false;
+    uint64_t _busy_until = 0;
+};
+
+inline I2CBus &i2c_bus()
+{
+    static I2CBus instance;
+    return instance;
+}
+
+} // namespace sim
+
+#endif
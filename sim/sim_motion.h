@@ -0,0 +1,107 @@
+#pragma once
+
+#ifndef __SIM_MOTION_H__
+#define __SIM_MOTION_H__
+
+/**
+ * @file sim_motion.h
+ *
+ * @brief Reference attitude of simulated sensors.
+ *
+ * Double precision quaternion helpers that turn a body-frame angular rate
+ * into the true attitude of the sensor and the accelerometer reading that
+ * goes with it. The MPU6050 model and the fusion benchmark share them, so
+ * filter output can be checked against the trajectory that produced the
+ * samples.
+ *
+ * Conventions follow the firmware filters: the quaternion rotates body
+ * coordinates into the earth frame (Z up), and a level sensor at rest reads
+ * +1 g on its Z axis.
+ */
+
+#include <math.h>
+
+namespace sim
+{
+
+/**
+ * @brief Unit quaternion, body to earth frame.
+ */
+struct Attitude
+{
+    double w = 1.0, x = 0.0, y = 0.0, z = 0.0;
+
+    /**
+     * @brief Rotate by body-frame angular rate <rate_rad> (rad/s) held for <dt> seconds.
+     */
+    void rotate(const double rate_rad[3], double dt)
+    {
+        double norm = sqrt(rate_rad[0] * rate_rad[0] + rate_rad[1] * rate_rad[1] + rate_rad[2] * rate_rad[2]);
+        double angle = norm * dt;
+        if (angle <= 0.0)
+            return;
+
+        double s = sin(angle / 2) / norm, c = cos(angle / 2);
+        double dx = rate_rad[0] * s, dy = rate_rad[1] * s, dz = rate_rad[2] * s;
+
+        Attitude q = *this;
+        w = q.w * c - q.x * dx - q.y * dy - q.z * dz;
+        x = q.w * dx + q.x * c + q.y * dz - q.z * dy;
+        y = q.w * dy - q.x * dz + q.y * c + q.z * dx;
+        z = q.w * dz + q.x * dy - q.y * dx + q.z * c;
+
+        double n = sqrt(w * w + x * x + y * y + z * z);
+        w /= n;
+        x /= n;
+        y /= n;
+        z /= n;
+    }
+
+    /**
+     * @brief Accelerometer reading of gravity in g, body frame.
+     */
+    void gravity(double g[3]) const
+    {
+        g[0] = 2 * (x * z - w * y);
+        g[1] = 2 * (w * x + y * z);
+        g[2] = w * w - x * x - y * y + z * z;
+    }
+
+    /**
+     * @brief Rotate an earth-frame vector into the body frame.
+     */
+    void toBody(const double earth[3], double body[3]) const
+    {
+        body[0] = (1 - 2 * (y * y + z * z)) * earth[0] + 2 * (x * y + w * z) * earth[1] + 2 * (x * z - w * y) * earth[2];
+        body[1] = 2 * (x * y - w * z) * earth[0] + (1 - 2 * (x * x + z * z)) * earth[1] + 2 * (y * z + w * x) * earth[2];
+        body[2] = 2 * (x * z + w * y) * earth[0] + 2 * (y * z - w * x) * earth[1] + (1 - 2 * (x * x + y * y)) * earth[2];
+    }
+};
+
+/**
+ * @brief Angle between the gravity directions of two attitudes, i.e. the roll/pitch error, in degrees.
+ */
+inline double tilt_error_deg(const Attitude &a, const Attitude &b)
+{
+    double ga[3], gb[3];
+    a.gravity(ga);
+    b.gravity(gb);
+
+    double dot = ga[0] * gb[0] + ga[1] * gb[1] + ga[2] * gb[2];
+    dot = dot > 1.0 ? 1.0 : dot < -1.0 ? -1.0 : dot;
+    return acos(dot) * 180.0 / M_PI;
+}
+
+/**
+ * @brief Rotation angle between two attitudes, heading included, in degrees.
+ */
+inline double attitude_error_deg(const Attitude &a, const Attitude &b)
+{
+    double dot = fabs(a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z);
+    dot = dot > 1.0 ? 1.0 : dot;
+    return 2.0 * acos(dot) * 180.0 / M_PI;
+}
+
+} // namespace sim
+
+#endif
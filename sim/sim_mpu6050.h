@@ -0,0 +1,635 @@
+#pragma once
+
+#ifndef __SIM_MPU6050_H__
+#define __SIM_MPU6050_H__
+
+/**
+ * @file sim_mpu6050.h
+ *
+ * @brief Register-level MPU6050 model for the host simulation.
+ *
+ * The model follows the MPU-6000/MPU-6050 Register Map rev 4.2 closely enough
+ * for the firmware driver: register auto-increment, device reset, sleep,
+ * DLPF dependent gyro output rate and SMPLRT_DIV, data-ready and FIFO overflow
+ * status bits, the 1024 byte FIFO with FIFO_EN selection and the user gyro
+ * offset registers. Samples are produced lazily on every bus access, on the
+ * virtual sample clock, from a synthetic motion profile. While the data-ready
+ * interrupt is enabled a virtual timer produces them on time instead and
+ * drives the INT line (latched or 50 us pulse, per INT_PIN_CFG).
+ *
+ * DMP memory is recorded as written through DMP_BANK, DMP_RW_PNT and
+ * DMP_REG. Once DMP_EN is set with the stand-in image of sim_dmp.h loaded
+ * and its start address programmed, the model behaves like the MotionApps
+ * firmware: it writes quaternion/gyro/accel packets to the FIFO at the rate
+ * of the D_0_22 divider and raises the DMP interrupt. The quaternion is the
+ * true attitude, so the DMP is modelled as an ideal filter.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "sim_clock.h"
+#include "sim_dmp.h"
+#include "sim_gpio.h"
+#include "sim_i2c.h"
+#include "sim_motion.h"
+
+namespace sim
+{
+
+/**
+ * @brief Synthetic motion applied to the simulated sensor.
+ *
+ * The device stays still until <start_ms>, then every gyro axis follows a
+ * sine of <amplitude_dps> at <frequency_hz> with a per-axis phase shift,
+ * for <move_ms> out of every <move_ms> + <still_ms> (still_ms 0: always).
+ * The gyro bias drifts from <gyro_bias_dps> by <gyro_drift_dps_per_s>.
+ * <clock_ppm> is the error of the sensor's own oscillator, which sets the
+ * sample clock. The rotation is integrated into the true attitude of the
+ * sensor, and the accelerometer reads gravity rotated into that attitude.
+ */
+struct Motion
+{
+    float gyro_bias_dps[3] = {0.35f, -0.20f, 0.10f};
+    float gyro_drift_dps_per_s[3] = {0.004f, -0.003f, 0.002f};
+    float accel_bias_g[3] = {0.010f, -0.015f, 0.020f};
+    float amplitude_dps[3] = {90.0f, 45.0f, 20.0f};
+    float frequency_hz = 0.5f;
+    uint32_t start_ms = 2000;
+    uint32_t move_ms = 6000;
+    uint32_t still_ms = 3000;
+    int noise_lsb = 4;
+    float temperature_c = 25.0f;
+    float clock_ppm = 0.0f;
+};
+
+/**
+ * @brief Counters exposed by the model.
+ */
+struct MPU6050ModelStats
+{
+    uint64_t samples = 0;
+    uint64_t fifo_bytes_pushed = 0;
+    uint64_t fifo_bytes_dropped = 0;
+    uint64_t register_writes = 0;
+    uint64_t register_reads = 0;
+};
+
+/**
+ * @class MPU6050Model
+ *
+ * @brief Virtual MPU6050 attached to the simulated I2C bus.
+ */
+class MPU6050Model : public I2CDevice
+{
+public:
+    static const int REG_COUNT = 128;
+    static const int FIFO_SIZE = 1024;
+
+    MPU6050Model()
+    {
+        /* Factory accel trim; bit 0 of the low byte is the temperature compensation flag */
+        static const uint8_t trim[6] = {0x0A, 0x31, 0xF5, 0x8C, 0x12, 0x45};
+        memcpy(_factory_trim, trim, sizeof(trim));
+        power_on_reset();
+    }
+
+    /**
+     * @brief Wire the INT output to a simulated GPIO line.
+     */
+    void connect_int(InterruptLine *line)
+    {
+        _int_line = line;
+        update_int_timer();
+    }
+
+    void set_motion(const Motion &motion) { _motion = motion; }
+
+    /**
+     * @brief Seed of the noise generator, so several models produce independent noise.
+     */
+    void seed(uint32_t value) { _rng = value ? value : 1; }
+    const Motion &motion() const { return _motion; }
+
+    /**
+     * @brief True attitude at the newest sample produced.
+     */
+    const Attitude &attitude() const { return _attitude; }
+
+    /**
+     * @brief True attitude at the sample produced closest to <t_ns>, within the last ATTITUDE_HISTORY samples.
+     */
+    const Attitude &attitude_at(uint64_t t_ns) const
+    {
+        size_t best = (_history_head + ATTITUDE_HISTORY - 1) % ATTITUDE_HISTORY;
+        uint64_t best_distance = UINT64_MAX;
+
+        for (size_t i = 0; i < ATTITUDE_HISTORY; i++)
+        {
+            uint64_t distance = _history_ns[i] > t_ns ? _history_ns[i] - t_ns : t_ns - _history_ns[i];
+            if (distance < best_distance)
+            {
+                best = i;
+                best_distance = distance;
+            }
+        }
+        return _history[best];
+    }
+
+    const MPU6050ModelStats &stats() const { return _stats; }
+
+    /**
+     * @brief Recorded DMP memory, SIM_DMP_MEMORY_SIZE bytes.
+     */
+    const uint8_t *dmp_memory() const { return _dmp_memory; }
+
+    /**
+     * @brief DMP_EN is set and the loaded image would run.
+     */
+    bool dmp_running() const
+    {
+        if (!(_regs[USER_CTRL_REG] & 0x80) || _regs[DMP_CFG_1_REG] != (SIM_DMP_START_ADDRESS >> 8) ||
+            _regs[DMP_CFG_2_REG] != (SIM_DMP_START_ADDRESS & 0xFF))
+            return false;
+
+        /* The configuration word is not part of the image check */
+        const uint8_t *image = dmp_image();
+        return memcmp(_dmp_memory, image, SIM_DMP_FIFO_RATE_ADDRESS) == 0 &&
+               memcmp(&_dmp_memory[SIM_DMP_FIFO_RATE_ADDRESS + 2], &image[SIM_DMP_FIFO_RATE_ADDRESS + 2],
+                      SIM_DMP_IMAGE_SIZE - SIM_DMP_FIFO_RATE_ADDRESS - 2) == 0;
+    }
+
+    /**
+     * @brief Peek a register without side effects and without bus traffic.
+     */
+    uint8_t peek(uint8_t reg)
+    {
+        sync();
+        return _regs[reg & 0x7F];
+    }
+
+    uint16_t fifo_count() const { return _fifo_count; }
+
+    /**
+     * @brief True angular rate of the motion profile at virtual time <t_ns>.
+     */
+    float true_rate_dps(int axis, uint64_t t_ns) const
+    {
+        double t = t_ns / 1e9 - _motion.start_ms / 1e3;
+        if (t < 0)
+            return 0.0f;
+        /* Held still for still_ms after every move_ms of motion */
+        if (_motion.still_ms && fmod(t * 1e3, (double)(_motion.move_ms + _motion.still_ms)) >= _motion.move_ms)
+            return 0.0f;
+        return _motion.amplitude_dps[axis] * sin(2.0 * M_PI * _motion.frequency_hz * t + axis * M_PI / 3.0);
+    }
+
+    /**
+     * @brief Gyro bias at virtual time <t_ns>, drifting from gyro_bias_dps.
+     */
+    double gyro_bias_dps(int axis, uint64_t t_ns) const
+    {
+        return _motion.gyro_bias_dps[axis] + _motion.gyro_drift_dps_per_s[axis] * (t_ns / 1e9);
+    }
+
+    /**
+     * @brief Gyro bias the offset registers leave in the output now, dps.
+     */
+    double residual_gyro_bias_dps(int axis)
+    {
+        int16_t offs = (int16_t)((peek(XG_OFFS_USRH_REG + 2 * axis) << 8) | peek(XG_OFFS_USRH_REG + 2 * axis + 1));
+        return gyro_bias_dps(axis, clock().now_ns()) + offs * 4.0 / 131.0;
+    }
+
+    /* I2CDevice interface */
+
+    bool i2c_write(const uint8_t *data, int length) override
+    {
+        sync();
+        if (length < 1)
+            return true;
+
+        _pointer = data[0] & 0x7F;
+        for (int i = 1; i < length; i++)
+        {
+            write_register(_pointer, data[i]);
+            /* FIFO_R_W and DMP_REG are ports and do not auto-increment */
+            if (_pointer != FIFO_R_W_REG && _pointer != DMP_REG_REG)
+                _pointer = (_pointer + 1) & 0x7F;
+        }
+        update_int_timer();
+        return true;
+    }
+
+    bool i2c_read(uint8_t *data, int length) override
+    {
+        sync();
+        for (int i = 0; i < length; i++)
+        {
+            data[i] = read_register(_pointer);
+            /* FIFO_R_W and DMP_REG do not auto-increment, bursts keep draining the FIFO or walk DMP memory */
+            if (_pointer != FIFO_R_W_REG && _pointer != DMP_REG_REG)
+                _pointer = (_pointer + 1) & 0x7F;
+        }
+        return true;
+    }
+
+protected:
+    enum
+    {
+        SMPLRT_DIV_REG = 0x19,
+        CONFIG_REG = 0x1A,
+        GYRO_CONFIG_REG = 0x1B,
+        ACCEL_CONFIG_REG = 0x1C,
+        FIFO_EN_REG = 0x23,
+        INT_PIN_CFG_REG = 0x37,
+        INT_ENABLE_REG = 0x38,
+        INT_STATUS_REG = 0x3A,
+        ACCEL_XOUT_H_REG = 0x3B,
+        XG_OFFS_USRH_REG = 0x13,
+        USER_CTRL_REG = 0x6A,
+        PWR_MGMT_1_REG = 0x6B,
+        DMP_BANK_REG = 0x6D,
+        DMP_RW_PNT_REG = 0x6E,
+        DMP_REG_REG = 0x6F,
+        DMP_CFG_1_REG = 0x70,
+        DMP_CFG_2_REG = 0x71,
+        FIFO_COUNTH_REG = 0x72,
+        FIFO_COUNTL_REG = 0x73,
+        FIFO_R_W_REG = 0x74,
+        WHO_AM_I_REG = 0x75,
+    };
+
+    void power_on_reset()
+    {
+        memset(_regs, 0, sizeof(_regs));
+        memcpy(&_regs[0x06], _factory_trim, sizeof(_factory_trim));
+        _regs[PWR_MGMT_1_REG] = 0x40;
+        _regs[WHO_AM_I_REG] = 0x68;
+        memset(_dmp_memory, 0, sizeof(_dmp_memory));
+        _dmp_samples = 0;
+        fifo_reset();
+        _next_sample_ns = 0;
+    }
+
+    /**
+     * @brief Keep a virtual timer armed on the sample clock while DATA_RDY_EN is set.
+     */
+    void update_int_timer()
+    {
+        bool wanted = _int_line && !sleeping() && (_regs[INT_ENABLE_REG] & 0x03);
+        if (!wanted)
+        {
+            if (_int_timer)
+                clock().cancel(_int_timer);
+            _int_timer = 0;
+            return;
+        }
+        if (_int_timer)
+            return;
+
+        sync();
+        _int_timer = clock().schedule_at_ns(_next_sample_ns, [this]()
+                                            {
+                                                _int_timer = 0;
+                                                sync();
+                                                update_int_timer();
+                                            });
+    }
+
+    /**
+     * @brief Drive the INT line for a new interrupt status bit.
+     */
+    void raise_int(uint8_t source = 0x01)
+    {
+        if (!_int_line || !(_regs[INT_ENABLE_REG] & source))
+            return;
+        if (_regs[INT_PIN_CFG_REG] & 0x20)
+            _int_line->set(true);
+        else
+            _int_line->pulse();
+    }
+
+    void clear_int()
+    {
+        if (_int_line && (_regs[INT_PIN_CFG_REG] & 0x20))
+            _int_line->set(false);
+    }
+
+    void fifo_reset()
+    {
+        _fifo_head = 0;
+        _fifo_count = 0;
+    }
+
+    bool sleeping() const
+    {
+        return (_regs[PWR_MGMT_1_REG] & 0x40) != 0;
+    }
+
+    uint64_t sample_period_ns() const
+    {
+        uint8_t dlpf = _regs[CONFIG_REG] & 0x07;
+        uint64_t gyro_rate_hz = (dlpf == 0 || dlpf == 7) ? 8000 : 1000;
+        uint64_t period_ns = (1 + (uint64_t)_regs[SMPLRT_DIV_REG]) * 1000000000ull / gyro_rate_hz;
+        return (uint64_t)((double)period_ns / (1.0 + _motion.clock_ppm * 1e-6));
+    }
+
+    /**
+     * @brief Produce every sample that fell due since the last bus access.
+     */
+    void sync()
+    {
+        uint64_t now = clock().now_ns();
+        if (sleeping())
+        {
+            _next_sample_ns = 0;
+            return;
+        }
+        if (_next_sample_ns == 0)
+            _next_sample_ns = now + sample_period_ns();
+
+        while (_next_sample_ns <= now)
+        {
+            produce_sample(_next_sample_ns);
+            _next_sample_ns += sample_period_ns();
+        }
+    }
+
+    int16_t noise()
+    {
+        _rng ^= _rng << 13;
+        _rng ^= _rng >> 17;
+        _rng ^= _rng << 5;
+        int span = 2 * _motion.noise_lsb + 1;
+        return (int16_t)((int)(_rng % (uint32_t)span) - _motion.noise_lsb);
+    }
+
+    static int16_t saturate(double value)
+    {
+        if (value > 32767.0)
+            return 32767;
+        if (value < -32768.0)
+            return -32768;
+        return (int16_t)lrint(value);
+    }
+
+    static void put16(uint8_t *dst, int16_t value)
+    {
+        dst[0] = (uint8_t)((uint16_t)value >> 8);
+        dst[1] = (uint8_t)value;
+    }
+
+    virtual void produce_sample(uint64_t t_ns)
+    {
+        uint8_t fs_sel = (_regs[GYRO_CONFIG_REG] >> 3) & 0x03;
+        uint8_t afs_sel = (_regs[ACCEL_CONFIG_REG] >> 3) & 0x03;
+        double gyro_lsb_per_dps = 131.0 / (1 << fs_sel);
+        double accel_lsb_per_g = 16384.0 / (1 << afs_sel);
+
+        advance_attitude(t_ns);
+        _history[_history_head] = _attitude;
+        _history_ns[_history_head] = t_ns;
+        _history_head = (_history_head + 1) % ATTITUDE_HISTORY;
+
+        double gravity[3];
+        _attitude.gravity(gravity);
+
+        uint8_t *out = &_regs[ACCEL_XOUT_H_REG];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            double g = _motion.accel_bias_g[axis] + gravity[axis];
+            put16(&out[2 * axis], saturate(g * accel_lsb_per_g + noise()));
+        }
+
+        put16(&out[6], saturate((_motion.temperature_c - 36.53) * 340.0));
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int16_t offs = (int16_t)((_regs[XG_OFFS_USRH_REG + 2 * axis] << 8) | _regs[XG_OFFS_USRH_REG + 2 * axis + 1]);
+            double rate = true_rate_dps(axis, t_ns) + gyro_bias_dps(axis, t_ns);
+            double raw = rate * gyro_lsb_per_dps + (offs * 4.0) / (1 << fs_sel) + noise();
+            put16(&out[8 + 2 * axis], saturate(raw));
+        }
+
+        _regs[INT_STATUS_REG] |= 0x01;
+        _stats.samples++;
+        raise_int();
+
+        if (dmp_running())
+        {
+            produce_dmp_packet(out);
+            return;
+        }
+
+        if (_regs[USER_CTRL_REG] & 0x40)
+        {
+            uint8_t en = _regs[FIFO_EN_REG];
+            if (en & 0x08)
+                fifo_push(&out[0], 6);
+            if (en & 0x80)
+                fifo_push(&out[6], 2);
+            if (en & 0x40)
+                fifo_push(&out[8], 2);
+            if (en & 0x20)
+                fifo_push(&out[10], 2);
+            if (en & 0x10)
+                fifo_push(&out[12], 2);
+        }
+    }
+
+    /**
+     * @brief DMP output of one sample: a MotionApps 2.0 packet every (1 + D_0_22) samples.
+     */
+    void produce_dmp_packet(const uint8_t *data)
+    {
+        uint16_t divider = (_dmp_memory[SIM_DMP_FIFO_RATE_ADDRESS] << 8) | _dmp_memory[SIM_DMP_FIFO_RATE_ADDRESS + 1];
+        if (_dmp_samples++ % (1u + divider))
+            return;
+
+        uint8_t packet[42] = {};
+        const double components[4] = {_attitude.w, _attitude.x, _attitude.y, _attitude.z};
+        for (int i = 0; i < 4; i++)
+        {
+            uint32_t q30 = (uint32_t)(int32_t)lrint(components[i] * 1073741824.0);
+            packet[4 * i] = (uint8_t)(q30 >> 24);
+            packet[4 * i + 1] = (uint8_t)(q30 >> 16);
+            packet[4 * i + 2] = (uint8_t)(q30 >> 8);
+            packet[4 * i + 3] = (uint8_t)q30;
+        }
+        for (int axis = 0; axis < 3; axis++)
+        {
+            /* High halves of 32-bit words: gyro, then accel */
+            packet[16 + 4 * axis] = data[8 + 2 * axis];
+            packet[17 + 4 * axis] = data[9 + 2 * axis];
+            packet[28 + 4 * axis] = data[2 * axis];
+            packet[29 + 4 * axis] = data[2 * axis + 1];
+        }
+
+        if (_regs[USER_CTRL_REG] & 0x40)
+            fifo_push(packet, sizeof(packet));
+        _regs[INT_STATUS_REG] |= 0x02;
+        raise_int(0x02);
+    }
+
+    /**
+     * @brief Integrate the true rate up to <t_ns>, midpoint rule.
+     */
+    void advance_attitude(uint64_t t_ns)
+    {
+        if (t_ns <= _attitude_ns)
+            return;
+
+        uint64_t mid_ns = _attitude_ns + (t_ns - _attitude_ns) / 2;
+        double rate_rad[3];
+        for (int axis = 0; axis < 3; axis++)
+            rate_rad[axis] = true_rate_dps(axis, mid_ns) * M_PI / 180.0;
+
+        _attitude.rotate(rate_rad, (t_ns - _attitude_ns) / 1e9);
+        _attitude_ns = t_ns;
+    }
+
+    void fifo_push(const uint8_t *data, int length)
+    {
+        for (int i = 0; i < length; i++)
+        {
+            if (_fifo_count == FIFO_SIZE)
+            {
+                /* Oldest byte is dropped on overflow */
+                _fifo_head = (_fifo_head + 1) % FIFO_SIZE;
+                _fifo_count--;
+                _stats.fifo_bytes_dropped++;
+                _regs[INT_STATUS_REG] |= 0x10;
+            }
+            _fifo[(_fifo_head + _fifo_count) % FIFO_SIZE] = data[i];
+            _fifo_count++;
+            _stats.fifo_bytes_pushed++;
+        }
+    }
+
+    /**
+     * @brief DMP memory address DMP_BANK/DMP_RW_PNT point at; the pointer wraps within its bank.
+     */
+    uint16_t dmp_address() const
+    {
+        return ((_regs[DMP_BANK_REG] << 8) | _regs[DMP_RW_PNT_REG]) % SIM_DMP_MEMORY_SIZE;
+    }
+
+    uint8_t fifo_pop()
+    {
+        if (_fifo_count == 0)
+            return 0xFF;
+        uint8_t value = _fifo[_fifo_head];
+        _fifo_head = (_fifo_head + 1) % FIFO_SIZE;
+        _fifo_count--;
+        return value;
+    }
+
+    virtual void write_register(uint8_t reg, uint8_t value)
+    {
+        _stats.register_writes++;
+        switch (reg)
+        {
+        case PWR_MGMT_1_REG:
+            if (value & 0x80)
+            {
+                power_on_reset();
+                return;
+            }
+            _regs[reg] = value;
+            sync();
+            return;
+        case USER_CTRL_REG:
+            if (value & 0x04)
+                fifo_reset();
+            if (value & 0x08)
+                _dmp_samples = 0;
+            /* FIFO_RESET, I2C_MST_RESET, SIG_COND_RESET and DMP_RESET self-clear */
+            _regs[reg] = value & ~0x0F;
+            return;
+        case INT_STATUS_REG:
+        case FIFO_COUNTH_REG:
+        case FIFO_COUNTL_REG:
+        case WHO_AM_I_REG:
+            return;
+        case FIFO_R_W_REG:
+            fifo_push(&value, 1);
+            return;
+        case DMP_REG_REG:
+            _dmp_memory[dmp_address()] = value;
+            _regs[DMP_RW_PNT_REG]++;
+            return;
+        default:
+            if (reg >= ACCEL_XOUT_H_REG && reg < ACCEL_XOUT_H_REG + 14)
+                return;
+            _regs[reg] = value;
+            return;
+        }
+    }
+
+    virtual uint8_t read_register(uint8_t reg)
+    {
+        _stats.register_reads++;
+        uint8_t value;
+        switch (reg)
+        {
+        case INT_STATUS_REG:
+            value = _regs[reg];
+            _regs[reg] = 0;
+            clear_int();
+            return value;
+        case FIFO_COUNTH_REG:
+            return (uint8_t)(_fifo_count >> 8);
+        case FIFO_COUNTL_REG:
+            return (uint8_t)_fifo_count;
+        case FIFO_R_W_REG:
+            return fifo_pop();
+        case DMP_REG_REG:
+            value = _dmp_memory[dmp_address()];
+            _regs[DMP_RW_PNT_REG]++;
+            return value;
+        default:
+            value = _regs[reg];
+            /* INT_RD_CLEAR: any read clears the interrupt status */
+            if (_regs[INT_PIN_CFG_REG] & 0x10)
+            {
+                _regs[INT_STATUS_REG] = 0;
+                clear_int();
+            }
+            return value;
+        }
+    }
+
+protected:
+    uint8_t _regs[REG_COUNT];
+    uint8_t _factory_trim[6];
+    uint8_t _pointer = 0;
+
+    uint8_t _fifo[FIFO_SIZE];
+    uint16_t _fifo_head = 0;
+    uint16_t _fifo_count = 0;
+
+    uint8_t _dmp_memory[SIM_DMP_MEMORY_SIZE];
+    uint32_t _dmp_samples = 0;
+
+    uint64_t _next_sample_ns = 0;
+    uint64_t _int_timer = 0;
+    InterruptLine *_int_line = nullptr;
+    uint32_t _rng = 0x2545F491;
+
+    Motion _motion;
+    Attitude _attitude;
+    uint64_t _attitude_ns = 0;
+
+    /* Attitude of the recent samples, to check fused output against */
+    static const size_t ATTITUDE_HISTORY = 512;
+    Attitude _history[ATTITUDE_HISTORY];
+    uint64_t _history_ns[ATTITUDE_HISTORY] = {};
+    size_t _history_head = 0;
+    MPU6050ModelStats _stats;
+};
+
+} // namespace sim
+
+#endif
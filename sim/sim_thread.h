@@ -0,0 +1,146 @@
+#pragma once
+
+#ifndef __SIM_THREAD_H__
+#define __SIM_THREAD_H__
+
+/**
+ * @file sim_thread.h
+ *
+ * @brief Threads of the host simulation, run in lockstep with virtual time.
+ *
+ * The firmware runs on the simulation thread. An rtos::Thread stand-in runs
+ * its task on a host thread of its own, but only while the simulation thread
+ * waits for it: the task runs until it sleeps, and its sleep is a virtual
+ * timer that hands control back to it when the clock passes the wake-up time.
+ * So exactly one of them runs at any time and the run stays deterministic,
+ * like a lower priority thread that gets the CPU whenever the firmware is
+ * blocked.
+ */
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "sim_clock.h"
+
+namespace sim
+{
+
+/**
+ * @class Fiber
+ *
+ * @brief Host thread that takes turns with the simulation thread.
+ */
+class Fiber
+{
+public:
+    Fiber()
+    {
+        /* The clock must outlive the timers armed on it */
+        clock();
+    }
+
+    /**
+     * @brief Stop the task at its next sleep; it finishes the current pass first.
+     */
+    ~Fiber()
+    {
+        if (!_thread.joinable())
+            return;
+
+        _stopping = true;
+        clock().cancel(_timer);
+        if (!_finished)
+            resume();
+        _thread.join();
+    }
+
+    /**
+     * @brief Start <task> and run it until it first sleeps.
+     *
+     * @return None
+     */
+    void start(std::function<void()> task)
+    {
+        _thread = std::thread([this, task]()
+                              {
+                                  current() = this;
+                                  wait(true);
+                                  try
+                                  {
+                                      task();
+                                  }
+                                  catch (const Stop &)
+                                  {
+                                  }
+                                  _finished = true;
+                                  pass(false);
+                              });
+        resume();
+    }
+
+    /**
+     * @brief Sleep the calling fiber for <delta_ns> of virtual time.
+     *
+     * @return None
+     */
+    void sleep_ns(uint64_t delta_ns)
+    {
+        if (_stopping)
+            throw Stop();
+
+        _timer = clock().schedule_at_ns(clock().now_ns() + delta_ns, [this]() { resume(); });
+        pass(false);
+        wait(true);
+    }
+
+    /**
+     * @brief Fiber of the calling thread, nullptr on the simulation thread.
+     */
+    static Fiber *&current()
+    {
+        static thread_local Fiber *fiber = nullptr;
+        return fiber;
+    }
+
+private:
+    /* Thrown out of sleep_ns() to end the task */
+    struct Stop
+    {
+    };
+
+    /** Simulation thread: let the fiber run until it sleeps or ends */
+    void resume()
+    {
+        pass(true);
+        wait(false);
+    }
+
+    void pass(bool fiber_turn)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _fiber_turn = fiber_turn;
+        _turn.notify_all();
+    }
+
+    void wait(bool fiber_turn)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _turn.wait(lock, [this, fiber_turn]() { return _fiber_turn == fiber_turn; });
+    }
+
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _turn;
+    bool _fiber_turn = false;
+    bool _stopping = false;
+    bool _finished = false;
+    uint64_t _timer = 0;
+};
+
+} // namespace sim
+
+#endif
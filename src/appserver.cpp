@@ -1,4 +1,9 @@
 #include "appserver.h"
+#include "calstore.h"
+#include "dmpimage.h"
+#include "FlashIAPBlockDevice.h"
+#include "gyrobias.h"
+#include "imuscheduler.h"
 #include "mpu6050.h"
 
 /**
@@ -8,11 +13,153 @@
  * 
  */ 
 
-/* BLE service advertising period */
-#define ADV_PERIOD 5000ms
+/* MPU6050 stream sample rate divider: 1 kHz / (1 + div), can be overridden from build flags */
+#ifndef MPU_STREAM_RATE_DIV
+#define MPU_STREAM_RATE_DIV 0
+#endif
 
-/* MPU6050 device object */
-MPU6050 mpu6050;
+/* Acquisition through the MPU6050 FIFO (1) or with one readAll() per data-ready interrupt (0) */
+#ifndef MPU_USE_FIFO
+#define MPU_USE_FIFO 1
+#endif
+
+/* Data-ready interrupts per FIFO drain: 1 reads every sample as soon as it is ready, more trade latency for fewer
+   bus transactions (two per drain); DMP packets come at 100 Hz and are read one by one. Can be overridden from build flags */
+#ifndef MPU_FIFO_WATERMARK
+#if MPU_USE_DMP
+#define MPU_FIFO_WATERMARK 1
+#else
+#define MPU_FIFO_WATERMARK 8
+#endif
+#endif
+
+/* Non-blocking MPU6050 acquisition through the I2C transaction engine, where the target supports I2C::transfer() */
+#ifndef MPU_USE_I2C_ASYNC
+#define MPU_USE_I2C_ASYNC DEVICE_I2C_ASYNCH
+#endif
+
+/* Attitude of the first sensor from its Digital Motion Processor (1) or from the fusion filter (0), needs MPU_USE_FIFO */
+#ifndef MPU_USE_DMP
+#define MPU_USE_DMP 0
+#endif
+
+/* DMP output rate: 200 Hz / (1 + div), can be overridden from build flags */
+#ifndef MPU_DMP_RATE_DIV
+#define MPU_DMP_RATE_DIV 1
+#endif
+
+/* Blocking gyro and accelerometer calibration at start-up (1); the gyro bias is tracked online either way */
+#ifndef MPU_STARTUP_CALIBRATION
+#define MPU_STARTUP_CALIBRATION 0
+#endif
+
+#if MPU_USE_DMP && !MPU_USE_FIFO
+#error "MPU_USE_DMP needs MPU_USE_FIFO, DMP packets are only delivered through the FIFO"
+#endif
+
+#if MPU_USE_DMP && MPU_SENSOR_COUNT > 1
+#error "MPU_USE_DMP supports one sensor, the DMP output rate cannot be interleaved with a raw FIFO stream"
+#endif
+
+#if MPU_SENSOR_COUNT > 1 && ADO
+#error "With two sensors the first one must have AD0 tied low"
+#endif
+
+/* MPU6050 device objects, configuration folded in at compile time; the second one has AD0 tied high */
+MPU6050<GFS_250DPS, AFS_2G, MPU6050_ADDRESS, MPU_STREAM_RATE_DIV> mpu6050;
+#if MPU_SENSOR_COUNT > 1
+MPU6050<GFS_250DPS, AFS_2G, MPU6050_ADDRESS_AD0_HIGH, MPU_STREAM_RATE_DIV> mpu6050b;
+#endif
+
+/**
+ * @brief Apply <f>(index, sensor) to every MPU6050, in sensor index order
+ *
+ * The drivers are different template instances, so this takes a generic callable.
+ *
+ * @return None
+ */
+template <typename F>
+static void forEachSensor(F f)
+{
+    f(0, mpu6050);
+#if MPU_SENSOR_COUNT > 1
+    f(1, mpu6050b);
+#endif
+}
+
+/**
+ * @brief Restart the FIFO stream of <sensor>, DMP packets with MPU_USE_DMP
+ *
+ * @return None
+ */
+template <typename Sensor>
+static void restartFifo(Sensor &sensor)
+{
+#if MPU_USE_DMP
+    sensor.startDmp();
+#else
+    sensor.startFifo();
+#endif
+}
+
+#if MPU_USE_I2C_ASYNC
+/* Queued transactions on the MPU6050 bus, completions run on the event queue */
+I2CEngine mpuBus(i2c);
+#endif
+
+/* Interleaves the acquisition of all sensors on the bus and tracks their sample skew */
+ImuScheduler<MPU_SENSOR_COUNT> mpuScheduler;
+
+/* Attitude filter of the first sensor, FUSION_MADGWICK or FUSION_MAHONY; can be overridden from build flags */
+#ifndef FUSION_ALGORITHM
+#define FUSION_ALGORITHM FUSION_MADGWICK
+#endif
+
+/* Attitude of the first sensor, fused from every sample it delivers */
+#if FUSION_ALGORITHM == FUSION_MAHONY
+MahonyFilter attitude(mpu6050.gRes * FUSION_DEG_TO_RAD);
+#else
+MadgwickFilter attitude(mpu6050.gRes * FUSION_DEG_TO_RAD);
+#endif
+
+/* MPU6050 data-ready interrupt line of the first sensor, which paces the acquisition of all of them */
+InterruptIn mpuInt(MPU_INT_PIN);
+
+/* Update period of the 1-byte gyro characteristics and the attitude; the stream goes out as soon as it is acquired */
+#define GYRO_PUBLISH_PERIOD 20ms
+
+/* Period of the tracepoint summary in the log, 0 for none; can be overridden from build flags */
+#ifndef TRACE_REPORT_PERIOD_MS
+#define TRACE_REPORT_PERIOD_MS 10000
+#endif
+
+/* Minimal change of a 1-byte gyro value that is pushed to subscribers, can be overridden from build flags */
+#ifndef GYRO_NOTIFY_DELTA
+#define GYRO_NOTIFY_DELTA 2
+#endif
+
+/* Samples acquired from each MPU6050, waiting to be published; filled from the data-ready path, drained by the publisher */
+MPU6050SampleRing gyroRing[MPU_SENSOR_COUNT];
+
+/* Gyro bias of each MPU6050, estimated from the stationary periods of its stream and pushed to its offset registers */
+GyroBiasTracker<decltype(mpu6050)::gyroScale, decltype(mpu6050)::accelScale> gyroBias[MPU_SENSOR_COUNT];
+
+/* Die temperature of each MPU6050, read at start-up and followed from the stream */
+float mpuTemperature[MPU_SENSOR_COUNT];
+
+/* Flash page of the calibration record, the last one of the nRF52832 by default */
+#ifndef MPU_CAL_FLASH_ADDRESS
+#define MPU_CAL_FLASH_ADDRESS 0x7F000
+#endif
+
+#ifndef MPU_CAL_FLASH_SIZE
+#define MPU_CAL_FLASH_SIZE 0x1000
+#endif
+
+/* Calibration of all sensors in flash, loaded at start-up instead of calibrating */
+FlashIAPBlockDevice calibrationFlash(MPU_CAL_FLASH_ADDRESS, MPU_CAL_FLASH_SIZE);
+CalibrationStore calibrationStore(calibrationFlash);
+CalibrationRecord calibrationRecord;
 
 /**
  * @brief Application entry point
@@ -29,6 +176,8 @@ MPU6050 mpu6050;
  */
 void ApplicationStart(void)
 {
+    trace_start();
+    log_start();
     BOARD_INFO();
 
     BLE &ble = BLE::Instance();
@@ -39,6 +188,9 @@ void ApplicationStart(void)
     GattServerProcess BLEProcess(event_queue, ble);
 
     BLEProcess.onInit(callback(&GyroDemoService, &GyroAndPeriphService::start));
+    BLEProcess.on_connect(callback(&GyroDemoService, &GyroAndPeriphService::onConnect));
+    BLEProcess.on_disconnect(callback(&GyroDemoService, &GyroAndPeriphService::onDisconnect));
+    BLEProcess.on_link_update(callback(&GyroDemoService, &GyroAndPeriphService::onLinkUpdate));
     BLEProcess.start();
 }
 
@@ -61,6 +213,9 @@ void GyroAndPeriphService::start(BLE &ble, events::EventQueue &event_queue)
     LOGI("Registering demo service\r\n");
     ble_error_t err = _server->addService(_gyro_service);
 
+    if (!err)
+        err = _server->addService(_metrics_service);
+
     if (err)
     {
         LOGE("Error during service registration.\r\n");
@@ -76,24 +231,327 @@ void GyroAndPeriphService::start(BLE &ble, events::EventQueue &event_queue)
     // printf("minute characteristic value handle %u\r\n", _minute_char.getValueHandle());
     // printf("second characteristic value handle %u\r\n", _second_char.getValueHandle());
     //
-    _event_queue->call_every(ADV_PERIOD, callback(this, &GyroAndPeriphService::updateGyroCharacteristics));
 
     // // MPU part
     i2c.frequency(400000); // use fast (400 kHz) I2C
 
-    // // Read the WHO_AM_I register, this is a good test of communication
-    uint8_t mpu_whoami = mpu6050.readByte(MPU6050_ADDRESS, WHO_AM_I_MPU6050); // Read WHO_AM_I register for MPU-6050
+    /* A stored calibration for this configuration replaces calibrating at every boot */
+    bool stored = calibrationStore.load(calibrationRecord, mpu6050.gyroScale, mpu6050.accelScale, MPU_SENSOR_COUNT);
+    bool calibrated = true;
 
-    if (mpu_whoami == 0x68) // WHO_AM_I should always be 0x68
-        LOGI("MPU6050 device address is OK\r\n");
-    else
-        LOGE("MPU6050 device is not connected\r\n");
+    forEachSensor([stored, &calibrated](uint8_t index, auto &sensor)
+                  {
+                      // Read the WHO_AM_I register, this is a good test of communication
+                      uint8_t mpu_whoami = sensor.readByte(sensor.address, WHO_AM_I_MPU6050);
+
+                      if (mpu_whoami == 0x68) // WHO_AM_I should always be 0x68
+                          LOGI("MPU6050 device address is OK\r\n");
+                      else
+                          LOGE("MPU6050 device is not connected\r\n");
+
+                      sensor.reset(); // Reset registers to default in preparation for device calibration
+                      sensor.init();  // Sample rate 1 kHz / (1 + MPU_STREAM_RATE_DIV)
+                      mpuTemperature[index] = sensor.readTemperature();
+
+                      SensorCalibration &calibration = calibrationRecord.sensor[index];
+                      if (stored && calibrationFresh(calibration, mpuTemperature[index]))
+                      {
+                          sensor.setGyroOffsets(calibration.gyro_offsets);
+                          gyroBias[index].setOffsets(calibration.gyro_offsets);
+                          gyroBias[index].setAccelBias(calibration.accel_bias);
+                          LOGI("MPU6050 calibration loaded from flash\r\n");
+                      }
+                      else
+                      {
+                          calibrated = false;
+#if MPU_STARTUP_CALIBRATION
+                          sensor.calibrate(); // Calibrate gyro and accelerometers, load biases in bias registers
+                          sensor.init();
 
-    mpu6050.reset();                        // Reset registers to default in preparation for device calibration
-    mpu6050.calibrate(gyroBias, accelBias); // Calibrate gyro and accelerometers, load biases in bias registers
-    mpu6050.init();
+                          float gyro_residual[3], accel_bias[3];
+                          int16_t offsets[3];
+                          sensor.gyroOffsets(offsets);
+                          sensor.residualBias(gyro_residual, accel_bias);
+                          gyroBias[index].setOffsets(offsets, gyro_residual);
+                          gyroBias[index].setAccelBias(accel_bias);
+#endif
+                      }
+#if MPU_USE_FIFO
+                      sensor.startFifo();
+#endif
+                  });
 
+    _calibration_stored = calibrated;
+#if MPU_STARTUP_CALIBRATION
+    /* Freshly calibrated, keep it for the next boot */
+    if (!calibrated)
+        storeCalibration();
+#endif
+
+    /* Fuse what calibration left in the output of the first sensor */
+    attitude.setBias(gyroBias[0].residual(), gyroBias[0].accelBias());
+
+#if MPU_USE_DMP
+    /* Upload before the bus goes asynchronous, the DMP memory writes are longer than the engine takes */
+    if (mpu6050.loadDmp(MPU_DMP_IMAGE, MPU_DMP_IMAGE_SIZE, MPU_DMP_START_ADDRESS) && mpu6050.setDmpRate(MPU_DMP_RATE_DIV))
+        LOGI("MPU6050 DMP firmware loaded and verified\r\n");
+    else
+        LOGE("MPU6050 DMP firmware upload failed\r\n");
+#endif
+
+#if MPU_USE_FIFO
+    LOGI("MPU6050 device initialized for FIFO stream mode\r\n"); // Initialize device for stream read of acclerometer, gyroscope, and temperature
+#else
     LOGI("MPU6050 device initialized for active data mode\r\n"); // Initialize device for active mode read of acclerometer, gyroscope, and temperature
+#endif
+
+    /* Per-sensor reads, started together by the scheduler on every data-ready interrupt */
+#if MPU_USE_FIFO
+    mpuScheduler.attach(0, callback(&mpu6050, &decltype(mpu6050)::readFifoAsync), gyroRing[0]);
+#if MPU_SENSOR_COUNT > 1
+    mpuScheduler.attach(1, callback(&mpu6050b, &decltype(mpu6050b)::readFifoAsync), gyroRing[1]);
+#endif
+#else
+    mpuScheduler.attach(0, callback(&mpu6050, &decltype(mpu6050)::readAllAsync), gyroRing[0]);
+#if MPU_SENSOR_COUNT > 1
+    mpuScheduler.attach(1, callback(&mpu6050b, &decltype(mpu6050b)::readAllAsync), gyroRing[1]);
+#endif
+#endif
+    mpuScheduler.onDone(callback(this, &GyroAndPeriphService::onSensorAcquired),
+                        callback(this, &GyroAndPeriphService::onSamplesAcquired));
+
+#if MPU_USE_I2C_ASYNC
+    /* Configuration above is done blocking before anything else runs, from here on the bus is shared with BLE processing */
+    mpuBus.setEventQueue(event_queue);
+    forEachSensor([](uint8_t index, auto &sensor)
+                  { sensor.attachEngine(&mpuBus); });
+#endif
+
+    /* Acquisition is driven by the data-ready interrupt, but only while someone is subscribed */
+    mpuInt.rise(callback(this, &GyroAndPeriphService::onMpuDataReady));
+    forEachSensor([](uint8_t index, auto &sensor)
+                  { sensor.sleep(); });
+
+    refreshTrace();
+#if TRACE_ENABLED && TRACE_REPORT_PERIOD_MS
+    _event_queue->call_every(std::chrono::milliseconds(TRACE_REPORT_PERIOD_MS), callback(this, &GyroAndPeriphService::reportTrace));
+#endif
+}
+
+/**
+ * @brief Start sampling and publishing
+ *
+ * Wake the MPU6050 sensors up and, once their gyro PLL settled, go on in onMpuAwake(). With the
+ * transaction engine the wake-up only queues the register write and the settling time passes on
+ * the event queue, so BLE keeps running; data-ready interrupts are held off until then.
+ *
+ * @return None
+ */
+void GyroAndPeriphService::startSampling(void)
+{
+    LOGI("Subscribed, sampling started\r\n");
+
+    _drain_pending = true;
+    _sampling = true;
+    forEachSensor([](uint8_t index, auto &sensor)
+                  { sensor.wakeUp(); });
+#if MPU_USE_I2C_ASYNC
+    _wake_event = _event_queue->call_in(std::chrono::milliseconds(MPU_WAKEUP_MS), callback(this, &GyroAndPeriphService::onMpuAwake));
+#else
+    onMpuAwake();
+#endif
+}
+
+/**
+ * @brief The woken sensors are ready
+ *
+ * Restart their FIFOs so no stale samples are sent, let the data-ready interrupts in and schedule
+ * the publisher every GYRO_PUBLISH_PERIOD. The sensor may have moved while asleep, so the attitude
+ * starts over from gravity.
+ *
+ * @return None
+ */
+void GyroAndPeriphService::onMpuAwake(void)
+{
+    _wake_event = 0;
+#if MPU_USE_FIFO
+    /* Back to back, so the sample clocks of all sensors start together */
+    forEachSensor([](uint8_t index, auto &sensor)
+                  { restartFifo(sensor); });
+#endif
+    mpuScheduler.restarted();
+
+    for (uint8_t i = 0; i < MPU_SENSOR_COUNT; i++)
+    {
+        gyroRing[i].clear();
+        gyroBias[i].restart();
+        _channels[i].len = 0;
+        _channels[i].pending = 0;
+    }
+    attitude.reset();
+    _attitude_timestamp_us = 0;
+    _publish_ticks = 0;
+
+    _drdy_count = 0;
+    _fresh = false;
+    _drain_pending = false;
+    _publish_event = _event_queue->call_every(GYRO_PUBLISH_PERIOD, callback(this, &GyroAndPeriphService::updateGyroCharacteristics));
+}
+
+/**
+ * @brief Stop sampling and publishing
+ *
+ * Nobody listens anymore: put the MPU6050 sensors to sleep, which also stops the data-ready interrupts,
+ * cancel the publisher and save a calibration record that changed during the stream.
+ *
+ * @return None
+ */
+void GyroAndPeriphService::stopSampling(void)
+{
+    LOGI("No subscribers, sampling stopped\r\n");
+
+    _event_queue->cancel(_wake_event);
+    _event_queue->cancel(_publish_event);
+    _wake_event = 0;
+    _publish_event = 0;
+    forEachSensor([](uint8_t index, auto &sensor)
+                  { sensor.sleep(); });
+    _sampling = false;
+
+    /* No FIFO to overflow now, a record taken during the stream goes to flash */
+    saveCalibration();
+}
+
+/**
+ * @brief Refresh the subscription state of all characteristics
+ *
+ * Asks the stack which characteristics have notifications or indications enabled on every link,
+ * forces a push of the current value on the ones that just got a subscriber and starts or stops
+ * sampling on the first subscription and after the last one is gone.
+ *
+ * @return None
+ */
+void GyroAndPeriphService::updateSubscriptions(void)
+{
+    uint16_t subscribed = 0;
+
+    for (ClientState &client : _clients)
+    {
+        client.subscribed = 0;
+        if (client.handle == ble::INVALID_CONNECTION_HANDLE)
+            continue;
+
+        for (size_t i = 0; i < sizeof(_gyro_characteristics) / sizeof(_gyro_characteristics[0]); i++)
+        {
+            bool enabled = false;
+            _server->areUpdatesEnabled(client.handle, *_gyro_characteristics[i], &enabled);
+
+            if (enabled)
+                client.subscribed |= 1 << i;
+        }
+        subscribed |= client.subscribed;
+    }
+
+    /* A link that left a stream no longer waits for its pending notification */
+    for (uint8_t i = 0; i < MPU_SENSOR_COUNT; i++)
+    {
+        for (uint8_t slot = 0; slot < BLE_MAX_CONNECTIONS; slot++)
+        {
+            if (!(_clients[slot].subscribed & (1 << _channels[i].index)))
+                _channels[i].pending &= ~(1 << slot);
+        }
+    }
+
+    _force_push |= subscribed & ~_subscribed;
+    _subscribed = subscribed;
+
+    if (_subscribed && !_sampling)
+        startSampling();
+    else if (!_subscribed && _sampling)
+        stopSampling();
+}
+
+/**
+ * @brief Handle a new connection
+ *
+ * The client gets a free slot with the full stream rate and no subscriptions; the link
+ * parameters follow with the link updates (see onLinkUpdate()).
+ *
+ * @param ble Reference to BLE-capable radio transceivers or SOC
+ * @param event_queue Reference to event queue
+ * @param event Connection complete event
+ *
+ * @return None
+ */
+void GyroAndPeriphService::onConnect(BLE &ble, events::EventQueue &event_queue, const ble::ConnectionCompleteEvent &event)
+{
+    ClientState *client = findClient(ble::INVALID_CONNECTION_HANDLE);
+
+    if (!client)
+    {
+        LOGE("No client slot left\r\n");
+        return;
+    }
+
+    *client = ClientState();
+    client->handle = event.getConnectionHandle();
+    client->connected_ms = get_ms_count();
+}
+
+/**
+ * @brief Handle a disconnection
+ *
+ * The subscriptions of the link are gone with it, and so are its slot and the notifications
+ * it still had to take.
+ *
+ * @param ble Reference to BLE-capable radio transceivers or SOC
+ * @param event_queue Reference to event queue
+ * @param event Disconnection complete event
+ *
+ * @return None
+ */
+void GyroAndPeriphService::onDisconnect(BLE &ble, events::EventQueue &event_queue, const ble::DisconnectionCompleteEvent &event)
+{
+    ClientState *client = findClient(event.getConnectionHandle());
+
+    if (client)
+    {
+        uint8_t bit = 1 << (client - _clients);
+
+        for (uint8_t i = 0; i < MPU_SENSOR_COUNT; i++)
+            _channels[i].pending &= ~bit;
+        *client = ClientState();
+    }
+    updateSubscriptions();
+}
+
+/**
+ * @brief Handle a change of the link parameters
+ *
+ * Called after connecting and whenever a step of the throughput profile settles; the stream
+ * packs its notifications for the new ATT_MTU and data length from the next publish on. The
+ * new parameters are notified to the client of the link, if it subscribed to them.
+ *
+ * @param ble Reference to BLE-capable radio transceivers or SOC
+ * @param event_queue Reference to event queue
+ * @param state Parameters negotiated so far
+ *
+ * @return None
+ */
+void GyroAndPeriphService::onLinkUpdate(BLE &ble, events::EventQueue &event_queue, const LinkState &state)
+{
+    ClientState *client = findClient(state.handle);
+    uint8_t value[LINK_STATE_SIZE];
+    uint16_t length = packLinkState(value, state);
+    bool enabled = false;
+
+    if (!client || !_server)
+        return;
+
+    client->link = state;
+    _server->areUpdatesEnabled(state.handle, _link_char, &enabled);
+    if (enabled)
+        tracedWrite(*_server, state.handle, _link_char.getValueHandle(), value, length);
 }
 
 /**
@@ -110,7 +568,8 @@ void GyroAndPeriphService::start(BLE &ble, events::EventQueue &event_queue)
  */
 void GyroAndPeriphService::onDataSent(const GattDataSentCallbackParams &params)
 {
-    LOGI("Sent updates\r\n");
+    metrics_add(METRIC_NOTIFICATIONS_SENT);
+    LOGI_LIMIT("Sent updates\r\n");
 }
 
 /**
@@ -142,6 +601,42 @@ void GyroAndPeriphService::onDataWritten(const GattWriteCallbackParams &params)
     {
         LOGI("GZ characteristic was written\r\n");
     }
+    else if (params.handle == _stream_format_char.getValueHandle())
+    {
+        /* Value was checked by authorize_client_write(); a notification encoded in the old format is dropped */
+        _stream_format = params.data[0];
+
+        for (uint8_t i = 0; i < MPU_SENSOR_COUNT; i++)
+        {
+            _channels[i].len = 0;
+            _channels[i].pending = 0;
+        }
+        LOGI("Stream format was written\r\n");
+    }
+    else if (params.handle == _stream_rate_char.getValueHandle())
+    {
+        /* Value was checked by authorize_client_write() */
+        ClientState *client = findClient(params.connHandle);
+
+        if (client)
+            client->rate = params.data[0];
+        LOGI("Stream rate set to 1/%u\r\n", params.data[0]);
+    }
+    else if (params.handle == _log_level_char.getValueHandle())
+    {
+        /* Value was checked by authorize_client_write() */
+        logLevel().store(params.data[0], std::memory_order_relaxed);
+        LOGW("Log level set to %u\r\n", params.data[0]);
+    }
+    else if (params.handle == _trace_char.getValueHandle())
+    {
+        /* Value was checked by authorize_client_write() */
+        if (params.data[0] == TRACE_CLEAR)
+            trace_clear();
+        else
+            _trace_point = params.data[0];
+        refreshTrace();
+    }
     else
     {
         LOGI("No characteristic was written\r\n");
@@ -197,6 +692,7 @@ void GyroAndPeriphService::onDataRead(const GattReadCallbackParams &params)
 void GyroAndPeriphService::onUpdatesEnabled(const GattUpdatesEnabledCallbackParams &params)
 {
     LOGI("Update enabled on handle\r\n");
+    updateSubscriptions();
 }
 
 /**
@@ -212,6 +708,7 @@ void GyroAndPeriphService::onUpdatesEnabled(const GattUpdatesEnabledCallbackPara
 void GyroAndPeriphService::onUpdatesDisabled(const GattUpdatesDisabledCallbackParams &params)
 {
     LOGI("Update disabled on handle\r\n");
+    updateSubscriptions();
 }
 
 /**
@@ -225,6 +722,7 @@ void GyroAndPeriphService::onUpdatesDisabled(const GattUpdatesDisabledCallbackPa
  */
 void GyroAndPeriphService::onConfirmationReceived(const GattConfirmationReceivedCallbackParams &params)
 {
+    metrics_add(METRIC_NOTIFICATIONS_SENT);
     LOGI("Confirmation received on handle\r\n");
 }
 
@@ -255,55 +753,615 @@ void GyroAndPeriphService::authorize_client_write(GattWriteAuthCallbackParams *w
         write_auth_param->authorizationReply = AUTH_CALLBACK_REPLY_ATTERR_INVALID_ATT_VAL_LENGTH;
         return;
     }
+
+    if (write_auth_param->handle == _stream_format_char.getValueHandle() && write_auth_param->data[0] >= GYRO_FORMAT_COUNT)
+    {
+        LOGE("Error invalid stream format\r\n");
+        write_auth_param->authorizationReply = AUTH_CALLBACK_REPLY_ATTERR_WRITE_NOT_PERMITTED;
+        return;
+    }
+
+    if (write_auth_param->handle == _stream_rate_char.getValueHandle() &&
+        (write_auth_param->data[0] == 0 || write_auth_param->data[0] > GYRO_STREAM_RATE_MAX))
+    {
+        LOGE("Error invalid stream rate\r\n");
+        write_auth_param->authorizationReply = AUTH_CALLBACK_REPLY_ATTERR_WRITE_NOT_PERMITTED;
+        return;
+    }
+
+    if (write_auth_param->handle == _log_level_char.getValueHandle() && write_auth_param->data[0] > LOG_LEVEL_NONE)
+    {
+        LOGE("Error invalid log level\r\n");
+        write_auth_param->authorizationReply = AUTH_CALLBACK_REPLY_ATTERR_WRITE_NOT_PERMITTED;
+        return;
+    }
+
+    if (write_auth_param->handle == _trace_char.getValueHandle() && write_auth_param->data[0] >= TRACE_POINT_COUNT &&
+        write_auth_param->data[0] != TRACE_CLEAR)
+    {
+        LOGE("Error invalid tracepoint\r\n");
+        write_auth_param->authorizationReply = AUTH_CALLBACK_REPLY_ATTERR_WRITE_NOT_PERMITTED;
+        return;
+    }
     write_auth_param->authorizationReply = AUTH_CALLBACK_REPLY_SUCCESS;
 }
 
 /**
- * @brief Updating gyroscope characteristics
+ * @brief Handler called when a client reads a characteristic with a value per connection.
  *
- * Depending on the current MPU6050 address and interrupt value, read current angular velocity 
- * of rotation around the XYZ-axis and write it to BLE characteristics.
+ * The stream rate and the link parameters are answered from the slot of the reading
+ * connection. A long read of the link continues with the snapshot of its first part.
+ *
+ * @param params Pointer to read authorization parameters.
  *
  * @return None
  */
-void GyroAndPeriphService::updateGyroCharacteristics(void)
+void GyroAndPeriphService::authorize_client_read(GattReadAuthCallbackParams *params)
 {
-    if (mpu6050.readByte(MPU6050_ADDRESS, INT_STATUS) & 0x01)
+    ClientState *client = findClient(params->connHandle);
+
+    if (!client)
     {
-        mpu6050.readGyroData(gyroCount);
-        mpu6050.getGres();
+        params->authorizationReply = AUTH_CALLBACK_REPLY_ATTERR_READ_NOT_PERMITTED;
+        return;
+    }
 
-        uint8_t gX;
-        uint8_t gY;
-        uint8_t gZ;
+    if (params->handle == _stream_rate_char.getValueHandle())
+    {
+        params->data = &client->rate;
+        params->len = sizeof(client->rate);
+    }
+    else
+    {
+        if (params->offset == 0)
+            packLinkState(_link_value, client->link);
+        params->data = _link_value;
+        params->len = LINK_STATE_SIZE;
+    }
+    params->authorizationReply = AUTH_CALLBACK_REPLY_SUCCESS;
+}
 
-        ble_error_t err_gX = _accel_gX.get(*_server, gX);
-        ble_error_t err_gY = _accel_gY.get(*_server, gY);
-        ble_error_t err_gZ = _accel_gZ.get(*_server, gZ);
+/**
+ * @brief Handler of the MPU6050 data-ready interrupt
+ *
+ * Runs in interrupt context: only timestamps the sample and, once MPU_FIFO_WATERMARK samples are
+ * waiting, defers the acquisition to the event queue. Samples that become ready while an
+ * acquisition is pending are counted towards the next one, the FIFO keeps them.
+ *
+ * @return None
+ */
+void GyroAndPeriphService::onMpuDataReady(void)
+{
+    _drdy_timestamp_us = us_ticker_read();
+
+#if MPU_USE_FIFO
+    if (_drdy_count < MPU_FIFO_WATERMARK)
+        _drdy_count++;
+    if (_drain_pending || _drdy_count < MPU_FIFO_WATERMARK)
+        return;
+#else
+    if (_drain_pending)
+        return;
+#endif
+
+    _drdy_count = 0;
+
+    _drain_pending = true;
+    metrics_event_posted();
+    _event_queue->call(callback(this, &GyroAndPeriphService::acquireSamples));
+}
+
+/**
+ * @brief Acquire samples from MPU6050
+ *
+ * Producer side of the sample rings. Drain all samples every MPU6050 queued in its FIFO since the
+ * previous call (or, without FIFO, fetch status and sample with a single readAll() transaction)
+ * and push them, timestamped, to the sensor's ring.
+ *
+ * With the transaction engine this only starts the reads of all sensors, which interleave on the
+ * bus (see imuscheduler.h); the event queue keeps running (BLE included) while they are on the
+ * bus, and onSamplesAcquired() ends the acquisition. Blocking builds read the sensors one after
+ * the other.
+ *
+ * @return None
+ */
+void GyroAndPeriphService::acquireSamples(void)
+{
+    metrics_event_run();
+
+#if MPU_USE_I2C_ASYNC
+    mpuScheduler.acquire(_drdy_timestamp_us);
+#else
+    /* Interrupts from here on schedule a new acquisition */
+    _drain_pending = false;
+
+    forEachSensor([this](uint8_t index, auto &sensor)
+                  {
+#if MPU_USE_FIFO
+                      int result = sensor.readFifo(gyroRing[index], _drdy_timestamp_us);
+#else
+                      MPU6050Frame frame;
+                      int result = sensor.readAll(frame) ? 1 : 0;
+
+                      if (result)
+                      {
+                          MPU6050TimedSample timed;
+                          timed.timestamp_us = _drdy_timestamp_us;
+                          timed.sample = frame.sample;
+                          gyroRing[index].push(timed);
+                      }
+#endif
+                      mpuScheduler.account(index, result);
+                      onSensorAcquired(index, result);
+                  });
+
+    onSamplesAcquired();
+#endif
+}
+
+/**
+ * @brief Result of one sensor's acquisition
+ *
+ * @param sensor Sensor index
+ * @param result Number of samples pushed, -1 on FIFO overflow, -2 on bus error
+ *
+ * @return None
+ */
+void GyroAndPeriphService::onSensorAcquired(uint8_t sensor, int result)
+{
+    if (result > 0)
+    {
+        metrics_add(METRIC_SAMPLES_ACQUIRED, (uint32_t)result);
+    }
+    else if (result == -1)
+    {
+        LOGW_LIMIT("MPU FIFO overflow, stream restarted\r\n");
+    }
+    else if (result < -1)
+    {
+        LOGW_LIMIT("MPU I2C transaction failed\r\n");
+    }
+}
+
+/**
+ * @brief End of an acquisition cycle of all sensors
+ *
+ * The new samples go out on the stream right away, so they wait for the bus and the link only.
+ * In FIFO mode the sensor FIFOs are restarted together once their sample counts drifted apart by
+ * more than MPU_SKEW_MAX_SAMPLES. Without FIFO every cycle takes the newest sample of each sensor,
+ * so there is no drift to track.
+ *
+ * @return None
+ */
+void GyroAndPeriphService::onSamplesAcquired(void)
+{
+    /* Interrupts from here on schedule a new acquisition */
+    _drain_pending = false;
+
+#if MPU_USE_FIFO
+    if (mpuScheduler.resyncNeeded())
+    {
+        forEachSensor([](uint8_t index, auto &sensor)
+                      { restartFifo(sensor); });
+        mpuScheduler.restarted();
+        LOGI("MPU FIFOs restarted together\r\n");
+    }
+#else
+    mpuScheduler.restarted();
+#endif
+
+    if (publishGyroStream())
+        _fresh = true;
+}
+
+/**
+ * @brief Publish queued samples on the stream characteristics
+ *
+ * Consumer side of the sample rings. For every sensor, pop as many samples as one notification of
+ * every subscribed link holds (see streamCapacity()), encode them once and send the notification
+ * to each subscriber of the sensor whose stream rate divides its sequence number, until the ring
+ * is empty; without a stream subscriber the samples are only popped. When the stack had a transmit
+ * buffer for none of the targets the notification is kept and retried first on the next call, so
+ * the clients see no sequence gap; meanwhile samples back up in the ring. A single slow or failing
+ * link does not hold up the others: when some targets took the notification, the rest lose it.
+ * Notifications taken by at least one target count their samples as published and the age of
+ * their oldest sample as TRACE_SAMPLE_TO_NOTIFY. Every sample feeds the gyro
+ * bias tracker of its sensor, whose new offsets are queued on the bus at the end. Every sample of
+ * the first sensor is fused into the attitude as it is popped, and the newest one is left in
+ * mpu6050.gyroCount.
+ *
+ * @return true if at least one sample of the first sensor was popped
+ */
+bool GyroAndPeriphService::publishGyroStream(void)
+{
+    MPU6050TimedSample batch[GYRO_STREAM_MAX_SAMPLES];
+    uint8_t capacity = streamCapacity();
+    uint8_t offsets_changed = 0;
+    bool fresh = false;
+
+    for (uint8_t i = 0; i < MPU_SENSOR_COUNT; i++)
+    {
+        StreamChannel &channel = _channels[i];
 
-        if (err_gX && err_gY && err_gZ)
+        for (;;)
         {
-            LOGW("Read of the AZ value returned error\r\n");
-            return;
+            if (channel.len == 0)
+            {
+                uint32_t count = gyroRing[i].popBatch(batch, capacity);
+
+                if (count == 0)
+                    break;
+
+                bool was_still = gyroBias[i].stationaryWindows() != 0;
+#if !MPU_USE_DMP
+                /* DMP packets carry no temperature, the start-up reading stays */
+                mpuTemperature[i] = mpu6050.temperatureC(batch[count - 1].sample.temp);
+#endif
+
+                for (uint32_t n = 0; n < count; n++)
+                {
+                    /* The packed sample may sit at any address, the tracker takes aligned arrays */
+                    int16_t gyro[3], accel[3];
+
+                    memcpy(gyro, batch[n].sample.gyro, sizeof(gyro));
+                    memcpy(accel, batch[n].sample.accel, sizeof(accel));
+                    if (gyroBias[i].update(gyro, accel))
+                        offsets_changed |= 1 << i;
+                }
+
+                /* The first rest brings the accelerometer bias, align to gravity again while still */
+                if (i == 0 && !was_still && gyroBias[i].stationaryWindows() != 0)
+                    attitude.reset();
+
+                if (i == 0)
+                {
+#if !MPU_USE_DMP
+                    attitude.setBias(gyroBias[0].residual(), gyroBias[0].accelBias());
+                    for (uint32_t n = 0; n < count; n++)
+                    {
+                        /* FIFO timestamps step by exactly one sample period, readAll() ones follow the interrupts */
+                        uint32_t elapsed_us = _attitude_timestamp_us ? batch[n].timestamp_us - _attitude_timestamp_us : mpu6050.samplePeriodUs;
+                        int16_t gyro[3], accel[3];
+
+                        memcpy(gyro, batch[n].sample.gyro, sizeof(gyro));
+                        memcpy(accel, batch[n].sample.accel, sizeof(accel));
+                        attitude.update(gyro, accel, (float)elapsed_us * 1e-6f);
+                        _attitude_timestamp_us = batch[n].timestamp_us;
+                    }
+#endif
+
+                    mpu6050.gyroCount[0] = batch[count - 1].sample.gyro[0];
+                    mpu6050.gyroCount[1] = batch[count - 1].sample.gyro[1];
+                    mpu6050.gyroCount[2] = batch[count - 1].sample.gyro[2];
+                    fresh = true;
+                }
+
+                if (!(_subscribed & (1 << channel.index)))
+                    continue;
+
+                uint16_t seq = channel.seq++;
+
+                for (uint8_t slot = 0; slot < BLE_MAX_CONNECTIONS; slot++)
+                {
+                    if ((_clients[slot].subscribed & (1 << channel.index)) && seq % _clients[slot].rate == 0)
+                        channel.pending |= 1 << slot;
+                }
+
+                if (!channel.pending)
+                    continue;
+
+                channel.len = packGyroStream(channel.buf, seq, _stream_format, mpu6050.gyroScale, batch, (uint8_t)count);
+                channel.count = (uint8_t)count;
+                channel.timestamp_us = batch[0].timestamp_us;
+            }
+
+            uint8_t sent = 0, busy = 0;
+
+            for (uint8_t slot = 0; slot < BLE_MAX_CONNECTIONS; slot++)
+            {
+                if (!(channel.pending & (1 << slot)))
+                    continue;
+
+                ble_error_t err = tracedWrite(*_server, _clients[slot].handle, channel.characteristic->getValueHandle(), channel.buf, channel.len);
+
+                if (!err)
+                    sent |= 1 << slot;
+                else if (err == BLE_ERROR_NO_MEM || err == BLE_STACK_BUSY)
+                    busy |= 1 << slot;
+            }
+
+            /* Every target out of buffers: keep the notification and back up, nobody else waits for it */
+            channel.pending = busy;
+            if (busy && !sent)
+                break;
+
+            /* A link that is behind or failed while others took the notification loses it, its client sees the gap */
+            if (channel.pending)
+            {
+                LOGW_LIMIT("Stream notification dropped on a congested link\r\n");
+                channel.pending = 0;
+            }
+
+            if (sent)
+            {
+                metrics_add(METRIC_SAMPLES_PUBLISHED, channel.count);
+                trace_record_us(TRACE_SAMPLE_TO_NOTIFY, us_ticker_read() - channel.timestamp_us);
+            }
+            channel.len = 0;
         }
+    }
+
+    if (offsets_changed)
+    {
+        forEachSensor([offsets_changed](uint8_t index, auto &sensor)
+                      {
+                          if (offsets_changed & (1 << index))
+                              sensor.setGyroOffsets(gyroBias[index].offsets());
+                      });
+        LOGI("MPU gyro bias offsets updated\r\n");
+    }
+
+    return fresh;
+}
+
+/**
+ * @brief Updating gyroscope characteristics
+ *
+ * Runs every GYRO_PUBLISH_PERIOD while sampling. Stream what the acquisitions left queued (stream
+ * notifications still pending on a link); if the first sensor delivered samples since the last
+ * tick, publish the attitude, then stage the newest angular velocity of rotation around the
+ * XYZ-axis in the shadow of every subscribed 1-byte characteristic whose value moved by at least
+ * GYRO_NOTIFY_DELTA since the last push, and flush the dirty ones in one pass. Ring overflows are
+ * reported.
+ *
+ * @return None
+ */
+void GyroAndPeriphService::updateGyroCharacteristics(void)
+{
+    TraceScope trace(TRACE_UPDATE_CHARACTERISTICS);
+    uint32_t dropped = 0;
+
+    for (uint8_t i = 0; i < MPU_SENSOR_COUNT; i++)
+        dropped += gyroRing[i].dropped();
+
+    if (dropped != _reported_drops)
+    {
+        metrics_add(METRIC_SAMPLES_DROPPED, dropped - _reported_drops);
+        _reported_drops = dropped;
+        LOGW_LIMIT("Sample ring overflow, %u samples dropped\r\n", (unsigned)dropped);
+    }
+
+    if (publishGyroStream())
+        _fresh = true;
+
+    /* Nothing new since the last tick; failed reads are reported where they end */
+    if (!_fresh)
+        return;
+    _fresh = false;
+
+    publishAttitude();
+    storeCalibration();
+
+    /* Signed compact values, 2 dps per count, stored as their two's complement byte */
+    int8_t values[3] = {mpu6050.getTinyGyroX(), mpu6050.getTinyGyroY(), mpu6050.getTinyGyroZ()};
 
-        gX = mpu6050.getTinyGyroX();
-        gY = mpu6050.getTinyGyroY();
-        gZ = mpu6050.getTinyGyroZ();
+    for (int axis = 0; axis < 3; axis++)
+    {
+        uint8_t bit = 1 << axis;
+        int delta = (int)values[axis] - (int)(int8_t)_gyro_shadow.value(axis)[0];
 
-        err_gX = _accel_gX.set(*_server, gX);
-        err_gY = _accel_gY.set(*_server, gY);
-        err_gZ = _accel_gZ.set(*_server, gZ);
+        if (!(_subscribed & bit))
+            continue;
 
-        if (err_gX && err_gY && err_gZ)
+        if (!(_force_push & bit) && delta < GYRO_NOTIFY_DELTA && delta > -GYRO_NOTIFY_DELTA)
         {
-            LOGW("Write of accel values returned errors\r\n");
-            return;
+            _gyro_shadow.skip(axis);
+            continue;
         }
+
+        _gyro_shadow.update(axis, &values[axis], sizeof(values[axis]), _force_push & bit);
+        _force_push &= ~bit;
     }
-    else
+
+    if (_gyro_shadow.flush(*_server))
+    {
+        LOGW_LIMIT("Write of accel values returned errors\r\n");
+    }
+}
+
+/**
+ * @brief Keep the calibration record in step with the tracked one
+ *
+ * Nothing is stored before every sensor has been at rest once, which brings its accelerometer bias.
+ * Without a valid record from this boot the record is taken right away, afterwards only when the
+ * offsets moved and MPU_CAL_SAVE_PERIOD_MS passed since the last save. Temperatures are the newest
+ * ones of the streams. The page erase halts the CPU for longer than the FIFO holds samples, so while
+ * sampling the record is only marked for saveCalibration() when the stream stops.
+ *
+ * @return None
+ */
+void GyroAndPeriphService::storeCalibration(void)
+{
+    bool rested = true, moved = false;
+
+    for (uint8_t i = 0; i < MPU_SENSOR_COUNT; i++)
+    {
+        rested = rested && gyroBias[i].stationaryWindows() != 0;
+        moved = moved || memcmp(gyroBias[i].offsets(), calibrationRecord.sensor[i].gyro_offsets,
+                                sizeof(calibrationRecord.sensor[i].gyro_offsets)) != 0;
+    }
+
+    if (_calibration_stored && (!moved || get_ms_count() - _calibration_saved_ms < MPU_CAL_SAVE_PERIOD_MS))
+        return;
+    if (_calibration_dirty && !moved)
+        return;
+
+#if !MPU_STARTUP_CALIBRATION
+    if (!rested)
+        return;
+#endif
+
+    calibrationRecord.gyro_scale = mpu6050.gyroScale;
+    calibrationRecord.accel_scale = mpu6050.accelScale;
+    calibrationRecord.sensors = MPU_SENSOR_COUNT;
+    for (uint8_t i = 0; i < MPU_SENSOR_COUNT; i++)
     {
-        LOGW("Reading from MPU returned errors\r\n");
+        SensorCalibration &calibration = calibrationRecord.sensor[i];
+
+        memcpy(calibration.gyro_offsets, gyroBias[i].offsets(), sizeof(calibration.gyro_offsets));
+        memcpy(calibration.accel_bias, gyroBias[i].accelBias(), sizeof(calibration.accel_bias));
+        calibration.temperature_c = mpuTemperature[i];
+    }
+
+    _calibration_dirty = true;
+    if (!_sampling)
+        saveCalibration();
+}
+
+/**
+ * @brief Write a calibration record marked by storeCalibration() to flash
+ *
+ * Only called with the sensors idle, the erase stalls the event queue for about 85 ms.
+ *
+ * @return None
+ */
+void GyroAndPeriphService::saveCalibration(void)
+{
+    if (!_calibration_dirty)
+        return;
+
+    _calibration_dirty = false;
+    _calibration_stored = true;
+    _calibration_saved_ms = get_ms_count();
+
+    if (calibrationStore.save(calibrationRecord))
+        LOGI("MPU6050 calibration saved to flash, sequence %u\r\n", (unsigned)calibrationStore.sequence());
+    else
+        LOGE("MPU6050 calibration could not be saved\r\n");
+}
+
+/**
+ * @brief Notify the attitude of the first sensor
+ *
+ * Runs every publish tick after the samples were fused; a link gets every tick its stream rate
+ * divides. Without a free transmit buffer the value is dropped, the next tick carries a newer one.
+ *
+ * @return None
+ */
+void GyroAndPeriphService::publishAttitude(void)
+{
+    uint8_t value[FUSION_QUATERNION_SIZE];
+    uint32_t tick = _publish_ticks++;
+
+    if (!(_subscribed & (1 << GYRO_ATTITUDE_INDEX)))
         return;
+
+#if MPU_USE_DMP
+    /* Fused on the sensor, the newest DMP packet carries it */
+    uint16_t length = packQuaternion(value, fusionFromQ30(mpu6050.dmpQuaternion), mpu6050.dmpTimestampUs);
+#else
+    uint16_t length = packQuaternion(value, attitude.quaternion(), _attitude_timestamp_us);
+#endif
+
+    for (const ClientState &client : _clients)
+    {
+        if ((client.subscribed & (1 << GYRO_ATTITUDE_INDEX)) && tick % client.rate == 0)
+            tracedWrite(*_server, client.handle, _attitude_char.getValueHandle(), value, length);
+    }
+}
+
+/* Arguments of one line of the trace report: passes, p50, p99 and maximum in ns */
+#define TRACE_REPORT_ARGS(point)                                                         \
+    (unsigned)traceHistograms()[point].count,                                            \
+        (unsigned)trace_ticks_to_ns(trace_percentile(traceHistograms()[point], 500)),   \
+        (unsigned)trace_ticks_to_ns(trace_percentile(traceHistograms()[point], 990)),   \
+        (unsigned)trace_ticks_to_ns(traceHistograms()[point].max)
+
+/**
+ * @brief Log a summary of every tracepoint
+ *
+ * Runs every TRACE_REPORT_PERIOD_MS. Percentiles are the ends of their log2 buckets, so they
+ * are upper bounds within a factor of two; the histograms keep counting from start-up or the
+ * last TRACE_CLEAR. The trace characteristic is refreshed as well.
+ *
+ * @return None
+ */
+void GyroAndPeriphService::reportTrace(void)
+{
+    LOGI("Trace publish tick: %u, p50 %u p99 %u max %u ns\r\n", TRACE_REPORT_ARGS(TRACE_UPDATE_CHARACTERISTICS));
+    LOGI("Trace MPU I2C: %u, p50 %u p99 %u max %u ns\r\n", TRACE_REPORT_ARGS(TRACE_MPU_I2C));
+    LOGI("Trace GATT write: %u, p50 %u p99 %u max %u ns\r\n", TRACE_REPORT_ARGS(TRACE_GATT_WRITE));
+    LOGI("Trace BLE events: %u, p50 %u p99 %u max %u ns\r\n", TRACE_REPORT_ARGS(TRACE_BLE_EVENTS));
+    LOGI("Trace BLE dispatch: %u, p50 %u p99 %u max %u ns\r\n", TRACE_REPORT_ARGS(TRACE_BLE_DISPATCH));
+    LOGI("Trace log write: %u, p50 %u p99 %u max %u ns\r\n", TRACE_REPORT_ARGS(TRACE_LOG_WRITE));
+    LOGI("Trace sample to notify: %u, p50 %u p99 %u max %u ns\r\n", TRACE_REPORT_ARGS(TRACE_SAMPLE_TO_NOTIFY));
+
+    refreshTrace();
+}
+
+/**
+ * @brief Put the histogram of the selected tracepoint into the trace characteristic
+ *
+ * Local only, clients read it on demand.
+ *
+ * @return None
+ */
+void GyroAndPeriphService::refreshTrace(void)
+{
+    uint8_t value[TRACE_SNAPSHOT_SIZE];
+    uint16_t length = trace_pack(value, _trace_point);
+
+    _server->write(_trace_char.getValueHandle(), value, length, true);
+}
+
+/**
+ * @brief Handler called when a client reads the metrics characteristic
+ *
+ * Snapshots the counters into the value the stack answers with, the connection uptime is the
+ * one of the reading link. A long read continues with the snapshot of its first part, so a value
+ * read in several requests stays consistent.
+ *
+ * @param params Pointer to read authorization parameters.
+ *
+ * @return None
+ */
+void GyroAndPeriphService::authorize_metrics_read(GattReadAuthCallbackParams *params)
+{
+    ClientState *client = findClient(params->connHandle);
+    uint64_t now_ms = get_ms_count();
+
+    if (params->offset == 0)
+        metrics_pack(_metrics_value, (uint32_t)now_ms, client ? (uint32_t)(now_ms - client->connected_ms) : 0);
+
+    params->data = _metrics_value;
+    params->len = METRICS_SNAPSHOT_SIZE;
+    params->authorizationReply = AUTH_CALLBACK_REPLY_SUCCESS;
+}
+
+/**
+ * @brief Samples per stream notification that every stream subscriber takes in whole PDUs
+ *
+ * The notification is encoded once for all links, so the one with the smallest ATT_MTU or data
+ * length sets the batch; without a stream subscriber the batch is the largest one.
+ *
+ * @return Samples per notification
+ */
+uint8_t GyroAndPeriphService::streamCapacity(void)
+{
+    uint8_t capacity = gyroStreamCapacity(GYRO_STREAM_MAX_MTU, GYRO_STREAM_MAX_DATA_LENGTH, _stream_format);
+    uint16_t stream_bits = 0;
+
+    for (uint8_t i = 0; i < MPU_SENSOR_COUNT; i++)
+        stream_bits |= 1 << _channels[i].index;
+
+    for (const ClientState &client : _clients)
+    {
+        if (!(client.subscribed & stream_bits))
+            continue;
+
+        uint8_t link_capacity = gyroStreamCapacity(client.link.att_mtu, client.link.tx_data_length, _stream_format);
+        if (link_capacity < capacity)
+            capacity = link_capacity;
     }
-}
\ No newline at end of file
+    return capacity;
+}
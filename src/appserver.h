@@ -4,17 +4,60 @@
 #define __APPSERVER_H__
 
 #include "gattserver.h"
+#include "fusion.h"
+#include "gattshadow.h"
+#include "gyroconvert.h"
+#include "gyrostream.h"
+#include "metrics.h"
 #include "syslogger.h"
 
+/* MPU6050 sensors on the bus: 1, or 2 for rigs with AD0 low and high; can be overridden from build flags */
+#ifndef MPU_SENSOR_COUNT
+#define MPU_SENSOR_COUNT 1
+#endif
+
+#if MPU_SENSOR_COUNT < 1 || MPU_SENSOR_COUNT > 2
+#error "MPU_SENSOR_COUNT must be 1 or 2"
+#endif
+
+/* Characteristics of the gyro service: GX, GY, GZ, stream format, attitude, one stream per sensor, stream rate, log level and trace */
+#define GYRO_CHARACTERISTIC_COUNT (8 + MPU_SENSOR_COUNT)
+
+/* Index of the attitude characteristic in the gyro service, i.e. its subscription bit */
+#define GYRO_ATTITUDE_INDEX 5
+
+/* Largest stream rate divider a client can ask for */
+#define GYRO_STREAM_RATE_MAX 100
+
+/* Value written to the trace characteristic to empty all histograms */
+#define TRACE_CLEAR 0xFF
+
 /**
  * @class GyroAndPeriphService 
  * 
  * @brief Gyroscope service demonstrating GattServer features of mbed OS 6
  * 
  * The service has 3 gyro-characteristics that contain the G-s values from MPU6050, gain via interrupt operation (MPU is pre-configured for this). A nRF Connect 
- * client can subscribe to updates of this characteristics and get notified when one of the value is changed. Clients can also change the value of the peripheral 
+ * client can subscribe to updates of this characteristics and get notified (or indicated) when one of the value changed by more than GYRO_NOTIFY_DELTA.
+ * The MPU6050 only samples while at least one characteristic has a subscriber. Clients can also change the value of the peripheral 
  * controled characteristic: set 0x01 to turn HIGH level of the appropriate output or 0x00 to set LOW pin level. 
- * The UUID of all characteristics was generated using python3 UUID module.
+ * The stream characteristic notifies batches of gyro samples, packed to the negotiated ATT_MTU and data length (see gyrostream.h), in the
+ * sample format the client wrote to the stream format characteristic (see gyroconvert.h). With MPU_SENSOR_COUNT 2 the
+ * second sensor (AD0 high) has its own stream characteristic; GX, GY and GZ follow the first sensor.
+ * The attitude characteristic notifies the orientation of the first sensor, fused from every gyro and accelerometer
+ * sample on the device (see fusion.h), once per publish period.
+ * Up to BLE_MAX_CONNECTIONS clients are served at once, each with its own subscriptions. A client writes N to the
+ * stream rate characteristic to get only every Nth stream notification and attitude update; the skipped ones show
+ * as sequence gaps. Every batch of samples is encoded once, in the stream format last written by any client, and
+ * the same notification goes to every subscriber of the stream; it holds as many samples as the smallest ATT_MTU
+ * and data length among them allow.
+ * The log level characteristic reads and sets the runtime log level, LOG_LEVEL_INFO..LOG_LEVEL_NONE (see syslogger.h).
+ * The trace characteristic reads the latency histogram of the tracepoint last written to it, or TRACE_CLEAR empties
+ * them all (see tracepoint.h); the histogram is refreshed on that write and with every trace report.
+ * A second service holds the metrics characteristic: a snapshot of the device health counters
+ * (see metrics.h), taken when a client reads it; and the link characteristic, which reads and notifies
+ * the parameters negotiated for the reading connection (see linkprofile.h).
+ * The UUID of all services and characteristics was generated using python3 UUID module.
  * 
  */
 class GyroAndPeriphService : public ble::GattServer::EventHandler
@@ -23,23 +66,72 @@ public:
     GyroAndPeriphService() : _accel_gX("90cb4365-2833-4541-a321-9437d9b38464", 0),
                      _accel_gY("df49a77c-4fd8-4327-aa5f-1410bce0d0ff", 0), 
                      _accel_gZ("a511aa3f-744e-4790-a225-8553838aa6ac", 0), 
+                     _gyro_stream("402bddc5-ebbd-4f39-b673-41847ed6ff40"),
+                     _stream_format_char("3abb60e4-54df-4c83-afb4-7271c9d58672", GYRO_FORMAT_RAW16),
+                     _attitude_char("55533d5d-5cac-49ec-b2e9-c34c5d0ce863"),
+#if MPU_SENSOR_COUNT > 1
+                     _gyro_stream_b("acbc4f4a-b094-4e74-b1f5-2be72a59f4ee"),
+#endif
+                     _stream_rate_char("b0076f1e-8b6c-4f6b-ba35-5f5e61b45644", 1),
+                     _log_level_char("dde4935f-3ff7-4068-94ac-76c1cef3d0ec", LOG_RUNTIME_LEVEL),
+                     _trace_char("7ffe706c-7fdd-410e-bd19-80367d343f67"),
                      _gyro_service(
                          /* uuid */                      "8c852eb9-8ec5-4ac0-a3eb-e9c375fbc756",
                          /* characteristics */           _gyro_characteristics,
                          /* number of characteristics */ sizeof(_gyro_characteristics) /
-                             sizeof(_gyro_characteristics[0]))
+                             sizeof(_gyro_characteristics[0])),
+                     _metrics_char("ba9f8450-5489-41d2-baec-fe3d64d2fe34"),
+                     _link_char("5ebfad9f-8aed-44ad-a0ca-b4337cea2b0b"),
+                     _metrics_service(
+                         /* uuid */                      "fa4bb8a1-cb73-4e6b-a31a-eacc7904cbe2",
+                         /* characteristics */           _metrics_characteristics,
+                         /* number of characteristics */ sizeof(_metrics_characteristics) /
+                             sizeof(_metrics_characteristics[0]))
     {
         /* Update internal pointers */
         _gyro_characteristics[0] = &_accel_gX;
         _gyro_characteristics[1] = &_accel_gY;
         _gyro_characteristics[2] = &_accel_gZ;
+        _gyro_characteristics[3] = &_gyro_stream;
+        _gyro_characteristics[4] = &_stream_format_char;
+        _gyro_characteristics[GYRO_ATTITUDE_INDEX] = &_attitude_char;
+
+        /* One stream channel per sensor */
+        _channels[0].characteristic = &_gyro_stream;
+        _channels[0].index = 3;
+#if MPU_SENSOR_COUNT > 1
+        _gyro_characteristics[6] = &_gyro_stream_b;
+        _channels[1].characteristic = &_gyro_stream_b;
+        _channels[1].index = 6;
+#endif
+        _gyro_characteristics[GYRO_CHARACTERISTIC_COUNT - 3] = &_stream_rate_char;
+        _gyro_characteristics[GYRO_CHARACTERISTIC_COUNT - 2] = &_log_level_char;
+        _gyro_characteristics[GYRO_CHARACTERISTIC_COUNT - 1] = &_trace_char;
+
+        /* Shadow the 1-byte values, the stream is a new value every time */
+        _gyro_shadow.bind(0, &_accel_gX);
+        _gyro_shadow.bind(1, &_accel_gY);
+        _gyro_shadow.bind(2, &_accel_gZ);
 
         /* Setup auth-handlers */
         _accel_gX.setWriteAuthorizationCallback(this, &GyroAndPeriphService::authorize_client_write);
         _accel_gY.setWriteAuthorizationCallback(this, &GyroAndPeriphService::authorize_client_write);
         _accel_gZ.setWriteAuthorizationCallback(this, &GyroAndPeriphService::authorize_client_write);
+        _stream_format_char.setWriteAuthorizationCallback(this, &GyroAndPeriphService::authorize_client_write);
+        _stream_rate_char.setWriteAuthorizationCallback(this, &GyroAndPeriphService::authorize_client_write);
+        _stream_rate_char.setReadAuthorizationCallback(this, &GyroAndPeriphService::authorize_client_read);
+        _log_level_char.setWriteAuthorizationCallback(this, &GyroAndPeriphService::authorize_client_write);
+        _trace_char.setWriteAuthorizationCallback(this, &GyroAndPeriphService::authorize_client_write);
+
+        _metrics_characteristics[0] = &_metrics_char;
+        _metrics_characteristics[1] = &_link_char;
+        _metrics_char.setReadAuthorizationCallback(this, &GyroAndPeriphService::authorize_metrics_read);
+        _link_char.setReadAuthorizationCallback(this, &GyroAndPeriphService::authorize_client_read);
     }
     void start(BLE &, events::EventQueue &);
+    void onConnect(BLE &, events::EventQueue &, const ble::ConnectionCompleteEvent &);
+    void onDisconnect(BLE &, events::EventQueue &, const ble::DisconnectionCompleteEvent &);
+    void onLinkUpdate(BLE &, events::EventQueue &, const LinkState &);
 
 private:
     void onDataSent(const GattDataSentCallbackParams &) override;
@@ -50,8 +142,28 @@ private:
     void onConfirmationReceived(const GattConfirmationReceivedCallbackParams &) override;
 
 private:
+    /* LOG calls of the service are compiled in from this level on */
+    static constexpr uint8_t logModuleLevel = LOG_LEVEL_APP;
+
     void authorize_client_write(GattWriteAuthCallbackParams *);
+    void authorize_client_read(GattReadAuthCallbackParams *);
+    void authorize_metrics_read(GattReadAuthCallbackParams *);
+    void onMpuDataReady(void);
+    void acquireSamples(void);
+    void onSensorAcquired(uint8_t, int);
+    void onSamplesAcquired(void);
     void updateGyroCharacteristics(void);
+    bool publishGyroStream(void);
+    void publishAttitude(void);
+    uint8_t streamCapacity(void);
+    void storeCalibration(void);
+    void saveCalibration(void);
+    void updateSubscriptions(void);
+    void startSampling(void);
+    void onMpuAwake(void);
+    void stopSampling(void);
+    void reportTrace(void);
+    void refreshTrace(void);
 
 private:
     /**
@@ -118,6 +230,9 @@ private:
     /**
      * @class Read-only Characteristic declaration helper.
      *
+     * Clients cannot write the value but can read it or subscribe to notifications or
+     * indications through its CCCD, which the stack adds for these properties.
+     *
      * @tparam T type of data held by the characteristic.
      */
     template <typename T>
@@ -125,7 +240,7 @@ private:
     {
     public:
         /**
-         * Construct a characteristic that can be read.
+         * Construct a characteristic that can be read and subscribed to.
          *
          * @param[in] uuid The UUID of the characteristic.
          * @param[in] initial_value Initial value contained by the characteristic.
@@ -135,7 +250,9 @@ private:
                                                                                     /* Initial value */ &_value,
                                                                                     /* Value size */ sizeof(_value),
                                                                                     /* Value capacity */ sizeof(_value),
-                                                                                    /* Properties */ GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ,
+                                                                                    /* Properties */ GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ |
+                                                                                        GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY |
+                                                                                        GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE,
                                                                                     /* Descriptors */ nullptr,
                                                                                     /* Num descriptors */ 0,
                                                                                     /* variable len */ false),
@@ -175,16 +292,326 @@ private:
         uint8_t _value;
     };
 
+private:
+    /**
+     * @class Notify-only variable length characteristic declaration helper.
+     *
+     * @tparam Capacity maximum value length in bytes.
+     */
+    template <uint16_t Capacity>
+    class NotifyStreamCharacteristic : public GattCharacteristic
+    {
+    public:
+        /**
+         * Construct an empty characteristic that can be subscribed to.
+         *
+         * @param[in] uuid The UUID of the characteristic.
+         */
+        NotifyStreamCharacteristic(const UUID &uuid) : GattCharacteristic(
+                                                           /* UUID */ uuid,
+                                                           /* Initial value */ _value,
+                                                           /* Value size */ 0,
+                                                           /* Value capacity */ Capacity,
+                                                           /* Properties */ GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY,
+                                                           /* Descriptors */ nullptr,
+                                                           /* Num descriptors */ 0,
+                                                           /* variable len */ true)
+        {
+        }
+
+        /**
+         * Assign a new value and notify it to subscribed clients.
+         *
+         * @param[in] server GattServer instance that will receive the new value.
+         * @param[in] value The new value.
+         * @param[in] length Length of the value, at most Capacity.
+         */
+        ble_error_t set(GattServer &server, const uint8_t *value, uint16_t length) const
+        {
+            return server.write(getValueHandle(), value, length);
+        }
+
+    private:
+        uint8_t _value[Capacity];
+    };
+
+private:
+    /**
+     * @class Read-write Characteristic declaration helper.
+     *
+     * @tparam T type of data held by the characteristic.
+     */
+    template <typename T>
+    class ReadWriteCharacteristic : public GattCharacteristic
+    {
+    public:
+        /**
+         * Construct a characteristic that can be read and written by clients.
+         *
+         * @param[in] uuid The UUID of the characteristic.
+         * @param[in] initial_value Initial value contained by the characteristic.
+         */
+        ReadWriteCharacteristic(const UUID &uuid, const T &initial_value) : GattCharacteristic(
+                                                                                /* UUID */ uuid,
+                                                                                /* Initial value */ &_value,
+                                                                                /* Value size */ sizeof(_value),
+                                                                                /* Value capacity */ sizeof(_value),
+                                                                                /* Properties */ GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ |
+                                                                                    GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE,
+                                                                                /* Descriptors */ nullptr,
+                                                                                /* Num descriptors */ 0,
+                                                                                /* variable len */ false),
+                                                                            _value(initial_value)
+        {
+        }
+
+    private:
+        T _value;
+    };
+
+private:
+    /**
+     * @class Read-write variable length characteristic declaration helper.
+     *
+     * Clients write a short request and read back a longer value the application puts together.
+     *
+     * @tparam Capacity maximum value length in bytes.
+     */
+    template <uint16_t Capacity>
+    class ReadWriteBlobCharacteristic : public GattCharacteristic
+    {
+    public:
+        /**
+         * Construct an empty characteristic that can be read and written by clients.
+         *
+         * @param[in] uuid The UUID of the characteristic.
+         */
+        ReadWriteBlobCharacteristic(const UUID &uuid) : GattCharacteristic(
+                                                            /* UUID */ uuid,
+                                                            /* Initial value */ _value,
+                                                            /* Value size */ 0,
+                                                            /* Value capacity */ Capacity,
+                                                            /* Properties */ GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ |
+                                                                GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE,
+                                                            /* Descriptors */ nullptr,
+                                                            /* Num descriptors */ 0,
+                                                            /* variable len */ true)
+        {
+        }
+
+    private:
+        uint8_t _value[Capacity];
+    };
+
+private:
+    /**
+     * @class Read-only variable length characteristic declaration helper.
+     *
+     * The application fills the value in, typically from a read authorization callback.
+     *
+     * @tparam Capacity maximum value length in bytes.
+     */
+    template <uint16_t Capacity>
+    class ReadOnlyBlobCharacteristic : public GattCharacteristic
+    {
+    public:
+        /**
+         * Construct an empty characteristic that can be read by clients.
+         *
+         * @param[in] uuid The UUID of the characteristic.
+         */
+        ReadOnlyBlobCharacteristic(const UUID &uuid) : GattCharacteristic(
+                                                           /* UUID */ uuid,
+                                                           /* Initial value */ _value,
+                                                           /* Value size */ 0,
+                                                           /* Value capacity */ Capacity,
+                                                           /* Properties */ GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ,
+                                                           /* Descriptors */ nullptr,
+                                                           /* Num descriptors */ 0,
+                                                           /* variable len */ true)
+        {
+        }
+
+    private:
+        uint8_t _value[Capacity];
+    };
+
+private:
+    /**
+     * @class Read-only variable length characteristic with notifications declaration helper.
+     *
+     * Every value the application sets is notified to subscribed clients, and read by the others.
+     *
+     * @tparam Capacity maximum value length in bytes.
+     */
+    template <uint16_t Capacity>
+    class ReadNotifyBlobCharacteristic : public GattCharacteristic
+    {
+    public:
+        /**
+         * Construct an empty characteristic that can be read and subscribed to.
+         *
+         * @param[in] uuid The UUID of the characteristic.
+         */
+        ReadNotifyBlobCharacteristic(const UUID &uuid) : GattCharacteristic(
+                                                             /* UUID */ uuid,
+                                                             /* Initial value */ _value,
+                                                             /* Value size */ 0,
+                                                             /* Value capacity */ Capacity,
+                                                             /* Properties */ GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ |
+                                                                 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY,
+                                                             /* Descriptors */ nullptr,
+                                                             /* Num descriptors */ 0,
+                                                             /* variable len */ true)
+        {
+        }
+
+    private:
+        uint8_t _value[Capacity];
+    };
+
 private:
     GattServer *_server = nullptr;
     events::EventQueue *_event_queue = nullptr;
 
+    /* Set by the data-ready interrupt until the deferred acquisition runs */
+    volatile bool _drain_pending = false;
+
+    /* Time of the last data-ready interrupt */
+    volatile uint32_t _drdy_timestamp_us = 0;
+
+    /* Data-ready interrupts since the last acquisition was scheduled, saturated at MPU_FIFO_WATERMARK */
+    volatile uint8_t _drdy_count = 0;
+
+    /* Samples of the first sensor were popped since the last publish tick */
+    bool _fresh = false;
+
+    /* Sample ring drop count already reported */
+    uint32_t _reported_drops = 0;
+
+    /**
+     * State of one connected client.
+     */
+    struct ClientState
+    {
+        /* INVALID_CONNECTION_HANDLE while the slot is free */
+        ble::connection_handle_t handle = ble::INVALID_CONNECTION_HANDLE;
+
+        /* Time the connection was established */
+        uint64_t connected_ms = 0;
+
+        /* Parameters negotiated on the connection, the stream is sized for its ATT_MTU and data length */
+        LinkState link;
+
+        /* Bit i set while the client subscribed to _gyro_characteristics[i] */
+        uint16_t subscribed = 0;
+
+        /* Only every rate-th stream notification and attitude update go to the client */
+        uint8_t rate = 1;
+    };
+
+    /**
+     * @brief Slot of the client on <handle>, INVALID_CONNECTION_HANDLE for a free one
+     *
+     * @return Pointer to the slot, nullptr if there is none
+     */
+    ClientState *findClient(ble::connection_handle_t handle)
+    {
+        for (ClientState &client : _clients)
+        {
+            if (client.handle == handle)
+                return &client;
+        }
+        return nullptr;
+    }
+
+    ClientState _clients[BLE_MAX_CONNECTIONS];
+
+    /* Bit i set while _gyro_characteristics[i] has at least one subscriber on any connection */
+    uint16_t _subscribed = 0;
+
+    /* Publish ticks since sampling started, paces the attitude of clients with a stream rate */
+    uint32_t _publish_ticks = 0;
+
+    /* Bit i set when _gyro_characteristics[i] must be pushed regardless of GYRO_NOTIFY_DELTA */
+    uint16_t _force_push = 0;
+
+    /* Last values staged for _accel_gX/gY/gZ, written once per publish tick */
+    GattShadow<3, 1> _gyro_shadow;
+
+    /* True while the MPU6050 is awake, or waking up with the wake-up event pending, and the publish event is scheduled */
+    bool _sampling = false;
+    int _wake_event = 0;
+    int _publish_event = 0;
+
+    /* Sample format of the stream, GyroFormat, set by the client */
+    uint8_t _stream_format = GYRO_FORMAT_RAW16;
+
+    /**
+     * Stream state of one sensor.
+     */
+    struct StreamChannel
+    {
+        GattCharacteristic *characteristic = nullptr;
+
+        /* Index in _gyro_characteristics, i.e. subscription bit */
+        uint8_t index = 0;
+
+        /* Sequence number of the next stream notification */
+        uint16_t seq = 0;
+
+        /* Encoded notification not yet taken by every subscriber, retried on the next publish; 0 if none */
+        uint16_t len = 0;
+        uint8_t buf[GYRO_STREAM_MAX_PAYLOAD];
+
+        /* Bit i set while _clients[i] still has to take buf */
+        uint8_t pending = 0;
+
+        /* Samples in buf and the timestamp of the oldest one */
+        uint8_t count = 0;
+        uint32_t timestamp_us = 0;
+    };
+
+    StreamChannel _channels[MPU_SENSOR_COUNT];
+
+    /* Time of the newest sample fused into the attitude, 0 before the first one */
+    uint32_t _attitude_timestamp_us = 0;
+
+    /* The calibration in flash matches the running one as of this boot, and when it was last saved */
+    bool _calibration_stored = false;
+    /* calibrationRecord holds offsets not yet in flash, written when sampling stops */
+    bool _calibration_dirty = false;
+    uint64_t _calibration_saved_ms = 0;
+
     GattService _gyro_service;
-    GattCharacteristic *_gyro_characteristics[3];
+    GattCharacteristic *_gyro_characteristics[GYRO_CHARACTERISTIC_COUNT];
 
     ReadOnlyAccelCharacteristic<uint8_t> _accel_gX;
     ReadOnlyAccelCharacteristic<uint8_t> _accel_gY;
     ReadOnlyAccelCharacteristic<uint8_t> _accel_gZ;
+    NotifyStreamCharacteristic<GYRO_STREAM_MAX_PAYLOAD> _gyro_stream;
+    ReadWriteCharacteristic<uint8_t> _stream_format_char;
+    NotifyStreamCharacteristic<FUSION_QUATERNION_SIZE> _attitude_char;
+#if MPU_SENSOR_COUNT > 1
+    NotifyStreamCharacteristic<GYRO_STREAM_MAX_PAYLOAD> _gyro_stream_b;
+#endif
+    ReadWriteCharacteristic<uint8_t> _stream_rate_char;
+    ReadWriteCharacteristic<uint8_t> _log_level_char;
+    ReadWriteBlobCharacteristic<TRACE_SNAPSHOT_SIZE> _trace_char;
+
+    /* Tracepoint whose histogram the trace characteristic holds */
+    uint8_t _trace_point = TRACE_UPDATE_CHARACTERISTICS;
+
+    ReadOnlyBlobCharacteristic<METRICS_SNAPSHOT_SIZE> _metrics_char;
+    ReadNotifyBlobCharacteristic<LINK_STATE_SIZE> _link_char;
+    GattService _metrics_service;
+    GattCharacteristic *_metrics_characteristics[2];
+
+    /* Snapshot handed to the stack by the last metrics read */
+    uint8_t _metrics_value[METRICS_SNAPSHOT_SIZE];
+
+    /* Link parameters handed to the stack by the last link read */
+    uint8_t _link_value[LINK_STATE_SIZE];
 };
 
 void ApplicationStart(void);
@@ -0,0 +1,202 @@
+#pragma once
+
+#ifndef __CAL_STORE_H__
+#define __CAL_STORE_H__
+
+/**
+ * @file calstore.h
+ *
+ * @brief Persistent MPU6050 calibration record in flash.
+ *
+ * One record per device at the start of a block device (on the target the
+ * last page of the internal flash through FlashIAPBlockDevice): magic,
+ * layout version and length, the sensor configuration the values belong to,
+ * then gyro offset register values, accelerometer bias and the die
+ * temperature at capture of every sensor, closed by a CRC-32 over all of it.
+ *
+ * A record that does not check out is treated as missing. Rewriting erases
+ * the page first, so a power loss during save leaves no valid record and the
+ * next boot calibrates again. The page erase halts the CPU for about 85 ms on
+ * the nRF52, so saves are rare: once after a calibration and then when the
+ * tracked offsets moved, at most every MPU_CAL_SAVE_PERIOD_MS, and never
+ * while the sensors stream into their FIFOs.
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "blockdevice/BlockDevice.h"
+
+/* Record layout version, bump on any change of CalibrationRecord */
+#define MPU_CAL_RECORD_VERSION 1
+
+#define MPU_CAL_RECORD_MAGIC 0x4C41434Du /* "MCAL" */
+
+/* Sensors one record holds */
+#define MPU_CAL_MAX_SENSORS 2
+
+/* Largest die temperature change a stored calibration is good for, in degrees C */
+#ifndef MPU_CAL_MAX_TEMP_DELTA_C
+#define MPU_CAL_MAX_TEMP_DELTA_C 15.0f
+#endif
+
+/* Shortest interval between two saves of tracked offsets */
+#ifndef MPU_CAL_SAVE_PERIOD_MS
+#define MPU_CAL_SAVE_PERIOD_MS 600000
+#endif
+
+/**
+ * Calibration of one sensor.
+ */
+struct SensorCalibration
+{
+    /* XG_OFFS_USR, YG_OFFS_USR, ZG_OFFS_USR */
+    int16_t gyro_offsets[3];
+    int16_t reserved;
+
+    /* Accelerometer bias in raw counts, gravity excluded */
+    float accel_bias[3];
+
+    /* Die temperature at capture */
+    float temperature_c;
+};
+
+/**
+ * Stored record, little endian as laid out in memory.
+ */
+struct CalibrationRecord
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;
+
+    /* Configuration the values are in: gyro and accelerometer full scale, number of sensors */
+    uint8_t gyro_scale;
+    uint8_t accel_scale;
+    uint8_t sensors;
+    uint8_t reserved;
+
+    /* Incremented on every save */
+    uint32_t sequence;
+
+    SensorCalibration sensor[MPU_CAL_MAX_SENSORS];
+
+    uint32_t crc;
+};
+
+/**
+ * @brief CRC-32 (IEEE 802.3, reflected), bitwise; the record is read once per boot
+ *
+ * @return CRC of <length> bytes at <data>
+ */
+inline uint32_t calibrationCrc32(const uint8_t *data, uint32_t length)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+
+    while (length--)
+    {
+        crc ^= *data++;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+    return ~crc;
+}
+
+/**
+ * @brief Stored calibration of a sensor is still good at <temperature_c>
+ *
+ * @return true if the values can be loaded instead of calibrating
+ */
+inline bool calibrationFresh(const SensorCalibration &calibration, float temperature_c)
+{
+    return fabsf(temperature_c - calibration.temperature_c) <= MPU_CAL_MAX_TEMP_DELTA_C;
+}
+
+/**
+ * @class CalibrationStore
+ *
+ * @brief Load and save the CalibrationRecord on a block device
+ */
+class CalibrationStore
+{
+public:
+    explicit CalibrationStore(mbed::BlockDevice &device) : _device(device)
+    {
+    }
+
+    /**
+     * @brief Read and check the stored record
+     *
+     * @param record     Destination, also on failure
+     * @param gyro_scale Gyro full scale the caller runs at
+     * @param accel_scale Accelerometer full scale the caller runs at
+     * @param sensors    Number of sensors the caller runs
+     *
+     * @return true if a valid record for this configuration was found
+     */
+    bool load(CalibrationRecord &record, uint8_t gyro_scale, uint8_t accel_scale, uint8_t sensors)
+    {
+        if (!ready() || _device.read(&record, 0, sizeof(record)) != mbed::BD_ERROR_OK)
+            return false;
+
+        if (record.magic != MPU_CAL_RECORD_MAGIC || record.version != MPU_CAL_RECORD_VERSION ||
+            record.length != sizeof(record) || record.crc != crc(record))
+            return false;
+
+        _sequence = record.sequence;
+        return record.gyro_scale == gyro_scale && record.accel_scale == accel_scale && record.sensors == sensors;
+    }
+
+    /**
+     * @brief Erase the record page and program <record>
+     *
+     * Fills in magic, version, length, sequence and CRC. Blocks for the erase and programming time.
+     *
+     * @return true if the record was written
+     */
+    bool save(CalibrationRecord &record)
+    {
+        uint8_t buffer[(sizeof(CalibrationRecord) + 15) & ~15u];
+        mbed::bd_size_t program_size = ready() ? _device.get_program_size() : 0;
+        mbed::bd_size_t length = (sizeof(record) + program_size - 1) / (program_size ? program_size : 1) * program_size;
+
+        if (!program_size || length > sizeof(buffer))
+            return false;
+
+        record.magic = MPU_CAL_RECORD_MAGIC;
+        record.version = MPU_CAL_RECORD_VERSION;
+        record.length = sizeof(record);
+        record.sequence = ++_sequence;
+        record.crc = crc(record);
+
+        memset(buffer, 0xFF, sizeof(buffer));
+        memcpy(buffer, &record, sizeof(record));
+
+        return _device.erase(0, _device.get_erase_size(0)) == mbed::BD_ERROR_OK &&
+               _device.program(buffer, 0, length) == mbed::BD_ERROR_OK;
+    }
+
+    /** Sequence number of the newest record loaded or saved */
+    uint32_t sequence() const { return _sequence; }
+
+private:
+    static uint32_t crc(const CalibrationRecord &record)
+    {
+        return calibrationCrc32((const uint8_t *)&record, offsetof(CalibrationRecord, crc));
+    }
+
+    bool ready()
+    {
+        if (!_initialized)
+            _initialized = _device.init() == mbed::BD_ERROR_OK;
+        return _initialized;
+    }
+
+    mbed::BlockDevice &_device;
+    bool _initialized = false;
+    uint32_t _sequence = 0;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#ifndef __DMP_IMAGE_H__
+#define __DMP_IMAGE_H__
+
+/**
+ * @file dmpimage.h
+ *
+ * @brief DMP firmware image used with MPU_USE_DMP.
+ *
+ * The motion firmware of the MPU6050 Digital Motion Processor is InvenSense
+ * property and is not distributed with this repository. Builds with
+ * MPU_USE_DMP link it from the integrator's own copy, a translation unit
+ * defining mpuDmpImage and mpuDmpImageSize from the MotionApps 2.0 image
+ * (dmpMemory[] of the MotionApps sources, 42-byte quaternion/gyro/accel FIFO
+ * packets). The host simulation has a stand-in image instead, which the
+ * simulated DMP accepts.
+ */
+
+#include <stdint.h>
+
+#ifdef HOST_SIM
+
+#include "sim_dmp.h"
+
+#define MPU_DMP_IMAGE sim::dmp_image()
+#define MPU_DMP_IMAGE_SIZE SIM_DMP_IMAGE_SIZE
+#define MPU_DMP_START_ADDRESS SIM_DMP_START_ADDRESS
+
+#else
+
+extern const uint8_t mpuDmpImage[];
+extern const uint16_t mpuDmpImageSize;
+
+#define MPU_DMP_IMAGE mpuDmpImage
+#define MPU_DMP_IMAGE_SIZE mpuDmpImageSize
+
+/* Program start address of the MotionApps 2.0 image */
+#define MPU_DMP_START_ADDRESS 0x0400
+
+#endif
+
+#endif
@@ -0,0 +1,395 @@
+#pragma once
+
+#ifndef __FUSION_H__
+#define __FUSION_H__
+
+/**
+ * @file fusion.h
+ *
+ * @brief Gyro and accelerometer fusion into an attitude quaternion.
+ *
+ * Two single-precision filters with the same interface, fed with raw sensor
+ * counts at the full sample rate:
+ *
+ *   MadgwickFilter  gradient descent step towards gravity, gain beta
+ *   MahonyFilter    PI feedback of the gravity error, the integral term
+ *                   tracks the gyro bias left after calibration
+ *
+ * Everything is float with no double promotion, so on the Cortex-M4F each
+ * operation is one FPU instruction; an update needs one square root per
+ * normalization and no trigonometry. The gyro scale (rad/s per count, halved
+ * for the quaternion derivative) is folded into one constant, and the
+ * accelerometer is only used as a direction, so its counts are never scaled.
+ *
+ * The quaternion rotates body coordinates into the earth frame, Z up. Without
+ * a magnetometer heading is not observed and drifts with the gyro bias.
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+/* Filters, for selecting one with FUSION_ALGORITHM */
+#define FUSION_MADGWICK 0
+#define FUSION_MAHONY 1
+
+/* Madgwick gain, rad/s of gyro error corrected towards gravity */
+#ifndef FUSION_MADGWICK_BETA
+#define FUSION_MADGWICK_BETA 0.04f
+#endif
+
+/* Mahony proportional and integral gains, rad/s of correction per unit of gravity error */
+#ifndef FUSION_MAHONY_KP
+#define FUSION_MAHONY_KP 0.5f
+#endif
+
+#ifndef FUSION_MAHONY_KI
+#define FUSION_MAHONY_KI 0.05f
+#endif
+
+#define FUSION_DEG_TO_RAD 0.0174532925f
+
+/* Encoded quaternion: uint32 timestamp in us, then w, x, y, z as int16 Q14 */
+#define FUSION_QUATERNION_SIZE 12
+#define FUSION_QUATERNION_ONE 16384
+
+/**
+ * Attitude quaternion, body to earth frame.
+ */
+struct Quaternion
+{
+    float w = 1.0f;
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+};
+
+/**
+ * @brief Quaternion from w, x, y, z in Q30, the DMP output format
+ */
+inline Quaternion fusionFromQ30(const int32_t q30[4])
+{
+    const float scale = 1.0f / 1073741824.0f;
+    Quaternion q;
+
+    q.w = (float)q30[0] * scale;
+    q.x = (float)q30[1] * scale;
+    q.y = (float)q30[2] * scale;
+    q.z = (float)q30[3] * scale;
+    return q;
+}
+
+/**
+ * @brief Scale <q> to unit length
+ *
+ * @return None
+ */
+inline void fusionNormalize(Quaternion &q)
+{
+    float recip = 1.0f / sqrtf(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+
+    q.w *= recip;
+    q.x *= recip;
+    q.y *= recip;
+    q.z *= recip;
+}
+
+/**
+ * @brief Attitude with zero heading whose gravity matches accelerometer reading <a>
+ *
+ * Shortest rotation taking <a> onto the earth Z axis.
+ *
+ * @return Unit quaternion
+ */
+inline Quaternion fusionFromGravity(const float a[3])
+{
+    Quaternion q;
+    float recip = 1.0f / sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    float ax = a[0] * recip, ay = a[1] * recip, az = a[2] * recip;
+
+    if (az < -0.9999f)
+    {
+        /* Upside down, any horizontal axis will do */
+        q.w = 0.0f;
+        q.x = 1.0f;
+        return q;
+    }
+
+    q.w = 1.0f + az;
+    q.x = ay;
+    q.y = -ax;
+    q.z = 0.0f;
+    fusionNormalize(q);
+    return q;
+}
+
+/**
+ * @brief Encode <q> as FUSION_QUATERNION_SIZE bytes, little endian
+ *
+ * @param dst          Output buffer
+ * @param q            Attitude
+ * @param timestamp_us Time of the newest sample fused into <q>
+ *
+ * @return Number of bytes written
+ */
+inline uint16_t packQuaternion(uint8_t *dst, const Quaternion &q, uint32_t timestamp_us)
+{
+    const float components[4] = {q.w, q.x, q.y, q.z};
+
+    dst[0] = (uint8_t)timestamp_us;
+    dst[1] = (uint8_t)(timestamp_us >> 8);
+    dst[2] = (uint8_t)(timestamp_us >> 16);
+    dst[3] = (uint8_t)(timestamp_us >> 24);
+
+    for (int i = 0; i < 4; i++)
+    {
+        uint16_t value = (uint16_t)(int16_t)lrintf(components[i] * FUSION_QUATERNION_ONE);
+        dst[4 + 2 * i] = (uint8_t)value;
+        dst[5 + 2 * i] = (uint8_t)(value >> 8);
+    }
+    return FUSION_QUATERNION_SIZE;
+}
+
+/**
+ * @class FusionFilter
+ *
+ * @brief State and input conditioning shared by the filters
+ */
+class FusionFilter
+{
+public:
+    /**
+     * @param gyro_scale Gyro rad/s per raw count, e.g. MPU6050::gRes * FUSION_DEG_TO_RAD
+     */
+    explicit FusionFilter(float gyro_scale) : _half_gyro_scale(0.5f * gyro_scale)
+    {
+    }
+
+    /**
+     * @brief Set the offsets subtracted from the raw counts before fusion
+     *
+     * @param gyro  Gyro bias in counts, what the offset registers did not remove
+     * @param accel Accelerometer bias in counts, gravity excluded
+     *
+     * @return None
+     */
+    void setBias(const float gyro[3], const float accel[3])
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            _gyro_bias[axis] = gyro[axis];
+            _accel_bias[axis] = accel[axis];
+        }
+    }
+
+    /**
+     * @brief Forget the attitude; the next sample aligns it to gravity again
+     *
+     * @return None
+     */
+    void reset(void)
+    {
+        _q = Quaternion();
+        _aligned = false;
+    }
+
+    /** Current attitude */
+    const Quaternion &quaternion() const { return _q; }
+
+protected:
+    /**
+     * @brief Remove biases, scale the gyro to half rad/s and align on the first sample
+     *
+     * @param gyro_half Angular rate / 2 in rad/s
+     * @param accel     Accelerometer in counts, bias removed
+     *
+     * @return false if the sample was consumed by the initial alignment
+     */
+    bool condition(const int16_t gyro[3], const int16_t accel[3], float gyro_half[3], float a[3])
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            gyro_half[axis] = ((float)gyro[axis] - _gyro_bias[axis]) * _half_gyro_scale;
+            a[axis] = (float)accel[axis] - _accel_bias[axis];
+        }
+
+        if (!_aligned && (a[0] != 0.0f || a[1] != 0.0f || a[2] != 0.0f))
+        {
+            _q = fusionFromGravity(a);
+            _aligned = true;
+            return false;
+        }
+        return true;
+    }
+
+    Quaternion _q;
+    bool _aligned = false;
+
+    float _half_gyro_scale;
+    float _gyro_bias[3] = {0, 0, 0};
+    float _accel_bias[3] = {0, 0, 0};
+};
+
+/**
+ * @class MadgwickFilter
+ *
+ * @brief Madgwick's IMU filter, S. Madgwick 2010, "An efficient orientation filter for inertial
+ *        and inertial/magnetic sensor arrays"
+ */
+class MadgwickFilter : public FusionFilter
+{
+public:
+    explicit MadgwickFilter(float gyro_scale, float beta = FUSION_MADGWICK_BETA) : FusionFilter(gyro_scale), _beta(beta)
+    {
+    }
+
+    /**
+     * @brief Fuse one sample
+     *
+     * @param gyro  Raw gyro counts
+     * @param accel Raw accelerometer counts
+     * @param dt    Time since the previous sample, seconds
+     *
+     * @return None
+     */
+    void update(const int16_t gyro[3], const int16_t accel[3], float dt)
+    {
+        float g[3], a[3];
+
+        if (!condition(gyro, accel, g, a))
+            return;
+
+        float q0 = _q.w, q1 = _q.x, q2 = _q.y, q3 = _q.z;
+
+        /* Rate of change of the quaternion from the gyro */
+        float dq0 = -q1 * g[0] - q2 * g[1] - q3 * g[2];
+        float dq1 = q0 * g[0] + q2 * g[2] - q3 * g[1];
+        float dq2 = q0 * g[1] - q1 * g[2] + q3 * g[0];
+        float dq3 = q0 * g[2] + q1 * g[1] - q2 * g[0];
+
+        float norm = a[0] * a[0] + a[1] * a[1] + a[2] * a[2];
+
+        if (norm > 0.0f)
+        {
+            float recip = 1.0f / sqrtf(norm);
+            float ax = a[0] * recip, ay = a[1] * recip, az = a[2] * recip;
+
+            float _2q0 = 2.0f * q0, _2q1 = 2.0f * q1, _2q2 = 2.0f * q2, _2q3 = 2.0f * q3;
+            float _4q0 = 4.0f * q0, _4q1 = 4.0f * q1, _4q2 = 4.0f * q2;
+            float _8q1 = 8.0f * q1, _8q2 = 8.0f * q2;
+            float q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+
+            /* Gradient of the gravity error */
+            float s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+            float s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+            float s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+            float s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+
+            float s_norm = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+
+            if (s_norm > 0.0f)
+            {
+                float step = _beta / sqrtf(s_norm);
+
+                dq0 -= step * s0;
+                dq1 -= step * s1;
+                dq2 -= step * s2;
+                dq3 -= step * s3;
+            }
+        }
+
+        _q.w = q0 + dq0 * dt;
+        _q.x = q1 + dq1 * dt;
+        _q.y = q2 + dq2 * dt;
+        _q.z = q3 + dq3 * dt;
+        fusionNormalize(_q);
+    }
+
+private:
+    float _beta;
+};
+
+/**
+ * @class MahonyFilter
+ *
+ * @brief Mahony's complementary filter on SO(3), R. Mahony et al. 2008, "Nonlinear complementary
+ *        filters on the special orthogonal group"
+ */
+class MahonyFilter : public FusionFilter
+{
+public:
+    explicit MahonyFilter(float gyro_scale, float kp = FUSION_MAHONY_KP, float ki = FUSION_MAHONY_KI)
+        : FusionFilter(gyro_scale), _kp(kp), _ki(ki)
+    {
+    }
+
+    /**
+     * @brief Fuse one sample, see MadgwickFilter::update()
+     *
+     * @return None
+     */
+    void update(const int16_t gyro[3], const int16_t accel[3], float dt)
+    {
+        float g[3], a[3];
+
+        if (!condition(gyro, accel, g, a))
+            return;
+
+        float q0 = _q.w, q1 = _q.x, q2 = _q.y, q3 = _q.z;
+        float norm = a[0] * a[0] + a[1] * a[1] + a[2] * a[2];
+
+        if (norm > 0.0f)
+        {
+            float recip = 1.0f / sqrtf(norm);
+            float ax = a[0] * recip, ay = a[1] * recip, az = a[2] * recip;
+
+            /* Half the gravity direction the current attitude predicts */
+            float vx = q1 * q3 - q0 * q2;
+            float vy = q0 * q1 + q2 * q3;
+            float vz = q0 * q0 - 0.5f + q3 * q3;
+
+            /* Half the error, cross product of measured and predicted gravity */
+            float ex = ay * vz - az * vy;
+            float ey = az * vx - ax * vz;
+            float ez = ax * vy - ay * vx;
+
+            _integral[0] += _ki * ex * dt;
+            _integral[1] += _ki * ey * dt;
+            _integral[2] += _ki * ez * dt;
+
+            /* g is already halved, so are the feedback terms */
+            g[0] += _kp * ex + _integral[0];
+            g[1] += _kp * ey + _integral[1];
+            g[2] += _kp * ez + _integral[2];
+        }
+
+        g[0] *= dt;
+        g[1] *= dt;
+        g[2] *= dt;
+
+        _q.w = q0 - q1 * g[0] - q2 * g[1] - q3 * g[2];
+        _q.x = q1 + q0 * g[0] + q2 * g[2] - q3 * g[1];
+        _q.y = q2 + q0 * g[1] - q1 * g[2] + q3 * g[0];
+        _q.z = q3 + q0 * g[2] + q1 * g[1] - q2 * g[0];
+        fusionNormalize(_q);
+    }
+
+    /**
+     * @brief Forget the attitude and the integrated bias
+     *
+     * @return None
+     */
+    void reset(void)
+    {
+        FusionFilter::reset();
+        _integral[0] = _integral[1] = _integral[2] = 0.0f;
+    }
+
+private:
+    float _kp;
+    float _ki;
+
+    /* Integrated gravity error, half rad/s of gyro bias */
+    float _integral[3] = {0, 0, 0};
+};
+
+#endif
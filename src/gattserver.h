@@ -30,6 +30,8 @@
 /* Payload size */
 #define MAX_ADVERTISING_PAYLOAD_SIZE 50
 
+#include "linkprofile.h"
+#include "metrics.h"
 #include "syslogger.h"
 
 /**
@@ -37,9 +39,17 @@
  * 
  * @brief Inherit general handler of GAP-related events.
  * 
+ * Also handles the GATT client events, for the ATT MTU exchange, and steps every new link
+ * through the throughput profile (see linkprofile.h). Advertising goes on while fewer than
+ * BLE_MAX_CONNECTIONS centrals are connected.
+ * 
  */
-class BLEProcess : private mbed::NonCopyable<BLEProcess>, public ble::Gap::EventHandler
+class BLEProcess : private mbed::NonCopyable<BLEProcess>, public ble::Gap::EventHandler, public ble::GattClient::EventHandler
 {
+protected:
+    /* LOG calls of the BLE process are compiled in from this level on */
+    static constexpr uint8_t logModuleLevel = LOG_LEVEL_BLE;
+
 public:
     /**
      * @brief Construct a BLEProcess from an event queue and a ble interface.
@@ -47,8 +57,10 @@ public:
     BLEProcess(events::EventQueue &event_queue, BLE &ble_interface) : _event_queue(event_queue),
                                                                       _ble(ble_interface),
                                                                       _gap(ble_interface.gap()),
-                                                                      _adv_data_builder(_adv_buffer)
+                                                                      _adv_data_builder(_adv_buffer),
+                                                                      _link(ble_interface, event_queue)
     {
+        _link.onUpdate(mbed::callback(this, &BLEProcess::onLinkUpdate));
     }
 
     ~BLEProcess()
@@ -74,6 +86,7 @@ public:
         }
 
         _gap.setEventHandler(this);
+        _ble.gattClient().setEventHandler(this);
 
         _ble.onEventsToProcess(
             makeFunctionPointer(this, &BLEProcess::schedule_ble_events));
@@ -128,6 +141,30 @@ public:
         _post_connect_cb = cb;
     }
 
+    /**
+     * @brief Set callback for a disconnection.
+     *
+     * @param[in] cb The callback object that will be called when a peer disconnects
+     * 
+     * @return None
+     */
+    void on_disconnect(mbed::Callback<void(BLE &, events::EventQueue &, const ble::DisconnectionCompleteEvent &event)> cb)
+    {
+        _post_disconnect_cb = cb;
+    }
+
+    /**
+     * @brief Set callback for a change of the link parameters.
+     *
+     * @param[in] cb The callback object that will be called with the parameters negotiated so far
+     * 
+     * @return None
+     */
+    void on_link_update(mbed::Callback<void(BLE &, events::EventQueue &, const LinkState &state)> cb)
+    {
+        _post_link_cb = cb;
+    }
+
     virtual const char *get_device_name()
     {
         static const char name[] = "BLE-Process";
@@ -175,12 +212,19 @@ protected:
     {
         if (event.getStatus() == BLE_ERROR_NONE)
         {
-            LOGI("Connected to BLE device in nRF Connect\r\n");
+            _connections++;
+            LOGI("Connected to BLE device in nRF Connect, %u of %u connections\r\n", _connections, BLE_MAX_CONNECTIONS);
 
             if (_post_connect_cb)
             {
                 _post_connect_cb(_ble, _event_queue, event);
             }
+
+            _link.connected(event);
+
+            /* Keep accepting centrals while there are slots left */
+            if (_connections < BLE_MAX_CONNECTIONS)
+                start_activity();
         }
         else
         {
@@ -200,12 +244,59 @@ protected:
      */
     void onDisconnectionComplete(const ble::DisconnectionCompleteEvent &event) override
     {
-        LOGE("Disconnected\r\n");
+        if (_connections)
+            _connections--;
+        LOGE("Disconnected, %u connections left\r\n", _connections);
+
+        _link.disconnected(event.getConnectionHandle());
+
+        if (_post_disconnect_cb)
+        {
+            _post_disconnect_cb(_ble, _event_queue, event);
+        }
         start_activity();
     }
 
     /**
-     * @brief Restarts main activity
+     * @brief Link layer and ATT events of the link, recorded by the negotiator
+     *
+     * @return None
+     */
+    void onPhyUpdateComplete(ble_error_t status, ble::connection_handle_t connectionHandle, ble::phy_t txPhy, ble::phy_t rxPhy) override
+    {
+        _link.phyUpdated(status, connectionHandle, txPhy, rxPhy);
+    }
+
+    void onConnectionParametersUpdateComplete(const ble::ConnectionParametersUpdateCompleteEvent &event) override
+    {
+        _link.parametersUpdated(event);
+    }
+
+    void onDataLengthChange(ble::connection_handle_t connectionHandle, uint16_t txSize, uint16_t rxSize) override
+    {
+        _link.dataLengthChanged(connectionHandle, txSize, rxSize);
+    }
+
+    void onAttMtuChange(ble::connection_handle_t connectionHandle, uint16_t attMtuSize) override
+    {
+        _link.mtuChanged(connectionHandle, attMtuSize);
+    }
+
+    /**
+     * @brief Hand the link parameters to the application
+     *
+     * @return None
+     */
+    void onLinkUpdate(const LinkState &state)
+    {
+        if (_post_link_cb)
+        {
+            _post_link_cb(_ble, _event_queue, state);
+        }
+    }
+
+    /**
+     * @brief Restarts main activity, unless every connection slot is taken
      * 
      * @param event Advertising end complete event
      *
@@ -213,7 +304,8 @@ protected:
      */
     void onAdvertisingEnd(const ble::AdvertisingEndEvent &event)
     {
-        start_activity();
+        if (_connections < BLE_MAX_CONNECTIONS)
+            start_activity();
     }
 
     /**
@@ -238,7 +330,7 @@ protected:
     {
         ble_error_t error;
 
-        if (_gap.isAdvertisingActive(_adv_handle))
+        if (_gap.isAdvertisingActive(_adv_handle) || _connections >= BLE_MAX_CONNECTIONS)
             return;
 
         ble::AdvertisingParameters adv_params(
@@ -287,7 +379,23 @@ protected:
      */
     void schedule_ble_events(BLE::OnEventsToProcessCallbackContext *event)
     {
-        _event_queue.call(mbed::callback(&event->ble, &BLE::processEvents));
+        _ble_scheduled_ticks = trace_ticks();
+        metrics_event_posted();
+        _event_queue.call(mbed::callback(this, &BLEProcess::process_ble_events));
+    }
+
+    /**
+     * @brief Process events from the BLE middleware, timed from their scheduling on
+     *
+     * @return None
+     */
+    void process_ble_events()
+    {
+        metrics_event_run();
+        trace_record(TRACE_BLE_DISPATCH, trace_ticks() - _ble_scheduled_ticks);
+
+        TraceScope trace(TRACE_BLE_EVENTS);
+        _ble.processEvents();
     }
 
 protected:
@@ -300,13 +408,58 @@ protected:
 
     ble::advertising_handle_t _adv_handle = ble::LEGACY_ADVERTISING_HANDLE;
 
+    /* Tracepoint clock when the middleware last asked for processing */
+    volatile uint32_t _ble_scheduled_ticks = 0;
+
+    /* Centrals connected right now */
+    uint8_t _connections = 0;
+
+    LinkNegotiator _link;
+
     mbed::Callback<void(BLE &, events::EventQueue &)> _post_init_cb;
     mbed::Callback<void(BLE &, events::EventQueue &, const ble::ConnectionCompleteEvent &event)> _post_connect_cb;
+    mbed::Callback<void(BLE &, events::EventQueue &, const ble::DisconnectionCompleteEvent &event)> _post_disconnect_cb;
+    mbed::Callback<void(BLE &, events::EventQueue &, const LinkState &state)> _post_link_cb;
 };
 
 using mbed::callback;
 using namespace std::literals::chrono_literals;
 
+/**
+ * @brief GattServer::write() of a characteristic value, timed as TRACE_GATT_WRITE
+ *
+ * Counted as METRIC_NOTIFICATIONS_QUEUED when the stack takes it; callers only write subscribed values.
+ *
+ * @return BLE_ERROR_NONE in case of success or an appropriate error code.
+ */
+inline ble_error_t tracedWrite(GattServer &server, GattAttribute::Handle_t handle, const uint8_t *value, uint16_t length)
+{
+    TraceScope trace(TRACE_GATT_WRITE);
+    ble_error_t err = server.write(handle, value, length);
+
+    if (!err)
+        metrics_add(METRIC_NOTIFICATIONS_QUEUED);
+    return err;
+}
+
+/**
+ * @brief GattServer::write() of a characteristic value to the one link <connection>, timed as TRACE_GATT_WRITE
+ *
+ * Counted as METRIC_NOTIFICATIONS_QUEUED when the stack takes it; callers only write values the link subscribed to.
+ *
+ * @return BLE_ERROR_NONE in case of success or an appropriate error code.
+ */
+inline ble_error_t tracedWrite(GattServer &server, ble::connection_handle_t connection, GattAttribute::Handle_t handle,
+                               const uint8_t *value, uint16_t length)
+{
+    TraceScope trace(TRACE_GATT_WRITE);
+    ble_error_t err = server.write(connection, handle, value, length);
+
+    if (!err)
+        metrics_add(METRIC_NOTIFICATIONS_QUEUED);
+    return err;
+}
+
 /**
  * @class GattServerProcess 
  * 
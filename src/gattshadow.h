@@ -0,0 +1,149 @@
+#pragma once
+
+#ifndef __GATT_SHADOW_H__
+#define __GATT_SHADOW_H__
+
+/**
+ * @file gattshadow.h
+ *
+ * @brief Local shadow of characteristic values with dirty tracking.
+ *
+ * The application stages new values into the shadow as often as it likes; a
+ * value equal to the one already held costs a memcmp and nothing else. All
+ * entries that changed are written to the GattServer in one flush() pass, so
+ * the stack sees at most one write per characteristic and tick, and none for
+ * characteristics that did not change.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "gattserver.h"
+
+/**
+ * @class GattShadow
+ *
+ * @tparam Entries   Number of shadowed characteristics
+ * @tparam MaxLength Largest value length of any of them
+ */
+template <uint8_t Entries, uint16_t MaxLength>
+class GattShadow
+{
+public:
+    /**
+     * @brief Shadow <characteristic> in entry <index>, starting from its initial value
+     *
+     * @return None
+     */
+    void bind(uint8_t index, GattCharacteristic *characteristic)
+    {
+        Entry &entry = _entries[index];
+        GattAttribute &attribute = characteristic->getValueAttribute();
+
+        entry.characteristic = characteristic;
+        entry.length = attribute.getLength() < MaxLength ? attribute.getLength() : MaxLength;
+        memcpy(entry.value, attribute.getValuePtr(), entry.length);
+        entry.dirty = false;
+    }
+
+    /**
+     * @brief Stage a new value for entry <index>
+     *
+     * @param force Mark the entry dirty even if the value did not change, e.g. for a new subscriber
+     *
+     * @return true if the entry is dirty and will be written by the next flush()
+     */
+    bool update(uint8_t index, const void *value, uint16_t length, bool force = false)
+    {
+        Entry &entry = _entries[index];
+
+        if (length > MaxLength)
+            length = MaxLength;
+
+        if (!force && !entry.dirty && length == entry.length && memcmp(entry.value, value, length) == 0)
+        {
+            _skipped++;
+            return false;
+        }
+
+        memcpy(entry.value, value, length);
+        entry.length = length;
+        entry.dirty = true;
+        return true;
+    }
+
+    /**
+     * @brief Leave entry <index> untouched this tick, counted as a skipped write
+     *
+     * For callers that filter values themselves (e.g. by a delta threshold).
+     *
+     * @return None
+     */
+    void skip(uint8_t index)
+    {
+        (void)index;
+        _skipped++;
+    }
+
+    /**
+     * @brief Write every dirty entry to the server
+     *
+     * Entries the stack refuses stay dirty and are retried by the next flush().
+     *
+     * @return Number of failed writes, 0 on success
+     */
+    uint8_t flush(GattServer &server)
+    {
+        uint8_t failures = 0;
+
+        for (uint8_t i = 0; i < Entries; i++)
+        {
+            Entry &entry = _entries[i];
+
+            if (!entry.dirty || !entry.characteristic)
+                continue;
+
+            if (tracedWrite(server, entry.characteristic->getValueHandle(), entry.value, entry.length))
+            {
+                _failed++;
+                failures++;
+                continue;
+            }
+
+            entry.dirty = false;
+            _performed++;
+        }
+
+        return failures;
+    }
+
+    /** Last staged value of entry <index> */
+    const uint8_t *value(uint8_t index) const { return _entries[index].value; }
+
+    bool isDirty(uint8_t index) const { return _entries[index].dirty; }
+
+    /** Writes avoided because the value did not change (or was filtered by the caller) */
+    uint32_t skipped() const { return _skipped; }
+
+    /** Writes passed to the GattServer successfully */
+    uint32_t performed() const { return _performed; }
+
+    /** Writes refused by the GattServer, retried later */
+    uint32_t failed() const { return _failed; }
+
+private:
+    struct Entry
+    {
+        GattCharacteristic *characteristic = nullptr;
+        uint16_t length = 0;
+        bool dirty = false;
+        uint8_t value[MaxLength];
+    };
+
+    Entry _entries[Entries];
+    uint32_t _skipped = 0;
+    uint32_t _performed = 0;
+    uint32_t _failed = 0;
+};
+
+#endif
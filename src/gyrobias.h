@@ -0,0 +1,250 @@
+#pragma once
+
+#ifndef __GYRO_BIAS_H__
+#define __GYRO_BIAS_H__
+
+/**
+ * @file gyrobias.h
+ *
+ * @brief Online gyro bias tracking from the live sample stream.
+ *
+ * The tracker cuts the stream of one sensor into windows of MPU_BIAS_WINDOW
+ * samples and keeps per-axis sums and sums of squares of gyro and
+ * accelerometer counts. A window is stationary when the spread of every
+ * axis stays below the sensor noise thresholds and the mean rate is within
+ * the range a bias can have; its gyro mean is then what the offset
+ * registers do not remove yet. The residual bias is a running mean of the
+ * stationary windows, an exponential average over the last
+ * MPU_BIAS_AVERAGE_WINDOWS once that many were seen.
+ *
+ * Once the residual reaches half an offset register count (4 raw counts of
+ * the +-250 dps scale) the new XG_OFFS_USR values are handed out for writing,
+ * and samples already queued with the old offsets are skipped. The part that
+ * does not fit the register resolution stays in residual() for the fusion
+ * filter.
+ *
+ * A rotation at constant rate about the gravity axis is indistinguishable
+ * from bias without a magnetometer; MPU_BIAS_MAX_DPS bounds what is taken
+ * for one.
+ *
+ * The accelerometer bias cannot be told from tilt. Unless set, it is taken
+ * once from the first stationary window, under the assumption the blocking
+ * calibration made: the device rests level after power-up, Z axis vertical.
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+/* Samples per stationarity window, also skipped after new offsets are handed out */
+#ifndef MPU_BIAS_WINDOW
+#define MPU_BIAS_WINDOW 128
+#endif
+
+/* Stationary windows averaged into the residual bias */
+#ifndef MPU_BIAS_AVERAGE_WINDOWS
+#define MPU_BIAS_AVERAGE_WINDOWS 8
+#endif
+
+/* Largest standard deviation of a window that is still stationary, gyro in dps and accelerometer in g */
+#ifndef MPU_BIAS_GYRO_STD_DPS
+#define MPU_BIAS_GYRO_STD_DPS 0.25f
+#endif
+
+#ifndef MPU_BIAS_ACCEL_STD_G
+#define MPU_BIAS_ACCEL_STD_G 0.02f
+#endif
+
+/* Largest mean rate taken for bias, the zero-rate offset of the MPU6050 is specified within +-20 dps */
+#ifndef MPU_BIAS_MAX_DPS
+#define MPU_BIAS_MAX_DPS 20.0f
+#endif
+
+/**
+ * @class GyroBiasTracker
+ *
+ * @tparam GyroScale  Gyro full scale of the stream, GFS_250DPS..GFS_2000DPS
+ * @tparam AccelScale Accelerometer full scale of the stream, AFS_2G..AFS_16G
+ */
+template <uint8_t GyroScale, uint8_t AccelScale>
+class GyroBiasTracker
+{
+public:
+    /**
+     * @brief Feed one sample
+     *
+     * @param gyro  Raw gyro counts, offset registers applied
+     * @param accel Raw accelerometer counts
+     *
+     * @return true if offsets() changed and should be written to the sensor
+     */
+    bool update(const int16_t gyro[3], const int16_t accel[3])
+    {
+        if (_skip)
+        {
+            _skip--;
+            return false;
+        }
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            _gyro_sum[axis] += gyro[axis];
+            _gyro_sum_sq[axis] += (int32_t)gyro[axis] * gyro[axis];
+            _accel_sum[axis] += accel[axis];
+            _accel_sum_sq[axis] += (int32_t)accel[axis] * accel[axis];
+        }
+
+        if (++_count < MPU_BIAS_WINDOW)
+            return false;
+
+        return closeWindow();
+    }
+
+    /**
+     * @brief Drop the window in progress, e.g. after a gap in the stream
+     *
+     * @return None
+     */
+    void restart(void)
+    {
+        clearWindow();
+        _skip = 0;
+    }
+
+    /**
+     * @brief Accelerometer bias known from elsewhere, e.g. MPU6050::calibrate(), in raw counts
+     *
+     * @return None
+     */
+    void setAccelBias(const float accel[3])
+    {
+        for (int axis = 0; axis < 3; axis++)
+            _accel_bias[axis] = accel[axis];
+        _accel_known = true;
+    }
+
+    /**
+     * @brief Offsets the sensor holds, e.g. after MPU6050::calibrate(), and the bias they leave if known
+     *
+     * @return None
+     */
+    void setOffsets(const int16_t offsets[3], const float residual[3] = nullptr)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            _offsets[axis] = offsets[axis];
+            _residual[axis] = residual ? residual[axis] : 0.0f;
+        }
+    }
+
+    /** XG_OFFS_USR, YG_OFFS_USR, ZG_OFFS_USR values to write */
+    const int16_t *offsets() const { return _offsets; }
+
+    /** Bias the offsets leave in the stream, in raw counts */
+    const float *residual() const { return _residual; }
+
+    /** Accelerometer bias in raw counts, gravity excluded; zero until known */
+    const float *accelBias() const { return _accel_bias; }
+
+    /** Stationary windows seen so far */
+    uint32_t stationaryWindows() const { return _windows; }
+
+    /** Offset updates handed out so far */
+    uint32_t offsetUpdates() const { return _updates; }
+
+private:
+    /* Raw counts per dps and per g of the stream */
+    static float gyroCountsPerDps() { return 131.072f / (float)(1 << GyroScale); }
+    static float accelCountsPerG() { return 16384.0f / (float)(1 << AccelScale); }
+
+    /* Raw counts per offset register count: 4 counts at +-250 dps */
+    static float countsPerOffset() { return 4.0f / (float)(1 << GyroScale); }
+
+    /** Variance of one axis of the window, in counts squared */
+    static float variance(int32_t sum, int64_t sum_sq)
+    {
+        return (float)(sum_sq - (int64_t)sum * sum / MPU_BIAS_WINDOW) / (float)MPU_BIAS_WINDOW;
+    }
+
+    void clearWindow(void)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            _gyro_sum[axis] = 0;
+            _gyro_sum_sq[axis] = 0;
+            _accel_sum[axis] = 0;
+            _accel_sum_sq[axis] = 0;
+        }
+        _count = 0;
+    }
+
+    bool closeWindow(void)
+    {
+        const float gyro_std = MPU_BIAS_GYRO_STD_DPS * gyroCountsPerDps();
+        const float accel_std = MPU_BIAS_ACCEL_STD_G * accelCountsPerG();
+        const float max_mean = MPU_BIAS_MAX_DPS * gyroCountsPerDps();
+        float mean[3], accel_mean[3];
+        bool stationary = true;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            mean[axis] = (float)_gyro_sum[axis] / (float)MPU_BIAS_WINDOW;
+            accel_mean[axis] = (float)_accel_sum[axis] / (float)MPU_BIAS_WINDOW;
+            stationary = stationary && fabsf(mean[axis]) <= max_mean &&
+                         variance(_gyro_sum[axis], _gyro_sum_sq[axis]) <= gyro_std * gyro_std &&
+                         variance(_accel_sum[axis], _accel_sum_sq[axis]) <= accel_std * accel_std;
+        }
+        clearWindow();
+
+        if (!stationary)
+            return false;
+
+        _windows++;
+        if (!_accel_known)
+        {
+            /* Level at rest: Z reads 1 g, up or down */
+            accel_mean[2] -= accel_mean[2] > 0.0f ? accelCountsPerG() : -accelCountsPerG();
+            setAccelBias(accel_mean);
+        }
+
+        float gain = 1.0f / (float)(_windows < MPU_BIAS_AVERAGE_WINDOWS ? _windows : MPU_BIAS_AVERAGE_WINDOWS);
+        bool changed = false;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            _residual[axis] += gain * (mean[axis] - _residual[axis]);
+
+            /* Offsets add to the output, so they move against the bias */
+            int32_t steps = (int32_t)lrintf(_residual[axis] / countsPerOffset());
+            if (steps == 0)
+                continue;
+
+            _offsets[axis] = (int16_t)(_offsets[axis] - steps);
+            _residual[axis] -= (float)steps * countsPerOffset();
+            changed = true;
+        }
+
+        if (changed)
+        {
+            /* Samples in the FIFO and the ring still carry the old offsets */
+            _skip = MPU_BIAS_WINDOW;
+            _updates++;
+        }
+        return changed;
+    }
+
+    int32_t _gyro_sum[3] = {0, 0, 0};
+    int64_t _gyro_sum_sq[3] = {0, 0, 0};
+    int32_t _accel_sum[3] = {0, 0, 0};
+    int64_t _accel_sum_sq[3] = {0, 0, 0};
+    uint32_t _count = 0;
+    uint32_t _skip = 0;
+
+    int16_t _offsets[3] = {0, 0, 0};
+    float _residual[3] = {0, 0, 0};
+    float _accel_bias[3] = {0, 0, 0};
+    bool _accel_known = false;
+    uint32_t _windows = 0;
+    uint32_t _updates = 0;
+};
+
+#endif
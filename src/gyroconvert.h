@@ -0,0 +1,159 @@
+#pragma once
+
+#ifndef __GYRO_CONVERT_H__
+#define __GYRO_CONVERT_H__
+
+/**
+ * @file gyroconvert.h
+ *
+ * @brief Fixed-point conversion of raw gyro counts, one batch at a time.
+ *
+ * A raw count is (250 << FS_SEL) / 32768 dps. The kernels scale with one
+ * integer multiply and shift per value (Q15 for the compact format, Q16 for
+ * milli-dps), saturate with conditional selects (SSAT on Cortex-M4) and write
+ * little endian output, so a whole notification is converted in a single loop
+ * without branches or divisions.
+ *
+ * Output formats, selectable per stream:
+ *
+ *   GYRO_FORMAT_RAW16     int16  raw counts, full resolution
+ *   GYRO_FORMAT_COMPACT8  int8   2 dps per count, saturated at +-254 dps
+ *   GYRO_FORMAT_MDPS32    int32  milli-degrees per second
+ */
+
+#include <stdint.h>
+
+enum GyroFormat
+{
+    GYRO_FORMAT_RAW16 = 0,
+    GYRO_FORMAT_COMPACT8,
+    GYRO_FORMAT_MDPS32,
+    GYRO_FORMAT_COUNT
+};
+
+/* Q15 gain of the compact format at +-250 dps: 250 / 32768 dps per count, 2 dps per compact count */
+#define GYRO_COMPACT8_Q15_250DPS 125
+
+/* Q16 gain of milli-dps at +-250 dps: 250000 / 32768 mdps per count */
+#define GYRO_MDPS_Q16_250DPS 500000
+
+/**
+ * @brief Encoded size of one gyro triple
+ *
+ * @return Bytes per sample in <format>
+ */
+inline uint8_t gyroFormatSampleSize(uint8_t format)
+{
+    return format == GYRO_FORMAT_COMPACT8 ? 3 : format == GYRO_FORMAT_MDPS32 ? 12 : 6;
+}
+
+/**
+ * @brief Convert one raw count to the compact format
+ *
+ * @param raw    Raw gyro count
+ * @param fs_sel Gyro full scale, GFS_250DPS..GFS_2000DPS
+ *
+ * @return Angular rate in units of 2 dps
+ */
+inline int8_t gyroCompact8(int16_t raw, int fs_sel)
+{
+    int32_t value = ((int32_t)raw * (GYRO_COMPACT8_Q15_250DPS << fs_sel) + (1 << 14)) >> 15;
+
+    value = value > INT8_MAX ? INT8_MAX : value;
+    value = value < INT8_MIN ? INT8_MIN : value;
+    return (int8_t)value;
+}
+
+/**
+ * @brief Convert one raw count to milli-degrees per second
+ *
+ * @return Angular rate in mdps, exact to +-0.5 mdps
+ */
+inline int32_t gyroMilliDps(int16_t raw, int fs_sel)
+{
+    return (int32_t)(((int64_t)raw * ((int32_t)GYRO_MDPS_Q16_250DPS << fs_sel) + (1 << 15)) >> 16);
+}
+
+/**
+ * @brief Batch kernel: raw counts to little endian int16
+ *
+ * @param raw   Input values
+ * @param dst   Output, 2 * <count> bytes
+ * @param count Number of values (3 per sample)
+ *
+ * @return Pointer past the last byte written
+ */
+inline uint8_t *gyroConvertRaw16(const int16_t *raw, uint8_t *dst, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint16_t value = (uint16_t)raw[i];
+        *dst++ = (uint8_t)value;
+        *dst++ = (uint8_t)(value >> 8);
+    }
+    return dst;
+}
+
+/**
+ * @brief Batch kernel: raw counts to compact int8, see gyroCompact8()
+ *
+ * @param dst Output, <count> bytes
+ *
+ * @return Pointer past the last byte written
+ */
+inline uint8_t *gyroConvertCompact8(const int16_t *raw, uint8_t *dst, uint32_t count, int fs_sel)
+{
+    const int32_t gain = GYRO_COMPACT8_Q15_250DPS << fs_sel;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        int32_t value = ((int32_t)raw[i] * gain + (1 << 14)) >> 15;
+
+        value = value > INT8_MAX ? INT8_MAX : value;
+        value = value < INT8_MIN ? INT8_MIN : value;
+        *dst++ = (uint8_t)value;
+    }
+    return dst;
+}
+
+/**
+ * @brief Batch kernel: raw counts to little endian int32 milli-dps, see gyroMilliDps()
+ *
+ * @param dst Output, 4 * <count> bytes
+ *
+ * @return Pointer past the last byte written
+ */
+inline uint8_t *gyroConvertMilliDps(const int16_t *raw, uint8_t *dst, uint32_t count, int fs_sel)
+{
+    const int64_t gain = (int64_t)GYRO_MDPS_Q16_250DPS << fs_sel;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t value = (uint32_t)(int32_t)(((int64_t)raw[i] * gain + (1 << 15)) >> 16);
+        *dst++ = (uint8_t)value;
+        *dst++ = (uint8_t)(value >> 8);
+        *dst++ = (uint8_t)(value >> 16);
+        *dst++ = (uint8_t)(value >> 24);
+    }
+    return dst;
+}
+
+/**
+ * @brief Convert <count> raw values to <format>
+ *
+ * @return Pointer past the last byte written
+ */
+inline uint8_t *gyroConvert(uint8_t format, const int16_t *raw, uint8_t *dst, uint32_t count, int fs_sel)
+{
+    switch (format)
+    {
+    case GYRO_FORMAT_COMPACT8:
+        return gyroConvertCompact8(raw, dst, count, fs_sel);
+    case GYRO_FORMAT_MDPS32:
+        return gyroConvertMilliDps(raw, dst, count, fs_sel);
+    default:
+        return gyroConvertRaw16(raw, dst, count);
+    }
+}
+
+#endif
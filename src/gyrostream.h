@@ -0,0 +1,136 @@
+#pragma once
+
+#ifndef __GYRO_STREAM_H__
+#define __GYRO_STREAM_H__
+
+/**
+ * @file gyrostream.h
+ *
+ * @brief Packing of gyro samples into batched GATT notifications.
+ *
+ * One notification carries as many samples as the negotiated ATT_MTU allows,
+ * behind a small header. All fields are little endian:
+ *
+ *   offset 0  uint16  sequence number, +1 per notification, wraps at 65536
+ *   offset 2  uint8   number of samples N
+ *   offset 3  uint8   sample format, GyroFormat
+ *   offset 4  N x { gx, gy, gz } in the sample format, oldest first
+ *
+ * The format is chosen by the client (see gyroconvert.h): raw int16 counts,
+ * compact int8 or int32 milli-dps.
+ *
+ * A gap in the sequence numbers tells the client how many notifications were
+ * lost, the sample spacing is the MPU6050 output period.
+ *
+ * A notification travels as one L2CAP packet (4 byte header, 3 byte ATT
+ * header, payload) split over link layer PDUs of the negotiated data length.
+ * Where the last PDU would only carry a few bytes, the notification is cut
+ * down to whole PDUs: with 27 byte PDUs and ATT_MTU 247, 38 raw samples in 9
+ * PDUs instead of 40 in 10.
+ */
+
+#include <stdint.h>
+
+#include "gyroconvert.h"
+
+/* Default ATT_MTU of a fresh connection */
+#define GYRO_STREAM_DEFAULT_MTU 23
+
+/* Link layer payload of a fresh connection, before the data length update */
+#define GYRO_STREAM_DEFAULT_DATA_LENGTH 27
+
+/* Largest link layer payload, with LE Data Length Extension */
+#define GYRO_STREAM_MAX_DATA_LENGTH 251
+
+/* L2CAP and ATT headers in front of the notification payload */
+#define GYRO_STREAM_L2CAP_OVERHEAD 7
+
+/* Largest ATT_MTU the stream is sized for (247 fills a 251 byte LE data length PDU) */
+#ifndef GYRO_STREAM_MAX_MTU
+#define GYRO_STREAM_MAX_MTU 247
+#endif
+
+#define GYRO_STREAM_HEADER_SIZE 4
+
+/* Smallest sample, GYRO_FORMAT_COMPACT8 */
+#define GYRO_STREAM_MIN_SAMPLE_SIZE 3
+
+/* Notification payload is ATT_MTU minus the 3 byte handle value notification header */
+#define GYRO_STREAM_MAX_PAYLOAD (GYRO_STREAM_MAX_MTU - 3)
+#define GYRO_STREAM_MAX_SAMPLES ((GYRO_STREAM_MAX_PAYLOAD - GYRO_STREAM_HEADER_SIZE) / GYRO_STREAM_MIN_SAMPLE_SIZE)
+
+/**
+ * @brief Number of samples per notification
+ *
+ * As many as ATT_MTU allows, unless one PDU less carries more samples per PDU.
+ *
+ * @param att_mtu     Negotiated ATT_MTU of the link
+ * @param data_length Negotiated link layer transmit payload, 27..251 octets
+ * @param format      Sample format, GyroFormat
+ *
+ * @return Samples per notification, at least 1
+ */
+inline uint8_t gyroStreamCapacity(uint16_t att_mtu, uint16_t data_length, uint8_t format)
+{
+    uint16_t sample_size = gyroFormatSampleSize(format);
+
+    if (att_mtu > GYRO_STREAM_MAX_MTU)
+        att_mtu = GYRO_STREAM_MAX_MTU;
+    if (att_mtu < GYRO_STREAM_DEFAULT_MTU)
+        att_mtu = GYRO_STREAM_DEFAULT_MTU;
+    if (data_length < GYRO_STREAM_DEFAULT_DATA_LENGTH)
+        data_length = GYRO_STREAM_DEFAULT_DATA_LENGTH;
+
+    uint16_t count = (att_mtu - 3 - GYRO_STREAM_HEADER_SIZE) / sample_size;
+    uint16_t pdus = (GYRO_STREAM_L2CAP_OVERHEAD + GYRO_STREAM_HEADER_SIZE + count * sample_size + data_length - 1) / data_length;
+
+    if (pdus > 1)
+    {
+        uint16_t whole = (uint16_t)(((pdus - 1) * data_length - GYRO_STREAM_L2CAP_OVERHEAD - GYRO_STREAM_HEADER_SIZE) / sample_size);
+
+        /* whole / (pdus - 1) > count / pdus */
+        if (whole * pdus > count * (pdus - 1))
+            count = whole;
+    }
+    return (uint8_t)(count ? count : 1);
+}
+
+/**
+ * @brief Encode one stream notification
+ *
+ * @tparam TimedSample Queued sample type, MPU6050TimedSample
+ *
+ * The gyro triples are gathered first and converted by one batch kernel call.
+ *
+ * @param dst     Output buffer, at least GYRO_STREAM_HEADER_SIZE + count * gyroFormatSampleSize(format) bytes
+ * @param seq     Sequence number of this notification
+ * @param format  Sample format, GyroFormat
+ * @param fs_sel  Gyro full scale the samples were taken with
+ * @param samples Samples to pack, oldest first
+ * @param count   Number of samples, at most gyroStreamCapacity()
+ *
+ * @return Encoded length in bytes
+ */
+template <typename TimedSample>
+inline uint16_t packGyroStream(uint8_t *dst, uint16_t seq, uint8_t format, int fs_sel, const TimedSample *samples, uint8_t count)
+{
+    int16_t raw[3 * GYRO_STREAM_MAX_SAMPLES];
+    uint8_t *p = dst;
+
+    *p++ = (uint8_t)seq;
+    *p++ = (uint8_t)(seq >> 8);
+    *p++ = count;
+    *p++ = format;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        raw[3 * i] = samples[i].sample.gyro[0];
+        raw[3 * i + 1] = samples[i].sample.gyro[1];
+        raw[3 * i + 2] = samples[i].sample.gyro[2];
+    }
+
+    p = gyroConvert(format, raw, p, 3 * (uint32_t)count, fs_sel);
+    return (uint16_t)(p - dst);
+}
+
+#endif
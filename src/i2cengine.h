@@ -0,0 +1,264 @@
+#pragma once
+
+#ifndef __I2C_ENGINE_H__
+#define __I2C_ENGINE_H__
+
+/**
+ * @file i2cengine.h
+ *
+ * @brief Queued, non-blocking I2C transactions on top of I2C::transfer().
+ *
+ * On the nRF52 I2C::transfer() runs on the TWIM peripheral with EasyDMA: the
+ * whole write-then-read goes out without the CPU and ends with one interrupt.
+ * The engine keeps a small queue of such transactions and starts the next one
+ * as soon as the previous completes, so the event queue only spends time on
+ * setting transfers up and on handling results instead of waiting for the bus.
+ *
+ * The end-of-transfer interrupt only records the result and defers to the
+ * event queue (I2C::transfer() takes a mutex and cannot be called from an
+ * interrupt), through an event allocated with the engine so posting it from
+ * the interrupt cannot fail for lack of queue memory and leave the bus claimed
+ * forever. Completion callbacks therefore run in event queue context and
+ * may submit follow-up transactions, which is how multi-step reads are
+ * chained. All submit calls must come from the event queue thread.
+ *
+ * Every transaction is timed as TRACE_MPU_I2C from the moment it goes to the
+ * peripheral until its completion runs on the event queue. Failed and retried
+ * transactions and the deferred calls are counted in the device metrics.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <mbed.h>
+#include <events/mbed_events.h>
+#include <platform/NonCopyable.h>
+
+#include "metrics.h"
+#include "tracepoint.h"
+
+#if DEVICE_I2C_ASYNCH
+
+/* Transactions waiting for the bus, including the one in flight */
+#ifndef I2C_ENGINE_QUEUE_SIZE
+#define I2C_ENGINE_QUEUE_SIZE 16
+#endif
+
+/* Largest write part of a transaction, copied into the queue */
+#ifndef I2C_ENGINE_MAX_WRITE
+#define I2C_ENGINE_MAX_WRITE 8
+#endif
+
+/**
+ * @class I2CEngine
+ *
+ * @brief FIFO of asynchronous I2C transactions with completion callbacks.
+ */
+class I2CEngine : private mbed::NonCopyable<I2CEngine>
+{
+public:
+    /* Completion callback; 0 on success, otherwise the I2C_EVENT_* error flags */
+    typedef mbed::Callback<void(int)> Completion;
+
+    I2CEngine(I2C &bus) : _bus(bus)
+    {
+    }
+
+    /**
+     * @brief Set the queue completions are deferred to; required before the first submission
+     *
+     * @return None
+     */
+    void setEventQueue(events::EventQueue &event_queue)
+    {
+        _event_queue = &event_queue;
+    }
+
+    /**
+     * @brief Queue a write-only transaction
+     *
+     * @param address 8-bit device address
+     * @param data    Bytes to write (register address first), copied
+     * @param length  Number of bytes, at most I2C_ENGINE_MAX_WRITE
+     * @param done    Optional completion callback
+     *
+     * @return false if the queue is full or the write too long
+     */
+    bool write(int address, const uint8_t *data, uint8_t length, Completion done = nullptr)
+    {
+        return submit(address, data, length, nullptr, 0, done);
+    }
+
+    /**
+     * @brief Queue a register read: write <subAddress>, repeated start, read <length> bytes
+     *
+     * @param dest Receive buffer, must stay valid until <done> runs
+     *
+     * @return false if the queue is full
+     */
+    bool writeRead(int address, uint8_t subAddress, uint8_t *dest, uint16_t length, Completion done)
+    {
+        return submit(address, &subAddress, 1, dest, length, done);
+    }
+
+    /** No transaction queued or in flight */
+    bool idle() const { return _count == 0; }
+
+    /** Transactions completed successfully */
+    uint32_t completed() const { return _completed; }
+
+    /** Transactions that ended with a bus error or NACK */
+    uint32_t errors() const { return _errors; }
+
+    /** Submissions refused because the queue was full */
+    uint32_t rejected() const { return _rejected; }
+
+    /** Largest number of transactions queued at once */
+    uint8_t highWaterMark() const { return _high_water; }
+
+private:
+    struct Transaction
+    {
+        int address;
+        uint8_t tx[I2C_ENGINE_MAX_WRITE];
+        uint8_t tx_length;
+        uint8_t *rx;
+        uint16_t rx_length;
+        Completion done;
+        uint32_t start_ticks;
+    };
+
+    bool submit(int address, const uint8_t *tx, uint8_t tx_length, uint8_t *rx, uint16_t rx_length, Completion done)
+    {
+        if (!_event_queue || _count == I2C_ENGINE_QUEUE_SIZE || tx_length > I2C_ENGINE_MAX_WRITE)
+        {
+            _rejected++;
+            return false;
+        }
+
+        Transaction &t = _queue[(_head + _count) % I2C_ENGINE_QUEUE_SIZE];
+        t.address = address;
+        memcpy(t.tx, tx, tx_length);
+        t.tx_length = tx_length;
+        t.rx = rx;
+        t.rx_length = rx_length;
+        t.done = done;
+
+        _count++;
+        if (_count > _high_water)
+            _high_water = _count;
+
+        if (!_active)
+            start();
+        return true;
+    }
+
+    /**
+     * @brief Hand the oldest transaction to the peripheral
+     *
+     * @return None
+     */
+    void start()
+    {
+        if (_active || _count == 0)
+            return;
+
+        Transaction &t = _queue[_head];
+        _active = true;
+        t.start_ticks = trace_ticks();
+
+        int err = _bus.transfer(t.address, (const char *)t.tx, t.tx_length, (char *)t.rx, t.rx_length,
+                                callback(this, &I2CEngine::onTransferEvent), I2C_EVENT_ALL, false);
+
+        if (err)
+        {
+            /* Peripheral still busy with a foreign transfer, try again from the queue */
+            _active = false;
+            metrics_add(METRIC_I2C_RETRIES);
+            metrics_event_posted();
+            if (!_retry_event.try_call_on(_event_queue))
+                metrics_event_run(); /* A retry is already pending */
+        }
+    }
+
+    /**
+     * @brief Deferred start() after the peripheral was busy
+     *
+     * @return None
+     */
+    void retry()
+    {
+        metrics_event_run();
+        start();
+    }
+
+    /**
+     * @brief End-of-transfer interrupt
+     *
+     * @return None
+     */
+    void onTransferEvent(int event)
+    {
+        _event = event;
+        metrics_event_posted();
+        if (!_complete_event.try_call_on(_event_queue))
+            metrics_event_run(); /* Cannot happen, one transfer is in flight at a time */
+    }
+
+    /**
+     * @brief Retire the finished transaction, start the next one and report the result
+     *
+     * The next transfer goes out before the callback runs so the bus stays busy while the
+     * result is processed.
+     *
+     * @return None
+     */
+    void complete()
+    {
+        Transaction &t = _queue[_head];
+        Completion done = t.done;
+        int result = (_event & I2C_EVENT_TRANSFER_COMPLETE) ? 0 : _event;
+
+        metrics_event_run();
+        trace_record(TRACE_MPU_I2C, trace_ticks() - t.start_ticks);
+
+        if (result)
+        {
+            _errors++;
+            metrics_add(METRIC_I2C_ERRORS);
+        }
+        else
+            _completed++;
+
+        _head = (_head + 1) % I2C_ENGINE_QUEUE_SIZE;
+        _count--;
+        _active = false;
+
+        start();
+
+        if (done)
+            done(result);
+    }
+
+    I2C &_bus;
+    events::EventQueue *_event_queue = nullptr;
+
+    /* Deferred calls posted from the interrupt, allocated with the engine */
+    events::UserAllocatedEvent<mbed::Callback<void()>, void()> _complete_event{callback(this, &I2CEngine::complete)};
+    events::UserAllocatedEvent<mbed::Callback<void()>, void()> _retry_event{callback(this, &I2CEngine::retry)};
+
+    Transaction _queue[I2C_ENGINE_QUEUE_SIZE];
+    uint8_t _head = 0;
+    uint8_t _count = 0;
+    bool _active = false;
+    volatile int _event = 0;
+
+    uint32_t _completed = 0;
+    uint32_t _errors = 0;
+    uint32_t _rejected = 0;
+    uint8_t _high_water = 0;
+};
+
+#endif /* DEVICE_I2C_ASYNCH */
+
+#endif
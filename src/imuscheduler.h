@@ -0,0 +1,203 @@
+#pragma once
+
+#ifndef __IMU_SCHEDULER_H__
+#define __IMU_SCHEDULER_H__
+
+/**
+ * @file imuscheduler.h
+ *
+ * @brief Acquisition scheduling of several MPU6050 on one I2C bus.
+ *
+ * One acquisition cycle (one data-ready interrupt of the first sensor)
+ * starts the FIFO read chain of every sensor at once. The transaction engine
+ * serves its queue in order, so the chains interleave on the bus: all
+ * FIFO_COUNT reads go out back to back, then the FIFO_R_W bursts of the
+ * sensors alternate. The bus never waits for the event queue between two
+ * sensors, and the FIFO levels of all sensors are latched within a few
+ * short transactions of each other instead of one full drain apart.
+ *
+ * Each sensor runs on its own oscillator, so after a common FIFO start the
+ * sample counts drift apart (about 1 sample per second for a 0.1 % error at
+ * 1 kHz). The scheduler counts samples per sensor since the last start and
+ * asks for a resynchronization (restart of all FIFOs back to back) once the
+ * spread exceeds MPU_SKEW_MAX_SAMPLES, which bounds the time skew between
+ * samples of equal index to that many sample periods.
+ */
+
+#include <stdint.h>
+
+#include <mbed.h>
+
+#include "mpu6050.h"
+
+/* Largest spread of per-sensor sample counts before the FIFOs are restarted together */
+#ifndef MPU_SKEW_MAX_SAMPLES
+#define MPU_SKEW_MAX_SAMPLES 4
+#endif
+
+/**
+ * @class ImuScheduler
+ *
+ * @tparam Sensors Number of sensors on the bus
+ */
+template <uint8_t Sensors>
+class ImuScheduler
+{
+public:
+    /* Asynchronous FIFO drain of one sensor, MPU6050::readFifoAsync() */
+    typedef mbed::Callback<bool(MPU6050SampleRing &, uint32_t, mbed::Callback<void(int)>)> Reader;
+
+    /* Result of one sensor: samples read, -1 on FIFO overflow, -2 on bus error */
+    typedef mbed::Callback<void(uint8_t, int)> SensorDone;
+
+    /**
+     * @brief Register sensor <index> with its sample ring
+     *
+     * @return None
+     */
+    void attach(uint8_t index, Reader reader, MPU6050SampleRing &ring)
+    {
+        _readers[index] = reader;
+        _rings[index] = &ring;
+    }
+
+    /**
+     * @brief Set the per-sensor and end-of-cycle callbacks
+     *
+     * @return None
+     */
+    void onDone(SensorDone sensor_done, mbed::Callback<void()> cycle_done)
+    {
+        _sensor_done = sensor_done;
+        _cycle_done = cycle_done;
+    }
+
+#if DEVICE_I2C_ASYNCH
+    /**
+     * @brief Start one interleaved acquisition cycle
+     *
+     * @param timestamp_us Time of the data-ready interrupt, stamped on the newest sample of every sensor
+     *
+     * @return false if a cycle is still running
+     */
+    bool acquire(uint32_t timestamp_us)
+    {
+        if (_pending)
+            return false;
+
+        _pending = Sensors;
+        _cycles++;
+
+        for (uint8_t i = 0; i < Sensors; i++)
+        {
+            if (!_readers[i](*_rings[i], timestamp_us, callback(this, completion(i))))
+                finish(i, -2);
+        }
+        return true;
+    }
+#endif
+
+    /**
+     * @brief Account the result of a sensor read, also for reads done without acquire()
+     *
+     * Reads come in sensor index order; the spread is checked once the last sensor of a cycle is
+     * counted, a drain of several samples puts the earlier sensors that far ahead in between.
+     *
+     * @return None
+     */
+    void account(uint8_t index, int result)
+    {
+        if (result > 0)
+            _samples[index] += result;
+        else if (result == -1)
+            _resync = true;
+
+        if (index != Sensors - 1)
+            return;
+
+        uint32_t spread = skew();
+        if (spread > _max_skew)
+            _max_skew = spread;
+        if (spread > MPU_SKEW_MAX_SAMPLES)
+            _resync = true;
+    }
+
+    /** The sensor FIFOs should be restarted together, see restarted() */
+    bool resyncNeeded() const { return _resync; }
+
+    /**
+     * @brief Report that all FIFOs were restarted together; sample counting starts over
+     *
+     * @return None
+     */
+    void restarted(void)
+    {
+        for (uint8_t i = 0; i < Sensors; i++)
+            _samples[i] = 0;
+        if (_resync)
+            _resyncs++;
+        _resync = false;
+    }
+
+    /** Spread of the per-sensor sample counts since the last restart */
+    uint32_t skew() const
+    {
+        uint32_t lo = _samples[0], hi = _samples[0];
+        for (uint8_t i = 1; i < Sensors; i++)
+        {
+            lo = _samples[i] < lo ? _samples[i] : lo;
+            hi = _samples[i] > hi ? _samples[i] : hi;
+        }
+        return hi - lo;
+    }
+
+    uint32_t cycles() const { return _cycles; }
+    uint32_t resyncs() const { return _resyncs; }
+    uint32_t maxSkew() const { return _max_skew; }
+
+private:
+    typedef void (ImuScheduler::*Completion)(int);
+
+    template <uint8_t Index>
+    void completed(int result)
+    {
+        finish(Index, result);
+    }
+
+    void finish(uint8_t index, int result)
+    {
+        account(index, result);
+        if (_sensor_done)
+            _sensor_done(index, result);
+
+        if (--_pending == 0 && _cycle_done)
+            _cycle_done();
+    }
+
+    static_assert(Sensors >= 1 && Sensors <= 2, "One MPU6050 bus holds at most two sensors (AD0 low and high)");
+
+    /* Only instantiate the completions of sensors that exist, completed<1> would index past a single sensor */
+    static Completion completion(uint8_t index)
+    {
+        if constexpr (Sensors > 1)
+        {
+            if (index == 1)
+                return &ImuScheduler::completed<1>;
+        }
+        return &ImuScheduler::completed<0>;
+    }
+
+    Reader _readers[Sensors];
+    MPU6050SampleRing *_rings[Sensors] = {};
+    SensorDone _sensor_done;
+    mbed::Callback<void()> _cycle_done;
+
+    uint8_t _pending = 0;
+    bool _resync = false;
+    uint32_t _samples[Sensors] = {};
+    uint32_t _cycles = 0;
+    uint32_t _resyncs = 0;
+    uint32_t _max_skew = 0;
+};
+
+#endif
@@ -0,0 +1,448 @@
+#pragma once
+
+#ifndef __LINK_PROFILE_H__
+#define __LINK_PROFILE_H__
+
+/**
+ * @file linkprofile.h
+ *
+ * @brief Throughput profile of a connection: connection interval, PHY, data length and ATT_MTU.
+ *
+ * A central connects with parameters of its own choosing, typically a 30 ms
+ * or longer interval on the 1M PHY with 27 byte PDUs and ATT_MTU 23. After
+ * every connection the negotiator asks, one step at a time, for
+ *
+ *   1. the 2M PHY, which halves the airtime of every PDU,
+ *   2. the largest ATT_MTU, unless the client already exchanged it,
+ *   3. a 7.5 to 15 ms connection interval, more connection events per second.
+ *
+ * Each step waits for the answer of the peer, or BLE_LINK_STEP_TIMEOUT_MS for
+ * peers that never answer, before the next one starts. The data length is
+ * raised by the Cordio host itself as soon as the link is up (up to 251 byte
+ * PDUs with cordio.rx-acl-buffer-size and cordio.desired-att-mtu set in
+ * mbed_app.json); the negotiator only records it. Whatever the peer ends up
+ * accepting is kept in a LinkState, handed to the application on every change
+ * and sized for by the stream (see gyroStreamCapacity()).
+ *
+ * Every one of the BLE_MAX_CONNECTIONS links has its own state and steps.
+ */
+
+#include <stdint.h>
+
+#include <events/mbed_events.h>
+#include <platform/Callback.h>
+
+#include <Gap.h>
+
+#include "syslogger.h"
+
+/* Simultaneous connections served, up to 8; follows cordio.max-connections of mbed_app.json, which sizes the stack's link table */
+#ifndef BLE_MAX_CONNECTIONS
+#if defined(MBED_CONF_CORDIO_MAX_CONNECTIONS)
+#define BLE_MAX_CONNECTIONS MBED_CONF_CORDIO_MAX_CONNECTIONS
+#else
+#define BLE_MAX_CONNECTIONS 3
+#endif
+#endif
+
+#if BLE_MAX_CONNECTIONS < 1 || BLE_MAX_CONNECTIONS > 8
+#error "BLE_MAX_CONNECTIONS must be 1 to 8"
+#endif
+
+/* Ask for the throughput profile after connecting (1), or only record what the central picks (0) */
+#ifndef BLE_THROUGHPUT_PROFILE
+#define BLE_THROUGHPUT_PROFILE 1
+#endif
+
+/* Connection interval range asked for, 1.25 ms units: 7.5 to 15 ms */
+#ifndef BLE_CONN_INTERVAL_MIN
+#define BLE_CONN_INTERVAL_MIN 6
+#endif
+
+#ifndef BLE_CONN_INTERVAL_MAX
+#define BLE_CONN_INTERVAL_MAX 12
+#endif
+
+/* Connection events the peripheral may skip; 0 answers every event, notifications go out without delay */
+#ifndef BLE_PERIPHERAL_LATENCY
+#define BLE_PERIPHERAL_LATENCY 0
+#endif
+
+/* Supervision timeout asked for, 10 ms units */
+#ifndef BLE_SUPERVISION_TIMEOUT
+#define BLE_SUPERVISION_TIMEOUT 400
+#endif
+
+/* Longest wait for the peer to answer one step */
+#ifndef BLE_LINK_STEP_TIMEOUT_MS
+#define BLE_LINK_STEP_TIMEOUT_MS 2000
+#endif
+
+/* Packed LinkState, see packLinkState() */
+#define LINK_STATE_SIZE 15
+
+/**
+ * Steps of the negotiation, in order.
+ */
+enum LinkStep
+{
+    LINK_STEP_PHY,        /* 2M PHY both ways */
+    LINK_STEP_MTU,        /* ATT MTU exchange, if the client did not run it */
+    LINK_STEP_PARAMETERS, /* Connection parameter update */
+    LINK_STEP_DONE
+};
+
+/**
+ * Negotiated parameters of one link.
+ */
+struct LinkState
+{
+    ble::connection_handle_t handle = ble::INVALID_CONNECTION_HANDLE;
+
+    /* Connection interval in 1.25 ms units, peripheral latency in events, supervision timeout in 10 ms units */
+    uint16_t interval = 0;
+    uint16_t latency = 0;
+    uint16_t supervision_timeout = 0;
+
+    /* PHY of each direction: 1 for 1M, 2 for 2M */
+    uint8_t tx_phy = 1;
+    uint8_t rx_phy = 1;
+
+    /* Largest link layer payload of each direction, 27..251 */
+    uint16_t tx_data_length = 27;
+    uint16_t rx_data_length = 27;
+
+    uint16_t att_mtu = 23;
+
+    /* Step the negotiation is at, LinkStep */
+    uint8_t step = LINK_STEP_DONE;
+};
+
+/**
+ * @brief Pack <state> for the link characteristic
+ *
+ * Interval, latency, supervision timeout, TX and RX PHY, TX and RX data length, ATT_MTU, step; little endian.
+ *
+ * @param out Destination, LINK_STATE_SIZE bytes
+ *
+ * @return Number of bytes written
+ */
+inline uint16_t packLinkState(uint8_t *out, const LinkState &state)
+{
+    uint16_t length = 0;
+
+    auto put16 = [out, &length](uint16_t value)
+    {
+        out[length++] = (uint8_t)value;
+        out[length++] = (uint8_t)(value >> 8);
+    };
+
+    put16(state.interval);
+    put16(state.latency);
+    put16(state.supervision_timeout);
+    out[length++] = state.tx_phy;
+    out[length++] = state.rx_phy;
+    put16(state.tx_data_length);
+    put16(state.rx_data_length);
+    put16(state.att_mtu);
+    out[length++] = state.step;
+    return length;
+}
+
+/**
+ * @class LinkNegotiator
+ *
+ * @brief Steps every new connection through the throughput profile and keeps track of its parameters.
+ *
+ * Fed with the GAP and GATT client events of the BLE process, runs on its event queue.
+ * Events of links it has no slot for are ignored.
+ */
+class LinkNegotiator
+{
+    /* LOG calls of the negotiator are compiled in from this level on */
+    static constexpr uint8_t logModuleLevel = LOG_LEVEL_BLE;
+
+public:
+    LinkNegotiator(BLE &ble, events::EventQueue &event_queue) : _ble(ble), _event_queue(event_queue)
+    {
+    }
+
+    /**
+     * @brief Set callback for every change of the link parameters.
+     *
+     * @return None
+     */
+    void onUpdate(mbed::Callback<void(const LinkState &)> cb)
+    {
+        _update_cb = cb;
+    }
+
+    /**
+     * @brief Record the parameters the central connected with and start the first step
+     *
+     * @return None
+     */
+    void connected(const ble::ConnectionCompleteEvent &event)
+    {
+        uint8_t slot = find(ble::INVALID_CONNECTION_HANDLE);
+
+        if (slot == BLE_MAX_CONNECTIONS)
+        {
+            LOGW("Link table full\r\n");
+            return;
+        }
+
+        LinkState &state = _states[slot];
+        state = LinkState();
+        state.handle = event.getConnectionHandle();
+        state.interval = event.getConnectionInterval().value();
+        state.latency = event.getConnectionLatency().value();
+        state.supervision_timeout = event.getSupervisionTimeout().value();
+
+        LOGI("Link interval %u x 1.25 ms, latency %u, timeout %u x 10 ms\r\n", state.interval, state.latency, state.supervision_timeout);
+        next(slot, LINK_STEP_PHY);
+    }
+
+    /**
+     * @brief Forget the link with <handle>
+     *
+     * @return None
+     */
+    void disconnected(ble::connection_handle_t handle)
+    {
+        uint8_t slot = find(handle);
+
+        if (slot == BLE_MAX_CONNECTIONS)
+            return;
+
+        cancelTimeout(slot);
+        _states[slot] = LinkState();
+    }
+
+    /**
+     * @brief Record the PHYs of a link; the answer to LINK_STEP_PHY, or a change by the central
+     *
+     * @return None
+     */
+    void phyUpdated(ble_error_t status, ble::connection_handle_t handle, ble::phy_t tx_phy, ble::phy_t rx_phy)
+    {
+        uint8_t slot = find(handle);
+
+        if (slot == BLE_MAX_CONNECTIONS)
+            return;
+
+        if (status)
+        {
+            LOGW("Link PHY update failed, error %u\r\n", status);
+        }
+        else
+        {
+            _states[slot].tx_phy = tx_phy.value();
+            _states[slot].rx_phy = rx_phy.value();
+            LOGI("Link PHY %uM TX, %uM RX\r\n", _states[slot].tx_phy, _states[slot].rx_phy);
+        }
+        answered(slot, LINK_STEP_PHY);
+    }
+
+    /**
+     * @brief Record the ATT_MTU of a link, from whichever side ran the exchange
+     *
+     * @return None
+     */
+    void mtuChanged(ble::connection_handle_t handle, uint16_t att_mtu)
+    {
+        uint8_t slot = find(handle);
+
+        if (slot == BLE_MAX_CONNECTIONS)
+            return;
+
+        _states[slot].att_mtu = att_mtu;
+        LOGI("ATT MTU updated to %u\r\n", att_mtu);
+        answered(slot, LINK_STEP_MTU);
+    }
+
+    /**
+     * @brief Record the connection parameters of a link; the answer to LINK_STEP_PARAMETERS, or a change by the central
+     *
+     * @return None
+     */
+    void parametersUpdated(const ble::ConnectionParametersUpdateCompleteEvent &event)
+    {
+        uint8_t slot = find(event.getConnectionHandle());
+
+        if (slot == BLE_MAX_CONNECTIONS)
+            return;
+
+        LinkState &state = _states[slot];
+        if (event.getStatus())
+        {
+            LOGW("Link connection parameters rejected, error %u\r\n", event.getStatus());
+        }
+        else
+        {
+            state.interval = event.getConnectionInterval().value();
+            state.latency = event.getSlaveLatency().value();
+            state.supervision_timeout = event.getSupervisionTimeout().value();
+            LOGI("Link interval %u x 1.25 ms, latency %u, timeout %u x 10 ms\r\n", state.interval, state.latency, state.supervision_timeout);
+        }
+        answered(slot, LINK_STEP_PARAMETERS);
+    }
+
+    /**
+     * @brief Record the data length of a link, raised by the host after connecting
+     *
+     * @return None
+     */
+    void dataLengthChanged(ble::connection_handle_t handle, uint16_t tx_size, uint16_t rx_size)
+    {
+        uint8_t slot = find(handle);
+
+        if (slot == BLE_MAX_CONNECTIONS)
+            return;
+
+        _states[slot].tx_data_length = tx_size;
+        _states[slot].rx_data_length = rx_size;
+        LOGI("Link data length %u TX, %u RX\r\n", tx_size, rx_size);
+        publish(slot);
+    }
+
+private:
+    /**
+     * @brief Slot of the link with <handle>
+     *
+     * @return Slot index, BLE_MAX_CONNECTIONS if there is none
+     */
+    uint8_t find(ble::connection_handle_t handle) const
+    {
+        uint8_t slot = 0;
+
+        while (slot < BLE_MAX_CONNECTIONS && _states[slot].handle != handle)
+            slot++;
+        return slot;
+    }
+
+    /**
+     * @brief Publish the change, and go on if it answered the current step of <slot>
+     *
+     * @return None
+     */
+    void answered(uint8_t slot, uint8_t step)
+    {
+        if (step == _states[slot].step)
+            next(slot, step + 1);
+        else
+            publish(slot);
+    }
+
+    /**
+     * @brief Run the steps of <slot> from <step> on until one waits for the peer
+     *
+     * @return None
+     */
+    void next(uint8_t slot, uint8_t step)
+    {
+        LinkState &state = _states[slot];
+
+        cancelTimeout(slot);
+
+        for (state.step = step; state.step < LINK_STEP_DONE; state.step++)
+        {
+            if (request(state, state.step))
+            {
+                _timeout_events[slot] = _event_queue.call_in(std::chrono::milliseconds(BLE_LINK_STEP_TIMEOUT_MS), [this, slot]()
+                                                             { timedOut(slot); });
+                break;
+            }
+        }
+        publish(slot);
+    }
+
+    /**
+     * @brief Ask the peer of <state> for <step>
+     *
+     * @return true if the request went out and the step waits for its answer
+     */
+    bool request(const LinkState &state, uint8_t step)
+    {
+        ble::Gap &gap = _ble.gap();
+        ble_error_t err = BLE_ERROR_NONE;
+
+        if (!BLE_THROUGHPUT_PROFILE)
+            return false;
+
+        switch (step)
+        {
+        case LINK_STEP_PHY:
+        {
+            if (state.tx_phy == 2 || !gap.isFeatureSupported(ble::controller_supported_features_t::LE_2M_PHY))
+                return false;
+
+            ble::phy_set_t phys(false, true, false);
+            err = gap.setPhy(state.handle, &phys, &phys, ble::coded_symbol_per_bit_t::UNDEFINED);
+            break;
+        }
+        case LINK_STEP_MTU:
+            if (state.att_mtu > 23)
+                return false;
+
+            err = _ble.gattClient().negotiateAttMtu(state.handle);
+            break;
+
+        case LINK_STEP_PARAMETERS:
+            if (state.interval >= BLE_CONN_INTERVAL_MIN && state.interval <= BLE_CONN_INTERVAL_MAX)
+                return false;
+
+            err = gap.updateConnectionParameters(state.handle,
+                                                 ble::conn_interval_t(BLE_CONN_INTERVAL_MIN),
+                                                 ble::conn_interval_t(BLE_CONN_INTERVAL_MAX),
+                                                 ble::slave_latency_t(BLE_PERIPHERAL_LATENCY),
+                                                 ble::supervision_timeout_t(BLE_SUPERVISION_TIMEOUT));
+            break;
+
+        default:
+            return false;
+        }
+
+        if (err)
+        {
+            LOGW("Link step %u not requested, error %u\r\n", step, err);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief The peer of <slot> did not answer the current step, go on with the next one
+     *
+     * @return None
+     */
+    void timedOut(uint8_t slot)
+    {
+        _timeout_events[slot] = 0;
+        LOGW("Link step %u unanswered\r\n", _states[slot].step);
+        next(slot, _states[slot].step + 1);
+    }
+
+    void cancelTimeout(uint8_t slot)
+    {
+        if (_timeout_events[slot])
+            _event_queue.cancel(_timeout_events[slot]);
+        _timeout_events[slot] = 0;
+    }
+
+    void publish(uint8_t slot)
+    {
+        if (_update_cb)
+            _update_cb(_states[slot]);
+    }
+
+    BLE &_ble;
+    events::EventQueue &_event_queue;
+
+    LinkState _states[BLE_MAX_CONNECTIONS];
+    int _timeout_events[BLE_MAX_CONNECTIONS] = {};
+
+    mbed::Callback<void(const LinkState &)> _update_cb;
+};
+
+#endif
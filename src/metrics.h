@@ -0,0 +1,157 @@
+#pragma once
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+/**
+ * @file metrics.h
+ *
+ * @brief Health counters of the device, read by collectors over BLE.
+ *
+ * Every counter is a 32-bit atomic updated with relaxed ordering, a single
+ * LDREX/STREX loop on the Cortex-M4, so interrupts, the event queue and the
+ * logger thread can all count without a lock. A snapshot reads each counter
+ * once; counters of one snapshot may be a few events apart, never torn.
+ * Counters wrap at 2^32, collectors take differences of two snapshots.
+ *
+ * The event queue depth counts deferred calls between their post and their
+ * run, for the calls posted from interrupts and the BLE stack (data-ready,
+ * I2C completions, BLE events); periodic events are not included.
+ *
+ * The sample-to-notify latency comes from the TRACE_SAMPLE_TO_NOTIFY
+ * histogram (see tracepoint.h) and reads 0 when built with TRACE_ENABLED 0.
+ */
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "tracepoint.h"
+
+/* Layout of the packed snapshot, raised when fields change meaning */
+#define METRICS_VERSION 1
+
+/* Fields of the packed snapshot, see metrics_pack() */
+#define METRICS_FIELD_COUNT 12
+
+/* Packed snapshot: version, field count, then the fields as uint32; little endian */
+#define METRICS_SNAPSHOT_SIZE (2 + 4 * METRICS_FIELD_COUNT)
+
+/**
+ * Counted events.
+ */
+enum Metric
+{
+    METRIC_SAMPLES_ACQUIRED,     /* Samples read from the sensors into the sample rings */
+    METRIC_SAMPLES_DROPPED,      /* Samples lost because a sample ring was full */
+    METRIC_SAMPLES_PUBLISHED,    /* Samples the stack accepted in stream notifications */
+    METRIC_I2C_ERRORS,           /* MPU6050 transactions that ended with a bus error or NACK */
+    METRIC_I2C_RETRIES,          /* Transactions started again because the I2C peripheral was busy */
+    METRIC_NOTIFICATIONS_QUEUED, /* Notifications handed to the BLE stack */
+    METRIC_NOTIFICATIONS_SENT,   /* Notifications the stack reported sent, and confirmed indications */
+    METRIC_EVENTS_PENDING,       /* Deferred calls waiting in the event queue */
+    METRIC_EVENTS_HIGH_WATER,    /* Most deferred calls waiting at once */
+    METRIC_COUNT
+};
+
+/**
+ * @brief Counters of all metrics, indexed by Metric
+ *
+ * Zero-filled static storage, no constructor runs.
+ *
+ * @return Array of METRIC_COUNT counters
+ */
+inline std::atomic<uint32_t> *deviceMetrics(void)
+{
+    static std::atomic<uint32_t> metrics[METRIC_COUNT];
+    return metrics;
+}
+
+/**
+ * @brief Add <count> to <metric>
+ *
+ * @return None
+ */
+inline void metrics_add(uint8_t metric, uint32_t count = 1)
+{
+    deviceMetrics()[metric].fetch_add(count, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Current value of <metric>
+ */
+inline uint32_t metrics_read(uint8_t metric)
+{
+    return deviceMetrics()[metric].load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Count a deferred call posted to the event queue, and the high-water mark
+ *
+ * Safe from interrupts.
+ *
+ * @return None
+ */
+inline void metrics_event_posted(void)
+{
+    uint32_t pending = deviceMetrics()[METRIC_EVENTS_PENDING].fetch_add(1, std::memory_order_relaxed) + 1;
+    uint32_t high = metrics_read(METRIC_EVENTS_HIGH_WATER);
+
+    while (pending > high &&
+           !deviceMetrics()[METRIC_EVENTS_HIGH_WATER].compare_exchange_weak(high, pending, std::memory_order_relaxed))
+    {
+    }
+}
+
+/**
+ * @brief Count a deferred call taken off the event queue, first thing in the call
+ *
+ * @return None
+ */
+inline void metrics_event_run(void)
+{
+    deviceMetrics()[METRIC_EVENTS_PENDING].fetch_sub(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Pack a snapshot of all metrics for the metrics characteristic
+ *
+ * Fields in order: uptime in ms, uptime of the reading connection in ms, samples acquired,
+ * dropped and published, I2C errors and retries, notifications queued and sent, event queue
+ * high-water mark, p50 and p99 sample-to-notify latency in us.
+ *
+ * @param out          Destination, METRICS_SNAPSHOT_SIZE bytes
+ * @param uptime_ms    Time since start-up
+ * @param connected_ms Time since the reading connection was established, 0 if none
+ *
+ * @return Number of bytes written
+ */
+inline uint16_t metrics_pack(uint8_t *out, uint32_t uptime_ms, uint32_t connected_ms)
+{
+    const TraceHistogram &latency = traceHistograms()[TRACE_SAMPLE_TO_NOTIFY];
+    uint16_t length = 0;
+
+    auto put32 = [out, &length](uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            out[length++] = (uint8_t)(value >> (8 * i));
+    };
+
+    out[length++] = METRICS_VERSION;
+    out[length++] = METRICS_FIELD_COUNT;
+    put32(uptime_ms);
+    put32(connected_ms);
+    put32(metrics_read(METRIC_SAMPLES_ACQUIRED));
+    put32(metrics_read(METRIC_SAMPLES_DROPPED));
+    put32(metrics_read(METRIC_SAMPLES_PUBLISHED));
+    put32(metrics_read(METRIC_I2C_ERRORS));
+    put32(metrics_read(METRIC_I2C_RETRIES));
+    put32(metrics_read(METRIC_NOTIFICATIONS_QUEUED));
+    put32(metrics_read(METRIC_NOTIFICATIONS_SENT));
+    put32(metrics_read(METRIC_EVENTS_HIGH_WATER));
+    put32(trace_ticks_to_ns(trace_percentile(latency, 500)) / 1000);
+    put32(trace_ticks_to_ns(trace_percentile(latency, 990)) / 1000);
+    return length;
+}
+
+#endif
@@ -17,6 +17,12 @@
 #include <mbed.h>
 #include <math.h>
 
+#include "gyroconvert.h"
+#include "i2cengine.h"
+#include "metrics.h"
+#include "ringbuffer.h"
+#include "tracepoint.h"
+
 #define XGOFFS_TC 0x00
 #define YGOFFS_TC 0x01
 #define ZGOFFS_TC 0x02
@@ -164,16 +170,24 @@
 #define MPU6050_INTCFG_I2C_BYPASS_EN_BIT 1
 #define MPU6050_INTCFG_CLKOUT_EN_BIT 0
 
+#define MPU6050_ADDRESS_AD0_LOW (0x68 << 1)  /* Device address when ADO = 0 */
+#define MPU6050_ADDRESS_AD0_HIGH (0x69 << 1) /* Device address when ADO = 1 */
+
 #define ADO 0
 #if ADO
-#define MPU6050_ADDRESS 0x69 << 1 /* Device address when ADO = 1 */
+#define MPU6050_ADDRESS MPU6050_ADDRESS_AD0_HIGH
 #else
-#define MPU6050_ADDRESS 0x68 << 1 /* Device address when ADO = 0 */
+#define MPU6050_ADDRESS MPU6050_ADDRESS_AD0_LOW
 #endif
 
 #define MPU_I2C_SDA P0_26
 #define MPU_I2C_SCL P0_27
 
+/* GPIO wired to the MPU6050 INT output, can be overridden from build flags */
+#ifndef MPU_INT_PIN
+#define MPU_INT_PIN P0_25
+#endif
+
 I2C i2c(MPU_I2C_SDA, MPU_I2C_SCL);
 
 enum Ascale
@@ -192,115 +206,330 @@ enum Gscale
     GFS_2000DPS
 };
 
-static int Gscale = GFS_250DPS; /* Set gyro  scale */
-static int Ascale = AFS_2G;     /* Set accel scale */
-static float aRes, gRes;                                        /* Scale resolutions per LSB for the sensors           */
 // static float ax, ay, az;                                        /* Stores the real accel value in g's                  */
-static int16_t gyroCount[3];                                    /* Stores the 16-bit signed gyro sensor output         */
 // static float gx, gy, gz;                                        /* Stores the real gyro value in degrees per seconds   */
-static float gyroBias[3] = {0, 0, 0}, accelBias[3] = {0, 0, 0}; /* Bias corrections for gyro and accelerometer         */
+
+/* FIFO packet in stream mode: accel XYZ, temperature, gyro XYZ, big-endian 16-bit words */
+#define MPU_FIFO_PACKET_SIZE 14
+
+/* FIFO capacity of the MPU6050 in bytes */
+#define MPU_FIFO_SIZE 1024
+
+/* Packets fetched by one FIFO_R_W burst read */
+#define MPU_FIFO_BURST_PACKETS 18
+
+/* INT_STATUS through GYRO_ZOUT_L, fetched by readAll() */
+#define MPU_FRAME_SIZE 15
+
+/* Registers in the driver's shadow copy, 0x00..0x7F */
+#define MPU_REGISTER_COUNT 128
+
+/* Gyro PLL start-up time after clearing the SLEEP bit, datasheet */
+#define MPU_WAKEUP_MS 30
+
+/* Longest register run committed in one burst write, bounded by the transaction engine's copy buffer */
+#ifndef MPU_SHADOW_MAX_BURST
+#define MPU_SHADOW_MAX_BURST 7
+#endif
+
+/* DMP FIFO packet, MotionApps 2.0 layout: quaternion w, x, y, z as Q30, then gyro and accel XYZ as the high halves of
+   32-bit words, 2 bytes padding; all big-endian */
+#define MPU_DMP_PACKET_SIZE 42
+
+/* DMP memory is addressed as banks of 256 bytes through DMP_BANK and DMP_RW_PNT */
+#define MPU_DMP_BANK_SIZE 256
+
+/* DMP memory bytes written or verified per transaction; a chunk never crosses a bank */
+#ifndef MPU_DMP_CHUNK_SIZE
+#define MPU_DMP_CHUNK_SIZE 16
+#endif
+
+/* DMP memory address of the FIFO rate divider, D_0_22 of the MotionApps images */
+#define MPU_DMP_FIFO_RATE_ADDRESS 0x0216
+
+/* Sample period the DMP runs on: 1 kHz gyro rate (DLPF on), SMPLRT_DIV 4 */
+#define MPU_DMP_SAMPLE_PERIOD_US 5000
+
+/* Samples held by the acquisition ring buffer, must be a power of two */
+#define MPU_SAMPLE_RING_SIZE 256
 
 /**
- * @brief Mapping two values, based on ranges
+ * @brief One accel + temperature + gyro sample, in data register order
+ */
+MBED_PACKED(struct) MPU6050Sample
+{
+    int16_t accel[3];
+    int16_t temp;
+    int16_t gyro[3];
+};
+
+/**
+ * @brief Interrupt status and the sample it refers to, as read by readAll()
+ */
+MBED_PACKED(struct) MPU6050Frame
+{
+    uint8_t int_status;
+    MPU6050Sample sample;
+};
+
+/**
+ * @brief Unpack the 14 big-endian data bytes of ACCEL_XOUT_H..GYRO_ZOUT_L (or one FIFO packet)
+ *
+ * @param raw    Register data
+ * @param sample Destination sample
  *
- * @param value    Integer number, out variable
- * @param from_min Minimal bound of value
- * @param from_max Maximum bound of value
- * @param to_min   Minimal bound of new value
- * @param to_max   Minimal bound of new value
- *   
- * @return long output value 
+ * @return None
  */
-long fromADCtoInt(long value, long from_min, long from_max, long to_min, long to_max)
+inline void unpackSample(const uint8_t *raw, MPU6050Sample &sample)
 {
-    return (value - from_min) * (to_max - to_min) / (from_max - from_min) + to_min;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        sample.accel[axis] = (int16_t)(((int16_t)raw[2 * axis] << 8) | raw[2 * axis + 1]);
+        sample.gyro[axis] = (int16_t)(((int16_t)raw[8 + 2 * axis] << 8) | raw[9 + 2 * axis]);
+    }
+    sample.temp = (int16_t)(((int16_t)raw[6] << 8) | raw[7]);
 }
 
+/**
+ * @brief Unpack one DMP FIFO packet, see MPU_DMP_PACKET_SIZE
+ *
+ * @param raw        Packet data
+ * @param sample     Destination for the gyro and accel counts; the DMP packet has no temperature
+ * @param quaternion Destination for w, x, y, z as Q30
+ *
+ * @return None
+ */
+inline void unpackDmpPacket(const uint8_t *raw, MPU6050Sample &sample, int32_t quaternion[4])
+{
+    for (int i = 0; i < 4; i++)
+    {
+        quaternion[i] = (int32_t)(((uint32_t)raw[4 * i] << 24) | ((uint32_t)raw[4 * i + 1] << 16) |
+                                  ((uint32_t)raw[4 * i + 2] << 8) | raw[4 * i + 3]);
+    }
+    for (int axis = 0; axis < 3; axis++)
+    {
+        sample.gyro[axis] = (int16_t)(((int16_t)raw[16 + 4 * axis] << 8) | raw[17 + 4 * axis]);
+        sample.accel[axis] = (int16_t)(((int16_t)raw[28 + 4 * axis] << 8) | raw[29 + 4 * axis]);
+    }
+    sample.temp = 0;
+}
+
+/**
+ * @brief Sample with the microsecond time it was taken, as queued between acquisition and publishing
+ */
+struct MPU6050TimedSample
+{
+    uint32_t timestamp_us;
+    MPU6050Sample sample;
+};
+
+/* Acquisition to BLE publishing queue */
+typedef SpscRing<MPU6050TimedSample, MPU_SAMPLE_RING_SIZE> MPU6050SampleRing;
+
+/**
+ * @class MPU6050
+ *
+ * @brief MPU6050 driver specialized at compile time
+ *
+ * Full-scale ranges, bus address and sample rate are template parameters: register values and
+ * scale factors are constants folded into the code, and there is no per-sample switch on the
+ * configuration. Every instance keeps its own sample, biases and register shadow, so drivers for
+ * several sensors (e.g. AD0 low and high on one bus) can coexist.
+ *
+ * @tparam GyroScale  Gyro full scale, Gscale (GFS_250DPS..GFS_2000DPS)
+ * @tparam AccelScale Accelerometer full scale, Ascale (AFS_2G..AFS_16G)
+ * @tparam Address    8-bit bus address, MPU6050_ADDRESS_AD0_LOW or MPU6050_ADDRESS_AD0_HIGH
+ * @tparam RateDiv    SMPLRT_DIV, sample rate 1 kHz/(1 + RateDiv)
+ */
+template <uint8_t GyroScale = GFS_250DPS, uint8_t AccelScale = AFS_2G, uint8_t Address = MPU6050_ADDRESS, uint8_t RateDiv = 0>
 class MPU6050
 {
+    static_assert(GyroScale <= GFS_2000DPS, "GyroScale must be one of Gscale");
+    static_assert(AccelScale <= AFS_16G, "AccelScale must be one of Ascale");
+
+public:
+    /* Configuration, usable as constant expressions */
+    static constexpr uint8_t gyroScale = GyroScale;
+    static constexpr uint8_t accelScale = AccelScale;
+    static constexpr uint8_t address = Address;
+
+    /* Degrees per second and g per count */
+    static constexpr float gRes = (float)(250 << GyroScale) / 32768.0f;
+    static constexpr float aRes = (float)(2 << AccelScale) / 32768.0f;
+
+    /* Sample period of the FIFO stream and of the data-ready interrupt */
+    static constexpr uint32_t samplePeriodUs = 1000 * (1 + (uint32_t)RateDiv);
+
 protected:
 public:
-    void writeByte(uint8_t address, uint8_t subAddress, uint8_t data)
+    /**
+     * @brief Write one register
+     *
+     * Blocks on the bus, or only queues the write once a transaction engine is attached.
+     * The register shadow takes the value only if the write went out or was queued.
+     *
+     * @return true on success
+     */
+    bool writeByte(uint8_t address, uint8_t subAddress, uint8_t data)
     {
-        char data_write[2];
-        data_write[0] = subAddress;
-        data_write[1] = data;
-        i2c.write(address, data_write, 2, 0);
-    }
+        if (!writeBurst(address, subAddress, &data, 1))
+            return false;
 
-    char readByte(uint8_t address, uint8_t subAddress)
-    {
-        char data[1]; 
-        char data_write[1];
-        data_write[0] = subAddress;
-        i2c.write(address, data_write, 1, 1);
-        i2c.read(address, data, 1, 0);
-        return data[0];
+        shadowWritten(subAddress, data);
+        return true;
     }
 
-    void readBytes(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t *dest)
+    /**
+     * @brief Write <count> consecutive registers in one transaction
+     *
+     * The register shadow is not touched, see writeByte() and commit().
+     *
+     * @return false if <count> exceeds MPU_SHADOW_MAX_BURST, the bus failed or the engine queue was full
+     */
+    bool writeBurst(uint8_t address, uint8_t subAddress, const uint8_t *data, uint8_t count)
     {
-        char data[14];
-        char data_write[1];
+        char data_write[1 + MPU_SHADOW_MAX_BURST];
+
+        if (count > MPU_SHADOW_MAX_BURST)
+            return false;
+
         data_write[0] = subAddress;
-        i2c.write(address, data_write, 1, 1); // no stop
-        i2c.read(address, data, count, 0);
-        for (int ii = 0; ii < count; ii++)
+        memcpy(&data_write[1], data, count);
+
+#if DEVICE_I2C_ASYNCH
+        if (engine)
+            return engine->write(address, (const uint8_t *)data_write, 1 + count);
+#endif
+        TraceScope trace(TRACE_MPU_I2C);
+        if (i2c.write(address, data_write, 1 + count, 0))
         {
-            dest[ii] = data[ii];
+            metrics_add(METRIC_I2C_ERRORS);
+            return false;
         }
+        return true;
     }
 
     /**
-     * @brief Possible gyro scales.
+     * @brief Stage a register value in the shadow
+     *
+     * Nothing goes on the bus until commit(), and only if the value differs from the one the
+     * device is known to hold.
      *
-     * Their register bit settings are:
-     * 250 DPS (00), 500 DPS (01), 1000 DPS (10), and 2000 DPS (11).
-     * Here's a bit of an algorith to calculate DPS/(ADC tick) based on that 2-bit value.
+     * @return None
      */
-    void getGres()
+    void setReg(uint8_t subAddress, uint8_t value)
     {
-        switch (Gscale)
+        if (isKnown(subAddress) && regShadow[subAddress] == value && !isDirty(subAddress))
+            return;
+
+        regShadow[subAddress] = value;
+        regDirty[subAddress >> 5] |= 1u << (subAddress & 31);
+    }
+
+    /**
+     * @brief Stage a bitfield edit: clear the bits of <mask>, then set <bits> within it
+     *
+     * Replaces a read-modify-write (or a clear write followed by a set write) with a local edit.
+     *
+     * @return None
+     */
+    void updateReg(uint8_t subAddress, uint8_t mask, uint8_t bits)
+    {
+        setReg(subAddress, (uint8_t)((readReg(subAddress) & ~mask) | (bits & mask)));
+    }
+
+    /**
+     * @brief Current value of a configuration register from the shadow; read once from the device if not known yet
+     *
+     * Not meant for sensor data or status registers, which change without the driver writing them.
+     *
+     * @return Register value, including staged edits
+     */
+    uint8_t readReg(uint8_t subAddress)
+    {
+        if (!isKnown(subAddress) && !isDirty(subAddress))
         {
-        case GFS_250DPS:
-            gRes = 250.0 / 32768.0;
-            break;
-        case GFS_500DPS:
-            gRes = 500.0 / 32768.0;
-            break;
-        case GFS_1000DPS:
-            gRes = 1000.0 / 32768.0;
-            break;
-        case GFS_2000DPS:
-            gRes = 2000.0 / 32768.0;
-            break;
+            regShadow[subAddress] = readByte(Address, subAddress);
+            regKnown[subAddress >> 5] |= 1u << (subAddress & 31);
         }
+        return regShadow[subAddress];
     }
 
     /**
-     * @brief Possible accelerometer scales.
+     * @brief Write all staged registers
+     *
+     * Contiguous dirty registers go out as one burst write of up to MPU_SHADOW_MAX_BURST bytes
+     * (the device auto-increments the register address), in ascending address order. Edits whose
+     * order matters across registers need a commit() in between. A run the bus or the engine did not
+     * take stays dirty, and so does everything after it, for the next commit().
      *
-     * Their register bit settings) are:
-     * 2 Gs (00), 4 Gs (01), 8 Gs (10), and 16 Gs  (11).
-     * Here's a bit of an algorith to calculate DPS/(ADC tick) based on that 2-bit value.
+     * @return Number of bus transactions used
      */
-    void getAres()
+    int commit()
     {
-        switch (Ascale)
+        int transactions = 0;
+        int reg = 0;
+
+        while (reg < MPU_REGISTER_COUNT)
         {
-        case AFS_2G:
-            aRes = 2.0 / 32768.0;
-            break;
-        case AFS_4G:
-            aRes = 4.0 / 32768.0;
-            break;
-        case AFS_8G:
-            aRes = 8.0 / 32768.0;
-            break;
-        case AFS_16G:
-            aRes = 16.0 / 32768.0;
-            break;
+            if (!regDirty[reg >> 5])
+            {
+                reg = (reg | 31) + 1;
+                continue;
+            }
+            if (!isDirty(reg))
+            {
+                reg++;
+                continue;
+            }
+
+            int first = reg;
+            while (reg < MPU_REGISTER_COUNT && isDirty(reg) && reg - first < MPU_SHADOW_MAX_BURST)
+                reg++;
+
+            if (!writeBurst(Address, first, &regShadow[first], reg - first))
+                break;
+
+            for (int written = first; written < reg; written++)
+            {
+                regDirty[written >> 5] &= ~(1u << (written & 31));
+                regKnown[written >> 5] |= 1u << (written & 31);
+            }
+            transactions++;
         }
+        return transactions;
+    }
+
+    char readByte(uint8_t address, uint8_t subAddress)
+    {
+        char data[1]; 
+        char data_write[1];
+        data_write[0] = subAddress;
+        TraceScope trace(TRACE_MPU_I2C);
+        int err = i2c.write(address, data_write, 1, 1);
+        err |= i2c.read(address, data, 1, 0);
+        if (err)
+            metrics_add(METRIC_I2C_ERRORS);
+        return data[0];
+    }
+
+    /**
+     * @brief Burst read of <count> consecutive registers
+     *
+     * Data is received straight into <dest>, so the length is only bounded by the caller's buffer
+     * (FIFO_R_W does not auto-increment, a long read of it drains the FIFO).
+     *
+     * @return None
+     */
+    void readBytes(uint8_t address, uint8_t subAddress, uint16_t count, uint8_t *dest)
+    {
+        char data_write[1];
+        data_write[0] = subAddress;
+        TraceScope trace(TRACE_MPU_I2C);
+        int err = i2c.write(address, data_write, 1, 1); // no stop
+        err |= i2c.read(address, (char *)dest, count, 0);
+        if (err)
+            metrics_add(METRIC_I2C_ERRORS);
     }
 
     /**
@@ -314,7 +543,7 @@ public:
     void readAccelData(int16_t *destination)
     {
         uint8_t rawData[6];
-        readBytes(MPU6050_ADDRESS, ACCEL_XOUT_H, 6, &rawData[0]);            
+        readBytes(Address, ACCEL_XOUT_H, 6, &rawData[0]);            
         destination[0] = (int16_t)(((int16_t)rawData[0] << 8) | rawData[1]); 
         destination[1] = (int16_t)(((int16_t)rawData[2] << 8) | rawData[3]);
         destination[2] = (int16_t)(((int16_t)rawData[4] << 8) | rawData[5]);
@@ -331,46 +560,349 @@ public:
     void readGyroData(int16_t *destination)
     {
         uint8_t rawData[6];
-        readBytes(MPU6050_ADDRESS, GYRO_XOUT_H, 6, &rawData[0]);             
+        readBytes(Address, GYRO_XOUT_H, 6, &rawData[0]);             
         destination[0] = (int16_t)(((int16_t)rawData[0] << 8) | rawData[1]); 
         destination[1] = (int16_t)(((int16_t)rawData[2] << 8) | rawData[3]);
         destination[2] = (int16_t)(((int16_t)rawData[4] << 8) | rawData[5]);
     }
 
+    /**
+     * @brief Start FIFO stream mode
+     *
+     * Accelerometer and gyro samples are queued by the sensor itself at gyroscope output rate/(1 + RateDiv),
+     * so nothing is lost between two readFifo() calls as long as they come before the FIFO fills up
+     * (1024 bytes, 73 samples).
+     *
+     * @return None
+     */
+    void startFifo()
+    {
+        fifoPacketSize = MPU_FIFO_PACKET_SIZE;
+        fifoPeriodUs = samplePeriodUs;
+
+        setReg(SMPLRT_DIV, RateDiv);
+        /* Stop FIFO writes, then reset and enable the FIFO */
+        setReg(FIFO_EN, 0x00);
+        commit();
+        writeByte(Address, USER_CTRL, 0x44);
+        /* Enable temperature, gyro and accelerometer sensors for FIFO */
+        setReg(FIFO_EN, 0xF8);
+        commit();
+    }
+
+    /**
+     * @brief Drain the FIFO into a sample ring
+     *
+     * Reads FIFO_COUNT once, then fetches all complete packets with FIFO_R_W bursts of up to
+     * MPU_FIFO_BURST_PACKETS packets (fewer DMP packets, which are larger). A full FIFO means the
+     * sensor already dropped bytes and packet alignment is lost, so the FIFO is reset and the
+     * overflow is counted instead. After startDmp() the packets are DMP packets, their quaternion
+     * is kept in dmpQuaternion.
+     *
+     * Samples are timestamped backwards from <timestamp_us>, the time of the newest one, in steps of
+     * the sample period.
+     *
+     * @param ring         Destination ring buffer
+     * @param timestamp_us Time of the newest sample in the FIFO, e.g. of the last data-ready interrupt
+     *
+     * @return Number of samples read, or -1 on FIFO overflow
+     */
+    int readFifo(MPU6050SampleRing &ring, uint32_t timestamp_us)
+    {
+        uint8_t data[2];
+        readBytes(Address, FIFO_COUNTH, 2, &data[0]);
+        uint16_t fifo_count = ((uint16_t)data[0] << 8) | data[1];
+
+        if (fifo_count >= MPU_FIFO_SIZE)
+        {
+            fifoOverflows++;
+            resetFifo();
+            return -1;
+        }
+
+        int packet_count = fifo_count / fifoPacketSize;
+        int read = 0;
+
+        while (read < packet_count)
+        {
+            int burst = packet_count - read;
+            if (burst > burstPackets())
+                burst = burstPackets();
+
+            readBytes(Address, FIFO_R_W, burst * fifoPacketSize, &fifoBurst[0]);
+
+            for (int p = 0; p < burst; p++)
+            {
+                MPU6050TimedSample timed;
+                timed.timestamp_us = timestamp_us - (uint32_t)(packet_count - 1 - read - p) * fifoPeriodUs;
+                unpackPacket(&fifoBurst[p * fifoPacketSize], timed);
+                ring.push(timed);
+            }
+            read += burst;
+        }
+        return read;
+    }
+
+    /**
+     * @brief Read status, accel, temperature and gyro in one transaction
+     *
+     * INT_STATUS (0x3A) through GYRO_ZOUT_L (0x48) are contiguous, so a single repeated-start
+     * read of 15 bytes replaces the INT_STATUS poll plus separate accel/gyro reads.
+     * Reading INT_STATUS also clears it.
+     *
+     * @param frame Destination frame
+     *
+     * @return true when DATA_RDY_INT was set, i.e. the sample is new
+     */
+    bool readAll(MPU6050Frame &frame)
+    {
+        uint8_t rawData[MPU_FRAME_SIZE];
+        readBytes(Address, INT_STATUS, MPU_FRAME_SIZE, &rawData[0]);
+        frame.int_status = rawData[0];
+        unpackSample(&rawData[1], frame.sample);
+        return (rawData[0] & 0x01) != 0;
+    }
+
+#if DEVICE_I2C_ASYNCH
+    /**
+     * @brief Route register access through a transaction engine
+     *
+     * From here on writeByte() (and everything built on it) only queues the write. The blocking
+     * readByte()/readBytes() must not be used any more while transactions are in flight, use
+     * readFifoAsync() and readAllAsync() instead.
+     *
+     * @param transactions Engine on the same bus, nullptr to go back to blocking access
+     *
+     * @return None
+     */
+    void attachEngine(I2CEngine *transactions)
+    {
+        engine = transactions;
+    }
+
+    /**
+     * @brief Drain the FIFO into a sample ring without blocking
+     *
+     * Same as readFifo(), as a chain of engine transactions: FIFO_COUNT, then FIFO_R_W bursts of up to
+     * MPU_FIFO_BURST_PACKETS packets, each one submitted from the completion of the previous one.
+     * Only one chain may be in flight.
+     *
+     * @param ring         Destination ring buffer
+     * @param timestamp_us Time of the newest sample in the FIFO
+     * @param done         Called with the number of samples read, -1 on FIFO overflow or -2 on bus error
+     *
+     * @return false if the first transaction could not be queued
+     */
+    bool readFifoAsync(MPU6050SampleRing &ring, uint32_t timestamp_us, mbed::Callback<void(int)> done)
+    {
+        if (!engine)
+            return false;
+
+        asyncRing = &ring;
+        asyncTimestampUs = timestamp_us;
+        asyncDone = done;
+        return engine->writeRead(Address, FIFO_COUNTH, asyncRaw, 2, callback(this, &MPU6050::onFifoCount));
+    }
+
+    /**
+     * @brief Read status and sample in one transaction without blocking
+     *
+     * Asynchronous readAll(): the sample is pushed to <ring> when DATA_RDY_INT was set.
+     *
+     * @param ring         Destination ring buffer
+     * @param timestamp_us Time of the sample
+     * @param done         Called with 1 if a new sample was pushed, 0 if not, -2 on bus error
+     *
+     * @return false if the transaction could not be queued
+     */
+    bool readAllAsync(MPU6050SampleRing &ring, uint32_t timestamp_us, mbed::Callback<void(int)> done)
+    {
+        if (!engine)
+            return false;
+
+        asyncRing = &ring;
+        asyncTimestampUs = timestamp_us;
+        asyncDone = done;
+        return engine->writeRead(Address, INT_STATUS, asyncRaw, MPU_FRAME_SIZE, callback(this, &MPU6050::onFrame));
+    }
+#endif
+
+    /**
+     * @brief Write DMP memory
+     *
+     * Each chunk of up to MPU_DMP_CHUNK_SIZE bytes within one bank is one pointer write (DMP_BANK
+     * and DMP_RW_PNT in one burst) and one data write to DMP_REG, which advances the memory pointer
+     * by itself. Blocking, before a transaction engine is attached.
+     *
+     * @param address DMP memory address, bank in the high byte
+     * @param data    Bytes to write
+     * @param length  Number of bytes
+     *
+     * @return false on a bus error
+     */
+    bool writeDmpMemory(uint16_t address, const uint8_t *data, uint16_t length)
+    {
+        char data_write[1 + MPU_DMP_CHUNK_SIZE];
+
+        while (length)
+        {
+            uint16_t chunk = dmpChunk(address, length);
+
+            if (!setDmpPointer(address))
+                return false;
+
+            data_write[0] = DMP_REG;
+            memcpy(&data_write[1], data, chunk);
+            if (i2c.write(Address, data_write, 1 + chunk, 0))
+                return false;
+
+            address += chunk;
+            data += chunk;
+            length -= chunk;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Read DMP memory, chunked like writeDmpMemory()
+     *
+     * @return false on a bus error
+     */
+    bool readDmpMemory(uint16_t address, uint8_t *data, uint16_t length)
+    {
+        while (length)
+        {
+            uint16_t chunk = dmpChunk(address, length);
+
+            if (!setDmpPointer(address))
+                return false;
+
+            char reg = DMP_REG;
+            if (i2c.write(Address, &reg, 1, 1) || i2c.read(Address, (char *)data, chunk, 0))
+                return false;
+
+            address += chunk;
+            data += chunk;
+            length -= chunk;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Upload a DMP firmware image, verify it and set its start address
+     *
+     * The image goes to DMP memory from address 0, then every chunk is read back and compared.
+     * The time taken, upload and verification, is left in dmpLoadUs. The DMP is not started,
+     * see startDmp().
+     *
+     * @param image         Firmware image
+     * @param size          Image size in bytes
+     * @param start_address Program start address of the image (DMP_CFG_1/2)
+     *
+     * @return false on a bus error or if the read-back differs
+     */
+    bool loadDmp(const uint8_t *image, uint16_t size, uint16_t start_address)
+    {
+        uint8_t verify[MPU_DMP_CHUNK_SIZE];
+        uint32_t started_us = us_ticker_read();
+        bool loaded = writeDmpMemory(0, image, size);
+
+        for (uint16_t address = 0; loaded && address < size; address += MPU_DMP_CHUNK_SIZE)
+        {
+            uint16_t chunk = size - address < MPU_DMP_CHUNK_SIZE ? size - address : MPU_DMP_CHUNK_SIZE;
+
+            loaded = readDmpMemory(address, verify, chunk) && memcmp(verify, &image[address], chunk) == 0;
+        }
+
+        if (loaded)
+        {
+            /* DMP_REG_1/2 hold the program start address, big-endian */
+            setReg(DMP_REG_1, (uint8_t)(start_address >> 8));
+            setReg(DMP_REG_2, (uint8_t)start_address);
+            commit();
+        }
+
+        dmpLoadUs = us_ticker_read() - started_us;
+        return loaded;
+    }
+
+    /**
+     * @brief Set the DMP output rate of a loaded image
+     *
+     * Blocking like loadDmp(); DMP memory survives sleep(), so this is done once after loading.
+     *
+     * @param rate_div DMP output rate divider, 200 Hz / (1 + <rate_div>)
+     *
+     * @return false on a bus error
+     */
+    bool setDmpRate(uint8_t rate_div)
+    {
+        const uint8_t rate[2] = {0x00, rate_div};
+
+        dmpPeriodUs = MPU_DMP_SAMPLE_PERIOD_US * (1 + (uint32_t)rate_div);
+        return writeDmpMemory(MPU_DMP_FIFO_RATE_ADDRESS, rate, sizeof(rate));
+    }
+
+    /**
+     * @brief Start the DMP on a loaded image and stream its packets through the FIFO
+     *
+     * The DMP runs on a 200 Hz sample clock (SMPLRT_DIV 4 with the 42 Hz DLPF of init()) and
+     * writes one MPU_DMP_PACKET_SIZE packet per output period (see setDmpRate()); the sensor FIFO
+     * feeds are switched off, the DMP fills the FIFO by itself. The INT line follows the DMP
+     * interrupt. readFifo() and readFifoAsync() then return DMP packets. Only register writes,
+     * so this also works with a transaction engine attached.
+     *
+     * @return None
+     */
+    void startDmp()
+    {
+        fifoPacketSize = MPU_DMP_PACKET_SIZE;
+        fifoPeriodUs = dmpPeriodUs;
+
+        setReg(SMPLRT_DIV, 4);
+        setReg(FIFO_EN, 0x00);
+        setReg(INT_ENABLE, 0x02);
+        commit();
+
+        /* Reset FIFO and DMP, then enable both */
+        writeByte(Address, USER_CTRL, 0x0C);
+        writeByte(Address, USER_CTRL, 0xC0);
+    }
+
     /**
      * @brief Gettin gyro-X value
      *
-     * Calculate and convert to uint8_t small range gyro X value. 
+     * Convert the last gyro X count to the signed compact format, 2 dps per count (see gyroCompact8()).
      * 
-     * @return <uint8_t> converted value.  
+     * @return <int8_t> converted value.  
      */
-    uint8_t getTinyGyroX(void)
+    int8_t getTinyGyroX(void)
     {
-        return fromADCtoInt(gyroCount[0], -32768, +32767, -250, +250);
+        return gyroCompact8(gyroCount[0], GyroScale);
     }
 
     /**
      * @brief Gettin gyro-Y value
      *
-     * Calculate and convert to uint8_t small range gyro Y value. 
+     * Convert the last gyro Y count to the signed compact format, 2 dps per count (see gyroCompact8()).
      * 
-     * @return <uint8_t> converted value.  
+     * @return <int8_t> converted value.  
      */
-    uint8_t getTinyGyroY(void)
+    int8_t getTinyGyroY(void)
     {
-        return fromADCtoInt(gyroCount[1], -32768, +32767, -250, +250);
+        return gyroCompact8(gyroCount[1], GyroScale);
     }
 
     /**
      * @brief Gettin gyro-Z value
      *
-     * Calculate and convert to uint8_t small range gyro Z value. 
+     * Convert the last gyro Z count to the signed compact format, 2 dps per count (see gyroCompact8()).
      * 
-     * @return <uint8_t> converted value.  
+     * @return <int8_t> converted value.  
      */
-    uint8_t getTinyGyroZ(void)
+    int8_t getTinyGyroZ(void)
     {
-        return fromADCtoInt(gyroCount[2], -32768, +32767, -250, +250);
+        return gyroCompact8(gyroCount[2], GyroScale);
     }
 
     /**
@@ -386,61 +918,67 @@ public:
      */
     void lowPowerAccelOnly()
     {
-        uint8_t c = readByte(MPU6050_ADDRESS, PWR_MGMT_1);
-        /* Clear sleep and cycle bits [5:6] */
-        writeByte(MPU6050_ADDRESS, PWR_MGMT_1, c & ~0x30);
-        /* Set sleep and cycle bits [5:6] to zero to make sure accelerometer is running */
-        writeByte(MPU6050_ADDRESS, PWR_MGMT_1, c | 0x30);
-
-        c = readByte(MPU6050_ADDRESS, PWR_MGMT_2);
-        /* Clear standby XA, YA, and ZA bits [3:5] */
-        writeByte(MPU6050_ADDRESS, PWR_MGMT_2, c & ~0x38);
-        /* Set XA, YA, and ZA bits [3:5] to zero to make sure accelerometer is running */
-        writeByte(MPU6050_ADDRESS, PWR_MGMT_2, c | 0x00);
-
-        c = readByte(MPU6050_ADDRESS, ACCEL_CONFIG);
-        /* Clear high-pass filter bits [2:0] */
-        writeByte(MPU6050_ADDRESS, ACCEL_CONFIG, c & ~0x07);
+        /* Set sleep and cycle bits [5:4] */
+        updateReg(PWR_MGMT_1, 0x30, 0x30);
+        /* Clear standby XA, YA, and ZA bits [3:5] to make sure accelerometer is running */
+        updateReg(PWR_MGMT_2, 0x38, 0x00);
         /* Set ACCEL_HPF to 0; reset mode disbaling high-pass filter */
-        writeByte(MPU6050_ADDRESS, ACCEL_CONFIG, c | 0x00);
-
-        c = readByte(MPU6050_ADDRESS, CONFIG);
-        /* Clear low-pass filter bits [2:0] */
-        writeByte(MPU6050_ADDRESS, CONFIG, c & ~0x07);
+        updateReg(ACCEL_CONFIG, 0x07, 0x00);
         /* Set DLPD_CFG to 0; 260 Hz bandwidth, 1 kHz rate */
-        writeByte(MPU6050_ADDRESS, CONFIG, c | 0x00);
-
-        c = readByte(MPU6050_ADDRESS, INT_ENABLE);
-        /* Clear all interrupts */
-        writeByte(MPU6050_ADDRESS, INT_ENABLE, c & ~0xFF);
+        updateReg(CONFIG, 0x07, 0x00);
         /* Enable motion threshold (bits 5) interrupt only */
-        writeByte(MPU6050_ADDRESS, INT_ENABLE, 0x40);
-        
+        setReg(INT_ENABLE, 0x40);
         /* Set motion detection to 0.256 g; LSB = 2 mg */
-        writeByte(MPU6050_ADDRESS, MOT_THR, 0x80);
+        setReg(MOT_THR, 0x80);
         /* Set motion detect duration to 1  ms; LSB is 1 ms @ 1 kHz rate */
-        writeByte(MPU6050_ADDRESS, MOT_DUR, 0x01);
+        setReg(MOT_DUR, 0x01);
+        commit();
 
         /* Add delay for accumulation of samples */
         thread_sleep_for(100);
 
-        c = readByte(MPU6050_ADDRESS, ACCEL_CONFIG);
-        /* Clear high-pass filter bits [2:0] */
-        writeByte(MPU6050_ADDRESS, ACCEL_CONFIG, c & ~0x07);
         /* Set ACCEL_HPF to 7; hold the initial accleration value as a referance */
-        writeByte(MPU6050_ADDRESS, ACCEL_CONFIG, c | 0x07);
+        updateReg(ACCEL_CONFIG, 0x07, 0x07);
+        /* Set wakeup frequency to 5 Hz (LP_WAKE_CTRL bits [6:7]), and disable XG, YG, and ZG gyros (bits [0:2]) */
+        updateReg(PWR_MGMT_2, 0xC7, 0x47);
+        /* Set cycle bit 5 to begin low power accelerometer motion interrupts */
+        updateReg(PWR_MGMT_1, 0x20, 0x20);
+        commit();
+    }
 
-        c = readByte(MPU6050_ADDRESS, PWR_MGMT_2);
-        /* Clear standby XA, YA, and ZA bits [3:5] and LP_WAKE_CTRL bits [6:7] */
-        writeByte(MPU6050_ADDRESS, PWR_MGMT_2, c & ~0xC7);
-        /* Set wakeup frequency to 5 Hz, and disable XG, YG, and ZG gyros (bits [0:2]) */
-        writeByte(MPU6050_ADDRESS, PWR_MGMT_2, c | 0x47);
+    /**
+     * @brief Put MPU device to sleep
+     *
+     * Set the SLEEP bit (6) of PWR_MGMT_1: sampling, FIFO writes and the data-ready interrupt stop,
+     * register contents and bias offsets are kept. PWR_MGMT_1 comes from the shadow, so no read is
+     * needed.
+     * 
+     * @return None
+     */
+    void sleep()
+    {
+        updateReg(PWR_MGMT_1, 0x40, 0x40);
+        commit();
+    }
 
-        c = readByte(MPU6050_ADDRESS, PWR_MGMT_1);
-        /* Clear sleep and cycle bit 5 */
-        writeByte(MPU6050_ADDRESS, PWR_MGMT_1, c & ~0x20);
-        /* Set cycle bit 5 to begin low power accelerometer motion interrupts */
-        writeByte(MPU6050_ADDRESS, PWR_MGMT_1, c | 0x20);
+    /**
+     * @brief Wake MPU device up from sleep()
+     *
+     * Clear the SLEEP bit (6) of PWR_MGMT_1, keeping the clock source. Blocking access also waits
+     * MPU_WAKEUP_MS for the gyro PLL to settle; with a transaction engine attached the write is only
+     * queued and the caller schedules whatever needs the settled sensor MPU_WAKEUP_MS later.
+     * 
+     * @return None
+     */
+    void wakeUp()
+    {
+        updateReg(PWR_MGMT_1, 0x40, 0x00);
+        commit();
+#if DEVICE_I2C_ASYNCH
+        if (engine)
+            return;
+#endif
+        thread_sleep_for(MPU_WAKEUP_MS);
     }
 
     /**
@@ -452,7 +990,7 @@ public:
      */
     void reset()
     {
-        writeByte(MPU6050_ADDRESS, PWR_MGMT_1, 0x80); 
+        writeByte(Address, PWR_MGMT_1, 0x80); 
         thread_sleep_for(100);
     }
 
@@ -462,46 +1000,41 @@ public:
      * Disable FSYNC and set accelerometer and gyro bandwidth to 44 and 42 Hz, respectively;
      * DLPF_CFG = bits 2:0 = 010; this sets the sample rate at 1 kHz for both.
      * Maximum delay is 4.9 ms which is just over a 200 Hz maximum rate.
+     * The sample rate divider is RateDiv, the full scales GyroScale and AccelScale.
+     *
+     * Register edits are staged in the shadow and committed as burst writes.
      * 
      * @return None
      */
     void init()
     {
-        /* Clear sleep mode bit (6), enable all sensors */
-        writeByte(MPU6050_ADDRESS, PWR_MGMT_1, 0x00);
-        thread_sleep_for(100);
+        bool asleep = (readReg(PWR_MGMT_1) & 0x40) != 0;
 
-        /* Set clock source to be PLL with x-axis gyroscope reference, bits 2:0 = 001 */
-        writeByte(MPU6050_ADDRESS, PWR_MGMT_1, 0x01);
-        writeByte(MPU6050_ADDRESS, CONFIG, 0x03);
+        /* Clear sleep mode bit (6), enable all sensors, set clock source to be PLL with x-axis gyroscope reference, bits 2:0 = 001 */
+        setReg(PWR_MGMT_1, 0x01);
+        commit();
+        if (asleep)
+            thread_sleep_for(100);
+
+        setReg(CONFIG, 0x03);
 
         /* Set sample rate = gyroscope output rate/(1 + SMPLRT_DIV) */
-        /* Use a 200 Hz rate; the same rate set in CONFIG above */
-        writeByte(MPU6050_ADDRESS, SMPLRT_DIV, 0x04);
+        setReg(SMPLRT_DIV, RateDiv);
 
         /* Set gyroscope full scale range */
         /* Range selects FS_SEL and AFS_SEL are 0 - 3, so 2-bit values are left-shifted into positions 4:3 */
-        uint8_t c = readByte(MPU6050_ADDRESS, GYRO_CONFIG);
-        /* Clear self-test bits [7:5] */
-        writeByte(MPU6050_ADDRESS, GYRO_CONFIG, c & ~0xE0);
-        /* Clear AFS bits [4:3] */
-        writeByte(MPU6050_ADDRESS, GYRO_CONFIG, c & ~0x18);
-        /* Set full scale range for the gyro */
-        writeByte(MPU6050_ADDRESS, GYRO_CONFIG, c | Gscale << 3);
+        /* Clear self-test bits [7:5], set full scale range bits [4:3] */
+        updateReg(GYRO_CONFIG, 0xF8, GyroScale << 3);
 
         /* Set accelerometer configuration */
-        c = readByte(MPU6050_ADDRESS, ACCEL_CONFIG);
-        /* Clear self-test bits [7:5] */
-        writeByte(MPU6050_ADDRESS, ACCEL_CONFIG, c & ~0xE0);
-        /* Clear AFS bits [4:3] */
-        writeByte(MPU6050_ADDRESS, ACCEL_CONFIG, c & ~0x18);
-        /* Set full scale range for the accelerometer */
-        writeByte(MPU6050_ADDRESS, ACCEL_CONFIG, c | Ascale << 3);
-
-        /* Set interrupt pin active high, push-pull, and clear on read of INT_STATUS, enable I2C_BYPASS_EN */
-        writeByte(MPU6050_ADDRESS, INT_PIN_CFG, 0x22);
+        /* Clear self-test bits [7:5], set full scale range bits [4:3] */
+        updateReg(ACCEL_CONFIG, 0xF8, AccelScale << 3);
+
+        /* Set interrupt pin active high, push-pull, 50 us pulse per event so no INT_STATUS read is needed to re-arm, enable I2C_BYPASS_EN */
+        setReg(INT_PIN_CFG, 0x02);
         /* 0x01 Enable data ready (bit 0) interrupt */
-        writeByte(MPU6050_ADDRESS, INT_ENABLE, 0x01);
+        setReg(INT_ENABLE, 0x01);
+        commit();
     }
 
     /**
@@ -510,60 +1043,78 @@ public:
      * Function which accumulates gyro and accelerometer data after device initialization. 
      * It calculates the average of the at-rest readings and then loads the resulting offsets into accelerometer and gyro bias registers.
      * Reset device, reset all registers, clear gyro and accelerometer bias registers.
+     * The measured biases are kept in gyroBias and accelBias.
      * 
      * @return None
      */
-    void calibrate(float *dest1, float *dest2)
+    void calibrate()
     {
         uint8_t data[12];
         uint16_t p, packet_count, fifo_count;
         int32_t gyro_bias[3] = {0, 0, 0}, accel_bias[3] = {0, 0, 0};
 
         /* Write a one to bit 7 reset bit; toggle reset device */
-        writeByte(MPU6050_ADDRESS, PWR_MGMT_1, 0x80);
+        writeByte(Address, PWR_MGMT_1, 0x80);
         thread_sleep_for(100);
 
         /* Set clock source to be PLL with x-axis gyroscope reference, bits 2:0 = 001 */
-        writeByte(MPU6050_ADDRESS, PWR_MGMT_1, 0x01);
-        writeByte(MPU6050_ADDRESS, PWR_MGMT_2, 0x00);
+        setReg(PWR_MGMT_1, 0x01);
+        setReg(PWR_MGMT_2, 0x00);
+        commit();
         thread_sleep_for(100);
 
-        writeByte(MPU6050_ADDRESS, INT_ENABLE, 0x00);   /* Disable all interrupts            */
-        writeByte(MPU6050_ADDRESS, FIFO_EN, 0x00);      /* Disable FIFO                      */
-        writeByte(MPU6050_ADDRESS, PWR_MGMT_1, 0x00);   /* Turn on internal clock source     */
-        writeByte(MPU6050_ADDRESS, I2C_MST_CTRL, 0x00); /* Disable I2C master                */
-        writeByte(MPU6050_ADDRESS, USER_CTRL, 0x00);    /* Disable FIFO and I2C master modes */
-        writeByte(MPU6050_ADDRESS, USER_CTRL, 0x0C);    /* Reset FIFO and DMP                */
+        setReg(INT_ENABLE, 0x00);   /* Disable all interrupts            */
+        setReg(FIFO_EN, 0x00);      /* Disable FIFO                      */
+        setReg(PWR_MGMT_1, 0x00);   /* Turn on internal clock source     */
+        setReg(I2C_MST_CTRL, 0x00); /* Disable I2C master                */
+        setReg(USER_CTRL, 0x00);    /* Disable FIFO and I2C master modes */
+        commit();
+        writeByte(Address, USER_CTRL, 0x0C); /* Reset FIFO and DMP */
         thread_sleep_for(150);
 
-        writeByte(MPU6050_ADDRESS, CONFIG, 0x01);       /* Set low-pass filter to 188 Hz                                      */
-        writeByte(MPU6050_ADDRESS, SMPLRT_DIV, 0x00);   /* Set sample rate to 1 kHz                                           */
-        writeByte(MPU6050_ADDRESS, GYRO_CONFIG, 0x00);  /* Set gyro full-scale to 250 degrees per second, maximum sensitivity */
-        writeByte(MPU6050_ADDRESS, ACCEL_CONFIG, 0x00); /* Set accelerometer full-scale to 2 g, maximum sensitivity           */
+        setReg(CONFIG, 0x01);       /* Set low-pass filter to 188 Hz                                      */
+        setReg(SMPLRT_DIV, 0x00);   /* Set sample rate to 1 kHz                                           */
+        setReg(GYRO_CONFIG, 0x00);  /* Set gyro full-scale to 250 degrees per second, maximum sensitivity */
+        setReg(ACCEL_CONFIG, 0x00); /* Set accelerometer full-scale to 2 g, maximum sensitivity           */
 
         uint16_t gyrosensitivity = 131;    /* 131 LSB/degrees/sec */
         uint16_t accelsensitivity = 16384; /* 16384 LSB/g         */
 
         /* Configure FIFO to capture accelerometer and gyro data for bias calculation */
-        writeByte(MPU6050_ADDRESS, USER_CTRL, 0x40); /* Enable FIFO                                    */
-        writeByte(MPU6050_ADDRESS, FIFO_EN, 0x78);   /* Enable gyro and accelerometer sensors for FIFO */
+        setReg(USER_CTRL, 0x40); /* Enable FIFO                                    */
+        setReg(FIFO_EN, 0x78);   /* Enable gyro and accelerometer sensors for FIFO */
+        commit();
         thread_sleep_for(80);
 
         /* Disable gyro and accelerometer sensors for FIFO */
-        writeByte(MPU6050_ADDRESS, FIFO_EN, 0x00);
+        setReg(FIFO_EN, 0x00);
+        commit();
         
         /* Read FIFO sample count */
-        readBytes(MPU6050_ADDRESS, FIFO_COUNTH, 2, &data[0]);
+        readBytes(Address, FIFO_COUNTH, 2, &data[0]);
         fifo_count = ((uint16_t)data[0] << 8) | data[1];
         packet_count = fifo_count / 12;
 
+        /* Read the packets MPU_FIFO_BURST_PACKETS at a time */
+        uint16_t burst = 0;
+        uint8_t *packet = fifoBurst;
+
         for (p = 0; p < packet_count; p++)
         {
             int16_t accel_temp[3] = {0, 0, 0}, gyro_temp[3] = {0, 0, 0};
 
-            /* Read data for averaging */
-            readBytes(MPU6050_ADDRESS, FIFO_R_W, 12, &data[0]);
-            
+            if (burst == 0)
+            {
+                burst = packet_count - p;
+                if (burst > MPU_FIFO_BURST_PACKETS)
+                    burst = MPU_FIFO_BURST_PACKETS;
+                readBytes(Address, FIFO_R_W, burst * 12, fifoBurst);
+                packet = fifoBurst;
+            }
+            memcpy(data, packet, 12);
+            packet += 12;
+            burst--;
+
             /* Form signed 16-bit integer for each sample in FIFO */
             accel_temp[0] = (int16_t)(((int16_t)data[0] << 8) | data[1]);
             accel_temp[1] = (int16_t)(((int16_t)data[2] << 8) | data[3]);
@@ -597,36 +1148,23 @@ public:
 
         /* Construct the gyro biases for push to the hardware gyro bias registers, which are reset to zero upon device startup */
         /* Divide by 4 to get 32.9 LSB per deg/s to conform to expected bias input format */
-        data[0] = (-gyro_bias[0] / 4 >> 8) & 0xFF;
-
         /* Biases are additive, so change sign on calculated average gyro biases */
-        data[1] = (-gyro_bias[0] / 4) & 0xFF;
-        data[2] = (-gyro_bias[1] / 4 >> 8) & 0xFF;
-        data[3] = (-gyro_bias[1] / 4) & 0xFF;
-        data[4] = (-gyro_bias[2] / 4 >> 8) & 0xFF;
-        data[5] = (-gyro_bias[2] / 4) & 0xFF;
-
-        // Push gyro biases to hardware registers
-        writeByte(MPU6050_ADDRESS, XG_OFFS_USRH, data[0]);
-        writeByte(MPU6050_ADDRESS, XG_OFFS_USRL, data[1]);
-        writeByte(MPU6050_ADDRESS, YG_OFFS_USRH, data[2]);
-        writeByte(MPU6050_ADDRESS, YG_OFFS_USRL, data[3]);
-        writeByte(MPU6050_ADDRESS, ZG_OFFS_USRH, data[4]);
-        writeByte(MPU6050_ADDRESS, ZG_OFFS_USRL, data[5]);
+        int16_t gyro_offsets[3] = {(int16_t)(-gyro_bias[0] / 4), (int16_t)(-gyro_bias[1] / 4), (int16_t)(-gyro_bias[2] / 4)};
+
+        // Push gyro biases to hardware registers, one burst write
+        setGyroOffsets(gyro_offsets);
 
         /* Construct gyro bias in deg/s for later manual subtraction */
-        dest1[0] = (float)gyro_bias[0] / (float)gyrosensitivity;
-        dest1[1] = (float)gyro_bias[1] / (float)gyrosensitivity;
-        dest1[2] = (float)gyro_bias[2] / (float)gyrosensitivity;
+        gyroBias[0] = (float)gyro_bias[0] / (float)gyrosensitivity;
+        gyroBias[1] = (float)gyro_bias[1] / (float)gyrosensitivity;
+        gyroBias[2] = (float)gyro_bias[2] / (float)gyrosensitivity;
 
         int32_t accel_bias_reg[3] = {0, 0, 0};
-        /* Read factory accelerometer trim values */
-        readBytes(MPU6050_ADDRESS, XA_OFFSET_H, 2, &data[0]);
+        /* Read factory accelerometer trim values, XA_OFFSET_H through ZA_OFFSET_L_TC in one burst */
+        readBytes(Address, XA_OFFSET_H, 6, &data[0]);
         accel_bias_reg[0] = (int16_t)((int16_t)data[0] << 8) | data[1];
-        readBytes(MPU6050_ADDRESS, YA_OFFSET_H, 2, &data[0]);
-        accel_bias_reg[1] = (int16_t)((int16_t)data[0] << 8) | data[1];
-        readBytes(MPU6050_ADDRESS, ZA_OFFSET_H, 2, &data[0]);
-        accel_bias_reg[2] = (int16_t)((int16_t)data[0] << 8) | data[1];
+        accel_bias_reg[1] = (int16_t)((int16_t)data[2] << 8) | data[3];
+        accel_bias_reg[2] = (int16_t)((int16_t)data[4] << 8) | data[5];
 
         /* Define mask for temperature compensation bit 0 of lower byte of accelerometer bias registers */
         uint32_t mask = 1uL;
@@ -655,10 +1193,334 @@ public:
         data[5] = (accel_bias_reg[2]) & 0xFF;
         data[5] = data[5] | mask_bit[2];
 
-        dest2[0] = (float)accel_bias[0] / (float)accelsensitivity;
-        dest2[1] = (float)accel_bias[1] / (float)accelsensitivity;
-        dest2[2] = (float)accel_bias[2] / (float)accelsensitivity;
+        accelBias[0] = (float)accel_bias[0] / (float)accelsensitivity;
+        accelBias[1] = (float)accel_bias[1] / (float)accelsensitivity;
+        accelBias[2] = (float)accel_bias[2] / (float)accelsensitivity;
+    }
+
+    /**
+     * @brief Biases left in the raw output after calibrate(), in counts of the configured scales
+     *
+     * calibrate() pushes the gyro bias to the offset registers in steps of 4 counts of the
+     * +-250 dps scale it measures in, so up to 3 of those counts remain; the accelerometer bias
+     * is measured but not pushed.
+     *
+     * @param gyro  Remaining gyro bias
+     * @param accel Accelerometer bias
+     *
+     * @return None
+     */
+    void residualBias(float gyro[3], float accel[3]) const
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int32_t bias = (int32_t)lrintf(gyroBias[axis] * 131.0f);
+            gyro[axis] = (float)(bias - bias / 4 * 4) / (float)(1 << GyroScale);
+            accel[axis] = accelBias[axis] / aRes;
+        }
     }
+
+    /**
+     * @brief Write the gyro offset registers XG_OFFS_USR..ZG_OFFS_USR in one burst
+     *
+     * One offset count is 4 raw counts of the +-250 dps scale and adds to the output. Once a
+     * transaction engine is attached the write is only queued, so acquisition goes on.
+     *
+     * @return None
+     */
+    void setGyroOffsets(const int16_t offsets[3])
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            setReg(XG_OFFS_USRH + 2 * axis, (uint8_t)((uint16_t)offsets[axis] >> 8));
+            setReg(XG_OFFS_USRL + 2 * axis, (uint8_t)offsets[axis]);
+        }
+        commit();
+    }
+
+    /**
+     * @brief Gyro offset register values, from the register shadow
+     *
+     * @return None
+     */
+    void gyroOffsets(int16_t offsets[3])
+    {
+        for (int axis = 0; axis < 3; axis++)
+            offsets[axis] = (int16_t)((readReg(XG_OFFS_USRH + 2 * axis) << 8) | readReg(XG_OFFS_USRL + 2 * axis));
+    }
+
+    /**
+     * @brief Read the die temperature, blocking
+     *
+     * @return Temperature in degrees C
+     */
+    float readTemperature()
+    {
+        uint8_t raw[2];
+        readBytes(Address, TEMP_OUT_H, 2, raw);
+        return temperatureC((int16_t)(((int16_t)raw[0] << 8) | raw[1]));
+    }
+
+    /** Degrees C of a raw TEMP_OUT value */
+    static float temperatureC(int16_t raw) { return (float)raw / 340.0f + 36.53f; }
+
+public:
+    /* Number of FIFO overflows seen by readFifo() */
+    uint32_t fifoOverflows = 0;
+
+    /* Newest gyro sample, set by the consumer of the sample ring */
+    int16_t gyroCount[3] = {0, 0, 0};
+
+    /* Bias corrections for gyro (dps) and accelerometer (g), measured by calibrate() */
+    float gyroBias[3] = {0, 0, 0};
+    float accelBias[3] = {0, 0, 0};
+
+    /* Time the last loadDmp() took, upload and verification */
+    uint32_t dmpLoadUs = 0;
+
+    /* Newest DMP quaternion w, x, y, z as Q30 and the time of its packet, set by the FIFO reads after startDmp() */
+    int32_t dmpQuaternion[4] = {1 << 30, 0, 0, 0};
+    uint32_t dmpTimestampUs = 0;
+
+private:
+#if DEVICE_I2C_ASYNCH
+    void finishAsync(int result)
+    {
+        mbed::Callback<void(int)> done = asyncDone;
+        asyncDone = nullptr;
+        if (done)
+            done(result);
+    }
+
+    void onFifoCount(int result)
+    {
+        if (result)
+        {
+            finishAsync(-2);
+            return;
+        }
+
+        uint16_t fifo_count = ((uint16_t)asyncRaw[0] << 8) | asyncRaw[1];
+
+        if (fifo_count >= MPU_FIFO_SIZE)
+        {
+            fifoOverflows++;
+            resetFifo();
+            finishAsync(-1);
+            return;
+        }
+
+        asyncPackets = fifo_count / fifoPacketSize;
+        asyncRead = 0;
+        readFifoBurst();
+    }
+
+    void readFifoBurst()
+    {
+        if (asyncRead == asyncPackets)
+        {
+            finishAsync(asyncRead);
+            return;
+        }
+
+        asyncBurst = asyncPackets - asyncRead;
+        if (asyncBurst > burstPackets())
+            asyncBurst = burstPackets();
+
+        if (!engine->writeRead(Address, FIFO_R_W, &fifoBurst[0], asyncBurst * fifoPacketSize,
+                               callback(this, &MPU6050::onFifoBurst)))
+        {
+            finishAsync(-2);
+        }
+    }
+
+    void onFifoBurst(int result)
+    {
+        if (result)
+        {
+            finishAsync(-2);
+            return;
+        }
+
+        for (int p = 0; p < asyncBurst; p++)
+        {
+            MPU6050TimedSample timed;
+            timed.timestamp_us = asyncTimestampUs - (uint32_t)(asyncPackets - 1 - asyncRead - p) * fifoPeriodUs;
+            unpackPacket(&fifoBurst[p * fifoPacketSize], timed);
+            asyncRing->push(timed);
+        }
+        asyncRead += asyncBurst;
+        readFifoBurst();
+    }
+
+    void onFrame(int result)
+    {
+        if (result)
+        {
+            finishAsync(-2);
+            return;
+        }
+
+        if (!(asyncRaw[0] & 0x01))
+        {
+            finishAsync(0);
+            return;
+        }
+
+        MPU6050TimedSample timed;
+        timed.timestamp_us = asyncTimestampUs;
+        unpackSample(&asyncRaw[1], timed.sample);
+        asyncRing->push(timed);
+        finishAsync(1);
+    }
+#endif
+
+    /**
+     * @brief Reset the FIFO, keeping it (and the DMP) enabled
+     *
+     * @return None
+     */
+    void resetFifo()
+    {
+        writeByte(Address, USER_CTRL, (readReg(USER_CTRL) & 0xC0) | 0x04);
+    }
+
+    /** Packets of the current stream that fit one FIFO_R_W burst */
+    int burstPackets() const
+    {
+        return (int)sizeof(fifoBurst) / fifoPacketSize;
+    }
+
+    /**
+     * @brief Unpack one FIFO packet of the current stream
+     *
+     * @return None
+     */
+    void unpackPacket(const uint8_t *raw, MPU6050TimedSample &timed)
+    {
+        if (fifoPacketSize == MPU_DMP_PACKET_SIZE)
+        {
+            unpackDmpPacket(raw, timed.sample, dmpQuaternion);
+            dmpTimestampUs = timed.timestamp_us;
+        }
+        else
+        {
+            unpackSample(raw, timed.sample);
+        }
+    }
+
+    /** Bytes of DMP memory from <address> up to the end of its bank, at most MPU_DMP_CHUNK_SIZE and <length> */
+    static uint16_t dmpChunk(uint16_t address, uint16_t length)
+    {
+        uint16_t chunk = MPU_DMP_BANK_SIZE - (address & (MPU_DMP_BANK_SIZE - 1));
+
+        chunk = chunk < MPU_DMP_CHUNK_SIZE ? chunk : MPU_DMP_CHUNK_SIZE;
+        return chunk < length ? chunk : length;
+    }
+
+    /**
+     * @brief Point DMP_REG at <address>: DMP_BANK and DMP_RW_PNT in one burst
+     *
+     * @return false on a bus error
+     */
+    bool setDmpPointer(uint16_t address)
+    {
+        const char data_write[3] = {DMP_BANK, (char)(address >> 8), (char)address};
+        return i2c.write(Address, data_write, sizeof(data_write), 0) == 0;
+    }
+
+    bool isKnown(uint8_t subAddress) const
+    {
+        return (regKnown[subAddress >> 5] >> (subAddress & 31)) & 1u;
+    }
+
+    bool isDirty(uint8_t subAddress) const
+    {
+        return (regDirty[subAddress >> 5] >> (subAddress & 31)) & 1u;
+    }
+
+    /**
+     * @brief Record a direct register write in the shadow
+     *
+     * Self-clearing bits read back as 0: a device reset restores the power-on defaults and the
+     * reset bits of USER_CTRL and SIGNAL_PATH_RESET are not kept.
+     *
+     * @return None
+     */
+    void shadowWritten(uint8_t subAddress, uint8_t data)
+    {
+        if (subAddress == PWR_MGMT_1 && (data & 0x80))
+        {
+            resetShadow();
+            return;
+        }
+        if (subAddress == USER_CTRL)
+            data &= ~0x0F;
+        else if (subAddress == SIGNAL_PATH_RESET)
+            data = 0x00;
+
+        regShadow[subAddress] = data;
+        regKnown[subAddress >> 5] |= 1u << (subAddress & 31);
+        regDirty[subAddress >> 5] &= ~(1u << (subAddress & 31));
+    }
+
+    /**
+     * @brief Power-on register values: all 0 except PWR_MGMT_1 (0x40, sleep) and WHO_AM_I (0x68)
+     *
+     * The factory trim registers (self-test and accelerometer offsets) are left unknown.
+     *
+     * @return None
+     */
+    void resetShadow()
+    {
+        memset(regShadow, 0, sizeof(regShadow));
+        memset(regKnown, 0xFF, sizeof(regKnown));
+        memset(regDirty, 0, sizeof(regDirty));
+        regShadow[PWR_MGMT_1] = 0x40;
+        regShadow[WHO_AM_I_MPU6050] = 0x68;
+
+        for (uint8_t reg = 0x00; reg <= 0x10; reg++)
+            regKnown[reg >> 5] &= ~(1u << (reg & 31));
+    }
+
+    /* Last known value of every register, with staged edits; 1 bit per register in the masks */
+    uint8_t regShadow[MPU_REGISTER_COUNT];
+    uint32_t regKnown[MPU_REGISTER_COUNT / 32] = {0, 0, 0, 0};
+    uint32_t regDirty[MPU_REGISTER_COUNT / 32] = {0, 0, 0, 0};
+
+    /* Receive buffer of FIFO_R_W burst reads */
+    uint8_t fifoBurst[MPU_FIFO_BURST_PACKETS * MPU_FIFO_PACKET_SIZE];
+
+    /* FIFO stream format: sample packets after startFifo(), DMP packets after startDmp() */
+    int fifoPacketSize = MPU_FIFO_PACKET_SIZE;
+    uint32_t fifoPeriodUs = samplePeriodUs;
+
+    /* DMP output period, see setDmpRate() */
+    uint32_t dmpPeriodUs = MPU_DMP_SAMPLE_PERIOD_US;
+
+#if DEVICE_I2C_ASYNCH
+    /* Transaction engine used for writes and the asynchronous reads, nullptr for blocking access */
+    I2CEngine *engine = nullptr;
+
+    /* State of the read chain in flight */
+    MPU6050SampleRing *asyncRing = nullptr;
+    uint32_t asyncTimestampUs = 0;
+    mbed::Callback<void(int)> asyncDone;
+    uint8_t asyncRaw[MPU_FRAME_SIZE];
+    int asyncPackets = 0;
+    int asyncRead = 0;
+    int asyncBurst = 0;
+#endif
 };
 
+/* Definitions of the constexpr members, needed when they are odr-used before C++17 */
+#define MPU6050_TEMPLATE template <uint8_t GyroScale, uint8_t AccelScale, uint8_t Address, uint8_t RateDiv>
+MPU6050_TEMPLATE constexpr uint8_t MPU6050<GyroScale, AccelScale, Address, RateDiv>::gyroScale;
+MPU6050_TEMPLATE constexpr uint8_t MPU6050<GyroScale, AccelScale, Address, RateDiv>::accelScale;
+MPU6050_TEMPLATE constexpr uint8_t MPU6050<GyroScale, AccelScale, Address, RateDiv>::address;
+MPU6050_TEMPLATE constexpr float MPU6050<GyroScale, AccelScale, Address, RateDiv>::gRes;
+MPU6050_TEMPLATE constexpr float MPU6050<GyroScale, AccelScale, Address, RateDiv>::aRes;
+MPU6050_TEMPLATE constexpr uint32_t MPU6050<GyroScale, AccelScale, Address, RateDiv>::samplePeriodUs;
+#undef MPU6050_TEMPLATE
+
 #endif
\ No newline at end of file
@@ -0,0 +1,262 @@
+#pragma once
+
+#ifndef __RINGBUFFER_H__
+#define __RINGBUFFER_H__
+
+/**
+ * @file ringbuffer.h
+ *
+ * @brief Lock-free single-producer/single-consumer and multi-producer/single-consumer ring buffers.
+ *
+ * The producer (interrupt handler or sensor context) only writes the head
+ * index, the consumer only writes the tail index, so push and pop are
+ * wait-free: one acquire load of the other side's index, one copy and one
+ * release store. Both indexes run freely and wrap at 2^32, the slot is the
+ * index masked with the power-of-two size.
+ *
+ * The MPSC ring lets any number of threads and interrupt handlers push:
+ * producers claim a slot with a compare-and-swap on the head index and
+ * publish it through the slot's sequence number, so no producer ever waits
+ * for another and a preempted one only holds back the consumer.
+ */
+
+#include <stdint.h>
+#include <atomic>
+
+/*
+ * Alignment of the producer/consumer indexes, keeps them on separate cache lines on the host. The
+ * Cortex-M4 of the nRF52 has no data cache, padding there would only cost RAM in every ring.
+ */
+#ifndef SPSC_CACHE_LINE
+#if defined(HOST_SIM)
+#define SPSC_CACHE_LINE 64
+#else
+#define SPSC_CACHE_LINE alignof(std::atomic<uint32_t>)
+#endif
+#endif
+
+/**
+ * @class SpscRing
+ *
+ * @brief Fixed capacity SPSC queue with overflow accounting.
+ *
+ * When the ring is full push() drops the new item and counts it, so the
+ * consumer always sees a gap-free prefix of the stream.
+ *
+ * @tparam T    Item type, copied by value
+ * @tparam Size Capacity, must be a power of two
+ */
+template <typename T, uint32_t Size>
+class SpscRing
+{
+    static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    /**
+     * @brief Append one item; producer side only.
+     *
+     * @return false if the ring was full and the item was dropped
+     */
+    bool push(const T &item)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+
+        if (head - _tail.load(std::memory_order_acquire) == Size)
+        {
+            _dropped.store(_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        _items[head & (Size - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Remove the oldest item; consumer side only.
+     *
+     * @return false if the ring was empty
+     */
+    bool pop(T &item)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+
+        if (_head.load(std::memory_order_acquire) == tail)
+            return false;
+
+        item = _items[tail & (Size - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Remove up to <max> oldest items with a single index update; consumer side only.
+     *
+     * @return Number of items copied to <dst>
+     */
+    uint32_t popBatch(T *dst, uint32_t max)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        uint32_t available = _head.load(std::memory_order_acquire) - tail;
+        uint32_t count = available < max ? available : max;
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            dst[i] = _items[(tail + i) & (Size - 1)];
+        }
+
+        _tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * @brief Drop everything queued so far; consumer side only.
+     *
+     * @return Number of items discarded
+     */
+    uint32_t clear()
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        uint32_t head = _head.load(std::memory_order_acquire);
+
+        _tail.store(head, std::memory_order_release);
+        return head - tail;
+    }
+
+    /** Items currently queued; exact on either side, a snapshot elsewhere */
+    uint32_t size() const
+    {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    /** Items dropped because the ring was full */
+    uint32_t dropped() const
+    {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+    /** Items accepted since start */
+    uint32_t pushed() const
+    {
+        return _head.load(std::memory_order_relaxed);
+    }
+
+    static constexpr uint32_t capacity() { return Size; }
+
+private:
+    alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> _head{0};
+    std::atomic<uint32_t> _dropped{0};
+    alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> _tail{0};
+    alignas(SPSC_CACHE_LINE) alignas(T) T _items[Size];
+};
+
+/**
+ * @class MpscRing
+ *
+ * @brief Fixed capacity MPSC queue with drop-on-full accounting.
+ *
+ * Bounded queue after D. Vyukov: every slot carries a sequence number that
+ * tells producers whether it is free for their lap and the consumer whether
+ * it was published. Sequences are stored relative to the slot index, so the
+ * zero-filled state is the empty ring: an instance with static storage needs
+ * no constructor and can be pushed to from an interrupt handler at any time.
+ * Instances elsewhere must be value-initialized.
+ *
+ * @tparam T    Item type, copied by value
+ * @tparam Size Capacity, must be a power of two
+ */
+template <typename T, uint32_t Size>
+class MpscRing
+{
+    static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "MpscRing size must be a power of two");
+
+public:
+    /**
+     * @brief Append one item; any thread or interrupt handler.
+     *
+     * @return false if the ring was full and the item was dropped
+     */
+    bool push(const T &item)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        Slot *slot;
+
+        for (;;)
+        {
+            slot = &_slots[head & (Size - 1)];
+            int32_t lap = (int32_t)(slot->sequence.load(std::memory_order_acquire) + (head & (Size - 1)) - head);
+
+            if (lap == 0)
+            {
+                if (_head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (lap < 0)
+            {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                head = _head.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->item = item;
+        slot->sequence.store(head + 1 - (head & (Size - 1)), std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Remove the oldest item; consumer side only.
+     *
+     * @return false if the ring was empty or its oldest item is still being written
+     */
+    bool pop(T &item)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        Slot &slot = _slots[tail & (Size - 1)];
+
+        if (slot.sequence.load(std::memory_order_acquire) + (tail & (Size - 1)) != tail + 1)
+            return false;
+
+        item = slot.item;
+        slot.sequence.store(tail + Size - (tail & (Size - 1)), std::memory_order_release);
+        _tail.store(tail + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /** Items currently queued or being written; a snapshot */
+    uint32_t size() const
+    {
+        return _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_relaxed);
+    }
+
+    /** Items dropped because the ring was full */
+    uint32_t dropped() const
+    {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+    /** Items accepted since start */
+    uint32_t pushed() const
+    {
+        return _head.load(std::memory_order_relaxed);
+    }
+
+    static constexpr uint32_t capacity() { return Size; }
+
+private:
+    struct Slot
+    {
+        std::atomic<uint32_t> sequence;
+        T item;
+    };
+
+    alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> _head;
+    std::atomic<uint32_t> _dropped;
+    alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> _tail;
+    alignas(SPSC_CACHE_LINE) alignas(Slot) Slot _slots[Size];
+};
+
+#endif
@@ -7,6 +7,16 @@
  * Additional compilation unit for logging, 
  * data conversation and service info.
  * 
+ * With LOG_BINARY the LOG macros write compact binary records instead of
+ * text: message ID, timestamp and raw arguments. The text is put back
+ * together on the host by logdecode.py from the format strings in the
+ * sources.
+ * 
+ * With LOG_DEFERRED (the default) a LOG call only captures the record into
+ * a lock-free queue; a low-priority logger thread formats and transmits it,
+ * so callers never wait for the mutex or the serial port. A full queue
+ * drops records and counts them.
+ * 
  */ 
 
 #include <mbed.h>
@@ -17,6 +27,12 @@
 #include <stdlib.h>
 #include <malloc.h>
 
+#include <atomic>
+#include <type_traits>
+
+#include "ringbuffer.h"
+#include "tracepoint.h"
+
 /* Maximum USB-TX buffer */
 #define MAX_TX_BUFFER_SIZE 255
 
@@ -26,6 +42,65 @@
 /* PC-USB connection Baudrate */
 #define BAUDRATE 115200
 
+/* Log output: text lines (0) or binary records decoded on the host by logdecode.py (1) */
+#ifndef LOG_BINARY
+#define LOG_BINARY 0
+#endif
+
+/* Log levels, also the level field of a binary record; LOG_LEVEL_NONE only as a minimum */
+#define LOG_LEVEL_INFO 0
+#define LOG_LEVEL_WARNING 1
+#define LOG_LEVEL_ERROR 2
+#define LOG_LEVEL_NONE 3
+
+/* Lowest level compiled in; LOG calls below it compile to nothing */
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+/* Lowest level compiled in per module: GyroAndPeriphService (APP) and BLEProcess (BLE) */
+#ifndef LOG_LEVEL_APP
+#define LOG_LEVEL_APP LOG_LEVEL
+#endif
+
+#ifndef LOG_LEVEL_BLE
+#define LOG_LEVEL_BLE LOG_LEVEL
+#endif
+
+/* Lowest level logged after start-up, raised or lowered at runtime with logLevel() */
+#ifndef LOG_RUNTIME_LEVEL
+#define LOG_RUNTIME_LEVEL LOG_LEVEL_INFO
+#endif
+
+/* Shortest interval between two records of one rate-limited LOG call */
+#ifndef LOG_RATE_LIMIT_MS
+#define LOG_RATE_LIMIT_MS 1000
+#endif
+
+/* Binary record: header byte, message ID and timestamp, then up to LOG_RECORD_MAX_ARGS 32-bit arguments */
+#define LOG_RECORD_SYNC 0xA0
+#define LOG_RECORD_HEADER_SIZE 7
+#define LOG_RECORD_MAX_ARGS 7
+
+/* LOG macros queue records for the logger thread (1) or write on the caller's thread (0) */
+#ifndef LOG_DEFERRED
+#define LOG_DEFERRED 1
+#endif
+
+/* Records the log queue holds, a power of two; more are dropped and counted */
+#ifndef LOG_QUEUE_SIZE
+#define LOG_QUEUE_SIZE 32
+#endif
+
+/* Logger thread: wake-up period and stack size */
+#ifndef LOG_DRAIN_PERIOD_MS
+#define LOG_DRAIN_PERIOD_MS 10
+#endif
+
+#ifndef LOG_THREAD_STACK_SIZE
+#define LOG_THREAD_STACK_SIZE 1536
+#endif
+
 /* Colors for debug info */
 #define black "\033[0;30m"
 #define red "\033[0;31m"
@@ -193,54 +268,460 @@ inline void BOARD_INFO(void)
 }
 
 /**
- * @brief Simple log to the terminal appropriate message 
- * 
- * Representing information [I] message with runtime ms addition
- * 
- * @param message Pointer for char message array
+ * @brief Message ID of a log format string, computed by the compiler
+ *
+ * FNV-1a over the bytes of the string, folded to 16 bits. logdecode.py
+ * computes the same over the LOG format strings of the sources.
+ *
+ * @param format Format string literal
+ *
+ * @return Message ID
+ */
+constexpr uint16_t log_message_id(const char *format)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*format)
+        hash = (hash ^ (uint8_t)*format++) * 16777619u;
+    return (uint16_t)((hash >> 16) ^ hash);
+}
+
+/* Message ID of a format string literal, a constant even in unoptimized builds */
+#define LOG_ID(format) (std::integral_constant<uint16_t, log_message_id(format)>::value)
+
+/**
+ * @brief Log argument as it goes into a binary record
+ *
+ * Integers are truncated to 32 bits, floats keep their IEEE 754 bits.
+ *
+ * @return Raw 32-bit argument
+ */
+template <typename T>
+inline uint32_t log_arg(T value)
+{
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "log arguments are integers or floats");
+    return (uint32_t)value;
+}
+
+inline uint32_t log_arg(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline uint32_t log_arg(double value)
+{
+    return log_arg((float)value);
+}
+
+/**
+ * Log message as the caller captured it, nothing formatted yet.
+ */
+struct LogRecord
+{
+    /* Format string for text output, nullptr in binary builds */
+    const char *format;
+
+    /* us_ticker_read() at capture */
+    uint32_t timestamp_us;
+
+    /* LOG_ID() of the format string */
+    uint16_t id;
+
+    uint8_t level;
+
+    /* Arguments in use */
+    uint8_t count;
+    uint32_t args[LOG_RECORD_MAX_ARGS];
+};
+
+/**
+ * @brief Capture a log message: timestamp and raw arguments
+ *
+ * @param record Destination
+ * @param level  LOG_LEVEL_INFO, LOG_LEVEL_WARNING or LOG_LEVEL_ERROR
+ * @param id     LOG_ID() of the format string
+ * @param format Format string, or nullptr if only the ID is written
+ * @param args   Integer or float arguments of the format string
  *
  * @return None
  */
-inline void LOGI(const char *message)
+template <typename... Args>
+inline void log_capture(LogRecord &record, uint8_t level, uint16_t id, const char *format, Args... args)
 {
-    debugMutex.lock();
-    debugOut.write(blueBold, 8);
-    debugMutex.unlock();
-    nrf_fast_log(message);
+    static_assert(sizeof...(Args) <= LOG_RECORD_MAX_ARGS, "too many log arguments");
+
+    const uint32_t values[sizeof...(Args) + 1] = {log_arg(args)..., 0};
+
+    record.format = format;
+    record.timestamp_us = us_ticker_read();
+    record.id = id;
+    record.level = level;
+    record.count = (uint8_t)sizeof...(Args);
+    memcpy(record.args, values, sizeof(uint32_t) * sizeof...(Args));
 }
 
 /**
- * @brief Simple log to the terminal appropriate message 
- * 
- * Representing warning [W] message with runtime ms addition
- * 
- * @param message Pointer for char message array
+ * @brief Binary encoding of <record>
+ *
+ * Little endian: header byte LOG_RECORD_SYNC | level << 3 | argument count,
+ * 16-bit message ID, 32-bit timestamp, then one 32-bit word per argument.
+ *
+ * @return Bytes written to <out>, at most LOG_RECORD_HEADER_SIZE + 4 * LOG_RECORD_MAX_ARGS
+ */
+inline uint32_t log_encode_binary(uint8_t *out, const LogRecord &record)
+{
+    out[0] = (uint8_t)(LOG_RECORD_SYNC | record.level << 3 | record.count);
+    out[1] = (uint8_t)record.id;
+    out[2] = (uint8_t)(record.id >> 8);
+    memcpy(&out[3], &record.timestamp_us, sizeof(record.timestamp_us));
+    memcpy(&out[LOG_RECORD_HEADER_SIZE], record.args, 4 * record.count);
+    return LOG_RECORD_HEADER_SIZE + 4 * record.count;
+}
+
+/**
+ * @brief Text line of <record>: level color and letter, time in ms, the formatted message
+ *
+ * Every conversion takes the next 32-bit word of the record, length
+ * modifiers are ignored.
+ *
+ * @param out     Destination, always terminated
+ * @param size    Size of <out>
+ * @param record  Captured message
+ * @param time_us Capture time, extended beyond the 32-bit timestamp
+ *
+ * @return Length of the line, truncated to fit <out>
+ */
+inline uint32_t log_format_text(char *out, uint32_t size, const LogRecord &record, uint64_t time_us)
+{
+    static const char *const colors[] = {blueBold, yellow, redBold};
+    const char *format = record.format ? record.format : "";
+    uint32_t length = 0, arg = 0;
+
+    auto append = [&](int written)
+    {
+        if (written > 0)
+            length += (uint32_t)written < size - 1 - length ? (uint32_t)written : size - 1 - length;
+    };
+
+    append(snprintf(out, size, "%s%c  (%lu)\t", colors[record.level % 3], "IWE"[record.level % 3],
+                    (unsigned long)(time_us / 1000)));
+
+    while (*format && length < size - 1)
+    {
+        if (*format != '%')
+        {
+            out[length++] = *format++;
+            continue;
+        }
+
+        char spec[16] = "%";
+        uint32_t n = 1;
+
+        for (format++; *format && strchr("-+ #0123456789.", *format) && n < sizeof(spec) - 2; format++)
+            spec[n++] = *format;
+        while (*format && strchr("hljzt", *format))
+            format++;
+
+        char conversion = *format ? *format++ : '%';
+        uint32_t word = arg < record.count ? record.args[arg] : 0;
+        float value;
+
+        spec[n++] = conversion;
+        spec[n] = '\0';
+
+        switch (conversion)
+        {
+        case 'd':
+        case 'i':
+            append(snprintf(out + length, size - length, spec, (int)(int32_t)word));
+            arg++;
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+            append(snprintf(out + length, size - length, spec, (unsigned)word));
+            arg++;
+            break;
+        case 'c':
+            append(snprintf(out + length, size - length, spec, (int)word));
+            arg++;
+            break;
+        case 'f':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+            memcpy(&value, &word, sizeof(value));
+            append(snprintf(out + length, size - length, spec, (double)value));
+            arg++;
+            break;
+        default:
+            out[length++] = '%';
+        }
+    }
+
+    append(snprintf(out + length, size - length, "\r\n"));
+    out[length] = '\0';
+    return length;
+}
+
+/**
+ * @brief Write <record> to the terminal, in the format LOG_BINARY selects
+ *
+ * Blocks while the serial buffer is full; timed as TRACE_LOG_WRITE, waiting
+ * for the mutex excluded. Text lines extend the 32-bit
+ * timestamps to 64 bit, which holds as long as records are written at least
+ * once per 71 minutes.
  *
  * @return None
  */
-inline void LOGW(const char *message)
+inline void log_write(const LogRecord &record)
 {
+    static uint32_t last_us = 0;
+    static uint64_t epoch_us = 0;
+    char line[MAX_TX_BUFFER_SIZE];
+    uint32_t length;
+
     debugMutex.lock();
-    debugOut.write(yellow, 8);
+    {
+        TraceScope trace(TRACE_LOG_WRITE);
+#if LOG_BINARY
+        length = log_encode_binary((uint8_t *)line, record);
+#else
+        /* Records queued by interrupt handlers can be a little out of order, only forward steps count */
+        if ((int32_t)(record.timestamp_us - last_us) > 0)
+        {
+            if (record.timestamp_us < last_us)
+                epoch_us += 1ull << 32;
+            last_us = record.timestamp_us;
+        }
+        length = log_format_text(line, sizeof(line), record, epoch_us + record.timestamp_us);
+#endif
+        debugOut.write(line, length);
+    }
     debugMutex.unlock();
-    nrf_fast_log(message);
 }
 
 /**
- * @brief Simple log to the terminal appropriate message 
- * 
- * Representing error [E] message with runtime ms addition
- * 
- * @param message Pointer for char message array
+ * @brief Queue of captured records between the LOG macros and the logger thread
+ *
+ * Zero-filled static storage, so it takes records from reset on, before
+ * any constructor ran and from interrupt handlers.
+ *
+ * @return The queue
+ */
+inline MpscRing<LogRecord, LOG_QUEUE_SIZE> &logQueue(void)
+{
+    static MpscRing<LogRecord, LOG_QUEUE_SIZE> queue;
+    return queue;
+}
+
+/**
+ * @brief Capture a log message into logQueue(), dropped if the queue is full
+ *
+ * Never blocks, callable from interrupt handlers.
  *
  * @return None
  */
-inline void LOGE(const char *message)
+template <typename... Args>
+inline void log_push(uint8_t level, uint16_t id, const char *format, Args... args)
 {
-    debugMutex.lock();
-    debugOut.write(redBold, 8);
-    debugMutex.unlock();
-    nrf_fast_log(message);
+    LogRecord record;
+
+    log_capture(record, level, id, format, args...);
+    logQueue().push(record);
+}
+
+/**
+ * @brief Capture a log message and write it right away, on the caller's thread
+ *
+ * @return None
+ */
+template <typename... Args>
+inline void log_now(uint8_t level, uint16_t id, const char *format, Args... args)
+{
+    LogRecord record;
+
+    log_capture(record, level, id, format, args...);
+    log_write(record);
+}
+
+/**
+ * Compile-time minimum level of the calling code. Classes of a module
+ * shadow it with a static member of the same name, e.g.
+ * static constexpr uint8_t logModuleLevel = LOG_LEVEL_BLE, so LOG calls in
+ * their member functions use the module level.
+ */
+constexpr uint8_t logModuleLevel = LOG_LEVEL;
+
+/**
+ * @brief Runtime minimum level, for every module; cannot go below the compile-time one
+ *
+ * @return The level, relaxed loads and stores
+ */
+inline std::atomic<uint8_t> &logLevel(void)
+{
+    static std::atomic<uint8_t> level{LOG_RUNTIME_LEVEL};
+    return level;
+}
+
+/**
+ * State of one rate-limited LOG call site.
+ */
+struct LogRateLimit
+{
+    uint32_t last_us;
+    uint32_t suppressed;
+    bool shown;
+};
+
+/**
+ * @brief Let a record of a rate-limited call site through at most once per LOG_RATE_LIMIT_MS
+ *
+ * Not synchronized: a call site shared by threads or interrupt handlers may
+ * let one record too many through, never blocks.
+ *
+ * @param limit      State of the call site
+ * @param suppressed Records held back since the previous one that passed, if it passes
+ *
+ * @return true if the record passes
+ */
+inline bool log_rate_pass(LogRateLimit &limit, uint32_t &suppressed)
+{
+    uint32_t now_us = us_ticker_read();
+
+    if (limit.shown && now_us - limit.last_us < (uint32_t)LOG_RATE_LIMIT_MS * 1000u)
+    {
+        limit.suppressed++;
+        return false;
+    }
+
+    suppressed = limit.suppressed;
+    limit.suppressed = 0;
+    limit.last_us = now_us;
+    limit.shown = true;
+    return true;
+}
+
+/* A LOG call of <level> is compiled in and passes the runtime level */
+#define LOG_ENABLED(level) ((level) >= logModuleLevel && (level) >= logLevel().load(std::memory_order_relaxed))
+
+#if LOG_BINARY
+#define LOG_FORMAT(format) nullptr
+#else
+#define LOG_FORMAT(format) format
+#endif
+
+#if LOG_DEFERRED
+#define LOG_RECORD(level, format, ...) log_push(level, LOG_ID(format), LOG_FORMAT(format), ##__VA_ARGS__)
+#else
+#define LOG_RECORD(level, format, ...) log_now(level, LOG_ID(format), LOG_FORMAT(format), ##__VA_ARGS__)
+#endif
+
+#define LOG_EMIT(level, format, ...)                        \
+    do                                                      \
+    {                                                       \
+        if (LOG_ENABLED(level))                             \
+            LOG_RECORD(level, format, ##__VA_ARGS__);       \
+    } while (0)
+
+#define LOG_EMIT_LIMITED(level, format, ...)                                                                         \
+    do                                                                                                               \
+    {                                                                                                                \
+        static LogRateLimit log_limit;                                                                               \
+        uint32_t log_suppressed = 0;                                                                                 \
+        if (LOG_ENABLED(level) && log_rate_pass(log_limit, log_suppressed))                                          \
+        {                                                                                                            \
+            LOG_RECORD(level, format, ##__VA_ARGS__);                                                                \
+            if (log_suppressed)                                                                                      \
+                LOG_RECORD(level, "Message above repeated %u times since last shown\r\n", (unsigned)log_suppressed); \
+        }                                                                                                            \
+    } while (0)
+
+/**
+ * Log to the terminal: information [I], warning [W] and error [E] messages
+ * with runtime addition: LOGx(format, args...) like printf().
+ *
+ * The format must be a string literal, so its message ID is known at build
+ * time. Arguments are integers or floats for %d, %i, %u, %x, %X, %c, %f, %e
+ * and %g, at most LOG_RECORD_MAX_ARGS, each transferred as 32 bits.
+ *
+ * With LOG_DEFERRED the caller only captures the record into logQueue(),
+ * the logger thread started by log_start() formats and transmits it. This
+ * is safe in interrupt handlers; without LOG_DEFERRED it is not.
+ *
+ * Calls below the module level (see logModuleLevel) compile to nothing,
+ * arguments are not evaluated. Calls below logLevel() cost one load.
+ *
+ * The _LIMIT variants let at most one record per LOG_RATE_LIMIT_MS through
+ * per call site, and count what they hold back, for messages that repeat
+ * on every event while a fault lasts.
+ */
+#define LOGI(...) LOG_EMIT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOGW(...) LOG_EMIT(LOG_LEVEL_WARNING, __VA_ARGS__)
+#define LOGE(...) LOG_EMIT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#define LOGI_LIMIT(...) LOG_EMIT_LIMITED(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOGW_LIMIT(...) LOG_EMIT_LIMITED(LOG_LEVEL_WARNING, __VA_ARGS__)
+#define LOGE_LIMIT(...) LOG_EMIT_LIMITED(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+/**
+ * @brief Write every queued record, then report records dropped since the last drain
+ *
+ * Runs on the logger thread; any other context that may block on the
+ * serial port can drain too, one at a time.
+ *
+ * @return Number of records written
+ */
+inline uint32_t log_drain(void)
+{
+    static uint32_t reported = 0;
+    LogRecord record;
+    uint32_t written = 0;
+
+    while (logQueue().pop(record))
+    {
+        log_write(record);
+        written++;
+    }
+
+    uint32_t dropped = logQueue().dropped();
+    if (dropped != reported)
+    {
+        LOGW("Log queue full, %u records dropped\r\n", (unsigned)(dropped - reported));
+        reported = dropped;
+    }
+    return written;
+}
+
+/**
+ * @brief Body of the logger thread: drain every LOG_DRAIN_PERIOD_MS
+ *
+ * @return None
+ */
+inline void log_run(void)
+{
+    for (;;)
+    {
+        log_drain();
+        thread_sleep_for(LOG_DRAIN_PERIOD_MS);
+    }
+}
+
+/**
+ * @brief Start the logger thread at low priority, records queued so far are written first
+ *
+ * @return None
+ */
+inline void log_start(void)
+{
+#if LOG_DEFERRED
+    static Thread thread(osPriorityLow, LOG_THREAD_STACK_SIZE, nullptr, "logger");
+
+    thread.start(callback(log_run));
+#endif
 }
 
 /**
@@ -0,0 +1,247 @@
+#pragma once
+
+#ifndef __TRACEPOINT_H__
+#define __TRACEPOINT_H__
+
+/**
+ * @file tracepoint.h
+ *
+ * @brief Latency histograms of the hot paths, in static memory.
+ *
+ * A tracepoint times one pass through a code path with the DWT cycle counter
+ * of the Cortex-M4 (a steady clock in nanoseconds on the host) and counts the
+ * duration in a log2 histogram: bucket k holds the passes that took 2^k to
+ * 2^(k+1) - 1 ticks, the last bucket everything longer; a running total
+ * gives the mean. Recording is a CLZ and a handful of read-modify-writes,
+ * about 6 cycles in the host benchmark; on the target a point adds two
+ * CYCCNT loads to that, not measured on hardware yet. On the host the two
+ * steady clock reads dominate: an empty TraceScope measures 150 to 200
+ * cycles there. Percentiles read from the histogram are upper bounds within
+ * a factor of two, exact enough to tell a microsecond from a millisecond.
+ *
+ * Every point has one writer context at a time (the event queue, or the
+ * logger thread under the log mutex); readers may see a pass half counted.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <mbed.h>
+
+#if defined(HOST_SIM)
+#include <chrono>
+#endif
+
+/* Tracepoints compiled in (1) or not (0); without them the histograms stay empty */
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+/* Buckets of a histogram, the last one also counts everything longer; 32 tell every 32-bit duration apart */
+#ifndef TRACE_BUCKETS
+#define TRACE_BUCKETS 32
+#endif
+
+/* Ticks of the tracepoint clock per microsecond: CPU cycles on the target, nanoseconds on the host */
+#if defined(HOST_SIM)
+#define TRACE_TICKS_PER_US 1000
+#else
+#define TRACE_TICKS_PER_US (SystemCoreClock / 1000000)
+#endif
+
+/* Packed histogram of one point: point, buckets, ticks per us, count, max, then the buckets; little endian */
+#define TRACE_SNAPSHOT_SIZE (12 + 4 * TRACE_BUCKETS)
+
+/**
+ * Timed code paths.
+ */
+enum TracePoint
+{
+    TRACE_UPDATE_CHARACTERISTICS, /* GyroAndPeriphService::updateGyroCharacteristics(), one publish tick */
+    TRACE_MPU_I2C,                /* One MPU6050 transaction: blocking call, or submit to completion through the engine */
+    TRACE_GATT_WRITE,             /* One GattServer::write() of a characteristic value */
+    TRACE_BLE_EVENTS,             /* BLE::processEvents() run by the event queue */
+    TRACE_BLE_DISPATCH,           /* From schedule_ble_events() until the event queue processes them */
+    TRACE_LOG_WRITE,              /* Formatting or encoding one log record and handing it to the serial port */
+    TRACE_SAMPLE_TO_NOTIFY,       /* From the data-ready interrupt of the oldest sample in a stream notification until the stack takes it */
+    TRACE_POINT_COUNT
+};
+
+/**
+ * Latency histogram of one tracepoint.
+ */
+struct TraceHistogram
+{
+    uint32_t count;
+    uint32_t max;
+    uint64_t total;
+    uint32_t buckets[TRACE_BUCKETS];
+};
+
+/**
+ * @brief Histograms of all tracepoints, indexed by TracePoint
+ *
+ * Zero-filled static storage, no constructor runs.
+ *
+ * @return Array of TRACE_POINT_COUNT histograms
+ */
+inline TraceHistogram *traceHistograms(void)
+{
+    static TraceHistogram histograms[TRACE_POINT_COUNT];
+    return histograms;
+}
+
+/**
+ * @brief Enable the DWT cycle counter; the host clock needs nothing
+ *
+ * @return None
+ */
+inline void trace_start(void)
+{
+#if TRACE_ENABLED && !defined(HOST_SIM)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+/**
+ * @brief Current tick of the tracepoint clock, wraps at 2^32
+ */
+inline uint32_t trace_ticks(void)
+{
+#if !TRACE_ENABLED
+    return 0;
+#elif defined(HOST_SIM)
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+    return DWT->CYCCNT;
+#endif
+}
+
+/**
+ * @brief Count one pass of <point> that took <ticks>
+ *
+ * @return None
+ */
+inline void trace_record(uint8_t point, uint32_t ticks)
+{
+#if TRACE_ENABLED
+    TraceHistogram &histogram = traceHistograms()[point];
+    uint32_t bucket = ticks ? 31 - __builtin_clz(ticks) : 0;
+
+    histogram.buckets[bucket < TRACE_BUCKETS ? bucket : TRACE_BUCKETS - 1]++;
+    histogram.count++;
+    histogram.total += ticks;
+    if (ticks > histogram.max)
+        histogram.max = ticks;
+#endif
+}
+
+/**
+ * @class TraceScope
+ *
+ * @brief Times the enclosing scope as one pass of a tracepoint.
+ */
+class TraceScope
+{
+public:
+    explicit TraceScope(uint8_t point) : _point(point), _start(trace_ticks())
+    {
+    }
+
+    ~TraceScope()
+    {
+        trace_record(_point, trace_ticks() - _start);
+    }
+
+private:
+    uint8_t _point;
+    uint32_t _start;
+};
+
+/**
+ * @brief Empty all histograms
+ *
+ * @return None
+ */
+inline void trace_clear(void)
+{
+    memset(traceHistograms(), 0, sizeof(TraceHistogram) * TRACE_POINT_COUNT);
+}
+
+/**
+ * @brief Upper bound of the <permille> percentile of <histogram>, in ticks
+ *
+ * @return End of the bucket the percentile falls in, capped by the maximum; 0 without passes
+ */
+inline uint32_t trace_percentile(const TraceHistogram &histogram, uint32_t permille)
+{
+    uint32_t rank = (uint32_t)(((uint64_t)histogram.count * permille + 999) / 1000);
+    uint32_t seen = 0;
+
+    for (uint32_t bucket = 0; bucket < TRACE_BUCKETS - 1; bucket++)
+    {
+        seen += histogram.buckets[bucket];
+        if (seen >= rank && seen)
+        {
+            uint32_t end = (2u << bucket) - 1;
+            return end < histogram.max ? end : histogram.max;
+        }
+    }
+    return histogram.max;
+}
+
+/**
+ * @brief Count a latency of <us> microseconds measured with us_ticker_read() as one pass of <point>
+ *
+ * For spans that start in one code path and end in another, like the age of a sample; capped at 2^32 ticks.
+ *
+ * @return None
+ */
+inline void trace_record_us(uint8_t point, uint32_t us)
+{
+    uint64_t ticks = (uint64_t)us * TRACE_TICKS_PER_US;
+
+    trace_record(point, ticks < UINT32_MAX ? (uint32_t)ticks : UINT32_MAX);
+}
+
+/**
+ * @brief Ticks of the tracepoint clock in nanoseconds
+ */
+inline uint32_t trace_ticks_to_ns(uint32_t ticks)
+{
+    return (uint32_t)((uint64_t)ticks * 1000 / TRACE_TICKS_PER_US);
+}
+
+/**
+ * @brief Pack the histogram of <point> for the diagnostics characteristic
+ *
+ * @param out Destination, TRACE_SNAPSHOT_SIZE bytes
+ *
+ * @return Number of bytes written
+ */
+inline uint16_t trace_pack(uint8_t *out, uint8_t point)
+{
+    const TraceHistogram &histogram = traceHistograms()[point];
+    uint16_t ticks_per_us = (uint16_t)TRACE_TICKS_PER_US;
+    uint16_t length = 0;
+
+    auto put32 = [out, &length](uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            out[length++] = (uint8_t)(value >> (8 * i));
+    };
+
+    out[length++] = point;
+    out[length++] = TRACE_BUCKETS;
+    out[length++] = (uint8_t)ticks_per_us;
+    out[length++] = (uint8_t)(ticks_per_us >> 8);
+    put32(histogram.count);
+    put32(histogram.max);
+    for (uint32_t bucket = 0; bucket < TRACE_BUCKETS; bucket++)
+        put32(histogram.buckets[bucket]);
+    return length;
+}
+
+#endif